@@ -0,0 +1,130 @@
+//===-- bench/dispatch.c - Costo de las llamadas al driver ------------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Compara el costo por llamada de las operaciones frecuentes a través de la interfaz (puntero a función) y a través
+/// de `dispatch.h`. Sin `ABSERIO_STATIC_DISPATCH` las dos columnas deberían ser iguales; con la opción (y LTO), la
+/// segunda muestra lo que se ahorra. `get_stats` no hace llamadas al sistema, así que es la que mejor muestra la
+/// diferencia; `write_buffer` de un byte incluye el costo de `write` sobre la pseudo-terminal.
+///
+/// Uso: bench_dispatch [iteraciones]
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#define _GNU_SOURCE
+#include <abserio/dispatch.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                      Globales
+//===--------------------------------------------------------------------------------------------------------------===//
+// Los resultados se acumulan aquí para que el compilador no elimine las llamadas
+static volatile guint64 sink;
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                   Funciones extra
+//===--------------------------------------------------------------------------------------------------------------===//
+// Vacía el lado maestro para que la cola de salida del esclavo nunca se llene
+static void drain_master(int master) {
+  char buffer[4096];
+  while (read(master, buffer, sizeof(buffer)) > 0) {
+  }
+}
+
+static void print_row(const char *name, gint64 vtable_ns, gint64 direct_ns, int iterations) {
+  printf("%-22s interfaz %8.2f ns   dispatch.h %8.2f ns\n",
+         name,
+         (double) vtable_ns/iterations,
+         (double) direct_ns/iterations);
+}
+
+static gint64 monotonic_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (gint64) now.tv_sec*1000000000LL + now.tv_nsec;
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                        Main
+//===--------------------------------------------------------------------------------------------------------------===//
+int main(int argc, char **argv) {
+  int iterations = argc > 1 ? atoi(argv[1]) : 10000000;
+  if (iterations <= 0) {
+    iterations = 10000000;
+  }
+  int master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (master==-1 || grantpt(master)==-1 || unlockpt(master)==-1) {
+    fprintf(stderr, "Unable to create a pseudo-terminal: %s\n", g_strerror(errno));
+    return EXIT_FAILURE;
+  }
+  GString *slave = g_string_new(ptsname(master));
+  const struct AbstractSerialDevice *dev = NULL;
+  if (!open_serial_port(&dev, slave)) {
+    fprintf(stderr, "Unable to open '%s': %s\n", slave->str, g_strerror(errno));
+    return EXIT_FAILURE;
+  }
+#ifdef ABSERIO_STATIC_DISPATCH
+  printf("Port: %s, %d iterations, static dispatch\n", slave->str, iterations);
+#else
+  printf("Port: %s, %d iterations, dispatch through the interface\n", slave->str, iterations);
+#endif
+
+  struct SerialStats stats;
+  gint64 t0 = monotonic_ns();
+  for (int i = 0; i < iterations; i++) {
+    dev->get_stats(&stats, &dev);
+    sink += stats.rx_bytes;
+  }
+  gint64 t1 = monotonic_ns();
+  for (int i = 0; i < iterations; i++) {
+    serial_get_stats(&stats, &dev);
+    sink += stats.rx_bytes;
+  }
+  gint64 t2 = monotonic_ns();
+  print_row("get_stats", t1 - t0, t2 - t1, iterations);
+
+  // Las escrituras son mucho más lentas: basta con una fracción de las iteraciones
+  int writes = MAX(iterations/100, 1);
+  const guchar byte = 0x55;
+  gint64 vtable_ns = 0;
+  gint64 direct_ns = 0;
+  for (int i = 0; i < writes; i += 256) {
+    int batch = MIN(256, writes - i);
+    gint64 w0 = monotonic_ns();
+    for (int j = 0; j < batch; j++) {
+      sink += (guint64) dev->write_buffer(&byte, 1, &dev);
+    }
+    gint64 w1 = monotonic_ns();
+    drain_master(master);
+    gint64 w2 = monotonic_ns();
+    for (int j = 0; j < batch; j++) {
+      sink += (guint64) serial_write_buffer(&byte, 1, &dev);
+    }
+    gint64 w3 = monotonic_ns();
+    drain_master(master);
+    vtable_ns += w1 - w0;
+    direct_ns += w3 - w2;
+  }
+  print_row("write_buffer (1 byte)", vtable_ns, direct_ns, writes);
+
+  close_serial_port(&dev);
+  g_string_free(slave, TRUE);
+  close(master);
+  return EXIT_SUCCESS;
+}
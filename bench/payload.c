@@ -0,0 +1,113 @@
+//===-- bench/payload.c - Decodificación de cargas útiles -------------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Mide cuánto tarda `serial_payload_decode` con el texto de una carga útil grande, en las formas que se pegan en la
+/// caja de texto de la ventana principal. El hexadecimal separado por espacios (`de ad be ef`) nunca tiene bloques de
+/// 16 dígitos seguidos, así que pasa completo por la ruta escalar y sirve de referencia para la ruta SIMD.
+///
+/// Uso: bench_payload [KiB decodificados] [repeticiones]
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#include <abserio/payload.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                   Funciones extra
+//===--------------------------------------------------------------------------------------------------------------===//
+static gint64 monotonic_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (gint64) now.tv_sec*1000000000LL + now.tv_nsec;
+}
+
+static gchar *hex_text(const guint8 *data, gsize length, gboolean spaced) {
+  GString *text = g_string_sized_new(length*3);
+  for (gsize i = 0; i < length; i++) {
+    g_string_append_printf(text, spaced ? "%02x " : "%02X", data[i]);
+  }
+  return g_string_free(text, FALSE);
+}
+
+// Base64 con saltos de línea cada 76 caracteres, como lo escriben `base64` y los correos
+static gchar *base64_wrapped(const guint8 *data, gsize length) {
+  gchar *plain = g_base64_encode(data, length);
+  GString *text = g_string_sized_new(strlen(plain) + strlen(plain)/76 + 1);
+  for (const gchar *p = plain; *p!='\0'; p += MIN(strlen(p), 76)) {
+    g_string_append_len(text, p, (gssize) MIN(strlen(p), 76));
+    g_string_append_c(text, '\n');
+  }
+  g_free(plain);
+  return g_string_free(text, FALSE);
+}
+
+static gboolean run(const char *name, const gchar *text, enum SerialPayloadFormat format, gsize expected, int rounds) {
+  gint64 best = G_MAXINT64;
+  for (int i = 0; i < rounds; i++) {
+    gint64 t0 = monotonic_ns();
+    GBytes *bytes = serial_payload_decode(text, format, NULL);
+    gint64 elapsed = monotonic_ns() - t0;
+    if (bytes==NULL || g_bytes_get_size(bytes)!=expected) {
+      fprintf(stderr, "%s: decoding failed\n", name);
+      return FALSE;
+    }
+    g_bytes_unref(bytes);
+    best = MIN(best, elapsed);
+  }
+  printf("%-16s %10" G_GSIZE_FORMAT " caracteres  %8.3f ms  %8.1f MiB/s de texto\n",
+         name,
+         strlen(text),
+         best/1e6,
+         strlen(text)/(1024.0*1024.0)/(best/1e9));
+  return TRUE;
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                        Main
+//===--------------------------------------------------------------------------------------------------------------===//
+int main(int argc, char **argv) {
+  int kib = argc > 1 ? atoi(argv[1]) : 1024;
+  int rounds = argc > 2 ? atoi(argv[2]) : 20;
+  if (kib <= 0 || rounds <= 0) {
+    fprintf(stderr, "Usage: %s [KiB decoded] [rounds]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  gsize length = (gsize) kib*1024;
+  guint8 *data = g_malloc(length);
+  GRand *rand = g_rand_new_with_seed(1);
+  for (gsize i = 0; i < length; i++) {
+    data[i] = (guint8) g_rand_int_range(rand, 0, 256);
+  }
+  g_rand_free(rand);
+  printf("%d KiB per payload, best of %d rounds\n", kib, rounds);
+
+  gchar *hex = hex_text(data, length, FALSE);
+  gchar *spaced = hex_text(data, length, TRUE);
+  gchar *b64 = g_base64_encode(data, length);
+  gchar *wrapped = base64_wrapped(data, length);
+  gboolean ok = run("hex", hex, SERIAL_PAYLOAD_HEX, length, rounds)
+      && run("hex separado", spaced, SERIAL_PAYLOAD_HEX, length, rounds)
+      && run("base64", b64, SERIAL_PAYLOAD_BASE64, length, rounds)
+      && run("base64 (76 col)", wrapped, SERIAL_PAYLOAD_BASE64, length, rounds);
+  g_free(hex);
+  g_free(spaced);
+  g_free(b64);
+  g_free(wrapped);
+  g_free(data);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
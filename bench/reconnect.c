@@ -0,0 +1,132 @@
+//===-- bench/reconnect.c - Latencia de reconexión --------------------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Mide cuánto tarda el ciclo de vida completo de un puerto: abrirlo, arrancar el hilo lector, recibir el primer byte
+/// y cerrarlo (cancelación y join del hilo incluidos). Usa una pseudo-terminal: el esclavo hace de puerto serial y el
+/// maestro hace de dispositivo.
+///
+/// Uso: bench_reconnect [iteraciones]
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#define _GNU_SOURCE
+#include <abserio/abserio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                      Globales
+//===--------------------------------------------------------------------------------------------------------------===//
+static GMutex received_lock;
+static GCond received_cond;
+static gboolean received;
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                   Funciones extra
+//===--------------------------------------------------------------------------------------------------------------===//
+static void on_data(const guchar *data, gsize length, const struct SerialTimestamp *stamp, gpointer user_data) {
+  g_mutex_lock(&received_lock);
+  received = TRUE;
+  g_cond_signal(&received_cond);
+  g_mutex_unlock(&received_lock);
+}
+
+static int compare_gint64(const void *a, const void *b) {
+  gint64 x = *(const gint64 *) a;
+  gint64 y = *(const gint64 *) b;
+  return (x > y) - (x < y);
+}
+
+static void print_summary(const char *name, gint64 *samples, int count) {
+  qsort(samples, (size_t) count, sizeof(gint64), compare_gint64);
+  gint64 total = 0;
+  for (int i = 0; i < count; i++) {
+    total += samples[i];
+  }
+  printf("%-18s min %6" G_GINT64_FORMAT " us   p50 %6" G_GINT64_FORMAT " us   p99 %6" G_GINT64_FORMAT
+         " us   max %6" G_GINT64_FORMAT " us   mean %8.1f us\n",
+         name,
+         samples[0],
+         samples[count/2],
+         samples[(count*99)/100],
+         samples[count - 1],
+         (double) total/count);
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                        Main
+//===--------------------------------------------------------------------------------------------------------------===//
+int main(int argc, char **argv) {
+  int iterations = argc > 1 ? atoi(argv[1]) : 1000;
+  if (iterations <= 0) {
+    iterations = 1000;
+  }
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master==-1 || grantpt(master)==-1 || unlockpt(master)==-1) {
+    fprintf(stderr, "Unable to create a pseudo-terminal: %s\n", g_strerror(errno));
+    return EXIT_FAILURE;
+  }
+  GString *slave = g_string_new(ptsname(master));
+  printf("Port: %s, %d iterations\n", slave->str, iterations);
+
+  gint64 *open_us = g_new(gint64, iterations);
+  gint64 *first_byte_us = g_new(gint64, iterations);
+  gint64 *close_us = g_new(gint64, iterations);
+  const struct AbstractSerialDevice *dev = NULL;
+  for (int i = 0; i < iterations; i++) {
+    received = FALSE;
+    gint64 t0 = g_get_monotonic_time();
+    if (!open_serial_port(&dev, slave) || !start_serial_listener(&dev, on_data, NULL)) {
+      fprintf(stderr, "Unable to open '%s': %s\n", slave->str, g_strerror(errno));
+      return EXIT_FAILURE;
+    }
+    gint64 t1 = g_get_monotonic_time();
+    // Un byte desde el "dispositivo" para confirmar que el hilo lector nuevo ya recibe
+    const char byte = 0x55;
+    if (write(master, &byte, 1)!=1) {
+      fprintf(stderr, "Unable to write to the master side: %s\n", g_strerror(errno));
+      return EXIT_FAILURE;
+    }
+    g_mutex_lock(&received_lock);
+    while (!received) {
+      g_cond_wait(&received_cond, &received_lock);
+    }
+    g_mutex_unlock(&received_lock);
+    gint64 t2 = g_get_monotonic_time();
+    close_serial_port(&dev);
+    gint64 t3 = g_get_monotonic_time();
+    open_us[i] = t1 - t0;
+    first_byte_us[i] = t2 - t1;
+    close_us[i] = t3 - t2;
+  }
+
+  print_summary("open + listener", open_us, iterations);
+  print_summary("first byte", first_byte_us, iterations);
+  print_summary("cancel + close", close_us, iterations);
+  for (int i = 0; i < iterations; i++) {
+    open_us[i] += close_us[i];
+  }
+  print_summary("reconnect total", open_us, iterations);
+
+  g_free(open_us);
+  g_free(first_byte_us);
+  g_free(close_us);
+  g_string_free(slave, TRUE);
+  close(master);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,195 @@
+//===-- bench/schema.c - Decodificación de mensajes con esquemas ------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Mide cuánto tarda `serial_schema_decode` en separar y decodificar un flujo de mensajes, con tres esquemas que
+/// cargan cada tipo de campo: enteros de todos los tamaños y órdenes de bytes, campos de bits que cruzan bytes y texto
+/// terminado en cero. El flujo repite unos mensajes de ejemplo, con algo de ruido entre ellos, y se recorre como lo
+/// hace el panel de la GUI: saltar al siguiente inicio posible, decodificar y avanzar.
+///
+/// Uso: bench_schema [MiB recibidos] [repeticiones]
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#include <abserio/macro.h>
+#include <abserio/schema.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Estructuras de datos
+//===--------------------------------------------------------------------------------------------------------------===//
+struct Case {
+  const char *name;
+  const gchar *schema;
+  // Mensajes de ejemplo (y ruido) como macros, terminados en NULL
+  const gchar *frames[4];
+};
+
+static const struct Case cases[] = {
+  {"enteros",
+   "message telemetria AA 55\n"
+   "  u8 secuencia\n  u16le voltaje\n  i16le corriente\n  u32be contador\n  i32le posicion\n"
+   "  u64le tiempo\n  i64be energia\n  u16be crc\n"
+   "end\n"
+   "message ack AA 06\n  u8 secuencia\nend\n",
+   {"AA 55 07 E80C 38FF 0001E240 FFFFFF85 00E40B5402000000 FFFFFFFFFFFFD8F0 BEEF",
+    "AA 06 07",
+    "00 FF",
+    NULL}},
+  {"bits",
+   "enum modo\n  0 reposo\n  1 midiendo\n  2 calibrando\n  3 error\nend\n"
+   "message estado 7E\n"
+   "  b3 modo modo\n  b5 alarmas\n  b12 canal_a\n  b12 canal_b\n  b1 listo\n  b7 nivel\n  b16 filtro\n"
+   "  b10 x\n  b10 y\n  b10 z\n  b2 reservado\n"
+   "end\n",
+   {"7E 25 AB C1 23 C5 12 34 5A 5A 5A 5B",
+    "00",
+    NULL}},
+  {"texto",
+   "message nombre 02 \"N\"\n  str16 modelo\n  strz nombre\n  strz version\n  bytes4 serie\nend\n"
+   "message registro 02 \"L\"\n  strz texto\nend\n",
+   {"02 \"N\" \"SENSOR-T100\" 00 00 00 00 00 \"termometro sala 3\" 00 \"v1.4.2\" 00 DEADBEEF",
+    "02 \"L\" \"arranque completo en 132 ms\" 00",
+    "\"\\r\\n\"",
+    NULL}},
+};
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                   Funciones extra
+//===--------------------------------------------------------------------------------------------------------------===//
+static gint64 monotonic_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (gint64) now.tv_sec*1000000000LL + now.tv_nsec;
+}
+
+// Repite los mensajes de ejemplo hasta llenar al menos la longitud dada; cuenta los mensajes que no son ruido
+static GByteArray *build_stream(const struct Case *test, struct SerialSchema *schema, gsize length, guint64 *count) {
+  GBytes *frames[G_N_ELEMENTS(test->frames)];
+  gboolean is_message[G_N_ELEMENTS(test->frames)];
+  guint frame_count = 0;
+  struct SerialSchemaValue *values = g_new(struct SerialSchemaValue, MAX(1, serial_schema_get_max_fields(schema)));
+  for (; test->frames[frame_count]!=NULL; frame_count++) {
+    GBytes *code = serial_macro_compile(test->frames[frame_count], NULL);
+    guint32 delay;
+    frames[frame_count] = serial_macro_get_payload(code, &delay);
+    g_bytes_unref(code);
+    gsize frame_length;
+    const guint8 *frame = g_bytes_get_data(frames[frame_count], &frame_length);
+    guint message;
+    gsize decoded_length;
+    is_message[frame_count] =
+        serial_schema_decode(schema, frame, frame_length, &message, &decoded_length, values)==SERIAL_SCHEMA_DECODED;
+  }
+  g_free(values);
+  GByteArray *stream = g_byte_array_sized_new((guint) length);
+  *count = 0;
+  for (guint i = 0; stream->len < length; i = (i + 1)%frame_count) {
+    gsize frame_length;
+    const guint8 *frame = g_bytes_get_data(frames[i], &frame_length);
+    g_byte_array_append(stream, frame, (guint) frame_length);
+    *count += is_message[i] ? 1 : 0;
+  }
+  for (guint i = 0; i < frame_count; i++) {
+    g_bytes_unref(frames[i]);
+  }
+  return stream;
+}
+
+// Separa y decodifica todo el flujo; devuelve el número de mensajes
+static guint64 decode_stream(struct SerialSchema *schema, const GByteArray *stream, struct SerialSchemaValue *values) {
+  guint64 count = 0;
+  gsize position = 0;
+  while (position < stream->len) {
+    position += serial_schema_find_start(schema, stream->data + position, stream->len - position);
+    if (position==stream->len) {
+      break;
+    }
+    guint message;
+    gsize frame_length;
+    enum SerialSchemaResult result = serial_schema_decode(schema,
+                                                          stream->data + position,
+                                                          stream->len - position,
+                                                          &message,
+                                                          &frame_length,
+                                                          values);
+    if (result==SERIAL_SCHEMA_INCOMPLETE) {
+      break;
+    }
+    if (result==SERIAL_SCHEMA_NO_MATCH) {
+      position++;
+      continue;
+    }
+    count++;
+    position += frame_length;
+  }
+  return count;
+}
+
+static gboolean run(const struct Case *test, gsize length, int rounds) {
+  gsize error_at = 0;
+  struct SerialSchema *schema = serial_schema_new(test->schema, &error_at);
+  if (schema==NULL) {
+    fprintf(stderr, "%s: invalid schema at byte %" G_GSIZE_FORMAT "\n", test->name, error_at);
+    return FALSE;
+  }
+  guint64 expected;
+  GByteArray *stream = build_stream(test, schema, length, &expected);
+  struct SerialSchemaValue *values = g_new(struct SerialSchemaValue, MAX(1, serial_schema_get_max_fields(schema)));
+  gint64 best = G_MAXINT64;
+  gboolean ok = TRUE;
+  for (int i = 0; i < rounds && ok; i++) {
+    gint64 t0 = monotonic_ns();
+    guint64 count = decode_stream(schema, stream, values);
+    gint64 elapsed = monotonic_ns() - t0;
+    if (count!=expected) {
+      fprintf(stderr, "%s: decoded %" G_GUINT64_FORMAT " messages, expected %" G_GUINT64_FORMAT "\n",
+              test->name, count, expected);
+      ok = FALSE;
+    }
+    best = MIN(best, elapsed);
+  }
+  if (ok) {
+    printf("%-10s %10" G_GUINT64_FORMAT " mensajes  %8.3f ms  %8.1f MiB/s  %8.2f M mensajes/s\n",
+           test->name,
+           expected,
+           best/1e6,
+           stream->len/(1024.0*1024.0)/(best/1e9),
+           expected/1e6/(best/1e9));
+  }
+  g_free(values);
+  g_byte_array_free(stream, TRUE);
+  serial_schema_free(schema);
+  return ok;
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                        Main
+//===--------------------------------------------------------------------------------------------------------------===//
+int main(int argc, char **argv) {
+  int mib = argc > 1 ? atoi(argv[1]) : 16;
+  int rounds = argc > 2 ? atoi(argv[2]) : 10;
+  if (mib <= 0 || rounds <= 0) {
+    fprintf(stderr, "Usage: %s [MiB received] [rounds]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  printf("%d MiB per schema, best of %d rounds\n", mib, rounds);
+  gboolean ok = TRUE;
+  for (guint i = 0; i < G_N_ELEMENTS(cases) && ok; i++) {
+    ok = run(&cases[i], (gsize) mib*1024*1024, rounds);
+  }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,235 @@
+//===-- bench/sim.c - Par de puertos simulados ------------------------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Usa el par simulado (`sim.h`) en lugar de una pseudo-terminal, así que los resultados dependen de la configuración
+/// de la línea y no de la máquina:
+///  -> Rendimiento: un extremo escribe tan rápido como acepta la cola de salida y el hilo lector del otro extremo
+///     recibe; se compara el tiempo total con el teórico de la línea
+///  -> Latencia: ida y vuelta de un byte (el hilo lector del otro extremo lo devuelve) con retraso y variación
+///  -> Errores: los mismos bytes dos veces con la misma semilla; las pérdidas y los bits invertidos deben coincidir
+///
+/// Uso: bench_sim [segundos por velocidad]
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#include <abserio/sim.h>
+#include <abserio/timestamp.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Estructuras de datos
+//===--------------------------------------------------------------------------------------------------------------===//
+// Lo que recibe el hilo lector de un extremo
+struct Receiver {
+  GMutex lock;
+  GCond cond;
+  gsize received;
+  gint64 last_ns;
+  // Extremo por el que se devuelve lo recibido, o NULL
+  const struct AbstractSerialDevice **echo;
+};
+
+#define PING_COUNT                      200
+#define ERROR_BYTES                     100000
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                   Funciones extra
+//===--------------------------------------------------------------------------------------------------------------===//
+static gint64 monotonic_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (gint64) now.tv_sec*1000000000LL + now.tv_nsec;
+}
+
+static void on_data(const guchar *data, gsize length, const struct SerialTimestamp *stamp, gpointer user_data) {
+  struct Receiver *receiver = user_data;
+  if (receiver->echo!=NULL) {
+    (*receiver->echo)->write_buffer(data, length, receiver->echo);
+  }
+  g_mutex_lock(&receiver->lock);
+  receiver->received += length;
+  // La fecha del bloque es el mismo CLOCK_MONOTONIC, leído en cuanto regresó la lectura
+  receiver->last_ns = stamp->monotonic_ns;
+  g_cond_signal(&receiver->cond);
+  g_mutex_unlock(&receiver->lock);
+}
+
+static void wait_received(struct Receiver *receiver, gsize count) {
+  g_mutex_lock(&receiver->lock);
+  while (receiver->received < count) {
+    g_cond_wait(&receiver->cond, &receiver->lock);
+  }
+  g_mutex_unlock(&receiver->lock);
+}
+
+// Escribe todo el bloque, esperando cuando la cola de salida se llena
+static gboolean write_all(const guchar *data, gsize length, const struct AbstractSerialDevice **dev) {
+  gsize sent = 0;
+  while (sent < length) {
+    gssize n = (*dev)->write_buffer(data + sent, length - sent, dev);
+    if (n > 0) {
+      sent += (gsize) n;
+    } else if (n==-1 && errno==EAGAIN) {
+      (*dev)->wait_writable(-1, dev);
+    } else {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+static gboolean run_throughput(glong bps, double seconds) {
+  const struct AbstractSerialDevice *a = NULL;
+  const struct AbstractSerialDevice *b = NULL;
+  struct Receiver receiver = {0};
+  if (!open_serial_sim_pair(&a, &b, NULL) || !a->set_baud_rate(bps, &a)
+      || !start_serial_listener(&b, on_data, &receiver)) {
+    return FALSE;
+  }
+  guint frame_bits = a->get_frame_bits(&a);
+  gsize length = (gsize) (seconds*bps/frame_bits);
+  guchar *data = g_malloc0(length);
+  gint64 start = monotonic_ns();
+  gboolean ok = write_all(data, length, &a);
+  if (ok) {
+    wait_received(&receiver, length);
+  }
+  double elapsed = (receiver.last_ns - start)/1e9;
+  double expected = (double) length*frame_bits/bps;
+  if (ok) {
+    printf("%8ld bps  %9" G_GSIZE_FORMAT " bytes  %8.3f s (teórico %8.3f s)  %10.1f B/s  %+6.2f %%\n",
+           bps,
+           length,
+           elapsed,
+           expected,
+           length/elapsed,
+           (elapsed/expected - 1.0)*100.0);
+  }
+  // Sin esto, el hilo lector de `b` ve el cierre de `a` como un error
+  stop_serial_listener(&b);
+  close_serial_port(&a);
+  close_serial_port(&b);
+  g_free(data);
+  return ok;
+}
+
+static gboolean run_latency(glong bps, guint latency_us, guint jitter_us) {
+  const struct AbstractSerialDevice *a = NULL;
+  const struct AbstractSerialDevice *b = NULL;
+  struct SerialSimConfig config = {0};
+  config.latency_us = latency_us;
+  config.jitter_us = jitter_us;
+  config.seed = 1;
+  struct Receiver echo = {0};
+  struct Receiver back = {0};
+  echo.echo = &b;
+  if (!open_serial_sim_pair(&a, &b, &config) || !a->set_baud_rate(bps, &a) || !b->set_baud_rate(bps, &b)
+      || !start_serial_listener(&b, on_data, &echo) || !start_serial_listener(&a, on_data, &back)) {
+    return FALSE;
+  }
+  gint64 min = G_MAXINT64;
+  gint64 max = 0;
+  gint64 total = 0;
+  for (int i = 0; i < PING_COUNT; i++) {
+    guchar ping = (guchar) i;
+    gint64 start = monotonic_ns();
+    a->write_buffer(&ping, 1, &a);
+    wait_received(&back, (gsize) i + 1);
+    gint64 rtt = back.last_ns - start;
+    min = MIN(min, rtt);
+    max = MAX(max, rtt);
+    total += rtt;
+  }
+  // Ida y vuelta: dos caracteres y dos veces el retraso, más la variación sorteada
+  double ideal = 2.0*(a->get_frame_bits(&a)*1e6/bps + latency_us);
+  printf("%8ld bps  retraso %5u us  variación %5u us  ida y vuelta: min %8.1f  mean %8.1f  max %8.1f us"
+         "  (ideal %8.1f us + variación)\n",
+         bps,
+         latency_us,
+         jitter_us,
+         min/1e3,
+         (double) total/PING_COUNT/1e3,
+         max/1e3,
+         ideal);
+  stop_serial_listener(&a);
+  stop_serial_listener(&b);
+  close_serial_port(&a);
+  close_serial_port(&b);
+  return TRUE;
+}
+
+// Envía ERROR_BYTES con pérdidas y bits invertidos; deja los contadores del receptor en `stats`
+static gboolean run_errors(struct SerialSimStats *stats, guint32 seed) {
+  const struct AbstractSerialDevice *a = NULL;
+  const struct AbstractSerialDevice *b = NULL;
+  struct SerialSimConfig config = {0};
+  config.drop_rate = 0.001;
+  config.bit_error_rate = 0.0001;
+  config.seed = seed;
+  config.rx_queue = ERROR_BYTES;
+  if (!open_serial_sim_pair(&a, &b, &config) || !a->set_baud_rate(4000000, &a)) {
+    return FALSE;
+  }
+  guchar *data = g_malloc0(ERROR_BYTES);
+  gboolean ok = write_all(data, ERROR_BYTES, &a) && a->drain_output(&a);
+  ok = ok && get_serial_sim_stats(&b, stats);
+  close_serial_port(&a);
+  close_serial_port(&b);
+  g_free(data);
+  return ok;
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                        Main
+//===--------------------------------------------------------------------------------------------------------------===//
+int main(int argc, char **argv) {
+  double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+  if (seconds <= 0.0) {
+    fprintf(stderr, "Usage: %s [seconds per rate]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  const glong rates[] = {9600, 115200, 921600, 4000000};
+  printf("Rendimiento (8N1, %.1f s por velocidad)\n", seconds);
+  for (gsize i = 0; i < G_N_ELEMENTS(rates); i++) {
+    if (!run_throughput(rates[i], seconds)) {
+      fprintf(stderr, "Throughput run failed at %ld bps: %s\n", rates[i], g_strerror(errno));
+      return EXIT_FAILURE;
+    }
+  }
+  printf("Latencia (%d bytes)\n", PING_COUNT);
+  if (!run_latency(115200, 0, 0) || !run_latency(115200, 500, 0) || !run_latency(115200, 500, 200)) {
+    fprintf(stderr, "Latency run failed: %s\n", g_strerror(errno));
+    return EXIT_FAILURE;
+  }
+  struct SerialSimStats first;
+  struct SerialSimStats second;
+  if (!run_errors(&first, 7) || !run_errors(&second, 7)) {
+    fprintf(stderr, "Error run failed: %s\n", g_strerror(errno));
+    return EXIT_FAILURE;
+  }
+  gboolean same = first.dropped==second.dropped && first.corrupted==second.corrupted
+      && first.overruns==second.overruns;
+  printf("Errores (%d bytes, semilla 7): %" G_GUINT64_FORMAT " perdidos, %" G_GUINT64_FORMAT
+         " corrompidos, %" G_GUINT64_FORMAT " overruns; segunda ejecución %s\n",
+         ERROR_BYTES,
+         first.dropped,
+         first.corrupted,
+         first.overruns,
+         same ? "idéntica" : "DISTINTA");
+  return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,163 @@
+//===-- bench/uring.c - Backend por defecto contra io_uring -----------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Recibe el mismo flujo por varios puertos a la vez con cada backend (`poll` + `read` e io_uring) y compara el tiempo
+/// de CPU por MiB y los cambios de contexto de los hilos lectores. Cada puerto es una pseudo-terminal con su propio
+/// hilo lector (`start_serial_listener`); el hilo principal escribe bloques en los maestros por turnos.
+///
+/// Los bytes son letras: una pseudo-terminal interpreta algunos caracteres de control (p.e. XOFF) en la entrada.
+///
+/// Uso: bench_uring [puertos] [MiB por puerto] [bytes por escritura]
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#define _GNU_SOURCE
+#include <abserio/abserio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Estructuras de datos
+//===--------------------------------------------------------------------------------------------------------------===//
+struct BenchPort {
+  int master;
+  GString *slave;
+  const struct AbstractSerialDevice *dev;
+  atomic_uint_fast64_t received;
+  atomic_uint_fast64_t chunks;
+};
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                   Funciones extra
+//===--------------------------------------------------------------------------------------------------------------===//
+static void on_data(const guchar *data, gsize length, const struct SerialTimestamp *stamp, gpointer user_data) {
+  struct BenchPort *port = user_data;
+  atomic_fetch_add_explicit(&port->received, length, memory_order_relaxed);
+  atomic_fetch_add_explicit(&port->chunks, 1, memory_order_relaxed);
+}
+
+static gint64 monotonic_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (gint64) now.tv_sec*1000000000LL + now.tv_nsec;
+}
+
+static gint64 timeval_ns(struct timeval tv) {
+  return (gint64) tv.tv_sec*1000000000LL + (gint64) tv.tv_usec*1000;
+}
+
+static gboolean open_ports(struct BenchPort *ports, int count, enum SerialBackend backend) {
+  for (int i = 0; i < count; i++) {
+    ports[i].master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (ports[i].master==-1 || grantpt(ports[i].master)==-1 || unlockpt(ports[i].master)==-1) {
+      fprintf(stderr, "Unable to create a pseudo-terminal: %s\n", g_strerror(errno));
+      return FALSE;
+    }
+    ports[i].slave = g_string_new(ptsname(ports[i].master));
+    ports[i].dev = NULL;
+    atomic_init(&ports[i].received, 0);
+    atomic_init(&ports[i].chunks, 0);
+    if (!open_serial_port_with_backend(&ports[i].dev, ports[i].slave, backend)) {
+      fprintf(stderr, "Unable to open '%s': %s\n", ports[i].slave->str, g_strerror(errno));
+      return FALSE;
+    }
+    start_serial_listener(&ports[i].dev, on_data, &ports[i]);
+  }
+  return TRUE;
+}
+
+static void close_ports(struct BenchPort *ports, int count) {
+  for (int i = 0; i < count; i++) {
+    close_serial_port(&ports[i].dev);
+    g_string_free(ports[i].slave, TRUE);
+    close(ports[i].master);
+  }
+}
+
+static gboolean run(const char *name, enum SerialBackend backend, int count, guint64 per_port, gsize chunk) {
+  struct BenchPort *ports = g_new0(struct BenchPort, count);
+  if (!open_ports(ports, count, backend)) {
+    g_free(ports);
+    return FALSE;
+  }
+  guchar *block = g_malloc(chunk);
+  for (gsize i = 0; i < chunk; i++) {
+    block[i] = (guchar) ('A' + i%26);
+  }
+  struct rusage before, after;
+  getrusage(RUSAGE_SELF, &before);
+  gint64 t0 = monotonic_ns();
+  for (guint64 sent = 0; sent < per_port; sent += chunk) {
+    gsize length = (gsize) MIN(chunk, per_port - sent);
+    for (int i = 0; i < count; i++) {
+      // El maestro es bloqueante: si el lector se atrasa, el escritor espera
+      if (write(ports[i].master, block, length)!=(ssize_t) length) {
+        fprintf(stderr, "Short write on '%s': %s\n", ports[i].slave->str, g_strerror(errno));
+        return FALSE;
+      }
+    }
+  }
+  guint64 chunks = 0;
+  for (int i = 0; i < count; i++) {
+    while (atomic_load(&ports[i].received) < per_port) {
+      g_usleep(100);
+    }
+    chunks += atomic_load(&ports[i].chunks);
+  }
+  gint64 elapsed = monotonic_ns() - t0;
+  getrusage(RUSAGE_SELF, &after);
+  gint64 cpu = timeval_ns(after.ru_utime) - timeval_ns(before.ru_utime)
+      + timeval_ns(after.ru_stime) - timeval_ns(before.ru_stime);
+  double mib = (double) per_port*count/(1024.0*1024.0);
+  printf("%-8s %8.1f MiB/s  CPU %8.1f ms/MiB  %8" G_GUINT64_FORMAT " bloques (%6.0f B c/u)  %8ld cambios de contexto\n",
+         name,
+         mib/(elapsed/1e9),
+         cpu/1e6/mib,
+         chunks,
+         (double) per_port*count/MAX(chunks, 1),
+         (after.ru_nvcsw - before.ru_nvcsw) + (after.ru_nivcsw - before.ru_nivcsw));
+  g_free(block);
+  close_ports(ports, count);
+  g_free(ports);
+  return TRUE;
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                        Main
+//===--------------------------------------------------------------------------------------------------------------===//
+int main(int argc, char **argv) {
+  int count = argc > 1 ? atoi(argv[1]) : 8;
+  int mib = argc > 2 ? atoi(argv[2]) : 16;
+  int chunk = argc > 3 ? atoi(argv[3]) : 256;
+  if (count <= 0 || mib <= 0 || chunk <= 0) {
+    fprintf(stderr, "Usage: %s [ports] [MiB per port] [bytes per write]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  printf("%d ports, %d MiB per port, %d bytes per write\n", count, mib, chunk);
+  guint64 per_port = (guint64) mib*1024*1024;
+  if (!run("poll", SERIAL_BACKEND_DEFAULT, count, per_port, (gsize) chunk)) {
+    return EXIT_FAILURE;
+  }
+  if (!run("io_uring", SERIAL_BACKEND_URING, count, per_port, (gsize) chunk)) {
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -60,10 +60,50 @@
 #define PARITY_DISABLE                  FALSE
 extern const long bauds[BAUDS_AVAIL];
 
+// Contadores acumulados desde que se abrió el puerto
+struct SerialStats {
+  // Bytes recibidos por `read_buffer`/`read_byte`
+  guint64 rx_bytes;
+  // Bytes escritos al puerto
+  guint64 tx_bytes;
+  // Tiempo (ns) que las escrituras esperaron a que la cola de salida aceptara más bytes
+  guint64 tx_wait_ns;
+  // La parte de `tx_wait_ns` en la que el otro extremo tenía detenido el flujo (CTS desactivado)
+  guint64 flow_blocked_ns;
+};
+
+// Pausas mínimas de `write_frame`, en tiempos de carácter (p.e. 3.5 entre tramas para Modbus RTU). Cero desactiva
+// la pausa correspondiente
+struct SerialPacing {
+  // Silencio entre dos bytes de la misma trama
+  gdouble inter_byte;
+  // Silencio entre el último byte de una trama y el primero de la siguiente
+  gdouble inter_frame;
+};
+
+// Retraso de cada escritura programada respecto a su fecha límite, desde el último `set_pacing`
+struct SerialPacingStats {
+  // Duración de un carácter con la configuración actual, en nanosegundos
+  gint64 char_time_ns;
+  // Escrituras que tuvieron que esperar una fecha límite
+  guint64 gaps;
+  // Retraso mínimo, máximo y promedio, en nanosegundos
+  gint64 min_late_ns;
+  gint64 max_late_ns;
+  gdouble mean_late_ns;
+  // Desviación estándar del retraso
+  gdouble jitter_ns;
+};
+
 // Esta interfaz representa un dispositivo serial abstracto. Contiene funciones y propiedades del dispositivo serial.
 struct AbstractSerialDevice {
   // Información interna
   void *_internal_info;
+  // Hilo lector asociado al puerto (ver `start_serial_listener`)
+  void *_listener;
+  // Cierre de un driver que no es el de la plataforma (p.e. el simulado, ver `sim.h`); NULL en los de la plataforma.
+  // `close_serial_port` lo llama después de detener el hilo lector
+  void (*_close)(struct AbstractSerialDevice **);
   // Esta función configura el baudrate
   gboolean (*set_baud_rate)(glong, const struct AbstractSerialDevice **);
   // Esta función devuelve el baudrate actual
@@ -78,10 +118,106 @@ struct AbstractSerialDevice {
   gboolean (*set_software_control_flow)(gboolean, const struct AbstractSerialDevice **);
   // Devuelve el estado del bit de control por software
   gboolean (*get_software_control_flow)(const struct AbstractSerialDevice **);
+  // Activa o desactiva el control de flujo por hardware (RTS/CTS). Mientras el otro extremo tenga CTS desactivado,
+  // la cola de salida no avanza: las escrituras lo ven como una cola llena, no como un error
+  gboolean (*set_hardware_control_flow)(gboolean, const struct AbstractSerialDevice **);
+  // Devuelve el estado del control de flujo por hardware
+  gboolean (*get_hardware_control_flow)(const struct AbstractSerialDevice **);
   // Escribir un byte al puerto
   gboolean (*write_byte)(gchar, const struct AbstractSerialDevice **);
   // Leer un byte del puerto. Bloquea el hilo hasta que se lea
   char (*read_byte)(const struct AbstractSerialDevice **);
+  // Leer todos los bytes disponibles (hasta el tamaño del buffer). Bloquea el hilo hasta que haya datos o hasta que
+  // se cancele la lectura, en cuyo caso devuelve -1 con errno en ECANCELED
+  gssize (*read_buffer)(guchar *, gsize, const struct AbstractSerialDevice **);
+  // Leer lo que ya esté en la cola de entrada (hasta el tamaño del buffer) sin bloquear. Devuelve los bytes leídos, 0
+  // si no había nada o -1 con errno configurado
+  gssize (*read_available)(guchar *, gsize, const struct AbstractSerialDevice **);
+  // Despierta al hilo bloqueado en `read_buffer`/`read_byte`, que retorna con ECANCELED. Si nadie está leyendo, la
+  // siguiente lectura es la que se cancela
+  void (*cancel_read)(const struct AbstractSerialDevice **);
+  // Copia los contadores del puerto. No toma ningún mutex: se puede llamar con la frecuencia que sea necesaria
+  void (*get_stats)(struct SerialStats *, const struct AbstractSerialDevice **);
+  // Escribe todo lo que acepte la cola de salida del sistema sin bloquear. Devuelve los bytes escritos (puede ser
+  // menos que el tamaño pedido) o -1 con errno en EAGAIN si la cola está llena
+  gssize (*write_buffer)(const guchar *, gsize, const struct AbstractSerialDevice **);
+  // Espera hasta que la cola de salida acepte más bytes o hasta que pase el timeout (en ms). Devuelve TRUE si se
+  // puede escribir
+  gboolean (*wait_writable)(gint, const struct AbstractSerialDevice **);
+  // Bloquea hasta que todos los bytes en la cola de salida se hayan transmitido
+  gboolean (*drain_output)(const struct AbstractSerialDevice **);
+  // Descarta los bytes de la cola de salida que no se han transmitido. Un hilo bloqueado en `drain_output` retorna y
+  // una trama de `write_frame` en curso (de cualquier hilo) se abandona: devuelve -1 con errno en ECANCELED
+  gboolean (*flush_output)(const struct AbstractSerialDevice **);
+  // Devuelve la velocidad de la línea en bits por segundo (el baud rate como número, no la constante del sistema)
+  glong (*get_line_rate)(const struct AbstractSerialDevice **);
+  // Devuelve los bits que ocupa un carácter en la línea: inicio, datos, pariedad y parada
+  guint (*get_frame_bits)(const struct AbstractSerialDevice **);
+  // Configura las pausas de `write_frame` y reinicia sus estadísticas
+  gboolean (*set_pacing)(const struct SerialPacing *, const struct AbstractSerialDevice **);
+  // Copia las pausas configuradas
+  void (*get_pacing)(struct SerialPacing *, const struct AbstractSerialDevice **);
+  // Escribe una trama completa respetando las pausas configuradas; bloquea hasta entregar el último byte al sistema.
+  // El tiempo de carácter se calcula en cada llamada a partir del baud rate, la pariedad y los bits de parada.
+  // Devuelve los bytes escritos o -1 con errno configurado. Con control de flujo por hardware, si el otro extremo
+  // detiene la línea demasiado tiempo, devuelve los bytes que sí se escribieron (menos que los pedidos) con errno en
+  // EAGAIN: quien llama decide si sigue esperando. En ese caso la siguiente llamada se toma como el resto de la misma
+  // trama: empieza con la pausa entre bytes, no con la pausa entre tramas
+  gssize (*write_frame)(const guchar *, gsize, const struct AbstractSerialDevice **);
+  // Copia las estadísticas de las pausas
+  void (*get_pacing_stats)(struct SerialPacingStats *, const struct AbstractSerialDevice **);
+  // Devuelve el descriptor de archivo del sistema (POSIX) o -1 si el driver no tiene uno. Solamente sirve para
+  // operaciones que la interfaz no ofrece (p.e. splice); quien lo use no debe cerrarlo
+  gint (*get_native_fd)(const struct AbstractSerialDevice **);
+  // Suma a los contadores de `get_stats` los bytes que se movieron directamente con el descriptor del sistema
+  void (*add_stats)(const struct SerialStats *, const struct AbstractSerialDevice **);
+};
+
+// Forma en que el driver espera y lee los datos del puerto. Se elige al abrirlo
+enum SerialBackend {
+  // `poll` + `read` en POSIX, E/S síncrona en Windows
+  SERIAL_BACKEND_DEFAULT,
+  // io_uring (solamente Linux): una llamada al sistema por cada bloque recibido en lugar de dos
+  SERIAL_BACKEND_URING
+};
+
+// La fecha de cada bloque está en `timestamp.h`
+struct SerialTimestamp;
+
+// Función que recibe los bytes leídos por el hilo lector junto con la fecha del bloque. Se ejecuta dentro del hilo
+// lector, no en el de la GUI.
+typedef void (*SerialReceiveFunc)(const guchar *, gsize, const struct SerialTimestamp *, gpointer);
+
+// Política del planificador para el hilo lector en tiempo real
+enum SerialRealtimePolicy {
+  SERIAL_RT_FIFO,
+  SERIAL_RT_RR
+};
+
+// Configuración del hilo lector en tiempo real (ver `start_serial_listener_realtime`)
+struct SerialRealtime {
+  enum SerialRealtimePolicy policy;
+  // Prioridad dentro de la política (en Linux, de 1 a 99)
+  gint priority;
+  // CPU a la que se fija el hilo, o -1 para dejarlo en cualquiera
+  gint cpu;
+  // Cada cuánto despierta el hilo a leer el puerto, en microsegundos
+  guint period_us;
+  // Bloquea en RAM (mlock) la pila y el buffer del hilo para que un fallo de página no lo retrase. Es solamente la
+  // memoria del hilo, no la del proceso, y se desbloquea cuando el hilo termina
+  gboolean lock_memory;
+};
+
+// Cubetas del histograma: la cubeta i cuenta los retrasos de [2^i, 2^(i+1)) ns; la 0 también cuenta los de 0 ns y la
+// última todos los que no caben en las anteriores
+#define SERIAL_JITTER_BUCKETS           32
+
+// Retraso de cada despertar del hilo lector en tiempo real respecto a su fecha programada
+struct SerialJitterHistogram {
+  guint64 samples;
+  gint64 max_ns;
+  gdouble mean_ns;
+  guint64 buckets[SERIAL_JITTER_BUCKETS];
 };
 
 // Esta función toma un puntero a un puntero de un Abstract Serial Device, reserva memoria, abre el puerto y devuelve
@@ -93,6 +229,42 @@ struct AbstractSerialDevice {
 //  -> Si lo logra, llena el driver con los pertinentes
 gboolean open_serial_port(const struct AbstractSerialDevice **, GString *);
 
+// Igual que `open_serial_port`, pero con el backend dado. Si la plataforma no lo tiene, retorna FALSE con errno en
+// ENOTSUP; si el kernel no lo soporta o no lo permite, con el errno de la llamada que falló (p.e. ENOSYS o EPERM).
+gboolean open_serial_port_with_backend(const struct AbstractSerialDevice **, GString *, enum SerialBackend);
+
 // Esta función cierra un puerto serial y libera los recursos asociados.
+//  -> Si hay un hilo lector, lo cancela y espera a que termine (`stop_serial_listener`)
+//  -> Solamente después de eso cierra el puerto y libera la memoria; el puntero se vuelve NULL
+// Al retornar, el mismo puerto (u otro) se puede volver a abrir con `open_serial_port`.
 void close_serial_port(const struct AbstractSerialDevice **);
+
+// Crea el hilo lector del puerto. El hilo bloquea en `read_buffer` y entrega cada bloque leído a la función dada,
+// con la fecha en que regresó la lectura.
+//  -> Solamente puede haber un hilo lector por puerto; si ya existe, retorna FALSE
+//  -> El hilo termina al llamar a `stop_serial_listener`/`close_serial_port` o ante un error del puerto
+gboolean start_serial_listener(const struct AbstractSerialDevice **, SerialReceiveFunc, gpointer);
+
+// Igual que `start_serial_listener`, pero el hilo corre con una política de tiempo real (SCHED_FIFO o SCHED_RR),
+// opcionalmente fijo a una CPU y con su memoria bloqueada. En lugar de bloquear en `read_buffer`, despierta en fechas
+// absolutas cada `period_us`, vacía la cola de entrada con `read_available` y registra el retraso del despertar en un
+// histograma. Todo lo que usa el ciclo se reserva antes de empezar.
+//  -> Si no se puede aplicar la configuración (p.e. EPERM sin CAP_SYS_NICE), el hilo no se crea y retorna FALSE con
+//     errno configurado
+//  -> Solamente en POSIX; en Windows retorna FALSE con errno en ENOTSUP
+gboolean start_serial_listener_realtime(const struct AbstractSerialDevice **,
+                                        SerialReceiveFunc,
+                                        gpointer,
+                                        const struct SerialRealtime *);
+
+// Copia el histograma del hilo lector en tiempo real. Retorna FALSE si el puerto no tiene un hilo lector en tiempo
+// real.
+gboolean get_serial_listener_jitter(const struct AbstractSerialDevice **, struct SerialJitterHistogram *);
+
+// Límite superior (en ns) del retraso de la fracción dada (p.e. 0.99) de los despertares del histograma
+gint64 serial_jitter_percentile(const struct SerialJitterHistogram *, gdouble);
+
+// Cancela el hilo lector mediante `cancel_read` y espera a que termine (join). Al retornar, la función de recepción
+// ya no se volverá a llamar.
+void stop_serial_listener(const struct AbstractSerialDevice **);
 #endif // ABSERIO_H
@@ -0,0 +1,484 @@
+//===-- lib/abserio/bridge.c - Puente entre el puerto serial y TCP ----------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Un solo hilo atiende el puerto, los sockets que escuchan y a todos los clientes con `poll`:
+///   -> Puerto -> clientes: `splice` del puerto a `rx_pipe`, `tee` de `rx_pipe` al pipe de salida de cada cliente y
+///      `splice` de ese pipe al socket. Al final, lo que quedó en `rx_pipe` se lee para la función de recepción local
+///      (la única copia al espacio del programa, la misma que hace el hilo lector)
+///   -> Cliente -> puerto: `splice` del socket al pipe de entrada del cliente y de ahí al puerto. Mientras el pipe de
+///      entrada tenga bytes pendientes, el socket no se vigila
+///
+/// Entre Linux 5.10 y 6.4 las TTY no tienen `splice_read`: el primer `splice` desde el puerto falla con EINVAL. En
+/// ese caso el puente sigue con `read` al buffer y `write` al pipe de salida de cada cliente (una copia más).
+///
+/// Si el hilo termina por un error del puerto, el errno queda en los contadores (`serial_bridge_get_stats`).
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#define _GNU_SOURCE
+#define G_LOG_DOMAIN                    "BridgeAbSerIO"
+#include "bridge.h"
+#include "timestamp.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Estructuras de datos
+//===--------------------------------------------------------------------------------------------------------------===//
+// Capacidad pedida para cada pipe: es lo que un cliente puede atrasarse antes de perder bytes
+#define BRIDGE_PIPE_SIZE                (256*1024)
+#define BRIDGE_MAX_CLIENTS              16
+#define BRIDGE_BACKLOG                  4
+// Buffer para entregar los bytes a la función de recepción local
+#define BRIDGE_BUFFER_SIZE              4096
+#define BRIDGE_SPLICE_FLAGS             (SPLICE_F_NONBLOCK | SPLICE_F_MOVE)
+// Descriptores fijos al inicio del arreglo de `poll`: wake, puerto, clientes completos y monitores
+#define BRIDGE_FIXED_FDS                4
+
+struct BridgeClient {
+  int socket;
+  gboolean monitor;
+  // Se desconecta al terminar la vuelta actual del ciclo
+  gboolean closed;
+  // Del puerto hacia el socket
+  int out_pipe[2];
+  gsize out_pending;
+  // Del socket hacia el puerto (solamente clientes completos)
+  int in_pipe[2];
+  gsize in_pending;
+};
+
+struct SerialBridge {
+  GThread *thread;
+  // Copia del puntero al driver, igual que el hilo lector
+  const struct AbstractSerialDevice *dev;
+  int tty_fd;
+  int listen_fd;
+  int monitor_fd;
+  // Pipe para despertar al hilo: [1] lo escribe `serial_bridge_free`
+  int wake_fd[2];
+  // Lo que llega por el puerto entra a este pipe y de aquí se copia a cada cliente
+  int rx_pipe[2];
+  GPtrArray *clients;
+  SerialReceiveFunc receive;
+  gpointer user_data;
+  struct SerialStamper stamper;
+  // FALSE si el puerto no acepta `splice` (se lee con `read`)
+  gboolean splice_port;
+  // errno del error que detuvo al hilo, 0 mientras funciona
+  atomic_int error;
+  atomic_uint clients_count;
+  atomic_uint monitors_count;
+  atomic_uint_fast64_t rx_bytes;
+  atomic_uint_fast64_t tx_bytes;
+  atomic_uint_fast64_t dropped_bytes;
+};
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                   Funciones extra
+//===--------------------------------------------------------------------------------------------------------------===//
+static gboolean open_pipe(int fds[2]) {
+  if (pipe2(fds, O_NONBLOCK | O_CLOEXEC)==-1) {
+    return FALSE;
+  }
+  // Si el límite del sistema (/proc/sys/fs/pipe-max-size) es menor, se queda el tamaño por defecto
+  fcntl(fds[1], F_SETPIPE_SZ, BRIDGE_PIPE_SIZE);
+  return TRUE;
+}
+
+static void close_pipe(int fds[2]) {
+  if (fds[0]!=-1) {
+    close(fds[0]);
+    close(fds[1]);
+  }
+}
+
+static int listen_on(const gchar *address, guint16 port) {
+  struct sockaddr_in addr = {0};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (inet_pton(AF_INET, address, &addr.sin_addr)!=1) {
+    errno = EINVAL;
+    return -1;
+  }
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd==-1) {
+    return -1;
+  }
+  int yes = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+  if (bind(fd, (struct sockaddr *) &addr, sizeof(addr))==-1 || listen(fd, BRIDGE_BACKLOG)==-1) {
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return -1;
+  }
+  return fd;
+}
+
+static void free_client(gpointer data) {
+  struct BridgeClient *client = data;
+  close(client->socket);
+  close_pipe(client->out_pipe);
+  close_pipe(client->in_pipe);
+  g_free(client);
+}
+
+static void accept_client(struct SerialBridge *bridge, int listen_fd, gboolean monitor) {
+  int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+  if (fd==-1) {
+    return;
+  }
+  if (bridge->clients->len >= BRIDGE_MAX_CLIENTS) {
+    g_warning("Bridge client rejected: already serving %d clients.", BRIDGE_MAX_CLIENTS);
+    close(fd);
+    return;
+  }
+  struct BridgeClient *client = g_new0(struct BridgeClient, 1);
+  client->socket = fd;
+  client->monitor = monitor;
+  client->out_pipe[0] = client->out_pipe[1] = -1;
+  client->in_pipe[0] = client->in_pipe[1] = -1;
+  if (!open_pipe(client->out_pipe) || (!monitor && !open_pipe(client->in_pipe))) {
+    g_critical("Unable to create the pipes for a bridge client.");
+    g_critical("Message: \'%s\'", g_strerror(errno));
+    free_client(client);
+    return;
+  }
+  g_ptr_array_add(bridge->clients, client);
+  atomic_fetch_add(monitor ? &bridge->monitors_count : &bridge->clients_count, 1);
+  g_debug("Bridge client connected (%s).", monitor ? "monitor" : "full");
+}
+
+// Pasa al socket lo que el cliente tenga pendiente. FALSE si el cliente se desconectó.
+static gboolean flush_client(struct BridgeClient *client) {
+  while (client->out_pending > 0) {
+    ssize_t n = splice(client->out_pipe[0], NULL, client->socket, NULL, client->out_pending, BRIDGE_SPLICE_FLAGS);
+    if (n > 0) {
+      client->out_pending -= (gsize) n;
+    } else if (n==-1 && (errno==EAGAIN || errno==EINTR)) {
+      return TRUE;
+    } else {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+// Escribe al puerto lo que el cliente tenga pendiente. FALSE si el puerto falló.
+static gboolean drain_client(struct SerialBridge *bridge, struct BridgeClient *client) {
+  while (client->in_pending > 0) {
+    ssize_t n = splice(client->in_pipe[0], NULL, bridge->tty_fd, NULL, client->in_pending, BRIDGE_SPLICE_FLAGS);
+    if (n > 0) {
+      client->in_pending -= (gsize) n;
+      atomic_fetch_add_explicit(&bridge->tx_bytes, (uint_fast64_t) n, memory_order_relaxed);
+      struct SerialStats moved = {0, (guint64) n};
+      bridge->dev->add_stats(&moved, &bridge->dev);
+    } else if (n==-1 && (errno==EAGAIN || errno==EINTR)) {
+      return TRUE;
+    } else {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+// Lee del socket de un cliente. FALSE si el cliente se desconectó.
+static gboolean receive_from_client(struct SerialBridge *bridge, struct BridgeClient *client) {
+  if (client->monitor) {
+    // Lo que envía un monitor se descarta; solamente importa detectar que cerró la conexión
+    guchar discard[256];
+    ssize_t n;
+    while ((n = recv(client->socket, discard, sizeof(discard), 0)) > 0) {
+    }
+    return n==-1 && (errno==EAGAIN || errno==EINTR);
+  }
+  ssize_t n = splice(client->socket, NULL, client->in_pipe[1], NULL, BRIDGE_PIPE_SIZE, BRIDGE_SPLICE_FLAGS);
+  if (n==0 || (n==-1 && errno!=EAGAIN && errno!=EINTR)) {
+    return FALSE;
+  }
+  if (n > 0) {
+    client->in_pending += (gsize) n;
+  }
+  if (!drain_client(bridge, client)) {
+    g_critical("Unable to write bridge data to the port.");
+    g_critical("Message: \'%s\'", g_strerror(errno));
+    return FALSE;
+  }
+  return TRUE;
+}
+
+// Pone la fecha a los bytes recién leídos del puerto y los cuenta
+static void count_from_port(struct SerialBridge *bridge, ssize_t n, struct SerialTimestamp *stamp) {
+  serial_stamper_stamp(&bridge->stamper, &bridge->dev, stamp);
+  atomic_fetch_add_explicit(&bridge->rx_bytes, (uint_fast64_t) n, memory_order_relaxed);
+  struct SerialStats moved = {(guint64) n, 0};
+  bridge->dev->add_stats(&moved, &bridge->dev);
+}
+
+// Registra lo que se pudo copiar al pipe de salida de un cliente y le pasa al socket lo pendiente
+static void queue_to_client(struct SerialBridge *bridge, struct BridgeClient *client, ssize_t n, ssize_t copied) {
+  if (copied < 0) {
+    copied = 0;
+  }
+  client->out_pending += (gsize) copied;
+  if (copied < n) {
+    atomic_fetch_add_explicit(&bridge->dropped_bytes, (uint_fast64_t) (n - copied), memory_order_relaxed);
+  }
+  if (!flush_client(client)) {
+    client->closed = TRUE;
+  }
+}
+
+// `forward_from_port` para los puertos sin `splice_read`: una lectura al buffer y una escritura por cliente
+static gboolean copy_from_port(struct SerialBridge *bridge, guchar *buffer) {
+  ssize_t n = read(bridge->tty_fd, buffer, BRIDGE_BUFFER_SIZE);
+  if (n==-1) {
+    return errno==EAGAIN || errno==EINTR;
+  }
+  if (n==0) {
+    errno = EIO;
+    return FALSE;
+  }
+  struct SerialTimestamp stamp;
+  count_from_port(bridge, n, &stamp);
+  for (guint i = 0; i < bridge->clients->len; i++) {
+    struct BridgeClient *client = g_ptr_array_index(bridge->clients, i);
+    queue_to_client(bridge, client, n, write(client->out_pipe[1], buffer, (size_t) n));
+  }
+  bridge->receive(buffer, (gsize) n, &stamp, bridge->user_data);
+  return TRUE;
+}
+
+// Reparte lo que llegó por el puerto. FALSE ante un error del puerto.
+static gboolean forward_from_port(struct SerialBridge *bridge, guchar *buffer) {
+  if (!bridge->splice_port) {
+    return copy_from_port(bridge, buffer);
+  }
+  ssize_t n = splice(bridge->tty_fd, NULL, bridge->rx_pipe[1], NULL, BRIDGE_PIPE_SIZE, BRIDGE_SPLICE_FLAGS);
+  if (n==-1 && errno==EINVAL) {
+    g_warning("The port does not support splice; the bridge falls back to read() and write().");
+    bridge->splice_port = FALSE;
+    return copy_from_port(bridge, buffer);
+  }
+  if (n==-1) {
+    return errno==EAGAIN || errno==EINTR;
+  }
+  if (n==0) {
+    // Fin de archivo: el otro extremo desapareció
+    errno = EIO;
+    return FALSE;
+  }
+  struct SerialTimestamp stamp;
+  count_from_port(bridge, n, &stamp);
+  for (guint i = 0; i < bridge->clients->len; i++) {
+    struct BridgeClient *client = g_ptr_array_index(bridge->clients, i);
+    // `tee` no consume `rx_pipe`: cada cliente recibe su propia copia de las mismas páginas
+    queue_to_client(bridge, client, n, tee(bridge->rx_pipe[0], client->out_pipe[1], (size_t) n, SPLICE_F_NONBLOCK));
+  }
+  // Finalmente se consume `rx_pipe`, entregando los bytes a la función de recepción local. Si no caben en una sola
+  // lectura, cada parte lleva la fecha de su último byte
+  ssize_t left = n;
+  while (left > 0) {
+    ssize_t r = read(bridge->rx_pipe[0], buffer, MIN((gsize) left, BRIDGE_BUFFER_SIZE));
+    if (r <= 0) {
+      break;
+    }
+    gsize last = (gsize) (n - left + r - 1);
+    struct SerialTimestamp part = stamp;
+    part.monotonic_ns = serial_timestamp_byte(&stamp, (gsize) n, last);
+    part.realtime_ns = serial_timestamp_byte_realtime(&stamp, (gsize) n, last);
+    bridge->receive(buffer, (gsize) r, &part, bridge->user_data);
+    left -= r;
+  }
+  return TRUE;
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Hilos de ejecución
+//===--------------------------------------------------------------------------------------------------------------===//
+static gpointer bridge_thread(gpointer data) {
+  struct SerialBridge *bridge = data;
+  guchar buffer[BRIDGE_BUFFER_SIZE];
+  struct pollfd fds[BRIDGE_FIXED_FDS + BRIDGE_MAX_CLIENTS];
+  while (TRUE) {
+    gboolean port_wanted = FALSE;
+    guint count = bridge->clients->len;
+    for (guint i = 0; i < count; i++) {
+      struct BridgeClient *client = g_ptr_array_index(bridge->clients, i);
+      fds[BRIDGE_FIXED_FDS + i].fd = client->socket;
+      fds[BRIDGE_FIXED_FDS + i].events = (client->monitor || client->in_pending==0) ? POLLIN : 0;
+      fds[BRIDGE_FIXED_FDS + i].events |= client->out_pending > 0 ? POLLOUT : 0;
+      port_wanted |= client->in_pending > 0;
+    }
+    fds[0].fd = bridge->wake_fd[0];
+    fds[0].events = POLLIN;
+    fds[1].fd = bridge->tty_fd;
+    fds[1].events = POLLIN | (port_wanted ? POLLOUT : 0);
+    fds[2].fd = bridge->listen_fd;
+    fds[2].events = POLLIN;
+    // Un descriptor negativo se ignora
+    fds[3].fd = bridge->monitor_fd;
+    fds[3].events = POLLIN;
+    if (poll(fds, BRIDGE_FIXED_FDS + count, -1)==-1) {
+      if (errno==EINTR) {
+        continue;
+      }
+      g_critical("Bridge stopped: poll failed.");
+      g_critical("Message: \'%s\'", g_strerror(errno));
+      atomic_store(&bridge->error, errno);
+      break;
+    }
+    if (fds[0].revents & POLLIN) {
+      g_debug("Bridge thread cancelled.");
+      break;
+    }
+    if (fds[1].revents & (POLLIN | POLLHUP | POLLERR | POLLNVAL)) {
+      if (!forward_from_port(bridge, buffer)) {
+        g_critical("Bridge stopped by an I/O error on the port.");
+        g_critical("Message: \'%s\'", g_strerror(errno));
+        atomic_store(&bridge->error, errno);
+        break;
+      }
+    }
+    for (guint i = 0; i < count; i++) {
+      struct BridgeClient *client = g_ptr_array_index(bridge->clients, i);
+      short revents = fds[BRIDGE_FIXED_FDS + i].revents;
+      if (client->closed) {
+        continue;
+      }
+      if ((fds[1].revents & POLLOUT) && !drain_client(bridge, client)) {
+        client->closed = TRUE;
+      }
+      if ((revents & POLLOUT) && !flush_client(client)) {
+        client->closed = TRUE;
+      }
+      if ((revents & (POLLIN | POLLHUP | POLLERR)) && !receive_from_client(bridge, client)) {
+        client->closed = TRUE;
+      }
+    }
+    // Las desconexiones se aplican al final para no mover los índices del arreglo de `poll`
+    for (guint i = bridge->clients->len; i > 0; i--) {
+      struct BridgeClient *client = g_ptr_array_index(bridge->clients, i - 1);
+      if (client->closed) {
+        atomic_fetch_sub(client->monitor ? &bridge->monitors_count : &bridge->clients_count, 1);
+        g_debug("Bridge client disconnected.");
+        g_ptr_array_remove_index(bridge->clients, i - 1);
+      }
+    }
+    if (fds[2].revents & POLLIN) {
+      accept_client(bridge, bridge->listen_fd, FALSE);
+    }
+    if (fds[3].revents & POLLIN) {
+      accept_client(bridge, bridge->monitor_fd, TRUE);
+    }
+  }
+  return NULL;
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                           Implementación de la interfaz
+//===--------------------------------------------------------------------------------------------------------------===//
+struct SerialBridge *serial_bridge_new(const struct AbstractSerialDevice **dev,
+                                       const gchar *address,
+                                       guint16 port,
+                                       guint16 monitor_port,
+                                       SerialReceiveFunc receive,
+                                       gpointer data) {
+  if (dev==NULL || *dev==NULL || receive==NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+  if ((*dev)->_listener!=NULL) {
+    // El puente y el hilo lector competirían por los mismos bytes
+    errno = EBUSY;
+    return NULL;
+  }
+  int tty_fd = (*dev)->get_native_fd(dev);
+  if (tty_fd==-1) {
+    errno = ENOTSUP;
+    return NULL;
+  }
+  struct SerialBridge *bridge = g_new0(struct SerialBridge, 1);
+  bridge->dev = *dev;
+  bridge->tty_fd = tty_fd;
+  bridge->monitor_fd = -1;
+  bridge->wake_fd[0] = bridge->wake_fd[1] = -1;
+  bridge->rx_pipe[0] = bridge->rx_pipe[1] = -1;
+  bridge->receive = receive;
+  bridge->user_data = data;
+  bridge->splice_port = TRUE;
+  serial_stamper_init(&bridge->stamper);
+  bridge->listen_fd = listen_on(address, port);
+  if (bridge->listen_fd==-1
+      || (monitor_port!=0 && (bridge->monitor_fd = listen_on(address, monitor_port))==-1)
+      || pipe2(bridge->wake_fd, O_NONBLOCK | O_CLOEXEC)==-1
+      || !open_pipe(bridge->rx_pipe)) {
+    int saved_errno = errno;
+    g_critical("Unable to start the bridge on %s:%u.", address, port);
+    g_critical("Message: \'%s\'", g_strerror(saved_errno));
+    if (bridge->listen_fd!=-1) {
+      close(bridge->listen_fd);
+    }
+    if (bridge->monitor_fd!=-1) {
+      close(bridge->monitor_fd);
+    }
+    close_pipe(bridge->wake_fd);
+    close_pipe(bridge->rx_pipe);
+    g_free(bridge);
+    errno = saved_errno;
+    return NULL;
+  }
+  bridge->clients = g_ptr_array_new_with_free_func(free_client);
+  atomic_init(&bridge->error, 0);
+  atomic_init(&bridge->clients_count, 0);
+  atomic_init(&bridge->monitors_count, 0);
+  atomic_init(&bridge->rx_bytes, 0);
+  atomic_init(&bridge->tx_bytes, 0);
+  atomic_init(&bridge->dropped_bytes, 0);
+  bridge->thread = g_thread_new("abserio-bridge", bridge_thread, bridge);
+  return bridge;
+}
+
+void serial_bridge_get_stats(struct SerialBridge *bridge, struct SerialBridgeStats *stats) {
+  stats->clients = atomic_load(&bridge->clients_count);
+  stats->monitors = atomic_load(&bridge->monitors_count);
+  stats->rx_bytes = atomic_load_explicit(&bridge->rx_bytes, memory_order_relaxed);
+  stats->tx_bytes = atomic_load_explicit(&bridge->tx_bytes, memory_order_relaxed);
+  stats->dropped_bytes = atomic_load_explicit(&bridge->dropped_bytes, memory_order_relaxed);
+  stats->error = atomic_load(&bridge->error);
+}
+
+void serial_bridge_free(struct SerialBridge *bridge) {
+  const char token = 0x00;
+  if (write(bridge->wake_fd[1], &token, 1)!=1) {
+    g_critical("Unable to wake up the bridge thread.");
+  }
+  g_thread_join(bridge->thread);
+  g_ptr_array_free(bridge->clients, TRUE);
+  close(bridge->listen_fd);
+  if (bridge->monitor_fd!=-1) {
+    close(bridge->monitor_fd);
+  }
+  close_pipe(bridge->wake_fd);
+  close_pipe(bridge->rx_pipe);
+  g_free(bridge);
+}
@@ -0,0 +1,71 @@
+//===-- lib/abserio/bridge.h - Puente entre el puerto serial y TCP ----------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Comparte un puerto abierto con otras herramientas por TCP (al estilo de ser2net), solamente en Linux. Los bytes
+/// se mueven entre el puerto y los sockets con `splice`/`tee` a través de pipes, sin pasar por buffers del programa.
+///
+/// Hay dos tipos de clientes:
+///   -> Completos: reciben todo lo que llega por el puerto y lo que envían se escribe al puerto
+///   -> Monitores (en otro puerto TCP): solamente reciben; lo que envían se descarta
+///
+/// Cada cliente tiene sus propios pipes, así que un cliente lento no frena a los demás ni al puerto: si su pipe de
+/// salida se llena, los bytes que no caben se descartan para ese cliente (y se cuentan). En el otro sentido, el
+/// socket de un cliente no se vuelve a leer hasta que lo anterior se escribió al puerto, lo que le transmite la
+/// contrapresión al cliente mediante la ventana de TCP.
+///
+/// Se puede probar sin hardware con un pty y `nc localhost <puerto>`.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#ifndef ABSERIO_BRIDGE_H
+#define ABSERIO_BRIDGE_H
+#include "abserio.h"
+
+// El puente es opaco
+struct SerialBridge;
+
+// Contadores del puente
+struct SerialBridgeStats {
+  // Clientes conectados
+  guint clients;
+  guint monitors;
+  // Bytes del puerto hacia los clientes (una vez, sin importar cuántos clientes haya) y de los clientes al puerto
+  guint64 rx_bytes;
+  guint64 tx_bytes;
+  // Bytes que no se entregaron a clientes lentos (la suma de todos los clientes)
+  guint64 dropped_bytes;
+  // errno del error del puerto que detuvo al puente, 0 mientras funciona. Después de un error ya no se lee el puerto:
+  // hay que liberar el puente (y volver a arrancar el hilo lector, si se quiere)
+  gint error;
+};
+
+// Empieza a compartir el puerto en la dirección dada. Si `monitor_port` es 0, no se aceptan monitores.
+//  -> El puente reemplaza al hilo lector: lo que llega por el puerto también se entrega a la función dada, igual que
+//     con `start_serial_listener`. Si ya hay un hilo lector, retorna NULL con errno en EBUSY
+//  -> Si no se puede escuchar en la dirección, retorna NULL con errno configurado
+//  -> El puerto no se debe cerrar antes de llamar a `serial_bridge_free`
+struct SerialBridge *serial_bridge_new(const struct AbstractSerialDevice **,
+                                       const gchar *,
+                                       guint16,
+                                       guint16,
+                                       SerialReceiveFunc,
+                                       gpointer);
+
+// Copia los contadores. Se puede llamar desde cualquier hilo.
+void serial_bridge_get_stats(struct SerialBridge *, struct SerialBridgeStats *);
+
+// Desconecta a todos los clientes, espera a que el hilo del puente termine y libera los recursos
+void serial_bridge_free(struct SerialBridge *);
+#endif // ABSERIO_BRIDGE_H
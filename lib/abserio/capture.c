@@ -0,0 +1,401 @@
+//===-- lib/abserio/capture.c - Archivos de captura -------------------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// El mapeo usa GMappedFile: el sistema carga solamente las páginas que se leen, así que la memoria residente depende
+/// de lo que se muestra y no del tamaño de la captura. Las entradas del índice están ordenadas por posición en el
+/// archivo y, por lo tanto, también por posición en el flujo y (mientras el reloj del sistema no retroceda) por
+/// fecha; las búsquedas son binarias sobre el índice y después lineales sobre a lo más CAPTURE_INDEX_STRIDE bytes.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#define G_LOG_DOMAIN                    "CaptureAbSerIO"
+#include "capture.h"
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Estructuras de datos
+//===--------------------------------------------------------------------------------------------------------------===//
+#define CAPTURE_HEADER_SIZE             16
+#define CAPTURE_RECORD_HEADER_SIZE      12
+// Bytes del archivo entre dos entradas del índice: 20 GB son unas 330 mil entradas (8 MB de índice)
+#define CAPTURE_INDEX_STRIDE            65536
+#define CAPTURE_INDEX_SUFFIX            ".idx"
+#define CAPTURE_INDEX_HEADER_SIZE       48
+#define CAPTURE_INDEX_ENTRY_SIZE        24
+// Buffer de stdio del archivo que se graba
+#define CAPTURE_WRITE_BUFFER            (256*1024)
+
+static const guchar CAPTURE_MAGIC[8] = {'A', 'B', 'S', 'C', 'A', 'P', 0x00, 0x01};
+static const guchar CAPTURE_INDEX_MAGIC[8] = {'A', 'B', 'S', 'I', 'D', 'X', 0x00, 0x01};
+
+struct SerialCaptureWriter {
+  FILE *file;
+};
+
+struct CaptureIndexEntry {
+  // Inicio de un registro en el archivo
+  guint64 file_offset;
+  // Bytes del flujo antes de ese registro
+  guint64 stream_offset;
+  // Fecha del registro
+  gint64 timestamp;
+};
+
+struct SerialCapture {
+  gchar *index_path;
+  GMappedFile *mapped;
+  const guchar *data;
+  gsize size;
+  GArray *index;
+  // Fin del último registro completo (lo que sigue puede ser un registro que se está grabando)
+  guint64 data_end;
+  guint64 length;
+  gint64 start_time;
+  gint64 end_time;
+};
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                   Funciones extra
+//===--------------------------------------------------------------------------------------------------------------===//
+static guint64 read_le64(const guchar *p) {
+  guint64 v;
+  memcpy(&v, p, sizeof(v));
+  return GUINT64_FROM_LE(v);
+}
+
+static guint32 read_le32(const guchar *p) {
+  guint32 v;
+  memcpy(&v, p, sizeof(v));
+  return GUINT32_FROM_LE(v);
+}
+
+static void write_le64(guchar *p, guint64 v) {
+  v = GUINT64_TO_LE(v);
+  memcpy(p, &v, sizeof(v));
+}
+
+static void write_le32(guchar *p, guint32 v) {
+  v = GUINT32_TO_LE(v);
+  memcpy(p, &v, sizeof(v));
+}
+
+// Lee el encabezado del registro en la posición dada. FALSE si el registro no está completo en el archivo.
+static gboolean record_at(const struct SerialCapture *capture, guint64 offset, gint64 *timestamp, guint32 *length) {
+  if (offset + CAPTURE_RECORD_HEADER_SIZE > capture->size) {
+    return FALSE;
+  }
+  *timestamp = (gint64) read_le64(capture->data + offset);
+  *length = read_le32(capture->data + offset + 8);
+  return offset + CAPTURE_RECORD_HEADER_SIZE + *length <= capture->size;
+}
+
+// Recorre los registros desde `data_end` y agrega al índice una entrada cada CAPTURE_INDEX_STRIDE bytes del archivo.
+// Devuelve TRUE si se indexó algo nuevo.
+static gboolean scan_records(struct SerialCapture *capture) {
+  guint64 start = capture->data_end;
+  guint64 offset = start;
+  guint64 next_entry = CAPTURE_HEADER_SIZE;
+  if (capture->index->len > 0) {
+    next_entry = g_array_index(capture->index, struct CaptureIndexEntry, capture->index->len - 1).file_offset
+        + CAPTURE_INDEX_STRIDE;
+  }
+  gint64 timestamp;
+  guint32 length;
+  while (record_at(capture, offset, &timestamp, &length)) {
+    if (offset >= next_entry) {
+      struct CaptureIndexEntry entry = {offset, capture->length, timestamp};
+      g_array_append_val(capture->index, entry);
+      next_entry = offset + CAPTURE_INDEX_STRIDE;
+    }
+    if (capture->data_end==CAPTURE_HEADER_SIZE) {
+      capture->start_time = timestamp;
+    }
+    capture->end_time = timestamp;
+    capture->length += length;
+    offset += CAPTURE_RECORD_HEADER_SIZE + length;
+    capture->data_end = offset;
+  }
+  return capture->data_end!=start;
+}
+
+// Carga el índice guardado si corresponde a esta captura (la captura pudo haber crecido desde entonces)
+static void load_index(struct SerialCapture *capture) {
+  gchar *contents;
+  gsize size;
+  if (!g_file_get_contents(capture->index_path, &contents, &size, NULL)) {
+    return;
+  }
+  const guchar *p = (const guchar *) contents;
+  guint64 count = size >= CAPTURE_INDEX_HEADER_SIZE ? read_le64(p + 40) : 0;
+  guint64 data_end = size >= CAPTURE_INDEX_HEADER_SIZE ? read_le64(p + 8) : 0;
+  if (size < CAPTURE_INDEX_HEADER_SIZE || memcmp(p, CAPTURE_INDEX_MAGIC, sizeof(CAPTURE_INDEX_MAGIC))!=0
+      || count==0 || count > (size - CAPTURE_INDEX_HEADER_SIZE)/CAPTURE_INDEX_ENTRY_SIZE
+      || data_end > capture->size) {
+    g_free(contents);
+    return;
+  }
+  g_array_set_size(capture->index, (guint) count);
+  for (guint i = 0; i < count; i++) {
+    const guchar *e = p + CAPTURE_INDEX_HEADER_SIZE + (gsize) i*CAPTURE_INDEX_ENTRY_SIZE;
+    struct CaptureIndexEntry *entry = &g_array_index(capture->index, struct CaptureIndexEntry, i);
+    entry->file_offset = read_le64(e);
+    entry->stream_offset = read_le64(e + 8);
+    entry->timestamp = (gint64) read_le64(e + 16);
+  }
+  // La primera y la última entrada deben apuntar a registros con la misma fecha; si no, es otra captura
+  struct CaptureIndexEntry *first = &g_array_index(capture->index, struct CaptureIndexEntry, 0);
+  struct CaptureIndexEntry *last = &g_array_index(capture->index, struct CaptureIndexEntry, count - 1);
+  gint64 timestamp;
+  guint32 length;
+  if (first->file_offset!=CAPTURE_HEADER_SIZE || last->file_offset >= data_end
+      || !record_at(capture, first->file_offset, &timestamp, &length) || timestamp!=first->timestamp
+      || !record_at(capture, last->file_offset, &timestamp, &length) || timestamp!=last->timestamp) {
+    g_debug("Ignoring stale index '%s'.", capture->index_path);
+    g_array_set_size(capture->index, 0);
+    g_free(contents);
+    return;
+  }
+  capture->data_end = data_end;
+  capture->length = read_le64(p + 16);
+  capture->start_time = (gint64) read_le64(p + 24);
+  capture->end_time = (gint64) read_le64(p + 32);
+  g_free(contents);
+}
+
+static void save_index(struct SerialCapture *capture) {
+  gsize size = CAPTURE_INDEX_HEADER_SIZE + (gsize) capture->index->len*CAPTURE_INDEX_ENTRY_SIZE;
+  guchar *contents = g_malloc(size);
+  memcpy(contents, CAPTURE_INDEX_MAGIC, sizeof(CAPTURE_INDEX_MAGIC));
+  write_le64(contents + 8, capture->data_end);
+  write_le64(contents + 16, capture->length);
+  write_le64(contents + 24, (guint64) capture->start_time);
+  write_le64(contents + 32, (guint64) capture->end_time);
+  write_le64(contents + 40, capture->index->len);
+  for (guint i = 0; i < capture->index->len; i++) {
+    guchar *e = contents + CAPTURE_INDEX_HEADER_SIZE + (gsize) i*CAPTURE_INDEX_ENTRY_SIZE;
+    struct CaptureIndexEntry *entry = &g_array_index(capture->index, struct CaptureIndexEntry, i);
+    write_le64(e, entry->file_offset);
+    write_le64(e + 8, entry->stream_offset);
+    write_le64(e + 16, (guint64) entry->timestamp);
+  }
+  // Si no se puede guardar (p.e. un directorio de solo lectura), la siguiente apertura vuelve a indexar
+  GError *error = NULL;
+  if (!g_file_set_contents(capture->index_path, (const gchar *) contents, (gssize) size, &error)) {
+    g_debug("Unable to save the index. Message: '%s'", error->message);
+    g_error_free(error);
+  }
+  g_free(contents);
+}
+
+// La última entrada del índice cuyo registro empieza en la posición del flujo dada o antes
+static const struct CaptureIndexEntry *entry_by_offset(const struct SerialCapture *capture, guint64 offset) {
+  guint low = 0;
+  guint high = capture->index->len;
+  while (high - low > 1) {
+    guint mid = low + (high - low)/2;
+    if (g_array_index(capture->index, struct CaptureIndexEntry, mid).stream_offset <= offset) {
+      low = mid;
+    } else {
+      high = mid;
+    }
+  }
+  return &g_array_index(capture->index, struct CaptureIndexEntry, low);
+}
+
+// La última entrada del índice con fecha anterior a la dada (o la primera)
+static const struct CaptureIndexEntry *entry_by_time(const struct SerialCapture *capture, gint64 timestamp) {
+  guint low = 0;
+  guint high = capture->index->len;
+  while (high - low > 1) {
+    guint mid = low + (high - low)/2;
+    if (g_array_index(capture->index, struct CaptureIndexEntry, mid).timestamp < timestamp) {
+      low = mid;
+    } else {
+      high = mid;
+    }
+  }
+  return &g_array_index(capture->index, struct CaptureIndexEntry, low);
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                Grabación de capturas
+//===--------------------------------------------------------------------------------------------------------------===//
+struct SerialCaptureWriter *serial_capture_writer_new(const gchar *path) {
+  FILE *file = g_fopen(path, "wb");
+  if (file==NULL) {
+    return NULL;
+  }
+  setvbuf(file, NULL, _IOFBF, CAPTURE_WRITE_BUFFER);
+  guchar header[CAPTURE_HEADER_SIZE] = {0};
+  memcpy(header, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+  if (fwrite(header, 1, sizeof(header), file)!=sizeof(header)) {
+    int saved_errno = errno;
+    fclose(file);
+    errno = saved_errno;
+    return NULL;
+  }
+  struct SerialCaptureWriter *writer = g_new0(struct SerialCaptureWriter, 1);
+  writer->file = file;
+  return writer;
+}
+
+gboolean serial_capture_writer_append(struct SerialCaptureWriter *writer,
+                                      gint64 timestamp,
+                                      const guchar *data,
+                                      gsize length) {
+  do {
+    // Un registro guarda a lo más G_MAXUINT32 bytes; un bloque más grande se parte con la misma fecha
+    guint32 chunk = (guint32) MIN(length, G_MAXUINT32);
+    guchar header[CAPTURE_RECORD_HEADER_SIZE];
+    write_le64(header, (guint64) timestamp);
+    write_le32(header + 8, chunk);
+    if (fwrite(header, 1, sizeof(header), writer->file)!=sizeof(header)
+        || fwrite(data, 1, chunk, writer->file)!=chunk) {
+      return FALSE;
+    }
+    data += chunk;
+    length -= chunk;
+  } while (length > 0);
+  return TRUE;
+}
+
+void serial_capture_writer_free(struct SerialCaptureWriter *writer) {
+  if (fclose(writer->file)!=0) {
+    g_critical("Unable to finish the capture file.");
+    g_critical("Message: \'%s\'", g_strerror(errno));
+  }
+  g_free(writer);
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                Lectura de capturas
+//===--------------------------------------------------------------------------------------------------------------===//
+struct SerialCapture *serial_capture_open(const gchar *path) {
+  GError *error = NULL;
+  GMappedFile *mapped = g_mapped_file_new(path, FALSE, &error);
+  if (mapped==NULL) {
+    g_debug("Unable to map '%s'. Message: '%s'", path, error->message);
+    g_error_free(error);
+    errno = errno!=0 ? errno : EIO;
+    return NULL;
+  }
+  gsize size = g_mapped_file_get_length(mapped);
+  const guchar *data = (const guchar *) g_mapped_file_get_contents(mapped);
+  if (size < CAPTURE_HEADER_SIZE || memcmp(data, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC))!=0) {
+    g_mapped_file_unref(mapped);
+    errno = EINVAL;
+    return NULL;
+  }
+  struct SerialCapture *capture = g_new0(struct SerialCapture, 1);
+  capture->index_path = g_strconcat(path, CAPTURE_INDEX_SUFFIX, NULL);
+  capture->mapped = mapped;
+  capture->data = data;
+  capture->size = size;
+  capture->index = g_array_new(FALSE, FALSE, sizeof(struct CaptureIndexEntry));
+  capture->data_end = CAPTURE_HEADER_SIZE;
+  load_index(capture);
+  gint64 started = g_get_monotonic_time();
+  if (scan_records(capture)) {
+    g_debug("Indexed up to %" G_GUINT64_FORMAT " bytes in %" G_GINT64_FORMAT " ms.",
+            capture->data_end,
+            (g_get_monotonic_time() - started)/1000);
+    save_index(capture);
+  }
+  return capture;
+}
+
+guint64 serial_capture_get_length(struct SerialCapture *capture) {
+  return capture->length;
+}
+
+gint64 serial_capture_get_start_time(struct SerialCapture *capture) {
+  return capture->start_time;
+}
+
+gint64 serial_capture_get_end_time(struct SerialCapture *capture) {
+  return capture->end_time;
+}
+
+gsize serial_capture_read(struct SerialCapture *capture, guint64 offset, guchar *buffer, gsize size) {
+  if (offset >= capture->length) {
+    return 0;
+  }
+  const struct CaptureIndexEntry *entry = entry_by_offset(capture, offset);
+  guint64 file_offset = entry->file_offset;
+  guint64 stream_offset = entry->stream_offset;
+  gsize copied = 0;
+  gint64 timestamp;
+  guint32 length;
+  while (copied < size && file_offset < capture->data_end && record_at(capture, file_offset, &timestamp, &length)) {
+    const guchar *payload = capture->data + file_offset + CAPTURE_RECORD_HEADER_SIZE;
+    if (stream_offset + length > offset + copied) {
+      gsize skip = (gsize) (offset + copied - stream_offset);
+      gsize n = MIN(length - skip, size - copied);
+      memcpy(buffer + copied, payload + skip, n);
+      copied += n;
+    }
+    stream_offset += length;
+    file_offset += CAPTURE_RECORD_HEADER_SIZE + length;
+  }
+  return copied;
+}
+
+gint64 serial_capture_get_time(struct SerialCapture *capture, guint64 offset) {
+  if (offset >= capture->length) {
+    return capture->end_time;
+  }
+  const struct CaptureIndexEntry *entry = entry_by_offset(capture, offset);
+  guint64 file_offset = entry->file_offset;
+  guint64 stream_offset = entry->stream_offset;
+  gint64 timestamp = entry->timestamp;
+  guint32 length;
+  while (file_offset < capture->data_end && record_at(capture, file_offset, &timestamp, &length)) {
+    if (stream_offset + length > offset) {
+      break;
+    }
+    stream_offset += length;
+    file_offset += CAPTURE_RECORD_HEADER_SIZE + length;
+  }
+  return timestamp;
+}
+
+guint64 serial_capture_find_time(struct SerialCapture *capture, gint64 wanted) {
+  if (capture->index->len==0) {
+    return 0;
+  }
+  const struct CaptureIndexEntry *entry = entry_by_time(capture, wanted);
+  guint64 file_offset = entry->file_offset;
+  guint64 stream_offset = entry->stream_offset;
+  gint64 timestamp;
+  guint32 length;
+  while (file_offset < capture->data_end && record_at(capture, file_offset, &timestamp, &length)) {
+    if (timestamp >= wanted) {
+      return stream_offset;
+    }
+    stream_offset += length;
+    file_offset += CAPTURE_RECORD_HEADER_SIZE + length;
+  }
+  return capture->length;
+}
+
+void serial_capture_close(struct SerialCapture *capture) {
+  g_array_free(capture->index, TRUE);
+  g_mapped_file_unref(capture->mapped);
+  g_free(capture->index_path);
+  g_free(capture);
+}
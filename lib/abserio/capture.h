@@ -0,0 +1,74 @@
+//===-- lib/abserio/capture.h - Archivos de captura -------------------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Graba lo que llega por el puerto en un archivo y lo lee después sin cargarlo completo en memoria.
+///
+/// Un archivo de captura es un encabezado de 16 bytes seguido de registros, uno por cada bloque recibido. Los números
+/// están en little-endian:
+///   -> Encabezado: "ABSCAP" 0x00 0x01 y 8 bytes reservados
+///   -> Registro: fecha del bloque (gint64, ns desde la época Unix), longitud (guint32) y los bytes
+///
+/// Para leerla, el archivo se mapea en memoria y se construye un índice disperso (una entrada cada
+/// CAPTURE_INDEX_STRIDE bytes del archivo) con la posición en el flujo y la fecha de cada entrada. El índice se guarda
+/// junto a la captura (`<captura>.idx`), así que solamente la primera apertura recorre el archivo completo; si la
+/// captura creció desde entonces, solamente se indexa lo nuevo. Cualquier búsqueda por posición o por fecha toca
+/// a lo más una entrada del índice de registros.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#ifndef ABSERIO_CAPTURE_H
+#define ABSERIO_CAPTURE_H
+#include <glib.h>
+
+// La grabación es opaca
+struct SerialCaptureWriter;
+// Una captura abierta para lectura es opaca
+struct SerialCapture;
+
+// Crea (o trunca) el archivo de captura. Devuelve NULL con errno configurado si no se puede crear.
+struct SerialCaptureWriter *serial_capture_writer_new(const gchar *);
+
+// Agrega un bloque con su fecha (ns desde la época Unix). Los datos se guardan en un buffer; no es seguro llamarla
+// desde varios hilos a la vez. Devuelve FALSE con errno configurado si falla la escritura.
+gboolean serial_capture_writer_append(struct SerialCaptureWriter *, gint64, const guchar *, gsize);
+
+// Escribe lo pendiente y cierra el archivo
+void serial_capture_writer_free(struct SerialCaptureWriter *);
+
+// Abre una captura: la mapea en memoria y carga (o construye) su índice. Devuelve NULL con errno configurado si no se
+// puede abrir o si no es una captura (EINVAL).
+struct SerialCapture *serial_capture_open(const gchar *);
+
+// Total de bytes recibidos en la captura (sin contar encabezados)
+guint64 serial_capture_get_length(struct SerialCapture *);
+
+// Fechas del primer y último bloque, en ns desde la época Unix (0 si la captura está vacía)
+gint64 serial_capture_get_start_time(struct SerialCapture *);
+gint64 serial_capture_get_end_time(struct SerialCapture *);
+
+// Copia los bytes del flujo a partir de la posición dada (hasta el tamaño del buffer). Devuelve cuántos copió; 0 si
+// la posición está después del final.
+gsize serial_capture_read(struct SerialCapture *, guint64, guchar *, gsize);
+
+// Fecha del bloque que contiene el byte en la posición dada
+gint64 serial_capture_get_time(struct SerialCapture *, guint64);
+
+// Posición del primer byte recibido en la fecha dada o después. Si la fecha es posterior al último bloque, devuelve
+// la longitud de la captura.
+guint64 serial_capture_find_time(struct SerialCapture *, gint64);
+
+// Libera el mapeo y el índice
+void serial_capture_close(struct SerialCapture *);
+#endif // ABSERIO_CAPTURE_H
@@ -0,0 +1,85 @@
+//===-- lib/abserio/dispatch.h - Llamadas frecuentes al driver --------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Las operaciones que se llaman en ciclos (leer, escribir y copiar los contadores) tienen aquí una versión `static
+/// inline`. Por defecto pasan por la interfaz, igual que `(*dev)->read_buffer(...)`. Con la opción de CMake
+/// `ABSERIO_STATIC_DISPATCH`, llaman directamente a la implementación del driver de la plataforma
+/// (`posix_alloc.c` o `win_alloc.c`): con LTO el compilador las puede integrar en quien las llama.
+///
+/// El driver simulado (`sim.h`) se compila junto con el de la plataforma, así que la llamada directa está protegida por
+/// una comparación con el puntero de la interfaz: siempre da el mismo resultado para un puerto y el procesador la
+/// predice, mientras que una llamada indirecta no se puede integrar. Un puerto simulado pasa por la interfaz.
+///
+/// El resto de la interfaz sigue pasando por los punteros a función.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#ifndef ABSERIO_DISPATCH_H
+#define ABSERIO_DISPATCH_H
+#include "abserio.h"
+
+#ifdef ABSERIO_STATIC_DISPATCH
+// Implementaciones del driver de la plataforma, las mismas que se asignan a la interfaz en `open_serial_port`
+gssize read_buffer(guchar *, gsize, const struct AbstractSerialDevice **);
+gssize read_available(guchar *, gsize, const struct AbstractSerialDevice **);
+gssize write_buffer(const guchar *, gsize, const struct AbstractSerialDevice **);
+void get_stats(struct SerialStats *, const struct AbstractSerialDevice **);
+
+static inline gssize serial_read_buffer(guchar *buffer, gsize size, const struct AbstractSerialDevice **dev) {
+  if (G_LIKELY((*dev)->read_buffer==read_buffer)) {
+    return read_buffer(buffer, size, dev);
+  }
+  return (*dev)->read_buffer(buffer, size, dev);
+}
+
+static inline gssize serial_read_available(guchar *buffer, gsize size, const struct AbstractSerialDevice **dev) {
+  if (G_LIKELY((*dev)->read_available==read_available)) {
+    return read_available(buffer, size, dev);
+  }
+  return (*dev)->read_available(buffer, size, dev);
+}
+
+static inline gssize serial_write_buffer(const guchar *buffer, gsize size, const struct AbstractSerialDevice **dev) {
+  if (G_LIKELY((*dev)->write_buffer==write_buffer)) {
+    return write_buffer(buffer, size, dev);
+  }
+  return (*dev)->write_buffer(buffer, size, dev);
+}
+
+static inline void serial_get_stats(struct SerialStats *stats, const struct AbstractSerialDevice **dev) {
+  if (G_LIKELY((*dev)->get_stats==get_stats)) {
+    get_stats(stats, dev);
+  } else {
+    (*dev)->get_stats(stats, dev);
+  }
+}
+#else
+static inline gssize serial_read_buffer(guchar *buffer, gsize size, const struct AbstractSerialDevice **dev) {
+  return (*dev)->read_buffer(buffer, size, dev);
+}
+
+static inline gssize serial_read_available(guchar *buffer, gsize size, const struct AbstractSerialDevice **dev) {
+  return (*dev)->read_available(buffer, size, dev);
+}
+
+static inline gssize serial_write_buffer(const guchar *buffer, gsize size, const struct AbstractSerialDevice **dev) {
+  return (*dev)->write_buffer(buffer, size, dev);
+}
+
+static inline void serial_get_stats(struct SerialStats *stats, const struct AbstractSerialDevice **dev) {
+  (*dev)->get_stats(stats, dev);
+}
+#endif // ABSERIO_STATIC_DISPATCH
+#endif // ABSERIO_DISPATCH_H
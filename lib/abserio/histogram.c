@@ -0,0 +1,84 @@
+//===-- lib/abserio/histogram.c - Histograma de bytes -----------------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Las tablas son de 32 bits (caben cuatro en 4 KiB, en L1), así que los bloques se cuentan de a lo más
+/// HISTOGRAM_BLOCK bytes antes de pasar las tablas a los contadores de 64 bits.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#define G_LOG_DOMAIN                    "HistogramAbSerIO"
+#include "histogram.h"
+#include <math.h>
+#include <string.h>
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Estructuras de datos
+//===--------------------------------------------------------------------------------------------------------------===//
+// Ningún contador de 32 bits se desborda dentro de un bloque
+#define HISTOGRAM_BLOCK                 ((gsize) G_MAXUINT32)
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                   Funciones extra
+//===--------------------------------------------------------------------------------------------------------------===//
+static void count_block(const guint8 *data, gsize length, guint64 *histogram) {
+  guint32 tables[SERIAL_HISTOGRAM_TABLES][256];
+  memset(tables, 0, sizeof(tables));
+  gsize i = 0;
+  for (; i + sizeof(guint64) <= length; i += sizeof(guint64)) {
+    // El orden de los bytes dentro de la palabra no importa para contarlos
+    guint64 word;
+    memcpy(&word, data + i, sizeof(word));
+    tables[0][word & 0xFF]++;
+    tables[1][(word >> 8) & 0xFF]++;
+    tables[2][(word >> 16) & 0xFF]++;
+    tables[3][(word >> 24) & 0xFF]++;
+    tables[0][(word >> 32) & 0xFF]++;
+    tables[1][(word >> 40) & 0xFF]++;
+    tables[2][(word >> 48) & 0xFF]++;
+    tables[3][word >> 56]++;
+  }
+  for (; i < length; i++) {
+    tables[0][data[i]]++;
+  }
+  for (guint value = 0; value < 256; value++) {
+    histogram[value] += (guint64) tables[0][value] + tables[1][value] + tables[2][value] + tables[3][value];
+  }
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                           Implementación de la interfaz
+//===--------------------------------------------------------------------------------------------------------------===//
+void serial_histogram_add(const guint8 *data, gsize length, guint64 *histogram) {
+  while (length > 0) {
+    gsize block = MIN(length, HISTOGRAM_BLOCK);
+    count_block(data, block, histogram);
+    data += block;
+    length -= block;
+  }
+}
+
+gdouble serial_histogram_entropy(const guint64 *histogram, guint64 total) {
+  if (total==0) {
+    return 0.0;
+  }
+  // H = log2(N) - (1/N)·Σ c·log2(c), con una sola división
+  gdouble sum = 0.0;
+  for (guint value = 0; value < 256; value++) {
+    if (histogram[value] > 0) {
+      sum += histogram[value]*log2((gdouble) histogram[value]);
+    }
+  }
+  return MAX(0.0, log2((gdouble) total) - sum/total);
+}
@@ -0,0 +1,37 @@
+//===-- lib/abserio/histogram.h - Histograma de bytes -----------------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Cuenta cuántas veces aparece cada valor de byte. Lo usan el panel de estadísticas de la aplicación (en el hilo
+/// lector, con cada bloque recibido) y `abserio-analyze`.
+///
+/// Con una sola tabla, los bytes iguales seguidos (p.e. un relleno de ceros) esperan cada uno a que termine la suma
+/// del anterior en el mismo contador. Aquí se leen 8 bytes a la vez y se reparten entre SERIAL_HISTOGRAM_TABLES
+/// tablas, así que sumas consecutivas casi nunca tocan el mismo contador; al final las tablas se suman.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#ifndef ABSERIO_HISTOGRAM_H
+#define ABSERIO_HISTOGRAM_H
+#include <glib.h>
+
+// Tablas en las que se reparten los bytes
+#define SERIAL_HISTOGRAM_TABLES         4
+
+// Suma los bytes al histograma (256 contadores), sin ponerlo en cero antes
+void serial_histogram_add(const guint8 *, gsize, guint64 *);
+
+// Entropía de Shannon del histograma, en bits por byte (de 0 a 8). Recibe el total de bytes, o 0 si está vacío.
+gdouble serial_histogram_entropy(const guint64 *, guint64);
+#endif // ABSERIO_HISTOGRAM_H
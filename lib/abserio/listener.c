@@ -0,0 +1,373 @@
+//===-- lib/abserio/listener.c - Hilo lector del puerto ---------------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// El hilo lector es común para todos los drivers: solamente usa `read_buffer` y `cancel_read` de la interfaz. El
+/// driver es dueño del hilo, de forma que `close_serial_port` puede cancelarlo y esperar a que termine antes de
+/// liberar la memoria. Cada bloque se entrega con su fecha (`timestamp.h`), tomada en cuanto regresa la lectura.
+///
+/// El hilo en tiempo real no bloquea en el puerto: con una política de tiempo real, un hilo que despierta con cada
+/// byte le quita la CPU al resto del sistema tantas veces como lleguen bloques. En su lugar despierta en fechas
+/// absolutas (como un ciclo de control) y vacía la cola de entrada con `read_available`; el retraso de cada despertar
+/// es lo que mide el histograma. Se detiene con una bandera, no con `cancel_read`.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#define _GNU_SOURCE
+#define G_LOG_DOMAIN                    "ListenerAbSerIO"
+#include "dispatch.h"
+#include "timestamp.h"
+#include "trace.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <string.h>
+#ifndef _WIN32
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <time.h>
+#endif
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Estructuras de datos
+//===--------------------------------------------------------------------------------------------------------------===//
+// Tamaño del buffer de lectura del hilo lector
+#define LISTENER_BUFFER_SIZE            4096
+// Pila que el hilo en tiempo real toca antes de empezar, para que sus páginas ya estén en RAM
+#define LISTENER_STACK_PREFAULT         (64*1024)
+#define NSEC_PER_SEC                    1000000000LL
+
+struct SerialListener {
+  GThread *thread;
+  // Copia del puntero al driver. El hilo nunca lee el puntero del usuario, que se vuelve NULL al cerrar el puerto
+  const struct AbstractSerialDevice *dev;
+  SerialReceiveFunc receive;
+  gpointer user_data;
+  // Solamente para el hilo en tiempo real
+  gboolean realtime;
+  struct SerialRealtime config;
+  volatile atomic_bool stop;
+  // Buffer de lectura, reservado y tocado antes de que empiece el ciclo
+  guchar *buffer;
+  // Pila bloqueada con mlock (junto con el buffer) mientras corre el hilo, o NULL. Solamente la usa el hilo
+  gpointer locked_stack;
+  // Fecha de los bloques. Solamente la usa el hilo
+  struct SerialStamper stamper;
+  // Arranque: el hilo aplica la configuración y avisa el resultado antes de entrar al ciclo
+  GMutex setup_lock;
+  GCond setup_cond;
+  gboolean setup_done;
+  int setup_errno;
+  // Histograma de retrasos. Lo escribe el hilo y lo lee cualquiera, sin mutex
+  atomic_int_fast64_t max_late_ns;
+  atomic_int_fast64_t total_late_ns;
+  atomic_uint_fast64_t buckets[SERIAL_JITTER_BUCKETS];
+};
+
+#define LISTENER(x)                     ((struct SerialListener *) (x))
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Hilos de ejecución
+//===--------------------------------------------------------------------------------------------------------------===//
+static gpointer listener_thread(gpointer data) {
+  struct SerialListener *listener = LISTENER(data);
+  guchar buffer[LISTENER_BUFFER_SIZE];
+  struct SerialTimestamp stamp;
+  while (TRUE) {
+    errno = 0x00;
+    gssize n = serial_read_buffer(buffer, sizeof(buffer), &listener->dev);
+    if (n > 0) {
+      serial_stamper_stamp(&listener->stamper, &listener->dev, &stamp);
+      SERIAL_TRACE(SERIAL_TRACE_DELIVER_BEGIN, listener->dev->get_native_fd(&listener->dev), n, 0);
+      listener->receive(buffer, (gsize) n, &stamp, listener->user_data);
+      SERIAL_TRACE(SERIAL_TRACE_DELIVER_END, listener->dev->get_native_fd(&listener->dev), n, 0);
+    } else if (errno==ECANCELED) {
+      g_debug("Listener thread cancelled.");
+      break;
+    } else if (errno!=EINTR && errno!=EAGAIN) {
+      g_critical("Listener thread stopped by an I/O error.");
+      g_critical("Message: \'%s\'", g_strerror(errno));
+      break;
+    }
+  }
+  return NULL;
+}
+
+#ifndef _WIN32
+static gint64 monotonic_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (gint64) now.tv_sec*NSEC_PER_SEC + now.tv_nsec;
+}
+
+static void sleep_until_ns(gint64 deadline) {
+#ifdef __APPLE__
+  // macOS no tiene clock_nanosleep
+  gint64 left = deadline - monotonic_ns();
+  if (left > 0) {
+    struct timespec remaining = {(time_t) (left/NSEC_PER_SEC), (long) (left%NSEC_PER_SEC)};
+    while (nanosleep(&remaining, &remaining)==-1 && errno==EINTR) {
+    }
+  }
+#else
+  struct timespec target = {(time_t) (deadline/NSEC_PER_SEC), (long) (deadline%NSEC_PER_SEC)};
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &target, NULL)==EINTR) {
+  }
+#endif
+}
+
+static void record_wakeup(struct SerialListener *listener, gint64 late) {
+  guint bucket = 0;
+  while (bucket < SERIAL_JITTER_BUCKETS - 1 && late >= (G_GINT64_CONSTANT(2) << bucket)) {
+    bucket++;
+  }
+  atomic_fetch_add_explicit(&listener->total_late_ns, late, memory_order_relaxed);
+  if (late > atomic_load_explicit(&listener->max_late_ns, memory_order_relaxed)) {
+    atomic_store_explicit(&listener->max_late_ns, late, memory_order_relaxed);
+  }
+  atomic_fetch_add_explicit(&listener->buckets[bucket], 1, memory_order_relaxed);
+}
+
+// Aplica la configuración de tiempo real al hilo actual. Devuelve 0 o el errno de lo que falló
+static int apply_realtime(const struct SerialRealtime *config) {
+  if (config->cpu >= 0) {
+#ifdef __linux__
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(config->cpu, &cpus);
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if (error!=0) {
+      return error;
+    }
+#else
+    return ENOTSUP;
+#endif
+  }
+  struct sched_param param;
+  memset(&param, 0, sizeof(param));
+  param.sched_priority = config->priority;
+  return pthread_setschedparam(pthread_self(), config->policy==SERIAL_RT_RR ? SCHED_RR : SCHED_FIFO, &param);
+}
+
+// Toca la pila que el hilo va a usar, para que ningún fallo de página caiga dentro del ciclo. Con `lock_memory`
+// además bloquea en RAM esa pila y el buffer de lectura; el resto del proceso no se toca. Devuelve 0 o el errno
+static int prefault_stack(struct SerialListener *listener) {
+  volatile guchar stack[LISTENER_STACK_PREFAULT];
+  for (gsize i = 0; i < sizeof(stack); i += 4096) {
+    stack[i] = 0;
+  }
+  if (!listener->config.lock_memory) {
+    return 0;
+  }
+  if (mlock(listener->buffer, LISTENER_BUFFER_SIZE)==-1) {
+    return errno;
+  }
+  // Las páginas siguen siendo de la pila del hilo después de retornar: el ciclo las vuelve a usar
+  if (mlock((const void *) stack, sizeof(stack))==-1) {
+    int error = errno;
+    munlock(listener->buffer, LISTENER_BUFFER_SIZE);
+    return error;
+  }
+  listener->locked_stack = (gpointer) stack;
+  return 0;
+}
+
+// Deshace lo que bloqueó `prefault_stack`
+static void unlock_memory(struct SerialListener *listener) {
+  if (listener->locked_stack!=NULL) {
+    munlock(listener->locked_stack, LISTENER_STACK_PREFAULT);
+    munlock(listener->buffer, LISTENER_BUFFER_SIZE);
+    listener->locked_stack = NULL;
+  }
+}
+
+static gpointer realtime_listener_thread(gpointer data) {
+  struct SerialListener *listener = LISTENER(data);
+  int error = apply_realtime(&listener->config);
+  if (error==0) {
+    error = prefault_stack(listener);
+  }
+  g_mutex_lock(&listener->setup_lock);
+  listener->setup_errno = error;
+  listener->setup_done = TRUE;
+  g_cond_signal(&listener->setup_cond);
+  g_mutex_unlock(&listener->setup_lock);
+  if (error!=0) {
+    return NULL;
+  }
+  gint64 period = (gint64) listener->config.period_us*1000;
+  gint64 deadline = monotonic_ns();
+  while (!atomic_load(&listener->stop)) {
+    deadline += period;
+    sleep_until_ns(deadline);
+    gint64 now = monotonic_ns();
+    record_wakeup(listener, now - deadline);
+    // Si el hilo perdió uno o más periodos completos, no intenta recuperarlos de golpe
+    if (now - deadline > period) {
+      deadline = now;
+    }
+    gssize n;
+    struct SerialTimestamp stamp;
+    while ((n = serial_read_available(listener->buffer, LISTENER_BUFFER_SIZE, &listener->dev)) > 0) {
+      serial_stamper_stamp(&listener->stamper, &listener->dev, &stamp);
+      SERIAL_TRACE(SERIAL_TRACE_DELIVER_BEGIN, listener->dev->get_native_fd(&listener->dev), n, 0);
+      listener->receive(listener->buffer, (gsize) n, &stamp, listener->user_data);
+      SERIAL_TRACE(SERIAL_TRACE_DELIVER_END, listener->dev->get_native_fd(&listener->dev), n, 0);
+    }
+    if (n==-1) {
+      g_critical("Real-time listener thread stopped by an I/O error.");
+      g_critical("Message: \'%s\'", g_strerror(errno));
+      break;
+    }
+  }
+  unlock_memory(listener);
+  return NULL;
+}
+#endif
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                          Funciones de control del hilo
+//===--------------------------------------------------------------------------------------------------------------===//
+// Valida el puerto y reserva el hilo lector (sin crear el hilo). Devuelve NULL si no se puede
+static struct SerialListener *new_listener(struct AbstractSerialDevice **dev, SerialReceiveFunc receive, gpointer ud) {
+  if (dev==NULL || *dev==NULL || receive==NULL) {
+    return NULL;
+  }
+  if ((*dev)->_listener!=NULL) {
+    g_critical("Trying to start a second listener on the same port. This is considered a bug.");
+    return NULL;
+  }
+  struct SerialListener *listener = g_new0(struct SerialListener, 1);
+  listener->dev = *dev;
+  listener->receive = receive;
+  listener->user_data = ud;
+  serial_stamper_init(&listener->stamper);
+  return listener;
+}
+
+static void free_listener(struct SerialListener *listener) {
+  if (listener->realtime) {
+    g_mutex_clear(&listener->setup_lock);
+    g_cond_clear(&listener->setup_cond);
+    g_free(listener->buffer);
+  }
+  g_free(listener);
+}
+
+gboolean start_serial_listener(const struct AbstractSerialDevice **cdev, SerialReceiveFunc receive, gpointer data) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  struct SerialListener *listener = new_listener(dev, receive, data);
+  if (listener==NULL) {
+    return FALSE;
+  }
+  (*dev)->_listener = listener;
+  listener->thread = g_thread_new("abserio-listener", listener_thread, listener);
+  return TRUE;
+}
+
+gboolean start_serial_listener_realtime(const struct AbstractSerialDevice **cdev,
+                                        SerialReceiveFunc receive,
+                                        gpointer data,
+                                        const struct SerialRealtime *config) {
+#ifdef _WIN32
+  errno = ENOTSUP;
+  return FALSE;
+#else
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  if (config==NULL || config->period_us==0) {
+    errno = EINVAL;
+    return FALSE;
+  }
+  struct SerialListener *listener = new_listener(dev, receive, data);
+  if (listener==NULL) {
+    return FALSE;
+  }
+  listener->realtime = TRUE;
+  listener->config = *config;
+  atomic_init(&listener->stop, FALSE);
+  // Se escribe completo para que sus páginas existan (y se puedan bloquear con mlock) antes del ciclo
+  listener->buffer = g_malloc(LISTENER_BUFFER_SIZE);
+  memset(listener->buffer, 0, LISTENER_BUFFER_SIZE);
+  g_mutex_init(&listener->setup_lock);
+  g_cond_init(&listener->setup_cond);
+  listener->thread = g_thread_new("abserio-rt", realtime_listener_thread, listener);
+  g_mutex_lock(&listener->setup_lock);
+  while (!listener->setup_done) {
+    g_cond_wait(&listener->setup_cond, &listener->setup_lock);
+  }
+  g_mutex_unlock(&listener->setup_lock);
+  if (listener->setup_errno!=0) {
+    int saved_errno = listener->setup_errno;
+    g_thread_join(listener->thread);
+    g_critical("Unable to apply the real-time configuration to the listener thread.");
+    g_critical("Message: \'%s\'", g_strerror(saved_errno));
+    free_listener(listener);
+    errno = saved_errno;
+    return FALSE;
+  }
+  (*dev)->_listener = listener;
+  g_debug("Real-time listener thread running every %u us.", config->period_us);
+  return TRUE;
+#endif
+}
+
+void stop_serial_listener(const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  if (dev==NULL || *dev==NULL || (*dev)->_listener==NULL) {
+    return;
+  }
+  struct SerialListener *listener = LISTENER((*dev)->_listener);
+  if (listener->realtime) {
+    // El hilo en tiempo real no bloquea: ve la bandera a lo más un periodo después
+    atomic_store(&listener->stop, TRUE);
+  } else {
+    // Despierta al hilo (si está bloqueado) y espera a que termine. Si el hilo ya había terminado por un error, el
+    // token de cancelación queda pendiente y se descarta al cerrar el puerto.
+    (*dev)->cancel_read(cdev);
+  }
+  g_thread_join(listener->thread);
+  g_debug("Listener thread joined.");
+  (*dev)->_listener = NULL;
+  free_listener(listener);
+}
+
+gboolean get_serial_listener_jitter(const struct AbstractSerialDevice **cdev, struct SerialJitterHistogram *histogram) {
+  if (cdev==NULL || *cdev==NULL || (*cdev)->_listener==NULL || !LISTENER((*cdev)->_listener)->realtime) {
+    return FALSE;
+  }
+  struct SerialListener *listener = LISTENER((*cdev)->_listener);
+  // El total de despertares es la suma de las cubetas, así que siempre coincide con lo que se copió
+  histogram->samples = 0;
+  for (guint i = 0; i < SERIAL_JITTER_BUCKETS; i++) {
+    histogram->buckets[i] = atomic_load_explicit(&listener->buckets[i], memory_order_relaxed);
+    histogram->samples += histogram->buckets[i];
+  }
+  histogram->max_ns = atomic_load_explicit(&listener->max_late_ns, memory_order_relaxed);
+  gint64 total = atomic_load_explicit(&listener->total_late_ns, memory_order_relaxed);
+  histogram->mean_ns = histogram->samples > 0 ? (gdouble) total/histogram->samples : 0.0;
+  return TRUE;
+}
+
+gint64 serial_jitter_percentile(const struct SerialJitterHistogram *histogram, gdouble fraction) {
+  guint64 target = (guint64) (fraction*histogram->samples);
+  guint64 counted = 0;
+  for (guint i = 0; i < SERIAL_JITTER_BUCKETS - 1; i++) {
+    counted += histogram->buckets[i];
+    if (counted >= target) {
+      return G_GINT64_CONSTANT(2) << i;
+    }
+  }
+  // La última cubeta no tiene límite superior
+  return histogram->max_ns;
+}
@@ -0,0 +1,427 @@
+//===-- lib/abserio/macro.c - Macros de transmisión -------------------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// El bytecode es una secuencia de instrucciones de un byte seguidas de sus operandos (little endian):
+///   -> MACRO_OP_SEND, longitud (16 bits), bytes
+///   -> MACRO_OP_WAIT, microsegundos (32 bits)
+///   -> MACRO_OP_END
+/// Los bytes consecutivos del texto (aunque vengan de elementos distintos) se juntan en un solo MACRO_OP_SEND, así el
+/// hilo los entrega al driver como una sola trama (`write_frame`).
+///
+/// Antes de cada pausa el hilo espera a que la cola de salida se vacíe (`drain_output`) y toma ese momento como
+/// referencia; las pausas seguidas se suman a la misma fecha límite y se duermen con `g_cond_wait_until`, que usa el
+/// reloj monotónico y además permite cancelar a mitad de la pausa.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#define G_LOG_DOMAIN                    "MacroAbSerIO"
+#include "macro.h"
+#include "payload.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <string.h>
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Estructuras de datos
+//===--------------------------------------------------------------------------------------------------------------===//
+#define MACRO_OP_END                    0x00
+#define MACRO_OP_SEND                   0x01
+#define MACRO_OP_WAIT                   0x02
+// Máximo de bytes de un solo MACRO_OP_SEND
+#define MACRO_SEND_MAX                  G_MAXUINT16
+
+struct SerialMacroRun {
+  GThread *thread;
+  // Copia del puntero al driver, igual que el hilo lector
+  const struct AbstractSerialDevice *dev;
+  GBytes *code;
+  GMutex lock;
+  GCond wake;
+  volatile atomic_bool cancel;
+  volatile atomic_bool done;
+  int error;
+};
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                   Funciones extra
+//===--------------------------------------------------------------------------------------------------------------===//
+static void emit_send(GByteArray *code, GByteArray *pending) {
+  for (guint offset = 0; offset < pending->len; offset += MACRO_SEND_MAX) {
+    guint length = MIN(pending->len - offset, MACRO_SEND_MAX);
+    guint8 op[3] = {MACRO_OP_SEND, length & 0xFF, (length >> 8) & 0xFF};
+    g_byte_array_append(code, op, sizeof(op));
+    g_byte_array_append(code, pending->data + offset, length);
+  }
+  g_byte_array_set_size(pending, 0);
+}
+
+static void emit_wait(GByteArray *code, guint32 microseconds) {
+  guint8 op[5] = {MACRO_OP_WAIT,
+                  microseconds & 0xFF,
+                  (microseconds >> 8) & 0xFF,
+                  (microseconds >> 16) & 0xFF,
+                  (microseconds >> 24) & 0xFF};
+  g_byte_array_append(code, op, sizeof(op));
+}
+
+// `<dígitos>us`, `<dígitos>ms` o `<dígitos>s`. Las pausas de más de G_MAXUINT32 us (71 minutos) son inválidas.
+static gboolean parse_delay(const gchar *token, const gchar *end, guint32 *microseconds) {
+  guint64 value = 0;
+  const gchar *p = token;
+  while (p < end && g_ascii_isdigit(*p)) {
+    value = value*10 + (guint64) (*p - '0');
+    if (value > G_MAXUINT32) {
+      return FALSE;
+    }
+    p++;
+  }
+  if (p==token) {
+    return FALSE;
+  }
+  guint64 scale;
+  if (end - p==2 && p[0]=='u' && p[1]=='s') {
+    scale = 1;
+  } else if (end - p==2 && p[0]=='m' && p[1]=='s') {
+    scale = 1000;
+  } else if (end - p==1 && p[0]=='s') {
+    scale = G_USEC_PER_SEC;
+  } else {
+    return FALSE;
+  }
+  if (value*scale > G_MAXUINT32) {
+    return FALSE;
+  }
+  *microseconds = (guint32) (value*scale);
+  return TRUE;
+}
+
+// Pares de dígitos hexadecimales, con `0x` opcional al inicio
+static gboolean parse_hex(const gchar *token, const gchar *end, GByteArray *pending) {
+  if (end - token > 2 && token[0]=='0' && (token[1]=='x' || token[1]=='X')) {
+    token += 2;
+  }
+  if ((end - token)%2!=0) {
+    return FALSE;
+  }
+  for (const gchar *p = token; p < end; p += 2) {
+    gint high = g_ascii_xdigit_value(p[0]);
+    gint low = g_ascii_xdigit_value(p[1]);
+    if (high==-1 || low==-1) {
+      return FALSE;
+    }
+    guint8 value = (guint8) ((high << 4) | low);
+    g_byte_array_append(pending, &value, 1);
+  }
+  return TRUE;
+}
+
+// Texto entre comillas. Al terminar, `*cursor` queda después de la comilla final.
+static gboolean parse_string(const gchar **cursor, GByteArray *pending) {
+  const gchar *p = *cursor + 1;
+  while (*p!='"') {
+    guint8 value;
+    if (*p=='\0') {
+      return FALSE;
+    } else if (*p!='\\') {
+      value = (guint8) *p++;
+    } else {
+      gsize used = serial_payload_unescape(p + 1, &value);
+      if (used==0) {
+        return FALSE;
+      }
+      p += 1 + used;
+    }
+    g_byte_array_append(pending, &value, 1);
+  }
+  *cursor = p + 1;
+  return TRUE;
+}
+
+// Cada MACRO_OP_SEND es una trama: `write_frame` respeta las pausas configuradas en el puerto (`set_pacing`)
+static gboolean send_frame(struct SerialMacroRun *run, const guchar *data, gsize length) {
+  gsize sent = 0;
+  while (sent < length) {
+    if (atomic_load(&run->cancel)) {
+      run->error = ECANCELED;
+      return FALSE;
+    }
+    errno = 0x00;
+    gssize n = run->dev->write_frame(data + sent, length - sent, &run->dev);
+    if (n==-1 && errno==ECANCELED) {
+      // `serial_macro_cancel` vació la cola a mitad de la trama
+      run->error = ECANCELED;
+      return FALSE;
+    }
+    if (n==-1) {
+      run->error = errno!=0 ? errno : EIO;
+      g_critical("Macro stopped while sending.");
+      g_critical("Message: \'%s\'", g_strerror(run->error));
+      return FALSE;
+    }
+    // Menos bytes de los pedidos: el control de flujo detuvo la línea. Se sigue esperando mientras no se cancele
+    sent += (gsize) n;
+  }
+  return TRUE;
+}
+
+// Duerme hasta la fecha límite (reloj monotónico). Devuelve FALSE si se canceló antes.
+static gboolean wait_until(struct SerialMacroRun *run, gint64 deadline) {
+  g_mutex_lock(&run->lock);
+  while (!atomic_load(&run->cancel)) {
+    if (!g_cond_wait_until(&run->wake, &run->lock, deadline)) {
+      break;
+    }
+  }
+  gboolean cancelled = atomic_load(&run->cancel);
+  g_mutex_unlock(&run->lock);
+  if (cancelled) {
+    run->error = ECANCELED;
+  }
+  return !cancelled;
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Hilos de ejecución
+//===--------------------------------------------------------------------------------------------------------------===//
+static gpointer macro_thread(gpointer data) {
+  struct SerialMacroRun *run = data;
+  gsize size;
+  const guchar *code = g_bytes_get_data(run->code, &size);
+  gsize pc = 0;
+  gint64 deadline = g_get_monotonic_time();
+  // Hay bytes escritos que quizá todavía no salen por la línea
+  gboolean unsent = FALSE;
+  run->error = 0;
+  while (pc < size && code[pc]!=MACRO_OP_END) {
+    if (code[pc]==MACRO_OP_SEND) {
+      gsize length = code[pc + 1] | (gsize) code[pc + 2] << 8;
+      if (!send_frame(run, code + pc + 3, length)) {
+        break;
+      }
+      unsent = TRUE;
+      pc += 3 + length;
+    } else if (code[pc]==MACRO_OP_WAIT) {
+      guint32 microseconds = code[pc + 1]
+          | (guint32) code[pc + 2] << 8
+          | (guint32) code[pc + 3] << 16
+          | (guint32) code[pc + 4] << 24;
+      if (unsent) {
+        // La pausa se cuenta desde que el último byte salió, no desde que se escribió
+        run->dev->drain_output(&run->dev);
+        deadline = g_get_monotonic_time();
+        unsent = FALSE;
+      }
+      deadline += microseconds;
+      if (!wait_until(run, deadline)) {
+        break;
+      }
+      pc += 5;
+    } else {
+      g_critical("Invalid macro opcode 0x%02X at %" G_GSIZE_FORMAT ".", code[pc], pc);
+      run->error = EINVAL;
+      break;
+    }
+  }
+  // Con un error no hay nada que esperar; si se canceló, lo que quedaba en la cola ya se descartó
+  if (run->error==0 && unsent) {
+    run->dev->drain_output(&run->dev);
+  }
+  atomic_store(&run->done, TRUE);
+  return NULL;
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                           Implementación de la interfaz
+//===--------------------------------------------------------------------------------------------------------------===//
+GBytes *serial_macro_compile(const gchar *source, gsize *error_at) {
+  GByteArray *code = g_byte_array_new();
+  GByteArray *pending = g_byte_array_new();
+  const gchar *p = source;
+  while (*p!='\0') {
+    if (g_ascii_isspace(*p) || *p==',') {
+      p++;
+      continue;
+    }
+    if (*p=='#') {
+      while (*p!='\0' && *p!='\n') {
+        p++;
+      }
+      continue;
+    }
+    const gchar *token = p;
+    if (*p=='"') {
+      if (!parse_string(&p, pending)) {
+        goto invalid;
+      }
+      continue;
+    }
+    const gchar *end = p;
+    while (*end!='\0' && !g_ascii_isspace(*end) && *end!=',' && *end!='#' && *end!='"') {
+      end++;
+    }
+    guint32 microseconds;
+    if (parse_delay(token, end, &microseconds)) {
+      emit_send(code, pending);
+      emit_wait(code, microseconds);
+    } else if (!parse_hex(token, end, pending)) {
+      goto invalid;
+    }
+    p = end;
+    continue;
+
+  invalid:
+    if (error_at!=NULL) {
+      *error_at = (gsize) (token - source);
+    }
+    g_byte_array_unref(pending);
+    g_byte_array_unref(code);
+    errno = EINVAL;
+    return NULL;
+  }
+  emit_send(code, pending);
+  guint8 end = MACRO_OP_END;
+  g_byte_array_append(code, &end, 1);
+  g_byte_array_unref(pending);
+  return g_byte_array_free_to_bytes(code);
+}
+
+gsize serial_macro_get_length(GBytes *bytecode) {
+  gsize size;
+  const guchar *code = g_bytes_get_data(bytecode, &size);
+  gsize pc = 0, total = 0;
+  while (pc < size && code[pc]!=MACRO_OP_END) {
+    if (code[pc]==MACRO_OP_SEND) {
+      gsize length = code[pc + 1] | (gsize) code[pc + 2] << 8;
+      total += length;
+      pc += 3 + length;
+    } else {
+      pc += 5;
+    }
+  }
+  return total;
+}
+
+GBytes *serial_macro_get_payload(GBytes *bytecode, guint32 *delay) {
+  gsize size;
+  const guchar *code = g_bytes_get_data(bytecode, &size);
+  GByteArray *payload = g_byte_array_new();
+  guint64 total_delay = 0;
+  gsize pc = 0;
+  while (pc < size && code[pc]!=MACRO_OP_END) {
+    if (code[pc]==MACRO_OP_SEND) {
+      gsize length = code[pc + 1] | (gsize) code[pc + 2] << 8;
+      g_byte_array_append(payload, code + pc + 3, (guint) length);
+      pc += 3 + length;
+      continue;
+    }
+    if (payload->len > 0) {
+      g_byte_array_unref(payload);
+      errno = EINVAL;
+      return NULL;
+    }
+    total_delay += code[pc + 1]
+        | (guint32) code[pc + 2] << 8
+        | (guint32) code[pc + 3] << 16
+        | (guint32) code[pc + 4] << 24;
+    pc += 5;
+  }
+  *delay = (guint32) MIN(total_delay, G_MAXUINT32);
+  return g_byte_array_free_to_bytes(payload);
+}
+
+GBytes *serial_macro_compile_payload(const gchar *text, const gchar *end, guint32 *delay, gsize *error_at) {
+  gchar *source = g_strndup(text, (gsize) (end - text));
+  gsize macro_error = 0;
+  GBytes *code = serial_macro_compile(source, &macro_error);
+  g_free(source);
+  if (code==NULL) {
+    if (error_at!=NULL) {
+      *error_at = macro_error;
+    }
+    return NULL;
+  }
+  GBytes *payload = serial_macro_get_payload(code, delay);
+  g_bytes_unref(code);
+  if (payload==NULL && error_at!=NULL) {
+    *error_at = 0;
+  }
+  return payload;
+}
+
+gboolean serial_macro_next_word(const gchar **p, const gchar *end, const gchar **word, const gchar **word_end) {
+  const gchar *start = *p;
+  while (start < end && g_ascii_isspace(*start)) {
+    start++;
+  }
+  if (start==end || *start=='#') {
+    return FALSE;
+  }
+  const gchar *q = start;
+  while (q < end && !g_ascii_isspace(*q)) {
+    q++;
+  }
+  *word = start;
+  *word_end = q;
+  *p = q;
+  return TRUE;
+}
+
+gboolean serial_macro_is_word(const gchar *word, const gchar *word_end, const gchar *expected) {
+  gsize length = strlen(expected);
+  return (gsize) (word_end - word)==length && memcmp(word, expected, length)==0;
+}
+
+struct SerialMacroRun *serial_macro_run(const struct AbstractSerialDevice **dev, GBytes *bytecode) {
+  if (dev==NULL || *dev==NULL || bytecode==NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+  struct SerialMacroRun *run = g_new0(struct SerialMacroRun, 1);
+  run->dev = *dev;
+  run->code = g_bytes_ref(bytecode);
+  g_mutex_init(&run->lock);
+  g_cond_init(&run->wake);
+  atomic_init(&run->cancel, FALSE);
+  atomic_init(&run->done, FALSE);
+  run->thread = g_thread_new("abserio-macro", macro_thread, run);
+  return run;
+}
+
+gboolean serial_macro_is_done(struct SerialMacroRun *run) {
+  return atomic_load(&run->done);
+}
+
+void serial_macro_cancel(struct SerialMacroRun *run) {
+  g_mutex_lock(&run->lock);
+  atomic_store(&run->cancel, TRUE);
+  g_cond_signal(&run->wake);
+  g_mutex_unlock(&run->lock);
+  // Igual que `serial_transmit_cancel`: sin esto, `serial_macro_finish` esperaría a que la línea termine la trama en
+  // curso (hasta 64 KiB) o un `drain_output`. Si ya terminó, lo que hay en la cola es de alguien más
+  if (!atomic_load(&run->done)) {
+    run->dev->flush_output(&run->dev);
+  }
+}
+
+gboolean serial_macro_finish(struct SerialMacroRun *run) {
+  g_thread_join(run->thread);
+  int error = run->error;
+  g_bytes_unref(run->code);
+  g_mutex_clear(&run->lock);
+  g_cond_clear(&run->wake);
+  g_free(run);
+  errno = error;
+  return error==0;
+}
@@ -0,0 +1,74 @@
+//===-- lib/abserio/macro.h - Macros de transmisión -------------------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Secuencias fijas de bytes y pausas. El texto se compila una sola vez a un bytecode compacto que después se ejecuta
+/// en un hilo dedicado, tantas veces como se quiera.
+///
+/// El texto es una lista de elementos separados por espacios, comas o saltos de línea:
+///   -> Bytes en hexadecimal, uno o varios juntos: `02`, `0x1B`, `DEADBEEF`
+///   -> Texto entre comillas con escapes de C: `"AT\r\n"`, `"\x02\0"`
+///   -> Pausas: `5ms`, `250us`, `1s`
+///   -> Comentarios: desde `#` hasta el final de la línea
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#ifndef ABSERIO_MACRO_H
+#define ABSERIO_MACRO_H
+#include "abserio.h"
+
+// La ejecución de una macro es opaca
+struct SerialMacroRun;
+
+// Compila el texto de una macro. Devuelve el bytecode o NULL con errno = EINVAL si hay un error de sintaxis; en ese
+// caso, si el segundo parámetro no es NULL, se guarda la posición (en bytes) del elemento inválido.
+GBytes *serial_macro_compile(const gchar *, gsize *);
+
+// Total de bytes que envía el bytecode
+gsize serial_macro_get_length(GBytes *);
+
+// Si el bytecode es una pausa opcional (o varias seguidas) y después solamente bytes, devuelve los bytes y guarda la
+// pausa en microsegundos (0 si no hay) en el segundo parámetro. Si hay pausas entre los bytes, devuelve NULL con
+// errno = EINVAL.
+GBytes *serial_macro_get_payload(GBytes *, guint32 *);
+
+// Compila un pedazo de texto (del primer parámetro al segundo, sin terminar en cero) y devuelve sus bytes como
+// `serial_macro_get_payload`. Es lo que usan los lenguajes que llevan macros dentro (respuestas, scripts, esquemas).
+// Si hay un error devuelve NULL con errno = EINVAL y, si el último parámetro no es NULL, guarda la posición del error
+// relativa al inicio del pedazo (0 si el problema son pausas entre los bytes).
+GBytes *serial_macro_compile_payload(const gchar *, const gchar *, guint32 *, gsize *);
+
+// Siguiente palabra a partir de `*p` (el primer parámetro avanza hasta después de ella), hasta el segundo parámetro.
+// Guarda su inicio y su fin. Devuelve FALSE si ya no hay palabras o si empieza un comentario (`#`).
+gboolean serial_macro_next_word(const gchar **, const gchar *, const gchar **, const gchar **);
+
+// TRUE si la palabra (inicio y fin) es exactamente el texto dado
+gboolean serial_macro_is_word(const gchar *, const gchar *, const gchar *);
+
+// Empieza a ejecutar el bytecode en un hilo. Las pausas se miden con fechas límite absolutas desde que el último byte
+// anterior salió por la línea, así que los errores de tiempo no se acumulan.
+//  -> El puerto no se debe cerrar antes de llamar a `serial_macro_finish`
+struct SerialMacroRun *serial_macro_run(const struct AbstractSerialDevice **, GBytes *);
+
+// TRUE cuando el hilo terminó (completo, cancelado o con error)
+gboolean serial_macro_is_done(struct SerialMacroRun *);
+
+// Pide que la ejecución se detenga, incluso a mitad de una pausa o de una trama: lo que todavía no sale por la línea
+// se descarta (`flush_output`), así que `serial_macro_finish` no espera a la línea
+void serial_macro_cancel(struct SerialMacroRun *);
+
+// Espera a que el hilo termine y libera la ejecución. Devuelve TRUE si la macro se ejecutó completa; si no, errno
+// indica la causa (ECANCELED si se canceló).
+gboolean serial_macro_finish(struct SerialMacroRun *);
+#endif // ABSERIO_MACRO_H
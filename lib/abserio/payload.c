@@ -0,0 +1,412 @@
+//===-- lib/abserio/payload.c - Bytes escritos como texto -------------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Cada decodificador escribe en un buffer del tamaño máximo posible (más 16 bytes de holgura para las escrituras de
+/// 128 bits) que al final se recorta y se entrega sin copiar a un GBytes.
+///
+/// Las rutas SIMD solamente existen en x86 con GCC o Clang, y se compilan con `target(...)` para no exigir banderas
+/// al resto de la biblioteca; se eligen en tiempo de ejecución con `__builtin_cpu_supports`. En otras arquitecturas
+/// (o sin SSSE3, para el base64) se usa la ruta escalar, que acepta exactamente lo mismo.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#define G_LOG_DOMAIN                    "PayloadAbSerIO"
+#include "payload.h"
+#include <errno.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PAYLOAD_X86_SIMD
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#endif
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Estructuras de datos
+//===--------------------------------------------------------------------------------------------------------------===//
+// Holgura al final del buffer de salida para las escrituras de 128 bits
+#define PAYLOAD_SLACK                   16
+// Caracteres que consume un bloque SIMD
+#define PAYLOAD_BLOCK                   16
+// Valor de los caracteres que no son base64 en `base64_value`
+#define BASE64_INVALID                  0xFF
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                   Funciones extra
+//===--------------------------------------------------------------------------------------------------------------===//
+static gboolean is_separator(gchar c) {
+  return g_ascii_isspace(c) || c==',' || c==':' || c=='-';
+}
+
+static guint8 base64_value(guchar c) {
+  if (c >= 'A' && c <= 'Z') {
+    return (guint8) (c - 'A');
+  } else if (c >= 'a' && c <= 'z') {
+    return (guint8) (c - 'a' + 26);
+  } else if (c >= '0' && c <= '9') {
+    return (guint8) (c - '0' + 52);
+  } else if (c=='+') {
+    return 62;
+  } else if (c=='/') {
+    return 63;
+  }
+  return BASE64_INVALID;
+}
+
+// Recorta el buffer de salida y lo entrega al GBytes
+static GBytes *take_output(guint8 *output, gsize length) {
+  return g_bytes_new_take(g_realloc(output, MAX(length, 1)), length);
+}
+
+static GBytes *fail(guint8 *output, const gchar *text, const gchar *at, gsize *error_offset) {
+  g_free(output);
+  if (error_offset!=NULL) {
+    *error_offset = (gsize) (at - text);
+  }
+  errno = EINVAL;
+  return NULL;
+}
+
+#ifdef PAYLOAD_X86_SIMD
+static gboolean cpu_has_ssse3(void) {
+  static gint supported = -1;
+  if (supported==-1) {
+    supported = __builtin_cpu_supports("ssse3") ? 1 : 0;
+  }
+  return supported==1;
+}
+
+// 16 dígitos hexadecimales a 8 bytes. Devuelve FALSE, sin escribir nada, si algún carácter no es un dígito (un
+// separador, el final del texto, un error); el llamador sigue entonces por la ruta escalar.
+__attribute__((target("sse2")))
+static gboolean hex_block(const gchar *input, guint8 *output) {
+  __m128i v = _mm_loadu_si128((const __m128i *) input);
+  // Los bytes de 0x80 en adelante son negativos en la comparación con signo, así que nunca pasan
+  __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+  __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+  __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+  if (_mm_movemask_epi8(_mm_or_si128(digit, alpha))!=0xFFFF) {
+    return FALSE;
+  }
+  __m128i nibbles = _mm_or_si128(_mm_and_si128(digit, _mm_sub_epi8(v, _mm_set1_epi8('0'))),
+                                 _mm_and_si128(alpha, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+  // Cada palabra de 16 bits tiene el dígito alto en el byte bajo y el dígito bajo en el byte alto
+  __m128i high = _mm_slli_epi16(_mm_and_si128(nibbles, _mm_set1_epi16(0x00FF)), 4);
+  __m128i bytes = _mm_or_si128(high, _mm_srli_epi16(nibbles, 8));
+  _mm_storel_epi64((__m128i *) output, _mm_packus_epi16(bytes, bytes));
+  return TRUE;
+}
+
+// 16 caracteres base64 a 12 bytes (escribe 16; el buffer tiene holgura). Devuelve FALSE, sin escribir nada, si algún
+// carácter no es del alfabeto (relleno, salto de línea, error).
+__attribute__((target("ssse3")))
+static gboolean base64_block(const gchar *input, guint8 *output) {
+  __m128i v = _mm_loadu_si128((const __m128i *) input);
+  __m128i high_nibbles = _mm_and_si128(_mm_srli_epi32(v, 4), _mm_set1_epi8(0x0F));
+  __m128i low_nibbles = _mm_and_si128(v, _mm_set1_epi8(0x0F));
+  // Cada nibble bajo y cada nibble alto marcan con bits los rangos en los que puede estar el carácter; si ningún
+  // rango coincide en los dos, el carácter no es del alfabeto
+  const __m128i lut_low = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                        0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+  const __m128i lut_high = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                         0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  __m128i ranges = _mm_and_si128(_mm_shuffle_epi8(lut_low, low_nibbles), _mm_shuffle_epi8(lut_high, high_nibbles));
+  if (_mm_movemask_epi8(_mm_cmpeq_epi8(ranges, _mm_setzero_si128()))!=0xFFFF) {
+    return FALSE;
+  }
+  // Desplazamiento de cada rango a su valor de 6 bits; `/` comparte nibble alto con `+` y se corrige aparte
+  const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  __m128i slash = _mm_cmpeq_epi8(v, _mm_set1_epi8('/'));
+  __m128i values = _mm_add_epi8(v, _mm_shuffle_epi8(lut_roll, _mm_add_epi8(slash, high_nibbles)));
+  // Junta 4 valores de 6 bits en 24 bits y acomoda los bytes en orden big endian
+  __m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+  __m128i words = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+  __m128i packed = _mm_shuffle_epi8(words, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+  _mm_storeu_si128((__m128i *) output, packed);
+  return TRUE;
+}
+#endif
+
+static GBytes *decode_hex(const gchar *text, gsize length, gsize *error_offset) {
+  guint8 *output = g_malloc(length/2 + PAYLOAD_SLACK);
+  guint8 *out = output;
+  const gchar *p = text, *end = text + length;
+  while (p < end) {
+    if (is_separator(*p)) {
+      p++;
+      continue;
+    }
+    if (p[0]=='0' && (p[1]=='x' || p[1]=='X') && g_ascii_isxdigit(p[2])) {
+      p += 2;
+    }
+    const gchar *token = p;
+#ifdef PAYLOAD_X86_SIMD
+    while (end - p >= PAYLOAD_BLOCK && hex_block(p, out)) {
+      p += PAYLOAD_BLOCK;
+      out += PAYLOAD_BLOCK/2;
+    }
+#endif
+    while (g_ascii_isxdigit(p[0]) && g_ascii_isxdigit(p[1])) {
+      *out++ = (guint8) (g_ascii_xdigit_value(p[0]) << 4 | g_ascii_xdigit_value(p[1]));
+      p += 2;
+    }
+    if (g_ascii_isxdigit(*p)) {
+      // Un dígito suelto solamente es válido como grupo completo (`0x5`, `A`)
+      if (p!=token || (p + 1 < end && !is_separator(p[1]))) {
+        return fail(output, text, p + 1 < end && !is_separator(p[1]) ? p + 1 : p, error_offset);
+      }
+      *out++ = (guint8) g_ascii_xdigit_value(*p++);
+    }
+    if (p < end && !is_separator(*p)) {
+      return fail(output, text, p, error_offset);
+    }
+  }
+  return take_output(output, (gsize) (out - output));
+}
+
+// Números de 0 a 255 en la base dada, separados por espacios o comas
+static GBytes *decode_numbers(const gchar *text, gsize length, guint base, gsize *error_offset) {
+  guint8 *output = g_malloc(length/2 + PAYLOAD_SLACK);
+  guint8 *out = output;
+  const gchar *p = text, *end = text + length;
+  while (p < end) {
+    if (g_ascii_isspace(*p) || *p==',') {
+      p++;
+      continue;
+    }
+    guint value = 0;
+    const gchar *token = p;
+    while (p < end && !g_ascii_isspace(*p) && *p!=',') {
+      gint digit = g_ascii_digit_value(*p);
+      if (digit==-1 || (guint) digit >= base) {
+        return fail(output, text, p, error_offset);
+      }
+      value = value*base + (guint) digit;
+      if (value > G_MAXUINT8) {
+        return fail(output, text, token, error_offset);
+      }
+      p++;
+    }
+    *out++ = (guint8) value;
+  }
+  return take_output(output, (gsize) (out - output));
+}
+
+static GBytes *decode_escaped(const gchar *text, gsize length, gsize *error_offset) {
+  guint8 *output = g_malloc(length + PAYLOAD_SLACK);
+  guint8 *out = output;
+  const gchar *p = text, *end = text + length;
+  while (p < end) {
+    if (*p!='\\') {
+      *out++ = (guint8) *p++;
+      continue;
+    }
+    gsize used = serial_payload_unescape(p + 1, out);
+    if (used==0) {
+      return fail(output, text, p, error_offset);
+    }
+    out++;
+    p += 1 + used;
+  }
+  return take_output(output, (gsize) (out - output));
+}
+
+static GBytes *decode_base64(const gchar *text, gsize length, gsize *error_offset) {
+  guint8 *output = g_malloc(length/4*3 + 3 + PAYLOAD_SLACK);
+  guint8 *out = output;
+  const gchar *p = text, *end = text + length;
+#ifdef PAYLOAD_X86_SIMD
+  gboolean simd = cpu_has_ssse3();
+#endif
+  guint8 quad[4];
+  guint pending = 0;
+  while (p < end) {
+#ifdef PAYLOAD_X86_SIMD
+    // Los bloques empiezan en un límite de 4 caracteres; un salto de línea o el relleno los interrumpe
+    if (simd && pending==0) {
+      while (end - p >= PAYLOAD_BLOCK && base64_block(p, out)) {
+        p += PAYLOAD_BLOCK;
+        out += PAYLOAD_BLOCK/4*3;
+      }
+      if (p==end) {
+        break;
+      }
+    }
+#endif
+    if (g_ascii_isspace(*p)) {
+      p++;
+      continue;
+    }
+    if (*p=='=') {
+      break;
+    }
+    quad[pending] = base64_value((guchar) *p);
+    if (quad[pending]==BASE64_INVALID) {
+      return fail(output, text, p, error_offset);
+    }
+    p++;
+    if (++pending==4) {
+      *out++ = (guint8) (quad[0] << 2 | quad[1] >> 4);
+      *out++ = (guint8) (quad[1] << 4 | quad[2] >> 2);
+      *out++ = (guint8) (quad[2] << 6 | quad[3]);
+      pending = 0;
+    }
+  }
+  // Un último grupo incompleto: 2 caracteres son 1 byte y 3 son 2; el relleno es opcional, pero si está debe cerrar
+  // exactamente el grupo
+  const gchar *padding = p;
+  guint pad = 0;
+  for (; p < end; p++) {
+    if (*p=='=') {
+      pad++;
+    } else if (!g_ascii_isspace(*p)) {
+      return fail(output, text, p, error_offset);
+    }
+  }
+  if (pending==1 || (pad > 0 && pending + pad!=4)) {
+    return fail(output, text, padding, error_offset);
+  }
+  if (pending >= 2) {
+    *out++ = (guint8) (quad[0] << 2 | quad[1] >> 4);
+  }
+  if (pending==3) {
+    *out++ = (guint8) (quad[1] << 4 | quad[2] >> 2);
+  }
+  return take_output(output, (gsize) (out - output));
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                           Implementación de la interfaz
+//===--------------------------------------------------------------------------------------------------------------===//
+GBytes *serial_payload_decode(const gchar *text, enum SerialPayloadFormat format, gsize *error_offset) {
+  gsize length = strlen(text);
+  switch (format) {
+    case SERIAL_PAYLOAD_HEX://
+      return decode_hex(text, length, error_offset);
+    case SERIAL_PAYLOAD_DECIMAL://
+      return decode_numbers(text, length, 10, error_offset);
+    case SERIAL_PAYLOAD_OCTAL://
+      return decode_numbers(text, length, 8, error_offset);
+    case SERIAL_PAYLOAD_BINARY://
+      return decode_numbers(text, length, 2, error_offset);
+    case SERIAL_PAYLOAD_ESCAPED://
+      return decode_escaped(text, length, error_offset);
+    case SERIAL_PAYLOAD_BASE64://
+      return decode_base64(text, length, error_offset);
+  }
+  if (error_offset!=NULL) {
+    *error_offset = 0;
+  }
+  errno = EINVAL;
+  return NULL;
+}
+
+gsize serial_payload_unescape(const gchar *p, guint8 *value) {
+  switch (*p) {
+    case 'a'://
+      *value = '\a';
+      return 1;
+    case 'b'://
+      *value = '\b';
+      return 1;
+    case 'e'://
+      *value = 0x1B;
+      return 1;
+    case 'f'://
+      *value = '\f';
+      return 1;
+    case 'n'://
+      *value = '\n';
+      return 1;
+    case 'r'://
+      *value = '\r';
+      return 1;
+    case 't'://
+      *value = '\t';
+      return 1;
+    case 'v'://
+      *value = '\v';
+      return 1;
+    case '\\':
+    case '\'':
+    case '"'://
+      *value = (guint8) *p;
+      return 1;
+    case 'x': {
+      // Uno o dos dígitos hexadecimales
+      gsize digits = 0;
+      gint result = 0;
+      while (digits < 2 && g_ascii_isxdigit(p[1 + digits])) {
+        result = (result << 4) | g_ascii_xdigit_value(p[1 + digits]);
+        digits++;
+      }
+      if (digits==0) {
+        return 0;
+      }
+      *value = (guint8) result;
+      return 1 + digits;
+    }
+    case '0' ... '7': {
+      // Hasta tres dígitos octales
+      gsize digits = 0;
+      gint result = 0;
+      while (digits < 3 && p[digits] >= '0' && p[digits] <= '7') {
+        result = (result << 3) | (p[digits] - '0');
+        digits++;
+      }
+      if (result > 0xFF) {
+        return 0;
+      }
+      *value = (guint8) result;
+      return digits;
+    }
+    default://
+      return 0;
+  }
+}
+
+gsize serial_payload_format_byte(guint8 value, enum SerialPayloadFormat format, gchar text[SERIAL_PAYLOAD_BYTE_MAX]) {
+  switch (format) {
+    case SERIAL_PAYLOAD_DECIMAL://
+      return (gsize) g_snprintf(text, SERIAL_PAYLOAD_BYTE_MAX, "%d", value);
+    case SERIAL_PAYLOAD_OCTAL://
+      return (gsize) g_snprintf(text, SERIAL_PAYLOAD_BYTE_MAX, "0%0o", value);
+    case SERIAL_PAYLOAD_BINARY://
+    {
+      text[0] = '0';
+      text[1] = 'b';
+      for (int i = 0; i < 8; i++) {
+        text[2 + i] = (gchar) ('0' + ((value >> (7 - i)) & 0x01));
+      }
+      text[10] = '\0';
+      return 10;
+    }
+    case SERIAL_PAYLOAD_ESCAPED://
+      // El valor decimal con un \ para los valores de 0 a 31 y de 128 a 255; de 32 a 126, el carácter ASCII
+      switch (value) {
+        case 0 ... 31://
+          return (gsize) g_snprintf(text, SERIAL_PAYLOAD_BYTE_MAX, "\'\\%02d\'", value);
+        case 0x7F://
+          return (gsize) g_snprintf(text, SERIAL_PAYLOAD_BYTE_MAX, "\'\\DEL\'");
+        case 0x80 ... 0xFF://
+          return (gsize) g_snprintf(text, SERIAL_PAYLOAD_BYTE_MAX, "\'\\-%02d\'", value);
+        default://
+          return (gsize) g_snprintf(text, SERIAL_PAYLOAD_BYTE_MAX, "\'%c\'", value);
+      }
+    default://
+      return (gsize) g_snprintf(text, SERIAL_PAYLOAD_BYTE_MAX, "0x%02X", value);
+  }
+}
@@ -0,0 +1,61 @@
+//===-- lib/abserio/payload.h - Bytes escritos como texto -------------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Convierte a bytes una carga útil escrita (o pegada) como texto, en cualquiera de estas formas:
+///   -> Hexadecimal: pares de dígitos, juntos o separados por espacios, comas, `:` o `-`, con `0x` opcional al inicio
+///      de cada grupo: `DEADBEEF`, `0x02 0x1B`, `de:ad:be:ef`. Un grupo de un solo dígito es un byte (`0x5`)
+///   -> Lista de números (decimal, octal o binario) de 0 a 255, separados por espacios o comas: `2, 65 255`
+///   -> Texto con escapes de C: `AT\r\n\x02\0`
+///   -> Base64, con o sin relleno y con saltos de línea en cualquier lugar
+///
+/// El hexadecimal y el base64 son las formas que se pegan en bloques grandes, así que se decodifican con SIMD (SSE2
+/// y SSSE3, si el procesador los tiene): cada bloque de 16 caracteres se valida completo con unas cuantas
+/// comparaciones y solamente los bloques con separadores o errores pasan por el camino de un carácter a la vez.
+///
+/// También hace lo contrario para un byte: el texto con el que la aplicación lo muestra en cada formato, para que
+/// las herramientas de línea de comandos lo escriban igual.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#ifndef ABSERIO_PAYLOAD_H
+#define ABSERIO_PAYLOAD_H
+#include <glib.h>
+
+// Forma del texto
+enum SerialPayloadFormat {
+  SERIAL_PAYLOAD_HEX,
+  SERIAL_PAYLOAD_DECIMAL,
+  SERIAL_PAYLOAD_OCTAL,
+  SERIAL_PAYLOAD_BINARY,
+  SERIAL_PAYLOAD_ESCAPED,
+  SERIAL_PAYLOAD_BASE64
+};
+
+// Decodifica el texto. Devuelve los bytes (posiblemente vacíos) o NULL con errno = EINVAL si el texto no es válido;
+// en ese caso, si el último parámetro no es NULL, se guarda la posición (en bytes) del primer carácter inválido.
+GBytes *serial_payload_decode(const gchar *, enum SerialPayloadFormat, gsize *);
+
+// Decodifica un escape de C sin la diagonal inicial (`n`, `x1B`, `033`, ...). Devuelve cuántos caracteres usó, o 0 si
+// no es un escape válido.
+gsize serial_payload_unescape(const gchar *, guint8 *);
+
+// Tamaño del buffer para `serial_payload_format_byte`, con el terminador
+#define SERIAL_PAYLOAD_BYTE_MAX         16
+
+// Escribe un byte como lo muestra la aplicación: `0x1B` en hexadecimal, `27` en decimal, `033` en octal,
+// `0b00011011` en binario y `'A'` (o `'\27'` para los de control) con escapes. El base64 usa el hexadecimal. Devuelve
+// la longitud del texto, sin el terminador.
+gsize serial_payload_format_byte(guint8, enum SerialPayloadFormat, gchar[SERIAL_PAYLOAD_BYTE_MAX]);
+#endif // ABSERIO_PAYLOAD_H
@@ -0,0 +1,273 @@
+//===-- lib/abserio/portenum.c - Enumeración de puertos seriales (Linux) ----------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Un puerto es "real" si su entrada en `/sys/class/tty` tiene un enlace `device` (las consolas virtuales y las
+/// pseudo-terminales no lo tienen). Los puertos 8250 se registran aunque no haya hardware; esos se descartan cuando
+/// su atributo `type` es 0 (PORT_UNKNOWN).
+///
+/// Los metadatos USB (idVendor, idProduct, serial...) están en el dispositivo USB, que es un ancestro de la interfaz
+/// a la que apunta `device`. Por eso se sube por el árbol hasta encontrar `idVendor`.
+///
+/// https://www.kernel.org/doc/Documentation/ABI/testing/sysfs-tty
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#define G_LOG_DOMAIN                    "PortEnumAbSerIO"
+#include "portenum.h"
+#include <glib-unix.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Estructuras de datos
+//===--------------------------------------------------------------------------------------------------------------===//
+#define SYSFS_TTY_DIR                   "/sys/class/tty"
+#define DEV_DIR                         "/dev"
+// Niveles que se sube desde la interfaz hasta encontrar el dispositivo USB
+#define USB_PARENT_DEPTH                4
+
+struct SerialPortIndex {
+  // Nombre del nodo (p.e. `ttyUSB0`) -> struct SerialPortInfo *
+  GHashTable *ports;
+  int inotify_fd;
+  guint watch_id;
+  SerialPortIndexChanged changed;
+  gpointer user_data;
+};
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                   Funciones extra
+//===--------------------------------------------------------------------------------------------------------------===//
+static void free_port_info(gpointer data) {
+  struct SerialPortInfo *info = data;
+  g_free(info->device);
+  g_free(info->driver);
+  g_free(info->vendor_id);
+  g_free(info->product_id);
+  g_free(info->manufacturer);
+  g_free(info->product);
+  g_free(info->serial_number);
+  g_free(info);
+}
+
+// Lee un atributo de sysfs sin el salto de línea final. Devuelve NULL si no existe.
+static gchar *read_sysfs_attr(const gchar *dir, const gchar *attr) {
+  gchar *path = g_build_filename(dir, attr, NULL);
+  gchar *contents = NULL;
+  if (!g_file_get_contents(path, &contents, NULL, NULL)) {
+    contents = NULL;
+  } else {
+    g_strstrip(contents);
+  }
+  g_free(path);
+  return contents;
+}
+
+// Devuelve el nombre del destino de un enlace simbólico (p.e. el nombre del driver)
+static gchar *read_link_basename(const gchar *dir, const gchar *link) {
+  gchar *path = g_build_filename(dir, link, NULL);
+  gchar *target = g_file_read_link(path, NULL);
+  gchar *name = target!=NULL ? g_path_get_basename(target) : NULL;
+  g_free(target);
+  g_free(path);
+  return name;
+}
+
+// Construye la información de un puerto a partir de sysfs. Devuelve NULL si no es un puerto serial real.
+static struct SerialPortInfo *probe_port(const gchar *name) {
+  gchar *class_dir = g_build_filename(SYSFS_TTY_DIR, name, NULL);
+  gchar *device_link = g_build_filename(class_dir, "device", NULL);
+  char *device_dir = realpath(device_link, NULL);
+  g_free(device_link);
+  if (device_dir==NULL) {
+    g_free(class_dir);
+    return NULL;
+  }
+  gchar *driver = read_link_basename(device_dir, "driver");
+  if (driver!=NULL && g_str_has_prefix(driver, "serial8250")) {
+    gchar *type = read_sysfs_attr(class_dir, "type");
+    gboolean present = type!=NULL && strtol(type, NULL, 10)!=0;
+    g_free(type);
+    if (!present) {
+      g_free(driver);
+      free(device_dir);
+      g_free(class_dir);
+      return NULL;
+    }
+  }
+
+  struct SerialPortInfo *info = g_new0(struct SerialPortInfo, 1);
+  info->device = g_build_filename(DEV_DIR, name, NULL);
+  info->driver = driver;
+  gchar *dir = g_strdup(device_dir);
+  for (int level = 0; level < USB_PARENT_DEPTH && strcmp(dir, "/")!=0; level++) {
+    gchar *vendor_id = read_sysfs_attr(dir, "idVendor");
+    if (vendor_id!=NULL) {
+      info->vendor_id = vendor_id;
+      info->product_id = read_sysfs_attr(dir, "idProduct");
+      info->manufacturer = read_sysfs_attr(dir, "manufacturer");
+      info->product = read_sysfs_attr(dir, "product");
+      info->serial_number = read_sysfs_attr(dir, "serial");
+      break;
+    }
+    gchar *parent = g_path_get_dirname(dir);
+    g_free(dir);
+    dir = parent;
+  }
+  g_free(dir);
+  free(device_dir);
+  g_free(class_dir);
+  return info;
+}
+
+// Agrega o quita un solo puerto. Devuelve TRUE si el índice cambió.
+static gboolean update_port(struct SerialPortIndex *index, const gchar *name, gboolean present) {
+  if (!present) {
+    return g_hash_table_remove(index->ports, name);
+  }
+  struct SerialPortInfo *info = probe_port(name);
+  if (info==NULL) {
+    return FALSE;
+  }
+  g_hash_table_replace(index->ports, g_strdup(name), info);
+  return TRUE;
+}
+
+static void scan_all(struct SerialPortIndex *index) {
+  GDir *dir = g_dir_open(SYSFS_TTY_DIR, 0, NULL);
+  if (dir==NULL) {
+    return;
+  }
+  const gchar *name;
+  while ((name = g_dir_read_name(dir))!=NULL) {
+    update_port(index, name, TRUE);
+  }
+  g_dir_close(dir);
+}
+
+static gint compare_port_info(gconstpointer a, gconstpointer b) {
+  const struct SerialPortInfo *x = *(const struct SerialPortInfo **) a;
+  const struct SerialPortInfo *y = *(const struct SerialPortInfo **) b;
+  return g_strcmp0(x->device, y->device);
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Eventos de inotify
+//===--------------------------------------------------------------------------------------------------------------===//
+static gboolean on_dev_event(gint fd, GIOCondition condition, gpointer data) {
+  struct SerialPortIndex *index = data;
+  // Alineado como lo pide inotify(7)
+  char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  gboolean changed = FALSE;
+  ssize_t length;
+  while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+    for (char *ptr = buffer; ptr < buffer + length;) {
+      const struct inotify_event *event = (const struct inotify_event *) ptr;
+      ptr += sizeof(struct inotify_event) + event->len;
+      if (event->mask & IN_Q_OVERFLOW) {
+        // Se perdieron eventos: es el único caso en el que se vuelve a recorrer sysfs
+        g_hash_table_remove_all(index->ports);
+        scan_all(index);
+        changed = TRUE;
+      } else if (event->len > 0 && g_str_has_prefix(event->name, "tty")) {
+        gboolean present = (event->mask & (IN_CREATE | IN_MOVED_TO | IN_ATTRIB))!=0;
+        changed |= update_port(index, event->name, present);
+      }
+    }
+  }
+  if (changed && index->changed!=NULL) {
+    index->changed(index, index->user_data);
+  }
+  return G_SOURCE_CONTINUE;
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                           Implementación de la interfaz
+//===--------------------------------------------------------------------------------------------------------------===//
+struct SerialPortIndex *serial_port_index_new(void) {
+  if (!g_file_test(SYSFS_TTY_DIR, G_FILE_TEST_IS_DIR)) {
+    g_debug("\'%s\' is not available, serial ports won't be listed.", SYSFS_TTY_DIR);
+    return NULL;
+  }
+  struct SerialPortIndex *index = g_new0(struct SerialPortIndex, 1);
+  index->ports = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free_port_info);
+  index->inotify_fd = -1;
+  scan_all(index);
+  g_debug("Found %u serial ports.", g_hash_table_size(index->ports));
+  return index;
+}
+
+gboolean serial_port_index_watch(struct SerialPortIndex *index, SerialPortIndexChanged changed, gpointer data) {
+  if (index==NULL || index->inotify_fd!=-1) {
+    return FALSE;
+  }
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd==-1) {
+    g_critical("Unable to initialize inotify.");
+    g_critical("Message: \'%s\'", g_strerror(errno));
+    return FALSE;
+  }
+  // IN_ATTRIB porque udev ajusta los permisos del nodo después de crearlo
+  if (inotify_add_watch(fd, DEV_DIR, IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB)==-1) {
+    g_critical("Unable to watch \'%s\'.", DEV_DIR);
+    g_critical("Message: \'%s\'", g_strerror(errno));
+    close(fd);
+    return FALSE;
+  }
+  index->inotify_fd = fd;
+  index->changed = changed;
+  index->user_data = data;
+  index->watch_id = g_unix_fd_add(fd, G_IO_IN, on_dev_event, index);
+  return TRUE;
+}
+
+GPtrArray *serial_port_index_list(struct SerialPortIndex *index) {
+  GPtrArray *list = g_ptr_array_new();
+  if (index==NULL) {
+    return list;
+  }
+  GHashTableIter iter;
+  gpointer value;
+  g_hash_table_iter_init(&iter, index->ports);
+  while (g_hash_table_iter_next(&iter, NULL, &value)) {
+    g_ptr_array_add(list, value);
+  }
+  g_ptr_array_sort(list, compare_port_info);
+  return list;
+}
+
+const struct SerialPortInfo *serial_port_index_lookup(struct SerialPortIndex *index, const gchar *device) {
+  if (index==NULL || device==NULL || !g_str_has_prefix(device, DEV_DIR "/")) {
+    return NULL;
+  }
+  return g_hash_table_lookup(index->ports, device + strlen(DEV_DIR "/"));
+}
+
+void serial_port_index_free(struct SerialPortIndex *index) {
+  if (index==NULL) {
+    return;
+  }
+  if (index->watch_id!=0) {
+    g_source_remove(index->watch_id);
+  }
+  if (index->inotify_fd!=-1) {
+    close(index->inotify_fd);
+  }
+  g_hash_table_destroy(index->ports);
+  g_free(index);
+}
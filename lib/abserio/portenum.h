@@ -0,0 +1,62 @@
+//===-- lib/abserio/portenum.h - Enumeración de puertos seriales ------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Índice de los puertos seriales reales del sistema (solamente Linux). El índice se construye una sola vez a partir
+/// de `/sys/class/tty` y después se mantiene al día con inotify sobre `/dev`, sin volver a recorrer sysfs.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#ifndef ABSERIO_PORTENUM_H
+#define ABSERIO_PORTENUM_H
+#include <glib.h>
+
+// Información de un puerto. Los campos que el kernel no expone (p.e. el número de serie de un puerto integrado) son
+// NULL.
+struct SerialPortInfo {
+  // Ruta del archivo del puerto, p.e. `/dev/ttyUSB0`
+  gchar *device;
+  // Nombre del driver del kernel, p.e. `ftdi_sio`
+  gchar *driver;
+  // Identificadores USB en hexadecimal
+  gchar *vendor_id;
+  gchar *product_id;
+  gchar *manufacturer;
+  gchar *product;
+  gchar *serial_number;
+};
+
+// El índice es opaco
+struct SerialPortIndex;
+
+// Se llama desde el main loop de glib cada vez que un puerto aparece o desaparece
+typedef void (*SerialPortIndexChanged)(struct SerialPortIndex *, gpointer);
+
+// Recorre `/sys/class/tty` y construye el índice. Devuelve NULL si sysfs no está disponible.
+struct SerialPortIndex *serial_port_index_new(void);
+
+// Empieza a vigilar `/dev` con inotify desde el main context por defecto. Cada evento actualiza solamente el puerto
+// afectado y luego llama a la función dada.
+gboolean serial_port_index_watch(struct SerialPortIndex *, SerialPortIndexChanged, gpointer);
+
+// Devuelve los puertos ordenados por ruta. Los elementos pertenecen al índice y son válidos hasta el siguiente cambio;
+// el arreglo se libera con `g_ptr_array_unref`.
+GPtrArray *serial_port_index_list(struct SerialPortIndex *);
+
+// Busca un puerto por su ruta. Devuelve NULL si no está en el índice.
+const struct SerialPortInfo *serial_port_index_lookup(struct SerialPortIndex *, const gchar *);
+
+// Deja de vigilar `/dev` y libera el índice
+void serial_port_index_free(struct SerialPortIndex *);
+#endif // ABSERIO_PORTENUM_H
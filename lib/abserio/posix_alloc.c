@@ -22,10 +22,19 @@
 
 #define G_LOG_DOMAIN                    "PosixAbSerIO"
 #include "abserio.h"
+#include "trace.h"
 #include <errno.h>
 #include <fcntl.h>
+#include <math.h>
+#include <poll.h>
 #include <stdatomic.h>
+#include <sys/ioctl.h>
+#include <time.h>
 #include <unistd.h>
+#ifdef __linux__
+#include "uring.h"
+#include <sys/prctl.h>
+#endif
 
 //===--------------------------------------------------------------------------------------------------------------===//
 //                                                 Estructuras de datos
@@ -37,16 +46,119 @@ struct InternalRepresentation {
   GMutex read_lock;
   GMutex write_lock;
   GMutex access_lock;
+  // Una trama de `write_frame` a la vez. Las pausas se duermen sin `write_lock`, así que no basta con ese
+  GMutex frame_lock;
   volatile atomic_bool open;
-  struct timeval timeout;
+  // Contadores para `get_stats`; los actualizan el hilo lector y quien escriba
+  atomic_uint_fast64_t rx_bytes;
+  atomic_uint_fast64_t tx_bytes;
+  atomic_uint_fast64_t tx_wait_ns;
+  atomic_uint_fast64_t flow_blocked_ns;
+  // Copia de CRTSCTS para que `wait_writable` no tenga que tomar `access_lock`
+  volatile atomic_bool hardware_flow;
+  // Cuántas veces se ha llamado a `flush_output`. Una trama de `write_frame` que ve cambiar la cuenta se interrumpe
+  atomic_uint flush_count;
+  // Pipe para despertar al hilo lector: [0] se vigila junto con el puerto, [1] lo escribe `cancel_read`
+  int wake_fd[2];
+  // Pausas de `write_frame` y sus estadísticas. Se protegen con `write_lock`
+  struct SerialPacing pacing;
+  struct SerialPacingStats pacing_stats;
+  // La última trama de `write_frame` quedó a medias por el control de flujo; la siguiente llamada es su continuación
+  gboolean frame_stalled;
+  // Suma de los cuadrados de las diferencias (Welford), para la desviación estándar del retraso
+  gdouble late_m2;
+  // Momento estimado (CLOCK_MONOTONIC, ns) en que la línea termina de transmitir lo escrito por `write_frame`
+  gint64 line_idle_ns;
+#ifdef __linux__
+  // Anillo de io_uring para las lecturas, o NULL con el backend por defecto
+  struct SerialUring *uring;
+#endif
 };
 
 #define IR(x)                           ((struct InternalRepresentation *) (x))
 #define INT_INFO(x)                     IR((x)->_internal_info)
 #define READ_LOCK                       &INT_INFO(*dev)->read_lock
 #define WRITE_LOCK                      &INT_INFO(*dev)->write_lock
+#define FRAME_LOCK                      &INT_INFO(*dev)->frame_lock
 #define ACCESS_LOCK                     &INT_INFO(*dev)->access_lock
 #define PRINT_ERRNO(x)                  x("Message: \'%s\'", g_strerror(errno))
+#define NSEC_PER_SEC                    1000000000LL
+// Máximo que `write_frame` espera a que la cola de salida acepte un byte
+#define PACING_WRITE_TIMEOUT_MS         1000
+
+// En Linux las constantes de `speed_t` no son el baud rate (p.e. B115200 es 0x1002); en macOS/BSD sí lo son
+static const struct {
+  speed_t speed;
+  glong bps;
+} SPEED_TABLE[] = {{B110, 110}, {B300, 300}, {B600, 600}, {B1200, 1200}, {B2400, 2400}, {B4800, 4800}, {B9600, 9600},
+                   {B19200, 19200}, {B38400, 38400}, {B57600, 57600}, {B115200, 115200},
+#ifdef B230400
+                   {B230400, 230400},
+#endif
+#ifdef B460800
+                   {B460800, 460800},
+#endif
+#ifdef B921600
+                   {B921600, 921600},
+#endif
+#ifdef B1000000
+                   {B1000000, 1000000},
+#endif
+#ifdef B2000000
+                   {B2000000, 2000000},
+#endif
+#ifdef B4000000
+                   {B4000000, 4000000},
+#endif
+};
+
+static glong speed_to_bps(speed_t speed) {
+  for (gsize i = 0; i < G_N_ELEMENTS(SPEED_TABLE); i++) {
+    if (SPEED_TABLE[i].speed==speed) {
+      return SPEED_TABLE[i].bps;
+    }
+  }
+  return (glong) speed;
+}
+
+static gint64 monotonic_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (gint64) now.tv_sec*NSEC_PER_SEC + now.tv_nsec;
+}
+
+// Duerme hasta una fecha absoluta del reloj monotónico. Con una fecha absoluta, el tiempo que se pierde entre calcular
+// la fecha y dormir no se suma a la pausa.
+static void sleep_until_ns(gint64 deadline) {
+#ifdef __APPLE__
+  // macOS no tiene clock_nanosleep
+  gint64 left = deadline - monotonic_ns();
+  if (left > 0) {
+    struct timespec remaining = {(time_t) (left/NSEC_PER_SEC), (long) (left%NSEC_PER_SEC)};
+    while (nanosleep(&remaining, &remaining)==-1 && errno==EINTR) {
+    }
+  }
+#else
+  struct timespec target = {(time_t) (deadline/NSEC_PER_SEC), (long) (deadline%NSEC_PER_SEC)};
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &target, NULL)==EINTR) {
+  }
+#endif
+}
+
+// Acumula el retraso de una escritura programada (algoritmo de Welford para el promedio y la varianza)
+static void record_lateness(struct InternalRepresentation *ir, gint64 late) {
+  struct SerialPacingStats *stats = &ir->pacing_stats;
+  stats->gaps++;
+  if (stats->gaps==1 || late < stats->min_late_ns) {
+    stats->min_late_ns = late;
+  }
+  if (stats->gaps==1 || late > stats->max_late_ns) {
+    stats->max_late_ns = late;
+  }
+  gdouble delta = late - stats->mean_late_ns;
+  stats->mean_late_ns += delta/stats->gaps;
+  ir->late_m2 += delta*(late - stats->mean_late_ns);
+}
 
 //===--------------------------------------------------------------------------------------------------------------===//
 //                                           Implementación de la interfaz
@@ -174,13 +286,44 @@ gboolean get_software_control_flow(const struct AbstractSerialDevice **cdev) {
   return (gboolean) ((INT_INFO(*dev)->options)->c_iflag & IXON);
 }
 
+gboolean set_hardware_control_flow(gboolean bit_enable, const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  g_mutex_lock(ACCESS_LOCK);
+  tcgetattr(INT_INFO(*dev)->kernel_fd, INT_INFO(*dev)->options);
+  if (bit_enable) {
+    (INT_INFO(*dev)->options)->c_cflag |= CRTSCTS;
+  } else {
+    (INT_INFO(*dev)->options)->c_cflag &= ~CRTSCTS;
+  }
+  gboolean res = tcsetattr(INT_INFO(*dev)->kernel_fd, TCSANOW, INT_INFO(*dev)->options)==0;
+  if (res) {
+    atomic_store(&INT_INFO(*dev)->hardware_flow, bit_enable);
+    g_mutex_unlock(ACCESS_LOCK);
+    return TRUE;
+  }
+  g_critical("Unable to set hardware control configuration. Won't restore original.");
+  PRINT_ERRNO(g_critical);
+  g_mutex_unlock(ACCESS_LOCK);
+  return FALSE;
+}
+
+gboolean get_hardware_control_flow(const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  g_mutex_lock(ACCESS_LOCK);
+  tcgetattr(INT_INFO(*dev)->kernel_fd, INT_INFO(*dev)->options);
+  g_mutex_unlock(ACCESS_LOCK);
+  return (gboolean) (((INT_INFO(*dev)->options)->c_cflag & CRTSCTS)!=0);
+}
+
 gboolean write_byte(gchar byte, const struct AbstractSerialDevice **cdev) {
   struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  SERIAL_TRACE(SERIAL_TRACE_WRITE_BEGIN, INT_INFO(*dev)->kernel_fd, 1, 0);
   gboolean isReading = !(g_mutex_trylock(READ_LOCK));
   ssize_t n;
+  guint32 lock_wait = 0;
   if (isReading) {
-    g_mutex_lock(WRITE_LOCK);
-    g_debug("Performing \'write\' operation while a \'read\' operation is running.");
+    SERIAL_TRACE_LOCK(WRITE_LOCK, lock_wait);
+    SERIAL_TRACE(SERIAL_TRACE_WRITE_CONTENDED, INT_INFO(*dev)->kernel_fd, 1, lock_wait);
     n = write(INT_INFO(*dev)->kernel_fd, &byte, 1);
     g_mutex_unlock(WRITE_LOCK);
   } else {
@@ -188,12 +331,14 @@ gboolean write_byte(gchar byte, const struct AbstractSerialDevice **cdev) {
     // lock
     g_mutex_unlock(READ_LOCK);
     g_mutex_lock(ACCESS_LOCK);
-    g_mutex_lock(WRITE_LOCK);
+    SERIAL_TRACE_LOCK(WRITE_LOCK, lock_wait);
     n = write(INT_INFO(*dev)->kernel_fd, &byte, 1);
     g_mutex_unlock(WRITE_LOCK);
     g_mutex_unlock(ACCESS_LOCK);
   }
+  SERIAL_TRACE(SERIAL_TRACE_WRITE_END, INT_INFO(*dev)->kernel_fd, MAX(n, 0), lock_wait);
   if (n==1) {
+    atomic_fetch_add_explicit(&INT_INFO(*dev)->tx_bytes, 1, memory_order_relaxed);
     return TRUE;
   }
   g_critical("Returning with an invalid number of bytes sent. Expected %d, sent %d", 1, (int) n);
@@ -201,44 +346,368 @@ gboolean write_byte(gchar byte, const struct AbstractSerialDevice **cdev) {
   return FALSE;
 }
 
-char read_byte(const struct AbstractSerialDevice **cdev) {
+gssize write_buffer(const guchar *buffer, gsize size, const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  // El FD es O_NONBLOCK: write acepta solamente lo que cabe en la cola de salida de la TTY
+  SERIAL_TRACE(SERIAL_TRACE_WRITE_BEGIN, INT_INFO(*dev)->kernel_fd, size, 0);
+  guint32 lock_wait = 0;
+  SERIAL_TRACE_LOCK(WRITE_LOCK, lock_wait);
+  ssize_t n = write(INT_INFO(*dev)->kernel_fd, buffer, size);
+  g_mutex_unlock(WRITE_LOCK);
+  SERIAL_TRACE(SERIAL_TRACE_WRITE_END, INT_INFO(*dev)->kernel_fd, MAX(n, 0), lock_wait);
+  if (n > 0) {
+    atomic_fetch_add_explicit(&INT_INFO(*dev)->tx_bytes, (uint_fast64_t) n, memory_order_relaxed);
+  }
+  return n;
+}
+
+gboolean wait_writable(gint timeout, const struct AbstractSerialDevice **cdev) {
   struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
-  ssize_t r;
-  fd_set set;
+  struct InternalRepresentation *ir = INT_INFO(*dev);
+  int saved_errno = errno;
+  // Si CTS está desactivado, la cola está llena porque el otro extremo detuvo el flujo y no por la velocidad de la
+  // línea. Un pty no tiene líneas de control: TIOCMGET falla y la espera cuenta como cola llena
+  int lines = 0;
+  gboolean blocked = atomic_load(&ir->hardware_flow) && ioctl(ir->kernel_fd, TIOCMGET, &lines)==0
+      && !(lines & TIOCM_CTS);
+  struct pollfd fds;
+  fds.fd = ir->kernel_fd;
+  fds.events = POLLOUT;
+  int r;
+  SERIAL_TRACE(SERIAL_TRACE_WAIT_WRITABLE_BEGIN, ir->kernel_fd, 0, 0);
+  gint64 start = monotonic_ns();
   do {
-    if (*dev==NULL) {
-      g_debug("Read operation cancelled: resource not available.");
+    r = poll(&fds, 1, timeout);
+  } while (r==-1 && errno==EINTR);
+  guint64 waited = (guint64) (monotonic_ns() - start);
+  SERIAL_TRACE(SERIAL_TRACE_WAIT_WRITABLE_END, ir->kernel_fd, 0, 0);
+  atomic_fetch_add_explicit(&ir->tx_wait_ns, waited, memory_order_relaxed);
+  if (blocked) {
+    atomic_fetch_add_explicit(&ir->flow_blocked_ns, waited, memory_order_relaxed);
+  }
+  // Quien llama normalmente sigue revisando el errno de la escritura anterior (EAGAIN)
+  errno = saved_errno;
+  return r==1 && (fds.revents & POLLOUT);
+}
+
+gboolean drain_output(const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  return tcdrain(INT_INFO(*dev)->kernel_fd)==0;
+}
+
+gboolean flush_output(const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  atomic_fetch_add(&INT_INFO(*dev)->flush_count, 1);
+  return tcflush(INT_INFO(*dev)->kernel_fd, TCOFLUSH)==0;
+}
+
+glong get_line_rate(const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  g_mutex_lock(ACCESS_LOCK);
+  tcgetattr(INT_INFO(*dev)->kernel_fd, INT_INFO(*dev)->options);
+  speed_t speed = cfgetospeed(INT_INFO(*dev)->options);
+  g_mutex_unlock(ACCESS_LOCK);
+  return speed_to_bps(speed);
+}
+
+guint get_frame_bits(const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  g_mutex_lock(ACCESS_LOCK);
+  tcgetattr(INT_INFO(*dev)->kernel_fd, INT_INFO(*dev)->options);
+  tcflag_t cflag = (INT_INFO(*dev)->options)->c_cflag;
+  g_mutex_unlock(ACCESS_LOCK);
+  guint data_bits;
+  switch (cflag & CSIZE) {
+    case CS5://
+      data_bits = 5;
+      break;
+    case CS6://
+      data_bits = 6;
+      break;
+    case CS7://
+      data_bits = 7;
+      break;
+    default://
+      data_bits = 8;
+      break;
+  }
+  // Bit de inicio + datos + pariedad + uno o dos bits de parada
+  return 1 + data_bits + ((cflag & PARENB) ? 1 : 0) + ((cflag & CSTOPB) ? 2 : 1);
+}
+
+gboolean set_pacing(const struct SerialPacing *pacing, const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  if (!(pacing->inter_byte >= 0.0) || !(pacing->inter_frame >= 0.0)) {
+    errno = EINVAL;
+    return FALSE;
+  }
+  g_mutex_lock(WRITE_LOCK);
+  INT_INFO(*dev)->pacing = *pacing;
+  INT_INFO(*dev)->pacing_stats = (struct SerialPacingStats) {0};
+  INT_INFO(*dev)->late_m2 = 0.0;
+  INT_INFO(*dev)->frame_stalled = FALSE;
+  g_mutex_unlock(WRITE_LOCK);
+  return TRUE;
+}
+
+void get_pacing(struct SerialPacing *pacing, const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  g_mutex_lock(WRITE_LOCK);
+  *pacing = INT_INFO(*dev)->pacing;
+  g_mutex_unlock(WRITE_LOCK);
+}
+
+gssize write_frame(const guchar *buffer, gsize size, const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  glong bps = get_line_rate(cdev);
+  if (bps <= 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  gint64 char_ns = (gint64) get_frame_bits(cdev)*NSEC_PER_SEC/bps;
+  SERIAL_TRACE(SERIAL_TRACE_FRAME_BEGIN, INT_INFO(*dev)->kernel_fd, size, 0);
+  // Antes de esperar a otra trama: un `flush_output` desde aquí también descarta esta
+  guint flushes = atomic_load(&INT_INFO(*dev)->flush_count);
+  guint32 lock_wait = 0;
+  g_mutex_lock(FRAME_LOCK);
+  SERIAL_TRACE_LOCK(WRITE_LOCK, lock_wait);
+  struct InternalRepresentation *ir = INT_INFO(*dev);
+  ir->pacing_stats.char_time_ns = char_ns;
+  gint64 byte_gap = (gint64) (ir->pacing.inter_byte*char_ns);
+  gint64 frame_gap = (gint64) (ir->pacing.inter_frame*char_ns);
+  gboolean paced = byte_gap > 0 || frame_gap > 0;
+#ifdef __linux__
+  int old_slack = -1;
+  if (paced) {
+    // El timer slack por defecto (50 us) retrasa cada despertar; se reduce al mínimo mientras dura la trama y al
+    // final se devuelve el que tenía el hilo (puede ser el de la GUI o el hilo lector)
+    old_slack = prctl(PR_GET_TIMERSLACK, 0UL, 0UL, 0UL, 0UL);
+    prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+  }
+#endif
+  // Las fechas se calculan a partir del momento en que la línea queda en silencio, no de cuando se llamó a `write`.
+  // El resto de una trama detenida por el control de flujo no es una trama nueva: lleva la pausa entre bytes
+  gint64 deadline = ir->line_idle_ns + (ir->frame_stalled ? byte_gap : frame_gap);
+  gsize sent = 0;
+  while (sent < size) {
+    if (atomic_load(&ir->flush_count)!=flushes) {
+      errno = ECANCELED;
+      break;
+    }
+    if (paced && deadline > monotonic_ns()) {
+      // Las pausas se duermen sin `write_lock`: `write_byte` y las estadísticas no esperan a que termine la trama
+      g_mutex_unlock(WRITE_LOCK);
+      SERIAL_TRACE(SERIAL_TRACE_PACING_BEGIN, ir->kernel_fd, 0, 0);
+      sleep_until_ns(deadline);
+      gint64 late = monotonic_ns() - deadline;
+      SERIAL_TRACE(SERIAL_TRACE_PACING_END, ir->kernel_fd, 0, 0);
+      g_mutex_lock(WRITE_LOCK);
+      record_lateness(ir, late);
+    }
+    // Sin pausa entre bytes, la trama completa va en una sola escritura
+    gsize chunk = byte_gap > 0 ? 1 : size - sent;
+    gint64 written_at = monotonic_ns();
+    ssize_t n = write(ir->kernel_fd, buffer + sent, chunk);
+    if (n==-1) {
+      if (errno==EINTR) {
+        continue;
+      }
+      if (errno==EAGAIN) {
+        // Igual que las pausas, la espera a que la cola acepte más bytes es sin `write_lock`
+        g_mutex_unlock(WRITE_LOCK);
+        gboolean writable = wait_writable(PACING_WRITE_TIMEOUT_MS, cdev);
+        g_mutex_lock(WRITE_LOCK);
+        errno = EAGAIN;
+        if (writable) {
+          continue;
+        }
+      }
+      if (errno==EAGAIN && !atomic_load(&ir->hardware_flow)) {
+        errno = ETIMEDOUT;
+      }
+      break;
+    }
+    sent += (gsize) n;
+    atomic_fetch_add_explicit(&ir->tx_bytes, (uint_fast64_t) n, memory_order_relaxed);
+    // Los bytes empiezan a salir cuando la línea termina con lo anterior
+    ir->line_idle_ns = MAX(written_at, ir->line_idle_ns) + n*char_ns;
+    deadline = ir->line_idle_ns + byte_gap;
+  }
+  int saved_errno = errno;
+  ir->frame_stalled = sent < size && saved_errno==EAGAIN;
+  g_mutex_unlock(WRITE_LOCK);
+  g_mutex_unlock(FRAME_LOCK);
+#ifdef __linux__
+  if (old_slack > 0) {
+    prctl(PR_SET_TIMERSLACK, (unsigned long) old_slack, 0UL, 0UL, 0UL);
+  }
+#endif
+  errno = saved_errno;
+  SERIAL_TRACE(SERIAL_TRACE_FRAME_END, ir->kernel_fd, sent, lock_wait);
+  if (sent < size && errno==EAGAIN) {
+    // El otro extremo detuvo el flujo: no es un error, es contrapresión
+    SERIAL_TRACE(SERIAL_TRACE_FRAME_STALLED, ir->kernel_fd, sent, 0);
+    return (gssize) sent;
+  }
+  if (sent < size && errno==ECANCELED) {
+    // Lo pidió quien llamó a `flush_output`: no es un error del puerto
+    return -1;
+  }
+  if (sent < size) {
+    g_critical("Frame interrupted after %" G_GSIZE_FORMAT " of %" G_GSIZE_FORMAT " bytes.", sent, size);
+    PRINT_ERRNO(g_critical);
+    return -1;
+  }
+  return (gssize) sent;
+}
+
+void get_pacing_stats(struct SerialPacingStats *stats, const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  g_mutex_lock(WRITE_LOCK);
+  *stats = INT_INFO(*dev)->pacing_stats;
+  stats->jitter_ns = stats->gaps > 1 ? sqrt(INT_INFO(*dev)->late_m2/(stats->gaps - 1)) : 0.0;
+  g_mutex_unlock(WRITE_LOCK);
+}
+
+// `read_buffer` sin los puntos de traza
+static gssize wait_and_read(guchar *buffer, gsize size, struct AbstractSerialDevice **dev) {
+#ifdef __linux__
+  if (INT_INFO(*dev)->uring!=NULL) {
+    if (INT_INFO(*dev)->open==FALSE) {
+      SERIAL_TRACE(SERIAL_TRACE_READ_CANCELLED, INT_INFO(*dev)->kernel_fd, 0, 0);
       errno = ECANCELED;
       return -1;
     }
-    g_mutex_lock(ACCESS_LOCK);
+    gssize r = serial_uring_read(INT_INFO(*dev)->uring, buffer, size);
+    if (r > 0) {
+      atomic_fetch_add_explicit(&INT_INFO(*dev)->rx_bytes, (uint_fast64_t) r, memory_order_relaxed);
+    }
+    return r;
+  }
+#endif
+  struct pollfd fds[2];
+  fds[0].fd = INT_INFO(*dev)->kernel_fd;
+  fds[0].events = POLLIN;
+  fds[1].fd = INT_INFO(*dev)->wake_fd[0];
+  fds[1].events = POLLIN;
+  while (TRUE) {
     if (INT_INFO(*dev)->open==FALSE) {
-      g_mutex_unlock(ACCESS_LOCK);
-      g_debug("Read operation cancelled: file is closed.");
+      SERIAL_TRACE(SERIAL_TRACE_READ_CANCELLED, INT_INFO(*dev)->kernel_fd, 0, 0);
       errno = ECANCELED;
       return -1;
     }
-    FD_ZERO(&set);
-    FD_SET(INT_INFO(*dev)->kernel_fd, &set);
-    g_mutex_lock(READ_LOCK);
-    select(INT_INFO(*dev)->kernel_fd + 1, &set, NULL, NULL, &INT_INFO(*dev)->timeout);
-    g_mutex_unlock(READ_LOCK);
-    g_mutex_unlock(ACCESS_LOCK);
-    g_thread_yield();
-  } while (!FD_ISSET(INT_INFO(*dev)->kernel_fd, &set));
-  char oneByte;
-  g_mutex_lock(ACCESS_LOCK);
+    // Sin timeout: el hilo solamente despierta cuando hay datos o cuando `cancel_read` escribe en el pipe
+    if (poll(fds, 2, -1)==-1) {
+      if (errno==EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    if (fds[1].revents & POLLIN) {
+      char token;
+      while (read(INT_INFO(*dev)->wake_fd[0], &token, 1)==1) {
+      }
+      SERIAL_TRACE(SERIAL_TRACE_READ_CANCELLED, INT_INFO(*dev)->kernel_fd, 0, 0);
+      errno = ECANCELED;
+      return -1;
+    }
+    if (fds[0].revents & (POLLIN | POLLHUP | POLLERR | POLLNVAL)) {
+      g_mutex_lock(READ_LOCK);
+      ssize_t r = read(INT_INFO(*dev)->kernel_fd, buffer, size);
+      g_mutex_unlock(READ_LOCK);
+      if (r > 0) {
+        atomic_fetch_add_explicit(&INT_INFO(*dev)->rx_bytes, (uint_fast64_t) r, memory_order_relaxed);
+        return r;
+      }
+      if (r==-1 && (errno==EAGAIN || errno==EINTR)) {
+        continue;
+      }
+      if (r==0) {
+        // Fin de archivo: el otro extremo desapareció (p.e. el adaptador USB se desconectó)
+        errno = EIO;
+      }
+      return -1;
+    }
+  }
+}
+
+gssize read_buffer(guchar *buffer, gsize size, const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  SERIAL_TRACE(SERIAL_TRACE_READ_BEGIN, INT_INFO(*dev)->kernel_fd, size, 0);
+  gssize r = wait_and_read(buffer, size, dev);
+  SERIAL_TRACE(SERIAL_TRACE_READ_END, INT_INFO(*dev)->kernel_fd, MAX(r, 0), 0);
+  return r;
+}
+
+gssize read_available(guchar *buffer, gsize size, const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+#ifdef __linux__
+  if (INT_INFO(*dev)->uring!=NULL) {
+    gssize r = serial_uring_read_available(INT_INFO(*dev)->uring, buffer, size);
+    if (r > 0) {
+      atomic_fetch_add_explicit(&INT_INFO(*dev)->rx_bytes, (uint_fast64_t) r, memory_order_relaxed);
+      SERIAL_TRACE(SERIAL_TRACE_READ_AVAILABLE, INT_INFO(*dev)->kernel_fd, r, 0);
+    }
+    return r;
+  }
+#endif
+  // El FD es O_NONBLOCK: sin datos, read falla con EAGAIN en lugar de esperar
   g_mutex_lock(READ_LOCK);
-  r = read(INT_INFO(*dev)->kernel_fd, &oneByte, 1);
+  ssize_t r = read(INT_INFO(*dev)->kernel_fd, buffer, size);
   g_mutex_unlock(READ_LOCK);
-  g_mutex_unlock(ACCESS_LOCK);
-  if (r==1) {
-    g_debug("Returning from blocking-read, read '%d' from port.", oneByte);
-    return oneByte;
+  if (r > 0) {
+    atomic_fetch_add_explicit(&INT_INFO(*dev)->rx_bytes, (uint_fast64_t) r, memory_order_relaxed);
+    SERIAL_TRACE(SERIAL_TRACE_READ_AVAILABLE, INT_INFO(*dev)->kernel_fd, r, 0);
+    return r;
+  }
+  if (r==-1 && (errno==EAGAIN || errno==EINTR)) {
+    return 0;
+  }
+  if (r==0) {
+    // Fin de archivo: el otro extremo desapareció (p.e. el adaptador USB se desconectó)
+    errno = EIO;
+  }
+  return -1;
+}
+
+char read_byte(const struct AbstractSerialDevice **cdev) {
+  guchar oneByte;
+  if (read_buffer(&oneByte, 1, cdev)==1) {
+    return (char) oneByte;
   }
   return (char) -1;
 }
 
+void cancel_read(const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  const char token = 0x00;
+  if (write(INT_INFO(*dev)->wake_fd[1], &token, 1)!=1 && errno!=EAGAIN) {
+    g_critical("Unable to wake up the reader thread.");
+    PRINT_ERRNO(g_critical);
+  }
+}
+
+void get_stats(struct SerialStats *stats, const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  stats->rx_bytes = atomic_load_explicit(&INT_INFO(*dev)->rx_bytes, memory_order_relaxed);
+  stats->tx_bytes = atomic_load_explicit(&INT_INFO(*dev)->tx_bytes, memory_order_relaxed);
+  stats->tx_wait_ns = atomic_load_explicit(&INT_INFO(*dev)->tx_wait_ns, memory_order_relaxed);
+  stats->flow_blocked_ns = atomic_load_explicit(&INT_INFO(*dev)->flow_blocked_ns, memory_order_relaxed);
+}
+
+gint get_native_fd(const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  return INT_INFO(*dev)->kernel_fd;
+}
+
+void add_stats(const struct SerialStats *stats, const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  atomic_fetch_add_explicit(&INT_INFO(*dev)->rx_bytes, stats->rx_bytes, memory_order_relaxed);
+  atomic_fetch_add_explicit(&INT_INFO(*dev)->tx_bytes, stats->tx_bytes, memory_order_relaxed);
+  atomic_fetch_add_explicit(&INT_INFO(*dev)->tx_wait_ns, stats->tx_wait_ns, memory_order_relaxed);
+  atomic_fetch_add_explicit(&INT_INFO(*dev)->flow_blocked_ns, stats->flow_blocked_ns, memory_order_relaxed);
+}
+
 //===--------------------------------------------------------------------------------------------------------------===//
 //                                          Funciones de control del puerto
 //===--------------------------------------------------------------------------------------------------------------===//
@@ -246,6 +715,7 @@ void free_sources(struct AbstractSerialDevice **dev) {
   g_mutex_clear(ACCESS_LOCK);
   g_mutex_clear(READ_LOCK);
   g_mutex_clear(WRITE_LOCK);
+  g_mutex_clear(FRAME_LOCK);
   g_debug("Freeing driver resources for Kernel File Descriptor %d.", INT_INFO(*dev)->kernel_fd);
   free(INT_INFO(*dev)->options);
   free(INT_INFO(*dev));
@@ -254,31 +724,89 @@ void free_sources(struct AbstractSerialDevice **dev) {
   *dev = NULL;
 }
 
-gboolean open_serial_port(const struct AbstractSerialDevice **cdev, GString *os_dev) {
+// Crea el pipe no bloqueante que usa `cancel_read`. No se usa pipe2 porque no existe en macOS.
+static gboolean open_wake_pipe(int wake_fd[2]) {
+  if (pipe(wake_fd)==-1) {
+    return FALSE;
+  }
+  for (int i = 0; i < 2; i++) {
+    fcntl(wake_fd[i], F_SETFL, fcntl(wake_fd[i], F_GETFL) | O_NONBLOCK);
+    fcntl(wake_fd[i], F_SETFD, FD_CLOEXEC);
+  }
+  return TRUE;
+}
+
+gboolean open_serial_port_with_backend(const struct AbstractSerialDevice **cdev,
+                                       GString *os_dev,
+                                       enum SerialBackend backend) {
   struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
   if (dev==NULL || *dev!=NULL) {
     // Si no es NULL, podemos estar cayendo encima de un driver reservado que ya no se podrá liberar.
     g_error("Trying to allocate a driver in a pointer which is not NULL. This is considered a bug.");
     return FALSE;
   }
+#ifndef __linux__
+  if (backend==SERIAL_BACKEND_URING) {
+    errno = ENOTSUP;
+    return FALSE;
+  }
+#endif
   if (os_dev!=NULL && os_dev->str!=NULL) {
     // Reservar memoria para el driver abstracto
     *dev = malloc(sizeof(struct AbstractSerialDevice));
     (*dev)->_internal_info = malloc(sizeof(struct InternalRepresentation));
+    (*dev)->_listener = NULL;
+    (*dev)->_close = NULL;
     INT_INFO(*dev)->options = malloc(sizeof(struct termios));
 
     // Inicializar los mutex
     g_mutex_init(ACCESS_LOCK);
     g_mutex_init(READ_LOCK);
     g_mutex_init(WRITE_LOCK);
+    g_mutex_init(FRAME_LOCK);
 
-    int k_fd = open(os_dev->str, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    int k_fd = open(os_dev->str, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
     if (k_fd==-1) {
       free_sources(dev);
       return FALSE;
     }
+    if (!open_wake_pipe(INT_INFO(*dev)->wake_fd)) {
+      int saved_errno = errno;
+      close(k_fd);
+      free_sources(dev);
+      errno = saved_errno;
+      return FALSE;
+    }
+#ifdef __linux__
+    INT_INFO(*dev)->uring = NULL;
+    if (backend==SERIAL_BACKEND_URING) {
+      INT_INFO(*dev)->uring = serial_uring_new(k_fd, INT_INFO(*dev)->wake_fd[0]);
+      if (INT_INFO(*dev)->uring==NULL) {
+        int saved_errno = errno;
+        g_critical("Unable to set up io_uring for \'%s\'.", os_dev->str);
+        PRINT_ERRNO(g_critical);
+        close(k_fd);
+        close(INT_INFO(*dev)->wake_fd[0]);
+        close(INT_INFO(*dev)->wake_fd[1]);
+        free_sources(dev);
+        errno = saved_errno;
+        return FALSE;
+      }
+    }
+#endif
     g_mutex_lock(ACCESS_LOCK);
     INT_INFO(*dev)->open = TRUE;
+    atomic_init(&INT_INFO(*dev)->rx_bytes, 0);
+    atomic_init(&INT_INFO(*dev)->tx_bytes, 0);
+    atomic_init(&INT_INFO(*dev)->tx_wait_ns, 0);
+    atomic_init(&INT_INFO(*dev)->flow_blocked_ns, 0);
+    atomic_init(&INT_INFO(*dev)->hardware_flow, FALSE);
+    atomic_init(&INT_INFO(*dev)->flush_count, 0);
+    INT_INFO(*dev)->pacing = (struct SerialPacing) {0};
+    INT_INFO(*dev)->pacing_stats = (struct SerialPacingStats) {0};
+    INT_INFO(*dev)->late_m2 = 0.0;
+    INT_INFO(*dev)->line_idle_ns = 0;
+    INT_INFO(*dev)->frame_stalled = FALSE;
     // Guardar el FD en la IR
     INT_INFO(*dev)->kernel_fd = k_fd;
     // Obtener la información de TERMIOS
@@ -291,6 +819,8 @@ gboolean open_serial_port(const struct AbstractSerialDevice **cdev, GString *os_
     (INT_INFO(*dev)->options)->c_oflag &= ~OPOST;
     // Aplica los cambios
     tcsetattr(k_fd, TCSANOW, INT_INFO(*dev)->options);
+    // El control de flujo por hardware se conserva como estaba configurado en el sistema
+    atomic_store(&INT_INFO(*dev)->hardware_flow, ((INT_INFO(*dev)->options)->c_cflag & CRTSCTS)!=0);
 
     // Configura las funciones del driver
     (*dev)->set_baud_rate = set_baud_rate;
@@ -300,15 +830,26 @@ gboolean open_serial_port(const struct AbstractSerialDevice **cdev, GString *os_
     (*dev)->get_parity_odd_neven = get_parity_odd_neven;
     (*dev)->set_software_control_flow = set_software_control_flow;
     (*dev)->get_software_control_flow = get_software_control_flow;
+    (*dev)->set_hardware_control_flow = set_hardware_control_flow;
+    (*dev)->get_hardware_control_flow = get_hardware_control_flow;
     (*dev)->write_byte = write_byte;
     (*dev)->read_byte = read_byte;
-
-    // Timeout
-    INT_INFO(*dev)->timeout.tv_sec = 0;
-    // 60 veces por segundo
-    INT_INFO(*dev)->timeout.tv_usec = (1000000/60);
-    g_debug("Driver polling timeout: %.6f.",
-            INT_INFO(*dev)->timeout.tv_sec + (INT_INFO(*dev)->timeout.tv_usec/1000000.0));
+    (*dev)->read_buffer = read_buffer;
+    (*dev)->read_available = read_available;
+    (*dev)->cancel_read = cancel_read;
+    (*dev)->get_stats = get_stats;
+    (*dev)->write_buffer = write_buffer;
+    (*dev)->wait_writable = wait_writable;
+    (*dev)->drain_output = drain_output;
+    (*dev)->flush_output = flush_output;
+    (*dev)->get_line_rate = get_line_rate;
+    (*dev)->get_frame_bits = get_frame_bits;
+    (*dev)->set_pacing = set_pacing;
+    (*dev)->get_pacing = get_pacing;
+    (*dev)->write_frame = write_frame;
+    (*dev)->get_pacing_stats = get_pacing_stats;
+    (*dev)->get_native_fd = get_native_fd;
+    (*dev)->add_stats = add_stats;
 
     g_mutex_unlock(ACCESS_LOCK);
     g_debug("Successfully created a driver for the file \'%s\' (Kernel File Descriptor: %d).",
@@ -319,22 +860,31 @@ gboolean open_serial_port(const struct AbstractSerialDevice **cdev, GString *os_
   return FALSE;
 }
 
-void close_serial_port(const struct AbstractSerialDevice **cdev) {
+gboolean open_serial_port(const struct AbstractSerialDevice **cdev, GString *os_dev) {
+  return open_serial_port_with_backend(cdev, os_dev, SERIAL_BACKEND_DEFAULT);
+}
 
+void close_serial_port(const struct AbstractSerialDevice **cdev) {
   struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
   if (dev!=NULL && *dev!=NULL) {
+    // Primero termina el hilo lector: después del join nadie más puede estar usando el driver desde ese hilo
+    stop_serial_listener(cdev);
+    if ((*dev)->_close!=NULL) {
+      (*dev)->_close(dev);
+      return;
+    }
     g_mutex_lock(ACCESS_LOCK);
     INT_INFO(*dev)->open = FALSE;
+#ifdef __linux__
+    if (INT_INFO(*dev)->uring!=NULL) {
+      serial_uring_free(INT_INFO(*dev)->uring);
+    }
+#endif
     close(INT_INFO(*dev)->kernel_fd);
+    close(INT_INFO(*dev)->wake_fd[0]);
+    close(INT_INFO(*dev)->wake_fd[1]);
     g_mutex_unlock(ACCESS_LOCK);
-    g_debug("Kernel File Descriptor %d closed. The driver will be unlocked and this thread will yield.",
-            INT_INFO(*dev)->kernel_fd);
-    g_thread_yield();
-    g_mutex_lock(ACCESS_LOCK);
-    g_debug(
-        "Thread returned from yield for Kernel File Descriptor %d. The driver will be permanently locked and freed.",
-        INT_INFO(*dev)->kernel_fd);
+    g_debug("Kernel File Descriptor %d closed. The driver will be freed.", INT_INFO(*dev)->kernel_fd);
     free_sources(dev);
   }
 }
-
@@ -0,0 +1,367 @@
+//===-- lib/abserio/responder.c - Respuestas automáticas --------------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Las peticiones se compilan a un autómata de Aho-Corasick completo: un trie con una tabla de 256 transiciones por
+/// estado en la que las transiciones que faltan ya siguen los enlaces de falla. Buscar cuesta una lectura de la tabla
+/// por byte recibido, sin importar cuántas reglas haya. Cada estado guarda la regla de menor índice que termina en
+/// él (o en alguno de sus sufijos), así que la prioridad también se resuelve al compilar.
+///
+/// Las respuestas con pausa van a una cola ordenada por fecha límite que atiende un hilo propio; el hilo existe
+/// solamente si alguna regla tiene pausa.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#define G_LOG_DOMAIN                    "ResponderAbSerIO"
+#include "responder.h"
+#include "macro.h"
+#include "timestamp.h"
+#include <errno.h>
+#include <string.h>
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Estructuras de datos
+//===--------------------------------------------------------------------------------------------------------------===//
+#define RESPONDER_ARROW                 "=>"
+// Estado inicial del autómata
+#define RESPONDER_ROOT                  0
+// Ninguna regla termina en el estado
+#define RESPONDER_NO_RULE               (-1)
+
+struct ResponderRule {
+  GBytes *reply;
+  guint32 delay_us;
+};
+
+// Respuesta con pausa en espera
+struct ResponderDelayed {
+  guint rule;
+  // Fecha límite en el reloj monotónico, en microsegundos
+  gint64 due;
+  // Copia del puntero al driver, igual que el hilo lector
+  const struct AbstractSerialDevice *dev;
+};
+
+struct SerialResponder {
+  // Transiciones: `next[estado*256 + byte]`, y la regla que termina en cada estado
+  guint32 *next;
+  gint32 *rule_at;
+  guint state_count;
+  // Estado actual; solamente lo usa el hilo lector
+  guint32 state;
+  struct ResponderRule *rules;
+  guint rule_count;
+  GMutex stats_lock;
+  struct SerialResponderStats *stats;
+  // Cola de respuestas con pausa, de la fecha límite más cercana a la más lejana
+  GThread *thread;
+  GMutex lock;
+  GCond wake;
+  GQueue delayed;
+  gboolean stop;
+};
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                   Funciones extra
+//===--------------------------------------------------------------------------------------------------------------===//
+// Busca `=>` fuera del texto entre comillas. Devuelve NULL si no hay.
+static const gchar *find_arrow(const gchar *line, const gchar *end) {
+  gboolean quoted = FALSE;
+  for (const gchar *p = line; p + 1 < end; p++) {
+    if (quoted && *p=='\\') {
+      p++;
+    } else if (*p=='"') {
+      quoted = !quoted;
+    } else if (!quoted && *p=='#') {
+      return NULL;
+    } else if (!quoted && memcmp(p, RESPONDER_ARROW, strlen(RESPONDER_ARROW))==0) {
+      return p;
+    }
+  }
+  return NULL;
+}
+
+// Agrega la petición al trie. El trie crece en `next`, que ya tiene lugar para todos los estados posibles.
+static void add_pattern(struct SerialResponder *responder, GBytes *pattern, guint rule) {
+  gsize length;
+  const guint8 *data = g_bytes_get_data(pattern, &length);
+  guint32 state = RESPONDER_ROOT;
+  for (gsize i = 0; i < length; i++) {
+    guint32 *slot = &responder->next[(gsize) state*256 + data[i]];
+    if (*slot==RESPONDER_ROOT) {
+      *slot = responder->state_count++;
+    }
+    state = *slot;
+  }
+  // Con dos peticiones iguales, la primera gana
+  if (responder->rule_at[state]==RESPONDER_NO_RULE) {
+    responder->rule_at[state] = (gint32) rule;
+  }
+}
+
+// Recorre el trie a lo ancho: calcula los enlaces de falla, los usa para llenar las transiciones que faltan y hereda
+// la regla del sufijo si tiene mayor prioridad
+static void build_automaton(struct SerialResponder *responder) {
+  guint32 *fail = g_new0(guint32, responder->state_count);
+  guint32 *queue = g_new(guint32, responder->state_count);
+  gsize head = 0;
+  gsize tail = 0;
+  for (guint byte = 0; byte < 256; byte++) {
+    guint32 child = responder->next[RESPONDER_ROOT*256 + byte];
+    if (child!=RESPONDER_ROOT) {
+      fail[child] = RESPONDER_ROOT;
+      queue[tail++] = child;
+    }
+  }
+  while (head < tail) {
+    guint32 state = queue[head++];
+    for (guint byte = 0; byte < 256; byte++) {
+      guint32 *slot = &responder->next[(gsize) state*256 + byte];
+      guint32 through_fail = responder->next[(gsize) fail[state]*256 + byte];
+      if (*slot==RESPONDER_ROOT) {
+        *slot = through_fail;
+        continue;
+      }
+      guint32 child = *slot;
+      fail[child] = through_fail;
+      gint32 inherited = responder->rule_at[through_fail];
+      if (inherited!=RESPONDER_NO_RULE
+          && (responder->rule_at[child]==RESPONDER_NO_RULE || inherited < responder->rule_at[child])) {
+        responder->rule_at[child] = inherited;
+      }
+      queue[tail++] = child;
+    }
+  }
+  g_free(queue);
+  g_free(fail);
+}
+
+// Escribe la respuesta completa. `reference` es el momento desde el que se mide la latencia.
+static void send_reply(struct SerialResponder *responder, guint rule, const struct AbstractSerialDevice **dev,
+                       gint64 reference) {
+  gsize length;
+  const guchar *data = g_bytes_get_data(responder->rules[rule].reply, &length);
+  gsize sent = 0;
+  while (sent < length) {
+    gssize n = (*dev)->write_frame(data + sent, length - sent, dev);
+    // Si el control de flujo detiene la línea, el hilo lector no se queda esperando: la respuesta se pierde
+    if (n <= 0) {
+      break;
+    }
+    sent += (gsize) n;
+  }
+  gint64 latency = g_get_monotonic_time() - reference;
+  struct SerialResponderStats *stats = &responder->stats[rule];
+  g_mutex_lock(&responder->stats_lock);
+  if (sent < length) {
+    stats->errors++;
+  } else {
+    stats->latency_min_us = stats->replies==0 ? latency : MIN(stats->latency_min_us, latency);
+    stats->latency_max_us = MAX(stats->latency_max_us, latency);
+    stats->latency_total_us += latency;
+    stats->replies++;
+  }
+  g_mutex_unlock(&responder->stats_lock);
+}
+
+static gint compare_due(gconstpointer a, gconstpointer b, gpointer user_data) {
+  gint64 first = ((const struct ResponderDelayed *) a)->due;
+  gint64 second = ((const struct ResponderDelayed *) b)->due;
+  return first < second ? -1 : first > second;
+}
+
+static void respond(struct SerialResponder *responder, guint rule, gint64 arrival,
+                    const struct AbstractSerialDevice **dev) {
+  g_mutex_lock(&responder->stats_lock);
+  responder->stats[rule].matches++;
+  g_mutex_unlock(&responder->stats_lock);
+  if (responder->rules[rule].delay_us==0) {
+    send_reply(responder, rule, dev, arrival);
+    return;
+  }
+  struct ResponderDelayed *delayed = g_new(struct ResponderDelayed, 1);
+  delayed->rule = rule;
+  delayed->due = arrival + responder->rules[rule].delay_us;
+  delayed->dev = *dev;
+  g_mutex_lock(&responder->lock);
+  g_queue_insert_sorted(&responder->delayed, delayed, compare_due, NULL);
+  g_cond_signal(&responder->wake);
+  g_mutex_unlock(&responder->lock);
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Hilos de ejecución
+//===--------------------------------------------------------------------------------------------------------------===//
+static gpointer delayed_thread(gpointer data) {
+  struct SerialResponder *responder = data;
+  g_mutex_lock(&responder->lock);
+  while (!responder->stop) {
+    struct ResponderDelayed *next = g_queue_peek_head(&responder->delayed);
+    if (next==NULL) {
+      g_cond_wait(&responder->wake, &responder->lock);
+      continue;
+    }
+    if (next->due > g_get_monotonic_time()) {
+      // Una respuesta nueva con una fecha más cercana también despierta al hilo
+      g_cond_wait_until(&responder->wake, &responder->lock, next->due);
+      continue;
+    }
+    g_queue_pop_head(&responder->delayed);
+    g_mutex_unlock(&responder->lock);
+    send_reply(responder, next->rule, &next->dev, next->due);
+    g_free(next);
+    g_mutex_lock(&responder->lock);
+  }
+  g_mutex_unlock(&responder->lock);
+  return NULL;
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                           Implementación de la interfaz
+//===--------------------------------------------------------------------------------------------------------------===//
+struct SerialResponder *serial_responder_new(const gchar *source, gsize *error_at) {
+  GPtrArray *patterns = g_ptr_array_new_with_free_func((GDestroyNotify) g_bytes_unref);
+  GArray *rules = g_array_new(FALSE, FALSE, sizeof(struct ResponderRule));
+  gsize states = 1;
+  gboolean delayed = FALSE;
+  const gchar *line = source;
+  while (*line!='\0') {
+    const gchar *end = strchr(line, '\n');
+    if (end==NULL) {
+      end = line + strlen(line);
+    }
+    const gchar *first = line;
+    while (first < end && g_ascii_isspace(*first)) {
+      first++;
+    }
+    if (first==end || *first=='#') {
+      line = *end=='\0' ? end : end + 1;
+      continue;
+    }
+    const gchar *arrow = find_arrow(line, end);
+    gsize side_error = 0;
+    guint32 match_delay = 0;
+    struct ResponderRule rule = {0};
+    GBytes *pattern = arrow!=NULL ? serial_macro_compile_payload(line, arrow, &match_delay, &side_error) : NULL;
+    if (pattern==NULL || match_delay!=0 || g_bytes_get_size(pattern)==0) {
+      // Sin `=>`, o una petición inválida, vacía o con pausa
+      side_error = arrow!=NULL && pattern==NULL ? side_error : (gsize) (first - line);
+      if (pattern!=NULL) {
+        g_bytes_unref(pattern);
+      }
+      if (error_at!=NULL) {
+        *error_at = (gsize) (line - source) + side_error;
+      }
+      goto invalid;
+    }
+    const gchar *reply = arrow + strlen(RESPONDER_ARROW);
+    rule.reply = serial_macro_compile_payload(reply, end, &rule.delay_us, &side_error);
+    if (rule.reply==NULL) {
+      g_bytes_unref(pattern);
+      if (error_at!=NULL) {
+        *error_at = (gsize) (reply - source) + side_error;
+      }
+      goto invalid;
+    }
+    states += g_bytes_get_size(pattern);
+    delayed = delayed || rule.delay_us > 0;
+    g_ptr_array_add(patterns, pattern);
+    g_array_append_val(rules, rule);
+    line = *end=='\0' ? end : end + 1;
+  }
+
+  struct SerialResponder *responder = g_new0(struct SerialResponder, 1);
+  responder->rule_count = rules->len;
+  responder->rules = (struct ResponderRule *) (void *) g_array_free(rules, FALSE);
+  responder->stats = g_new0(struct SerialResponderStats, responder->rule_count);
+  responder->next = g_new0(guint32, states*256);
+  responder->rule_at = g_new(gint32, states);
+  for (gsize i = 0; i < states; i++) {
+    responder->rule_at[i] = RESPONDER_NO_RULE;
+  }
+  responder->state_count = 1;
+  for (guint i = 0; i < patterns->len; i++) {
+    add_pattern(responder, g_ptr_array_index(patterns, i), i);
+  }
+  g_ptr_array_unref(patterns);
+  build_automaton(responder);
+  responder->state = RESPONDER_ROOT;
+  g_mutex_init(&responder->stats_lock);
+  g_mutex_init(&responder->lock);
+  g_cond_init(&responder->wake);
+  g_queue_init(&responder->delayed);
+  if (delayed) {
+    responder->thread = g_thread_new("abserio-responder", delayed_thread, responder);
+  }
+  return responder;
+
+invalid:
+  for (guint i = 0; i < rules->len; i++) {
+    g_bytes_unref(g_array_index(rules, struct ResponderRule, i).reply);
+  }
+  g_array_unref(rules);
+  g_ptr_array_unref(patterns);
+  errno = EINVAL;
+  return NULL;
+}
+
+guint serial_responder_get_rule_count(struct SerialResponder *responder) {
+  return responder->rule_count;
+}
+
+void serial_responder_feed(struct SerialResponder *responder,
+                           const guchar *data,
+                           gsize length,
+                           const struct SerialTimestamp *stamp,
+                           const struct AbstractSerialDevice **dev) {
+  guint32 state = responder->state;
+  for (gsize i = 0; i < length; i++) {
+    state = responder->next[(gsize) state*256 + data[i]];
+    gint32 rule = responder->rule_at[state];
+    if (G_UNLIKELY(rule!=RESPONDER_NO_RULE)) {
+      // La petición llegó con su último byte; el reloj de GLib es el mismo CLOCK_MONOTONIC, en microsegundos
+      respond(responder, (guint) rule, serial_timestamp_byte(stamp, length, i)/1000, dev);
+      state = RESPONDER_ROOT;
+    }
+  }
+  responder->state = state;
+}
+
+void serial_responder_get_stats(struct SerialResponder *responder, guint rule, struct SerialResponderStats *stats) {
+  g_mutex_lock(&responder->stats_lock);
+  *stats = responder->stats[rule];
+  g_mutex_unlock(&responder->stats_lock);
+}
+
+void serial_responder_free(struct SerialResponder *responder) {
+  if (responder->thread!=NULL) {
+    g_mutex_lock(&responder->lock);
+    responder->stop = TRUE;
+    g_cond_signal(&responder->wake);
+    g_mutex_unlock(&responder->lock);
+    g_thread_join(responder->thread);
+  }
+  g_queue_clear_full(&responder->delayed, g_free);
+  for (guint i = 0; i < responder->rule_count; i++) {
+    g_bytes_unref(responder->rules[i].reply);
+  }
+  g_free(responder->rules);
+  g_free(responder->stats);
+  g_free(responder->next);
+  g_free(responder->rule_at);
+  g_mutex_clear(&responder->stats_lock);
+  g_mutex_clear(&responder->lock);
+  g_cond_clear(&responder->wake);
+  g_free(responder);
+}
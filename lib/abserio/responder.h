@@ -0,0 +1,80 @@
+//===-- lib/abserio/responder.h - Respuestas automáticas --------------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Contesta solo, como lo haría un dispositivo: cuando llega una petición conocida, escribe la respuesta desde el
+/// mismo hilo lector, sin pasar por la GUI.
+///
+/// Las reglas son una por renglón, `petición => respuesta`, y cada lado se escribe como una macro (`macro.h`): bytes
+/// en hexadecimal y texto entre comillas. La respuesta puede empezar con una pausa (`5ms "OK\r\n"`), que se cuenta
+/// desde que llegó la petición; la respuesta puede estar vacía para solamente contar la petición. Los renglones
+/// vacíos y los comentarios (`#`) se ignoran.
+///
+///   "AT\r"          => "OK\r\n"
+///   "ATI\r"         => 2ms "SIMULADOR 1.0\r\n" "OK\r\n"
+///   02 "PING" 03    => 06
+///
+/// Las peticiones se buscan en el flujo recibido como un todo (una petición puede llegar partida en varias
+/// lecturas). Si varias terminan en el mismo byte, contesta la regla que aparece primero. Después de contestar, la
+/// búsqueda empieza de nuevo: la petición ya se consumió.
+///
+/// La latencia de cada respuesta va desde que llegó el último byte de la petición (según la fecha del bloque,
+/// `timestamp.h`) hasta que la respuesta se termina de escribir, sin contar la pausa de la regla. La pausa también se
+/// cuenta desde ese byte.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#ifndef ABSERIO_RESPONDER_H
+#define ABSERIO_RESPONDER_H
+#include "abserio.h"
+
+// El conjunto de reglas compilado es opaco
+struct SerialResponder;
+
+// Contadores de una regla
+struct SerialResponderStats {
+  // Veces que llegó la petición
+  guint64 matches;
+  // Respuestas escritas completas y las que no se pudieron escribir
+  guint64 replies;
+  guint64 errors;
+  // Latencia de las respuestas escritas, en microsegundos
+  gint64 latency_min_us;
+  gint64 latency_max_us;
+  gint64 latency_total_us;
+};
+
+// Compila las reglas. Devuelve NULL con errno = EINVAL si hay un error; en ese caso, si el segundo parámetro no es
+// NULL, se guarda la posición (en bytes) del error dentro del texto.
+struct SerialResponder *serial_responder_new(const gchar *, gsize *);
+
+// Número de reglas
+guint serial_responder_get_rule_count(struct SerialResponder *);
+
+// Busca las peticiones en un bloque recibido (con su fecha) y contesta en el puerto dado. Las respuestas sin pausa se
+// escriben antes de regresar; las que tienen pausa, desde un hilo propio. Se llama siempre desde el mismo hilo (el
+// lector).
+//  -> El puerto no se debe cerrar sin liberar antes el conjunto de reglas (quizá quedan respuestas con pausa)
+void serial_responder_feed(struct SerialResponder *,
+                           const guchar *,
+                           gsize,
+                           const struct SerialTimestamp *,
+                           const struct AbstractSerialDevice **);
+
+// Copia los contadores de una regla. Se puede llamar desde cualquier hilo.
+void serial_responder_get_stats(struct SerialResponder *, guint, struct SerialResponderStats *);
+
+// Descarta las respuestas con pausa pendientes y libera las reglas
+void serial_responder_free(struct SerialResponder *);
+#endif // ABSERIO_RESPONDER_H
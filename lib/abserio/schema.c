@@ -0,0 +1,612 @@
+//===-- lib/abserio/schema.c - Decodificación de mensajes binarios ----------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Todos los mensajes comparten un solo arreglo de operaciones; cada mensaje es un rango de ese arreglo. Una
+/// operación ocupa 8 bytes y solamente hay cuatro clases (entero, bits, bloque fijo y texto terminado en cero), así
+/// que decodificar es un ciclo con un `switch` pequeño sobre memoria contigua. Los nombres, las enumeraciones y la
+/// forma de mostrar cada campo están aparte, en la tabla de campos, que solamente se lee al convertir un valor a texto.
+///
+/// Para buscar el inicio de un mensaje hay una tabla con los bytes con los que empieza algún prefijo.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#define G_LOG_DOMAIN                    "SchemaAbSerIO"
+#include "schema.h"
+#include "macro.h"
+#include <errno.h>
+#include <string.h>
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Estructuras de datos
+//===--------------------------------------------------------------------------------------------------------------===//
+// La operación no guarda su valor (`pad`)
+#define SCHEMA_NO_FIELD                 G_MAXUINT16
+// El campo no tiene enumeración
+#define SCHEMA_NO_ENUM                  (-1)
+
+enum SchemaOpKind {
+  SCHEMA_OP_INT,
+  SCHEMA_OP_BITS,
+  SCHEMA_OP_BLOCK,
+  SCHEMA_OP_STRZ
+};
+
+// Banderas de SCHEMA_OP_INT
+#define SCHEMA_BIG_ENDIAN               0x01
+#define SCHEMA_SIGNED                   0x02
+
+struct SchemaOp {
+  guint8 kind;
+  guint8 flags;
+  // Índice del campo dentro de su mensaje, o SCHEMA_NO_FIELD
+  guint16 field;
+  // Bytes (INT y BLOCK) o bits (BITS)
+  guint32 size;
+};
+
+// Cómo se muestra un campo
+enum SchemaShow {
+  SCHEMA_SHOW_UNSIGNED,
+  SCHEMA_SHOW_SIGNED,
+  SCHEMA_SHOW_TEXT,
+  SCHEMA_SHOW_BYTES
+};
+
+struct SchemaField {
+  gchar *name;
+  enum SchemaShow show;
+  gint enumeration;
+};
+
+struct SchemaEnumEntry {
+  guint64 value;
+  gchar *label;
+};
+
+struct SchemaEnum {
+  gchar *name;
+  // Ordenadas por valor
+  GArray *entries;
+};
+
+struct SchemaMessage {
+  gchar *name;
+  GBytes *prefix;
+  guint first_op;
+  guint op_count;
+  guint first_field;
+  guint field_count;
+};
+
+struct SerialSchema {
+  struct SchemaOp *ops;
+  struct SchemaField *fields;
+  struct SchemaMessage *messages;
+  guint message_count;
+  guint max_fields;
+  GPtrArray *enums;
+  // Bytes con los que empieza algún mensaje
+  gboolean starts[256];
+};
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                   Funciones extra
+//===--------------------------------------------------------------------------------------------------------------===//
+// Número sin signo que ocupa toda la palabra: decimal o con `0x`. Devuelve FALSE si no es válido.
+static gboolean parse_number(const gchar *word, const gchar *word_end, guint64 *number) {
+  guint base = 10;
+  if (word_end - word > 2 && word[0]=='0' && (word[1]=='x' || word[1]=='X')) {
+    base = 16;
+    word += 2;
+  }
+  if (!g_ascii_isxdigit(*word)) {
+    return FALSE;
+  }
+  gchar *number_end = NULL;
+  errno = 0;
+  *number = g_ascii_strtoull(word, &number_end, base);
+  return errno==0 && number_end==word_end;
+}
+
+// Tamaño al final del nombre de un tipo (`str8` -> 8). Devuelve 0 si no es válido.
+static guint32 parse_size(const gchar *word, const gchar *word_end, const gchar *type) {
+  gsize length = strlen(type);
+  guint64 size = 0;
+  if ((gsize) (word_end - word) <= length || memcmp(word, type, length)!=0 || !g_ascii_isdigit(word[length])
+      || !parse_number(word + length, word_end, &size) || size > SERIAL_SCHEMA_FRAME_MAX) {
+    return 0;
+  }
+  return (guint32) size;
+}
+
+// Interpreta el tipo de un campo. Devuelve FALSE si no es válido.
+static gboolean parse_type(const gchar *word, const gchar *word_end, struct SchemaOp *op, enum SchemaShow *show) {
+  gsize length = (gsize) (word_end - word);
+  op->flags = 0;
+  if (length >= 2 && (word[0]=='u' || word[0]=='i') && g_ascii_isdigit(word[1])) {
+    // Enteros: `u8`, `i8` y los demás con `le` o `be`
+    gboolean big = length > 2 && memcmp(word_end - 2, "be", 2)==0;
+    gboolean little = length > 2 && memcmp(word_end - 2, "le", 2)==0;
+    guint64 bits = 0;
+    if (!parse_number(word + 1, word_end - (big || little ? 2 : 0), &bits)) {
+      return FALSE;
+    }
+    // `u8` sin orden; los demás, con orden
+    if ((bits==8)==(big || little) || (bits!=8 && bits!=16 && bits!=32 && bits!=64)) {
+      return FALSE;
+    }
+    op->kind = SCHEMA_OP_INT;
+    op->size = (guint32) bits/8;
+    op->flags = (big ? SCHEMA_BIG_ENDIAN : 0) | (word[0]=='i' ? SCHEMA_SIGNED : 0);
+    *show = word[0]=='i' ? SCHEMA_SHOW_SIGNED : SCHEMA_SHOW_UNSIGNED;
+    return TRUE;
+  }
+  if ((op->size = parse_size(word, word_end, "b"))!=0) {
+    op->kind = SCHEMA_OP_BITS;
+    *show = SCHEMA_SHOW_UNSIGNED;
+    return op->size <= 64;
+  }
+  if (serial_macro_is_word(word, word_end, "strz")) {
+    op->kind = SCHEMA_OP_STRZ;
+    op->size = 0;
+    *show = SCHEMA_SHOW_TEXT;
+    return TRUE;
+  }
+  op->kind = SCHEMA_OP_BLOCK;
+  if ((op->size = parse_size(word, word_end, "str"))!=0) {
+    *show = SCHEMA_SHOW_TEXT;
+    return TRUE;
+  }
+  if ((op->size = parse_size(word, word_end, "bytes"))!=0 || (op->size = parse_size(word, word_end, "pad"))!=0) {
+    *show = SCHEMA_SHOW_BYTES;
+    return TRUE;
+  }
+  return FALSE;
+}
+
+// Compila el prefijo de un mensaje. Devuelve NULL si no es válido, está vacío o tiene pausas.
+static GBytes *compile_prefix(const gchar *text, const gchar *end) {
+  guint32 delay = 0;
+  GBytes *prefix = serial_macro_compile_payload(text, end, &delay, NULL);
+  if (prefix!=NULL && (delay!=0 || g_bytes_get_size(prefix)==0)) {
+    g_bytes_unref(prefix);
+    prefix = NULL;
+  }
+  return prefix;
+}
+
+static gint find_enum(GPtrArray *enums, const gchar *name, const gchar *name_end) {
+  for (guint i = 0; i < enums->len; i++) {
+    const struct SchemaEnum *enumeration = g_ptr_array_index(enums, i);
+    if (serial_macro_is_word(name, name_end, enumeration->name)) {
+      return (gint) i;
+    }
+  }
+  return SCHEMA_NO_ENUM;
+}
+
+static gint compare_entries(gconstpointer a, gconstpointer b) {
+  guint64 first = ((const struct SchemaEnumEntry *) a)->value;
+  guint64 second = ((const struct SchemaEnumEntry *) b)->value;
+  return first < second ? -1 : first > second;
+}
+
+static const gchar *lookup_enum(const struct SchemaEnum *enumeration, guint64 value) {
+  const struct SchemaEnumEntry *entries = (const struct SchemaEnumEntry *) (void *) enumeration->entries->data;
+  guint low = 0, high = enumeration->entries->len;
+  while (low < high) {
+    guint middle = low + (high - low)/2;
+    if (entries[middle].value==value) {
+      return entries[middle].label;
+    }
+    if (entries[middle].value < value) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return NULL;
+}
+
+static void free_enum(gpointer data) {
+  struct SchemaEnum *enumeration = data;
+  for (guint i = 0; i < enumeration->entries->len; i++) {
+    g_free(g_array_index(enumeration->entries, struct SchemaEnumEntry, i).label);
+  }
+  g_array_unref(enumeration->entries);
+  g_free(enumeration->name);
+  g_free(enumeration);
+}
+
+static void clear_message(struct SchemaMessage *message) {
+  g_free(message->name);
+  if (message->prefix!=NULL) {
+    g_bytes_unref(message->prefix);
+  }
+}
+
+static guint64 read_int(const guint8 *data, const struct SchemaOp *op) {
+  guint64 raw = 0;
+  if (op->flags & SCHEMA_BIG_ENDIAN) {
+    for (guint32 i = 0; i < op->size; i++) {
+      raw = raw << 8 | data[i];
+    }
+  } else {
+    for (guint32 i = op->size; i > 0; i--) {
+      raw = raw << 8 | data[i - 1];
+    }
+  }
+  if ((op->flags & SCHEMA_SIGNED) && op->size < 8) {
+    guint shift = 64 - op->size*8;
+    raw = (guint64) ((gint64) (raw << shift) >> shift);
+  }
+  return raw;
+}
+
+// Ejecuta las operaciones de un mensaje después de su prefijo
+static enum SerialSchemaResult run_ops(const struct SchemaOp *op,
+                                       const struct SchemaOp *end,
+                                       const guint8 *data,
+                                       gsize length,
+                                       gsize position,
+                                       gsize *frame_length,
+                                       struct SerialSchemaValue *values) {
+  // Bits ya leídos de `data[position]`
+  guint bit = 0;
+  for (; op < end; op++) {
+    struct SerialSchemaValue value;
+    if (op->kind!=SCHEMA_OP_BITS && bit > 0) {
+      position++;
+      bit = 0;
+    }
+    value.offset = position;
+    value.raw = 0;
+    switch (op->kind) {
+      case SCHEMA_OP_INT://
+        if (length - position < op->size) {
+          return SERIAL_SCHEMA_INCOMPLETE;
+        }
+        value.raw = read_int(data + position, op);
+        value.length = op->size;
+        position += op->size;
+        break;
+      case SCHEMA_OP_BITS://
+        value.length = (bit + op->size + 7)/8;
+        if (length - position < value.length) {
+          return SERIAL_SCHEMA_INCOMPLETE;
+        }
+        // A lo más un byte por vuelta: lo que queda del byte actual o lo que falta del campo
+        for (guint32 left = op->size; left > 0;) {
+          guint available = 8 - bit;
+          guint take = MIN(available, left);
+          guint chunk = (guint) (data[position] >> (available - take)) & ((1u << take) - 1);
+          value.raw = value.raw << take | chunk;
+          bit += take;
+          left -= take;
+          if (bit==8) {
+            position++;
+            bit = 0;
+          }
+        }
+        break;
+      case SCHEMA_OP_BLOCK://
+        if (length - position < op->size) {
+          return SERIAL_SCHEMA_INCOMPLETE;
+        }
+        value.length = op->size;
+        position += op->size;
+        break;
+      case SCHEMA_OP_STRZ: {
+        const guint8 *zero = memchr(data + position, 0, length - position);
+        if (zero==NULL) {
+          return SERIAL_SCHEMA_INCOMPLETE;
+        }
+        value.length = (gsize) (zero - data) - position;
+        position += value.length + 1;
+        break;
+      }
+    }
+    if (op->field!=SCHEMA_NO_FIELD) {
+      values[op->field] = value;
+    }
+  }
+  *frame_length = position + (bit > 0);
+  return SERIAL_SCHEMA_DECODED;
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                           Implementación de la interfaz
+//===--------------------------------------------------------------------------------------------------------------===//
+struct SerialSchema *serial_schema_new(const gchar *source, gsize *error_at) {
+  GArray *ops = g_array_new(FALSE, FALSE, sizeof(struct SchemaOp));
+  GArray *fields = g_array_new(FALSE, FALSE, sizeof(struct SchemaField));
+  GArray *messages = g_array_new(FALSE, TRUE, sizeof(struct SchemaMessage));
+  GPtrArray *enums = g_ptr_array_new_with_free_func(free_enum);
+  // El bloque abierto: un mensaje, una enumeración o ninguno
+  struct SchemaMessage *message = NULL;
+  struct SchemaEnum *enumeration = NULL;
+  // Dónde empieza el bloque abierto
+  const gchar *block = NULL;
+  // Lo que mide como mínimo el mensaje abierto (de cada `strz`, solamente su cero), en bits
+  gsize message_bits = 0;
+  const gchar *error = NULL;
+  const gchar *line = source;
+  while (*line!='\0' && error==NULL) {
+    const gchar *end = strchr(line, '\n');
+    if (end==NULL) {
+      end = line + strlen(line);
+    }
+    const gchar *next_line = *end=='\0' ? end : end + 1;
+    const gchar *p = line, *keyword, *keyword_end, *word, *word_end;
+    if (!serial_macro_next_word(&p, end, &keyword, &keyword_end)) {
+      line = next_line;
+      continue;
+    }
+    gboolean has_name = serial_macro_next_word(&p, end, &word, &word_end);
+    if (serial_macro_is_word(keyword, keyword_end, "end")) {
+      if ((message==NULL && enumeration==NULL) || has_name) {
+        error = keyword;
+      } else if (enumeration!=NULL) {
+        g_array_sort(enumeration->entries, compare_entries);
+      }
+      message = NULL;
+      enumeration = NULL;
+    } else if (enumeration!=NULL) {
+      // `<valor> <nombre>`
+      struct SchemaEnumEntry entry;
+      const gchar *label, *label_end;
+      if (!parse_number(keyword, keyword_end, &entry.value)) {
+        error = keyword;
+      } else if (!has_name || serial_macro_next_word(&p, end, &label, &label_end)) {
+        error = has_name ? label : keyword;
+      } else {
+        entry.label = g_strndup(word, (gsize) (word_end - word));
+        g_array_append_val(enumeration->entries, entry);
+      }
+    } else if (message!=NULL) {
+      // `<tipo> [nombre [enumeración]]`
+      struct SchemaOp op;
+      struct SchemaField field = {NULL, SCHEMA_SHOW_UNSIGNED, SCHEMA_NO_ENUM};
+      const gchar *enum_name = NULL, *enum_end = NULL, *extra, *extra_end;
+      gboolean has_enum = has_name && serial_macro_next_word(&p, end, &enum_name, &enum_end);
+      gboolean pad = keyword_end - keyword > 3 && memcmp(keyword, "pad", 3)==0;
+      if (!parse_type(keyword, keyword_end, &op, &field.show)) {
+        error = keyword;
+      } else if (pad ? has_name : !has_name) {
+        error = pad ? word : keyword;
+      } else if (has_enum && (op.kind==SCHEMA_OP_BLOCK || op.kind==SCHEMA_OP_STRZ
+                              || (field.enumeration = find_enum(enums, enum_name, enum_end))==SCHEMA_NO_ENUM)) {
+        error = enum_name;
+      } else if (serial_macro_next_word(&p, end, &extra, &extra_end)) {
+        error = extra;
+      } else if (message->field_count >= SCHEMA_NO_FIELD) {
+        error = keyword;
+      } else {
+        op.field = SCHEMA_NO_FIELD;
+        if (!pad) {
+          op.field = (guint16) message->field_count++;
+          field.name = g_strndup(word, (gsize) (word_end - word));
+          g_array_append_val(fields, field);
+        }
+        g_array_append_val(ops, op);
+        message->op_count++;
+        if (op.kind==SCHEMA_OP_BITS) {
+          message_bits += op.size;
+        } else {
+          message_bits = (message_bits + 7)/8*8 + 8*(op.kind==SCHEMA_OP_STRZ ? 1 : op.size);
+        }
+        // Un mensaje más largo que lo que se intenta decodificar nunca se reconocería
+        if ((message_bits + 7)/8 > SERIAL_SCHEMA_FRAME_MAX) {
+          error = keyword;
+        }
+      }
+    } else if (serial_macro_is_word(keyword, keyword_end, "message")) {
+      struct SchemaMessage added = {0};
+      if (!has_name) {
+        error = keyword;
+      } else if ((added.prefix = compile_prefix(p, end))==NULL) {
+        error = g_ascii_isspace(*p) ? p + 1 : p;
+      } else if (g_bytes_get_size(added.prefix) > SERIAL_SCHEMA_FRAME_MAX) {
+        g_bytes_unref(added.prefix);
+        error = g_ascii_isspace(*p) ? p + 1 : p;
+      } else {
+        block = keyword;
+        message_bits = g_bytes_get_size(added.prefix)*8;
+        added.name = g_strndup(word, (gsize) (word_end - word));
+        added.first_op = ops->len;
+        added.first_field = fields->len;
+        g_array_append_val(messages, added);
+        message = &g_array_index(messages, struct SchemaMessage, messages->len - 1);
+      }
+    } else if (serial_macro_is_word(keyword, keyword_end, "enum")) {
+      const gchar *extra, *extra_end;
+      if (!has_name || serial_macro_next_word(&p, end, &extra, &extra_end)
+          || find_enum(enums, word, word_end)!=SCHEMA_NO_ENUM) {
+        error = has_name ? word : keyword;
+      } else {
+        block = keyword;
+        enumeration = g_new0(struct SchemaEnum, 1);
+        enumeration->name = g_strndup(word, (gsize) (word_end - word));
+        enumeration->entries = g_array_new(FALSE, FALSE, sizeof(struct SchemaEnumEntry));
+        g_ptr_array_add(enums, enumeration);
+      }
+    } else {
+      error = keyword;
+    }
+    line = next_line;
+  }
+  if (error==NULL && (message!=NULL || enumeration!=NULL)) {
+    // Un bloque sin `end`
+    error = block;
+  }
+
+  if (error!=NULL) {
+    for (guint i = 0; i < fields->len; i++) {
+      g_free(g_array_index(fields, struct SchemaField, i).name);
+    }
+    for (guint i = 0; i < messages->len; i++) {
+      clear_message(&g_array_index(messages, struct SchemaMessage, i));
+    }
+    g_array_unref(ops);
+    g_array_unref(fields);
+    g_array_unref(messages);
+    g_ptr_array_unref(enums);
+    if (error_at!=NULL) {
+      *error_at = (gsize) (error - source);
+    }
+    errno = EINVAL;
+    return NULL;
+  }
+  struct SerialSchema *schema = g_new0(struct SerialSchema, 1);
+  schema->message_count = messages->len;
+  schema->ops = (struct SchemaOp *) (void *) g_array_free(ops, FALSE);
+  schema->fields = (struct SchemaField *) (void *) g_array_free(fields, FALSE);
+  schema->messages = (struct SchemaMessage *) (void *) g_array_free(messages, FALSE);
+  schema->enums = enums;
+  for (guint i = 0; i < schema->message_count; i++) {
+    schema->max_fields = MAX(schema->max_fields, schema->messages[i].field_count);
+    schema->starts[*(const guint8 *) g_bytes_get_data(schema->messages[i].prefix, NULL)] = TRUE;
+  }
+  return schema;
+}
+
+guint serial_schema_get_message_count(struct SerialSchema *schema) {
+  return schema->message_count;
+}
+
+guint serial_schema_get_max_fields(struct SerialSchema *schema) {
+  return schema->max_fields;
+}
+
+const gchar *serial_schema_get_message_name(struct SerialSchema *schema, guint message) {
+  return schema->messages[message].name;
+}
+
+guint serial_schema_get_field_count(struct SerialSchema *schema, guint message) {
+  return schema->messages[message].field_count;
+}
+
+const gchar *serial_schema_get_field_name(struct SerialSchema *schema, guint message, guint field) {
+  return schema->fields[schema->messages[message].first_field + field].name;
+}
+
+gsize serial_schema_find_start(struct SerialSchema *schema, const guint8 *data, gsize length) {
+  gsize i = 0;
+  while (i < length && !schema->starts[data[i]]) {
+    i++;
+  }
+  return i;
+}
+
+enum SerialSchemaResult serial_schema_decode(struct SerialSchema *schema,
+                                             const guint8 *data,
+                                             gsize length,
+                                             guint *message,
+                                             gsize *frame_length,
+                                             struct SerialSchemaValue *values) {
+  if (length==0) {
+    return SERIAL_SCHEMA_INCOMPLETE;
+  }
+  if (!schema->starts[data[0]]) {
+    return SERIAL_SCHEMA_NO_MATCH;
+  }
+  for (guint i = 0; i < schema->message_count; i++) {
+    const struct SchemaMessage *candidate = &schema->messages[i];
+    gsize prefix_length;
+    const guint8 *prefix = g_bytes_get_data(candidate->prefix, &prefix_length);
+    if (memcmp(data, prefix, MIN(length, prefix_length))!=0) {
+      continue;
+    }
+    // Con un prefijo incompleto, o un mensaje incompleto, todavía no se sabe si es este mensaje: se espera
+    if (length < prefix_length) {
+      return SERIAL_SCHEMA_INCOMPLETE;
+    }
+    const struct SchemaOp *ops = schema->ops + candidate->first_op;
+    enum SerialSchemaResult result = run_ops(ops,
+                                             ops + candidate->op_count,
+                                             data,
+                                             MIN(length, SERIAL_SCHEMA_FRAME_MAX),
+                                             prefix_length,
+                                             frame_length,
+                                             values);
+    if (result==SERIAL_SCHEMA_DECODED) {
+      *message = i;
+      return result;
+    }
+    if (length < SERIAL_SCHEMA_FRAME_MAX) {
+      return SERIAL_SCHEMA_INCOMPLETE;
+    }
+    // Demasiado largo para este mensaje; quizá es otro
+  }
+  return SERIAL_SCHEMA_NO_MATCH;
+}
+
+void serial_schema_format_value(struct SerialSchema *schema,
+                                guint message,
+                                guint field,
+                                const guint8 *frame,
+                                const struct SerialSchemaValue *value,
+                                GString *text) {
+  const struct SchemaField *info = &schema->fields[schema->messages[message].first_field + field];
+  const guint8 *bytes = frame + value->offset;
+  gsize length = value->length;
+  switch (info->show) {
+    case SCHEMA_SHOW_UNSIGNED://
+    case SCHEMA_SHOW_SIGNED://
+      if (info->show==SCHEMA_SHOW_SIGNED) {
+        g_string_append_printf(text, "%" G_GINT64_FORMAT, (gint64) value->raw);
+      } else {
+        g_string_append_printf(text, "%" G_GUINT64_FORMAT " (0x%" G_GINT64_MODIFIER "X)", value->raw, value->raw);
+      }
+      if (info->enumeration!=SCHEMA_NO_ENUM) {
+        const gchar *label = lookup_enum(g_ptr_array_index(schema->enums, info->enumeration), value->raw);
+        g_string_append_printf(text, " %s", label!=NULL ? label : "?");
+      }
+      break;
+    case SCHEMA_SHOW_TEXT://
+      while (length > 0 && bytes[length - 1]==0x00) {
+        length--;
+      }
+      g_string_append_c(text, '"');
+      for (gsize i = 0; i < length; i++) {
+        if (bytes[i] >= 0x20 && bytes[i] <= 0x7E && bytes[i]!='"' && bytes[i]!='\\') {
+          g_string_append_c(text, (gchar) bytes[i]);
+        } else {
+          g_string_append_printf(text, "\\x%02X", bytes[i]);
+        }
+      }
+      g_string_append_c(text, '"');
+      break;
+    case SCHEMA_SHOW_BYTES://
+      for (gsize i = 0; i < length; i++) {
+        g_string_append_printf(text, i==0 ? "%02X" : " %02X", bytes[i]);
+      }
+      break;
+  }
+}
+
+void serial_schema_free(struct SerialSchema *schema) {
+  for (guint i = 0; i < schema->message_count; i++) {
+    clear_message(&schema->messages[i]);
+    for (guint j = 0; j < schema->messages[i].field_count; j++) {
+      g_free(schema->fields[schema->messages[i].first_field + j].name);
+    }
+  }
+  g_free(schema->messages);
+  g_free(schema->fields);
+  g_free(schema->ops);
+  g_ptr_array_unref(schema->enums);
+  g_free(schema);
+}
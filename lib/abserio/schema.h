@@ -0,0 +1,117 @@
+//===-- lib/abserio/schema.h - Decodificación de mensajes binarios ----------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Un esquema describe los mensajes de un dispositivo: cómo empieza cada uno y qué campos tiene. Se compila una sola
+/// vez a una tabla plana de operaciones que después se ejecuta sobre lo recibido, sin reservar memoria por campo: los
+/// valores se escriben en un arreglo que da quien decodifica y solamente se convierten a texto para mostrarlos.
+///
+/// Una declaración por renglón; los renglones vacíos y los comentarios (`#`) se ignoran:
+///
+///   enum modo
+///     0 reposo
+///     1 midiendo
+///   end
+///
+///   message estado 02 "S"
+///     u8     version
+///     u16le  temperatura
+///     b3     modo modo
+///     b5     alarmas
+///     str8   serie
+///     strz   nombre
+///     bytes2 crc
+///   end
+///
+/// -> `message <nombre> <prefijo>`: el prefijo son los bytes con los que empieza el mensaje, escritos como una macro
+///    (`macro.h`), sin pausas. Si dos prefijos coinciden, gana el mensaje que se declaró primero
+/// -> `enum <nombre>`: valores (decimales o con `0x`) y sus nombres, para los campos enteros que lo usen
+/// -> Campos, en orden, con un nombre y opcionalmente una enumeración:
+///      -> `u8`, `i8`, `u16le`, `u16be`, `i16le`, ..., `u64be`, `i64be`: enteros sin o con signo
+///      -> `b<n>` (de 1 a 64): n bits sin signo, del más significativo al menos significativo. Los bits seguidos
+///         comparten bytes; cualquier otro campo empieza en el siguiente byte completo
+///      -> `str<n>`: texto de n bytes (sin los ceros del final)
+///      -> `strz`: texto terminado en cero (el cero es parte del mensaje)
+///      -> `bytes<n>`: n bytes, que se muestran en hexadecimal
+///      -> `pad<n>`: n bytes que se saltan, sin nombre
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#ifndef ABSERIO_SCHEMA_H
+#define ABSERIO_SCHEMA_H
+#include <glib.h>
+
+// Lo más que puede medir un mensaje. Uno con `strz` que no encuentra el cero antes no es ese mensaje; uno que mide más
+// aunque sus `strz` estén vacíos es un error del esquema
+#define SERIAL_SCHEMA_FRAME_MAX         4096
+
+// El esquema compilado es opaco; no cambia al decodificar, así que varios hilos lo pueden usar a la vez
+struct SerialSchema;
+
+// Valor decodificado de un campo
+struct SerialSchemaValue {
+  // Dónde está el campo dentro del mensaje (para los bits, los bytes que los contienen)
+  gsize offset;
+  gsize length;
+  // Los enteros y los bits; los de signo ya están extendidos (se leen como gint64)
+  guint64 raw;
+};
+
+// Resultado de `serial_schema_decode`
+enum SerialSchemaResult {
+  // Ningún mensaje empieza aquí
+  SERIAL_SCHEMA_NO_MATCH,
+  // Puede empezar un mensaje, pero faltan bytes
+  SERIAL_SCHEMA_INCOMPLETE,
+  SERIAL_SCHEMA_DECODED
+};
+
+// Compila el esquema. Devuelve NULL con errno = EINVAL si hay un error (también si un mensaje no cabe en
+// SERIAL_SCHEMA_FRAME_MAX); en ese caso, si el segundo parámetro no es NULL, se guarda la posición (en bytes) del error
+// dentro del texto.
+struct SerialSchema *serial_schema_new(const gchar *, gsize *);
+
+// Número de mensajes y el mayor número de campos de un mensaje (el tamaño del arreglo para `serial_schema_decode`)
+guint serial_schema_get_message_count(struct SerialSchema *);
+guint serial_schema_get_max_fields(struct SerialSchema *);
+
+// Nombre y número de campos de un mensaje, y nombre de uno de sus campos
+const gchar *serial_schema_get_message_name(struct SerialSchema *, guint);
+guint serial_schema_get_field_count(struct SerialSchema *, guint);
+const gchar *serial_schema_get_field_name(struct SerialSchema *, guint, guint);
+
+// Posición del primer byte con el que puede empezar un mensaje, o la longitud si no hay ninguno
+gsize serial_schema_find_start(struct SerialSchema *, const guint8 *, gsize);
+
+// Decodifica el mensaje que empieza al principio de los datos. Si lo logra, guarda el mensaje, su longitud y el
+// valor de cada campo, en el orden del esquema, en el arreglo (de `serial_schema_get_max_fields` elementos).
+enum SerialSchemaResult serial_schema_decode(struct SerialSchema *,
+                                             const guint8 *,
+                                             gsize,
+                                             guint *,
+                                             gsize *,
+                                             struct SerialSchemaValue *);
+
+// Agrega al texto el valor de un campo (mensaje, campo, los bytes del mensaje y el valor) como se muestra: los enteros
+// en decimal (con su nombre si tienen enumeración), el texto entre comillas y los bytes en hexadecimal
+void serial_schema_format_value(struct SerialSchema *,
+                                guint,
+                                guint,
+                                const guint8 *,
+                                const struct SerialSchemaValue *,
+                                GString *);
+
+// Libera el esquema
+void serial_schema_free(struct SerialSchema *);
+#endif // ABSERIO_SCHEMA_H
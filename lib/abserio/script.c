@@ -0,0 +1,502 @@
+//===-- lib/abserio/script.c - Diálogos de envío y espera -------------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// El script se compila a un arreglo de instrucciones con los saltos ya resueltos: `loop` salta después de su `end`
+/// cuando no hay que repetir, `end` regresa a su `loop` y las etiquetas son índices. Los contadores de los ciclos
+/// viven en la ejecución, así que el mismo script compilado se ejecuta en varios hilos a la vez.
+///
+/// `expect` usa coincidencia parcial suave: si hay una coincidencia completa gana esa (así `/OK\d*/` coincide en
+/// cuanto llega `OK`), y si solamente hay una parcial se conserva el buffer desde donde empieza.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#define G_LOG_DOMAIN                    "ScriptAbSerIO"
+#include "script.h"
+#include "macro.h"
+#include <errno.h>
+#include <string.h>
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Estructuras de datos
+//===--------------------------------------------------------------------------------------------------------------===//
+enum ScriptOpType {
+  SCRIPT_OP_SEND,
+  SCRIPT_OP_EXPECT,
+  SCRIPT_OP_WAIT,
+  SCRIPT_OP_LOOP,
+  SCRIPT_OP_END,
+  SCRIPT_OP_GOTO,
+  SCRIPT_OP_FAIL
+};
+
+struct ScriptOp {
+  enum ScriptOpType type;
+  guint line;
+  // Posición de la instrucción en el texto, para los errores
+  gsize at;
+  // El renglón sin espacios alrededor, para los reportes
+  gchar *text;
+  // SEND: los bytes y la pausa antes de enviarlos
+  GBytes *payload;
+  guint32 delay_us;
+  // EXPECT
+  GRegex *regex;
+  // EXPECT y WAIT
+  gint64 timeout_us;
+  // LOOP: repeticiones
+  guint count;
+  // LOOP: la instrucción después de su END; END: su LOOP; GOTO y EXPECT con `else`: la etiqueta
+  guint target;
+  // GOTO y EXPECT con `else`: el nombre de la etiqueta y su posición en el texto
+  gchar *label;
+  gsize label_at;
+};
+
+struct SerialScript {
+  struct ScriptOp *ops;
+  guint op_count;
+};
+
+// Estado de una ejecución
+struct ScriptRun {
+  struct SerialScript *script;
+  const struct AbstractSerialDevice **dev;
+  struct SerialSubscription *subscription;
+  // Lo recibido que todavía no consume un `expect`
+  GByteArray *buffer;
+  // Repeticiones que le quedan a cada LOOP
+  guint *remaining;
+};
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                   Funciones extra
+//===--------------------------------------------------------------------------------------------------------------===//
+static const gchar *skip_spaces(const gchar *p, const gchar *end) {
+  while (p < end && g_ascii_isspace(*p)) {
+    p++;
+  }
+  return p;
+}
+
+static const gchar *trim_end(const gchar *start, const gchar *end) {
+  while (end > start && g_ascii_isspace(end[-1])) {
+    end--;
+  }
+  return end;
+}
+
+// Un tiempo con la sintaxis de las pausas de las macros (`500ms`), en microsegundos. Devuelve -1 si no es válido.
+static gint64 parse_duration(const gchar *text, const gchar *end) {
+  guint32 delay = 0;
+  GBytes *payload = serial_macro_compile_payload(text, end, &delay, NULL);
+  if (payload==NULL) {
+    return -1;
+  }
+  gboolean bytes = g_bytes_get_size(payload) > 0;
+  g_bytes_unref(payload);
+  return bytes || delay==0 ? -1 : (gint64) delay;
+}
+
+// Busca la `/` que cierra la expresión, saltando las escapadas. Devuelve NULL si no hay.
+static const gchar *find_slash(const gchar *p, const gchar *end) {
+  for (; p < end; p++) {
+    if (*p=='\\') {
+      p++;
+    } else if (*p=='/') {
+      return p;
+    }
+  }
+  return NULL;
+}
+
+
+// Compila los argumentos de `expect`. En caso de error devuelve FALSE y apunta `error` al argumento inválido.
+static gboolean parse_expect(struct ScriptOp *op, const gchar *arg, const gchar *end, const gchar *source,
+                             const gchar **error) {
+  const gchar *close = arg < end && *arg=='/' ? find_slash(arg + 1, end) : NULL;
+  if (close==NULL) {
+    *error = arg;
+    return FALSE;
+  }
+  // Lo recibido no tiene por qué ser UTF-8
+  GRegexCompileFlags flags = G_REGEX_RAW | G_REGEX_OPTIMIZE;
+  const gchar *p = close + 1;
+  if (p < end && *p=='i') {
+    flags |= G_REGEX_CASELESS;
+    p++;
+  }
+  gchar *pattern = g_strndup(arg + 1, (gsize) (close - arg - 1));
+  GError *regex_error = NULL;
+  op->regex = g_regex_new(pattern, flags, 0, &regex_error);
+  g_free(pattern);
+  if (op->regex==NULL) {
+    g_error_free(regex_error);
+    *error = arg;
+    return FALSE;
+  }
+  // Después: un tiempo y `else <etiqueta>`, los dos opcionales y en ese orden
+  op->timeout_us = (gint64) SERIAL_SCRIPT_DEFAULT_TIMEOUT_MS*1000;
+  const gchar *word, *word_end;
+  gboolean more = serial_macro_next_word(&p, end, &word, &word_end);
+  if (more && !serial_macro_is_word(word, word_end, "else")) {
+    op->timeout_us = parse_duration(word, word_end);
+    if (op->timeout_us < 0) {
+      *error = word;
+      return FALSE;
+    }
+    more = serial_macro_next_word(&p, end, &word, &word_end);
+  }
+  if (!more) {
+    return TRUE;
+  }
+  if (!serial_macro_is_word(word, word_end, "else") || !serial_macro_next_word(&p, end, &word, &word_end)) {
+    *error = word;
+    return FALSE;
+  }
+  op->label = g_strndup(word, (gsize) (word_end - word));
+  op->label_at = (gsize) (word - source);
+  if (serial_macro_next_word(&p, end, &word, &word_end)) {
+    *error = word;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static void clear_op(struct ScriptOp *op) {
+  g_free(op->text);
+  g_free(op->label);
+  if (op->payload!=NULL) {
+    g_bytes_unref(op->payload);
+  }
+  if (op->regex!=NULL) {
+    g_regex_unref(op->regex);
+  }
+}
+
+// Agrega un bloque recibido al buffer; si se pasa del máximo, descarta lo más viejo
+static void take_chunk(struct ScriptRun *run, struct SerialChunk *chunk) {
+  gsize length;
+  const guint8 *data = g_bytes_get_data(chunk->bytes, &length);
+  g_byte_array_append(run->buffer, data, (guint) length);
+  serial_chunk_unref(chunk);
+  if (run->buffer->len > SERIAL_SCRIPT_BUFFER_MAX) {
+    g_byte_array_remove_range(run->buffer, 0, run->buffer->len - SERIAL_SCRIPT_BUFFER_MAX);
+  }
+}
+
+// Espera a que llegue algo, a lo más hasta la fecha límite (reloj monotónico), y toma todo lo que haya en la cola.
+// Devuelve FALSE si no llegó nada.
+static gboolean receive(struct ScriptRun *run, gint64 deadline) {
+  gint64 timeout = MAX(deadline - g_get_monotonic_time(), 0);
+  struct SerialChunk *chunk = serial_subscription_pop(run->subscription, timeout);
+  if (chunk==NULL) {
+    return FALSE;
+  }
+  do {
+    take_chunk(run, chunk);
+  } while ((chunk = serial_subscription_pop(run->subscription, 0))!=NULL);
+  return TRUE;
+}
+
+// Espera hasta la fecha límite sin dejar de recibir
+static void receive_until(struct ScriptRun *run, gint64 deadline) {
+  while (g_get_monotonic_time() < deadline) {
+    receive(run, deadline);
+  }
+}
+
+static gboolean run_send(struct ScriptRun *run, struct ScriptOp *op) {
+  if (op->delay_us > 0) {
+    receive_until(run, g_get_monotonic_time() + op->delay_us);
+  }
+  gsize length;
+  const guchar *data = g_bytes_get_data(op->payload, &length);
+  gsize sent = 0;
+  while (sent < length) {
+    gssize n = (*run->dev)->write_frame(data + sent, length - sent, run->dev);
+    if (n <= 0) {
+      return FALSE;
+    }
+    sent += (gsize) n;
+  }
+  return TRUE;
+}
+
+// Busca la expresión en el buffer. Si coincide, consume el buffer hasta el final de la coincidencia; si no, descarta
+// lo que ya no puede ser parte de una.
+static gboolean search(struct ScriptRun *run, GRegex *regex) {
+  GMatchInfo *info = NULL;
+  gint start = 0, end = 0;
+  gboolean matched = g_regex_match_full(regex, (const gchar *) run->buffer->data, run->buffer->len, 0,
+                                        G_REGEX_MATCH_PARTIAL_SOFT, &info, NULL);
+  if (matched) {
+    g_match_info_fetch_pos(info, 0, &start, &end);
+    g_byte_array_remove_range(run->buffer, 0, (guint) end);
+  } else if (g_match_info_is_partial_match(info)) {
+    if (g_match_info_fetch_pos(info, 0, &start, &end) && start > 0) {
+      g_byte_array_remove_range(run->buffer, 0, (guint) start);
+    }
+  } else {
+    g_byte_array_set_size(run->buffer, 0);
+  }
+  g_match_info_free(info);
+  return matched;
+}
+
+static gboolean run_expect(struct ScriptRun *run, struct ScriptOp *op) {
+  gint64 deadline = g_get_monotonic_time() + op->timeout_us;
+  while (!search(run, op->regex)) {
+    if (g_get_monotonic_time() >= deadline) {
+      return FALSE;
+    }
+    receive(run, deadline);
+  }
+  return TRUE;
+}
+
+static void add_step_time(struct SerialScriptStepStats *stats, gint64 elapsed) {
+  stats->min_us = stats->runs==0 ? elapsed : MIN(stats->min_us, elapsed);
+  stats->max_us = MAX(stats->max_us, elapsed);
+  stats->total_us += elapsed;
+  stats->runs++;
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                           Implementación de la interfaz
+//===--------------------------------------------------------------------------------------------------------------===//
+struct SerialScript *serial_script_new(const gchar *source, gsize *error_at) {
+  GArray *ops = g_array_new(FALSE, TRUE, sizeof(struct ScriptOp));
+  GHashTable *labels = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  // Los LOOP que todavía no tienen su END
+  GArray *loops = g_array_new(FALSE, FALSE, sizeof(guint));
+  const gchar *error = NULL;
+  guint line_number = 0;
+  const gchar *line = source;
+  while (*line!='\0' && error==NULL) {
+    const gchar *end = strchr(line, '\n');
+    if (end==NULL) {
+      end = line + strlen(line);
+    }
+    const gchar *next_line = *end=='\0' ? end : end + 1;
+    const gchar *p = line, *keyword, *keyword_end;
+    line_number++;
+    if (!serial_macro_next_word(&p, end, &keyword, &keyword_end)) {
+      line = next_line;
+      continue;
+    }
+    const gchar *arg = skip_spaces(p, end);
+    const gchar *arg_end = trim_end(arg, end);
+    const gchar *word, *word_end;
+    struct ScriptOp op = {0};
+    op.line = line_number;
+    op.at = (gsize) (keyword - source);
+    if (serial_macro_is_word(keyword, keyword_end, "send")) {
+      gsize macro_error = 0;
+      op.type = SCRIPT_OP_SEND;
+      op.payload = serial_macro_compile_payload(arg, arg_end, &op.delay_us, &macro_error);
+      if (op.payload==NULL || g_bytes_get_size(op.payload)==0) {
+        error = arg + (op.payload==NULL ? macro_error : 0);
+      }
+    } else if (serial_macro_is_word(keyword, keyword_end, "expect")) {
+      op.type = SCRIPT_OP_EXPECT;
+      parse_expect(&op, arg, arg_end, source, &error);
+    } else if (serial_macro_is_word(keyword, keyword_end, "wait")) {
+      op.type = SCRIPT_OP_WAIT;
+      op.timeout_us = parse_duration(arg, arg_end);
+      if (op.timeout_us < 0) {
+        error = arg;
+      }
+    } else if (serial_macro_is_word(keyword, keyword_end, "loop")) {
+      gchar *number_end = NULL;
+      guint64 count = g_ascii_isdigit(*arg) ? g_ascii_strtoull(arg, &number_end, 10) : 0;
+      op.type = SCRIPT_OP_LOOP;
+      if (count==0 || count > G_MAXUINT || number_end!=arg_end) {
+        error = arg;
+      } else {
+        op.count = (guint) count;
+        g_array_append_val(loops, ops->len);
+      }
+    } else if (serial_macro_is_word(keyword, keyword_end, "end")) {
+      op.type = SCRIPT_OP_END;
+      if (arg!=arg_end || loops->len==0) {
+        error = keyword;
+      } else {
+        op.target = g_array_index(loops, guint, loops->len - 1);
+        g_array_set_size(loops, loops->len - 1);
+        g_array_index(ops, struct ScriptOp, op.target).target = ops->len + 1;
+      }
+    } else if (serial_macro_is_word(keyword, keyword_end, "label")) {
+      // No es una instrucción: la etiqueta apunta a la siguiente
+      p = arg;
+      if (!serial_macro_next_word(&p, arg_end, &word, &word_end) || word_end!=arg_end) {
+        error = arg;
+      } else {
+        gchar *name = g_strndup(arg, (gsize) (arg_end - arg));
+        if (g_hash_table_contains(labels, name)) {
+          g_free(name);
+          error = arg;
+        } else {
+          g_hash_table_insert(labels, name, GUINT_TO_POINTER(ops->len));
+        }
+      }
+      line = next_line;
+      continue;
+    } else if (serial_macro_is_word(keyword, keyword_end, "goto")) {
+      op.type = SCRIPT_OP_GOTO;
+      p = arg;
+      if (!serial_macro_next_word(&p, arg_end, &word, &word_end) || word_end!=arg_end) {
+        error = arg;
+      } else {
+        op.label = g_strndup(arg, (gsize) (arg_end - arg));
+        op.label_at = (gsize) (arg - source);
+      }
+    } else if (serial_macro_is_word(keyword, keyword_end, "fail")) {
+      op.type = SCRIPT_OP_FAIL;
+    } else {
+      error = keyword;
+    }
+    op.text = g_strndup(keyword, (gsize) (arg_end - keyword));
+    g_array_append_val(ops, op);
+    line = next_line;
+  }
+  if (error==NULL && loops->len > 0) {
+    // Un `loop` sin `end`
+    error = source + g_array_index(ops, struct ScriptOp, g_array_index(loops, guint, 0)).at;
+  }
+  for (guint i = 0; i < ops->len && error==NULL; i++) {
+    struct ScriptOp *op = &g_array_index(ops, struct ScriptOp, i);
+    gpointer target;
+    if (op->label==NULL) {
+      continue;
+    }
+    if (!g_hash_table_lookup_extended(labels, op->label, NULL, &target)) {
+      error = source + op->label_at;
+      break;
+    }
+    op->target = GPOINTER_TO_UINT(target);
+  }
+  g_array_unref(loops);
+  g_hash_table_unref(labels);
+
+  if (error!=NULL) {
+    for (guint i = 0; i < ops->len; i++) {
+      clear_op(&g_array_index(ops, struct ScriptOp, i));
+    }
+    g_array_unref(ops);
+    if (error_at!=NULL) {
+      *error_at = (gsize) (error - source);
+    }
+    errno = EINVAL;
+    return NULL;
+  }
+  struct SerialScript *script = g_new0(struct SerialScript, 1);
+  script->op_count = ops->len;
+  script->ops = (struct ScriptOp *) (void *) g_array_free(ops, FALSE);
+  return script;
+}
+
+guint serial_script_get_step_count(struct SerialScript *script) {
+  return script->op_count;
+}
+
+guint serial_script_get_step_line(struct SerialScript *script, guint step) {
+  return script->ops[step].line;
+}
+
+const gchar *serial_script_get_step_text(struct SerialScript *script, guint step) {
+  return script->ops[step].text;
+}
+
+struct SerialScriptResult *serial_script_run(struct SerialScript *script,
+                                             const struct AbstractSerialDevice **dev,
+                                             struct SerialSubscription *subscription) {
+  struct SerialScriptResult *result = g_new0(struct SerialScriptResult, 1);
+  result->outcome = SERIAL_SCRIPT_PASSED;
+  result->steps = g_new0(struct SerialScriptStepStats, script->op_count);
+  struct ScriptRun run;
+  run.script = script;
+  run.dev = dev;
+  run.subscription = subscription;
+  // Con el máximo reservado desde el principio, el buffer casi nunca se vuelve a reservar
+  run.buffer = g_byte_array_sized_new(SERIAL_SCRIPT_BUFFER_MAX);
+  run.remaining = g_new0(guint, script->op_count);
+  gint64 started = g_get_monotonic_time();
+  guint pc = 0;
+  while (pc < script->op_count && result->outcome==SERIAL_SCRIPT_PASSED) {
+    struct ScriptOp *op = &script->ops[pc];
+    guint next = pc + 1;
+    gint64 step_started = g_get_monotonic_time();
+    switch (op->type) {
+      case SCRIPT_OP_SEND://
+        if (!run_send(&run, op)) {
+          result->outcome = SERIAL_SCRIPT_WRITE_ERROR;
+        }
+        break;
+      case SCRIPT_OP_EXPECT://
+        if (!run_expect(&run, op)) {
+          result->steps[pc].timeouts++;
+          if (op->label!=NULL) {
+            next = op->target;
+          } else {
+            result->outcome = SERIAL_SCRIPT_TIMEOUT;
+          }
+        }
+        break;
+      case SCRIPT_OP_WAIT://
+        receive_until(&run, step_started + op->timeout_us);
+        break;
+      case SCRIPT_OP_LOOP://
+        run.remaining[pc] = op->count;
+        break;
+      case SCRIPT_OP_END://
+        // Si se llegó aquí con un `goto`, sin pasar por el `loop`, no se repite
+        if (run.remaining[op->target] > 1) {
+          run.remaining[op->target]--;
+          next = op->target + 1;
+        } else {
+          run.remaining[op->target] = 0;
+        }
+        break;
+      case SCRIPT_OP_GOTO://
+        next = op->target;
+        break;
+      case SCRIPT_OP_FAIL://
+        result->outcome = SERIAL_SCRIPT_FAILED;
+        break;
+    }
+    add_step_time(&result->steps[pc], g_get_monotonic_time() - step_started);
+    if (result->outcome!=SERIAL_SCRIPT_PASSED) {
+      result->step = pc;
+    }
+    pc = next;
+  }
+  result->duration_us = g_get_monotonic_time() - started;
+  g_byte_array_unref(run.buffer);
+  g_free(run.remaining);
+  return result;
+}
+
+void serial_script_result_free(struct SerialScriptResult *result) {
+  g_free(result->steps);
+  g_free(result);
+}
+
+void serial_script_free(struct SerialScript *script) {
+  for (guint i = 0; i < script->op_count; i++) {
+    clear_op(&script->ops[i]);
+  }
+  g_free(script->ops);
+  g_free(script);
+}
@@ -0,0 +1,115 @@
+//===-- lib/abserio/script.h - Diálogos de envío y espera -------------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Scripts de prueba para dispositivos: enviar un comando, esperar una respuesta con un tiempo límite y seguir según
+/// el resultado. El texto se compila una sola vez (las expresiones regulares incluidas) y el mismo script se puede
+/// ejecutar en varios puertos a la vez, cada uno en su propio hilo.
+///
+/// Una instrucción por renglón; los renglones vacíos y los comentarios (`#`) se ignoran:
+///   -> `send <macro>`: escribe los bytes, escritos como una macro (`macro.h`). Puede empezar con una pausa
+///   -> `expect /regex/ [tiempo] [else <etiqueta>]`: espera hasta que lo recibido coincida con la expresión (por
+///      omisión, SERIAL_SCRIPT_DEFAULT_TIMEOUT_MS). Después de `/` puede ir `i` para no distinguir mayúsculas. Si el
+///      tiempo se vence, salta a la etiqueta o, sin `else`, el script falla
+///   -> `wait <tiempo>`: espera sin leer (lo recibido mientras tanto se queda para el siguiente `expect`)
+///   -> `loop <n>` ... `end`: repite las instrucciones n veces; se pueden anidar
+///   -> `label <nombre>` y `goto <nombre>`
+///   -> `fail [mensaje]`: termina el script como fallido
+///
+/// Los tiempos se escriben como las pausas de las macros: `250us`, `500ms`, `2s`.
+///
+///   send "AT+CSQ\r"
+///   expect /\+CSQ: [1-9]/ 500ms else sin_senal
+///   loop 3
+///     send 02 "PING" 03
+///     expect /\x06/ 50ms
+///   end
+///   goto fin
+///   label sin_senal
+///   fail Sin señal
+///   label fin
+///
+/// Lo recibido se acumula en un buffer desde que empieza la ejecución. Cada `expect` busca en ese buffer con
+/// coincidencia parcial: lo que ya no puede ser el inicio de una coincidencia se descarta en cuanto llega, así que
+/// cada byte se examina pocas veces sin importar cuánto tarde la respuesta. Al coincidir, se consume el buffer hasta
+/// el final de la coincidencia. Las aserciones hacia atrás no ven lo que ya se descartó.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#ifndef ABSERIO_SCRIPT_H
+#define ABSERIO_SCRIPT_H
+#include "stream.h"
+
+// Tiempo límite de un `expect` sin tiempo
+#define SERIAL_SCRIPT_DEFAULT_TIMEOUT_MS 1000
+// Lo más que se guarda de lo recibido sin coincidir; lo más viejo se descarta
+#define SERIAL_SCRIPT_BUFFER_MAX        (64*1024)
+
+// El script compilado es opaco; no cambia al ejecutarlo
+struct SerialScript;
+
+// Cómo terminó una ejecución
+enum SerialScriptOutcome {
+  SERIAL_SCRIPT_PASSED,
+  // Un `expect` sin `else` se venció
+  SERIAL_SCRIPT_TIMEOUT,
+  // No se pudo escribir en el puerto
+  SERIAL_SCRIPT_WRITE_ERROR,
+  // Llegó a un `fail`
+  SERIAL_SCRIPT_FAILED
+};
+
+// Tiempos de una instrucción durante una ejecución (si está en un ciclo, de todas sus repeticiones)
+struct SerialScriptStepStats {
+  guint runs;
+  // `expect` que se vencieron
+  guint timeouts;
+  gint64 min_us;
+  gint64 max_us;
+  gint64 total_us;
+};
+
+// Resultado de una ejecución
+struct SerialScriptResult {
+  enum SerialScriptOutcome outcome;
+  // Instrucción en la que terminó, si no pasó
+  guint step;
+  gint64 duration_us;
+  // Una entrada por instrucción
+  struct SerialScriptStepStats *steps;
+};
+
+// Compila el script. Devuelve NULL con errno = EINVAL si hay un error; en ese caso, si el segundo parámetro no es
+// NULL, se guarda la posición (en bytes) del error dentro del texto.
+struct SerialScript *serial_script_new(const gchar *, gsize *);
+
+// Número de instrucciones (las etiquetas no cuentan)
+guint serial_script_get_step_count(struct SerialScript *);
+
+// Renglón (desde 1) y texto de una instrucción, para los reportes
+guint serial_script_get_step_line(struct SerialScript *, guint);
+const gchar *serial_script_get_step_text(struct SerialScript *, guint);
+
+// Ejecuta el script en el puerto dado y bloquea hasta que termina. Lo recibido se lee de la suscripción dada, que
+// debe estar suscrita al flujo en el que se publica lo que llega por ese puerto (ver `stream.h`).
+struct SerialScriptResult *serial_script_run(struct SerialScript *,
+                                             const struct AbstractSerialDevice **,
+                                             struct SerialSubscription *);
+
+// Libera el resultado de una ejecución
+void serial_script_result_free(struct SerialScriptResult *);
+
+// Libera el script
+void serial_script_free(struct SerialScript *);
+#endif // ABSERIO_SCRIPT_H
@@ -0,0 +1,265 @@
+//===-- lib/abserio/shmring.c - Flujo recibido en memoria compartida --------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// La posición de cada byte en el flujo (cuántos bytes se publicaron antes que él) funciona como número de secuencia.
+/// El escritor usa dos contadores, como un seqlock:
+///   -> `reserve`: hasta dónde va a escribir. Se actualiza ANTES de tocar los datos
+///   -> `head`: hasta dónde ya escribió. Se actualiza DESPUÉS
+/// Un lector lee `head`, copia los bytes y, después de copiar, lee `reserve`. Si `reserve` avanzó tanto que la
+/// región copiada pudo sobreescribirse a mitad de la copia, la descarta y salta hacia adelante. Así el escritor nunca
+/// espera ni toma un mutex, y un lector lento solamente se perjudica a sí mismo.
+///
+/// Para no hacer busy-waiting, los lectores pueden dormir en un futex compartido; el escritor solamente hace la
+/// llamada al sistema cuando hay alguien esperando.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#define _GNU_SOURCE
+#define G_LOG_DOMAIN                    "ShmRingAbSerIO"
+#include "shmring.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Estructuras de datos
+//===--------------------------------------------------------------------------------------------------------------===//
+// "ABSR"
+#define SHM_RING_MAGIC                  0x52534241
+#define SHM_RING_VERSION                1
+// El encabezado ocupa una página completa para que los datos queden alineados
+#define SHM_RING_HEADER_SIZE            4096
+#define SHM_RING_MIN_CAPACITY           4096
+
+// Encabezado en la memoria compartida. Todos los procesos lo ven igual: solamente usa tipos de tamaño fijo
+struct ShmRingHeader {
+  guint32 magic;
+  guint32 version;
+  // Tamaño del área de datos (potencia de dos)
+  guint64 capacity;
+  // Posición hasta la que el escritor va a escribir y hasta la que ya escribió
+  _Atomic guint64 reserve;
+  _Atomic guint64 head;
+  // Palabra del futex: cambia en cada publicación mientras haya lectores esperando
+  _Atomic guint32 wake_word;
+  _Atomic guint32 waiters;
+};
+
+G_STATIC_ASSERT(sizeof(struct ShmRingHeader) <= SHM_RING_HEADER_SIZE);
+
+// Un mapeo del memfd, del lado del escritor o de un lector
+struct ShmRingMapping {
+  int fd;
+  gsize size;
+  struct ShmRingHeader *header;
+  guchar *data;
+};
+
+struct SerialShmRing {
+  struct ShmRingMapping map;
+};
+
+struct SerialShmReader {
+  struct ShmRingMapping map;
+  // Siguiente byte a leer
+  guint64 position;
+};
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                   Funciones extra
+//===--------------------------------------------------------------------------------------------------------------===//
+static gboolean map_ring(struct ShmRingMapping *map, int fd, gsize size) {
+  void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base==MAP_FAILED) {
+    return FALSE;
+  }
+  map->fd = fd;
+  map->size = size;
+  map->header = base;
+  map->data = (guchar *) base + SHM_RING_HEADER_SIZE;
+  return TRUE;
+}
+
+static void unmap_ring(struct ShmRingMapping *map) {
+  munmap(map->header, map->size);
+  close(map->fd);
+}
+
+static long futex(_Atomic guint32 *word, int op, guint32 value, const struct timespec *timeout) {
+  return syscall(SYS_futex, (guint32 *) word, op, value, timeout, NULL, 0);
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                             Implementación del escritor
+//===--------------------------------------------------------------------------------------------------------------===//
+struct SerialShmRing *serial_shm_ring_new(gsize capacity) {
+  gsize rounded = SHM_RING_MIN_CAPACITY;
+  while (rounded < capacity) {
+    rounded <<= 1;
+  }
+  int fd = memfd_create("abserio-rx", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd==-1) {
+    return NULL;
+  }
+  gsize size = SHM_RING_HEADER_SIZE + rounded;
+  struct SerialShmRing *ring = g_new0(struct SerialShmRing, 1);
+  if (ftruncate(fd, (off_t) size)==-1 || !map_ring(&ring->map, fd, size)) {
+    int saved_errno = errno;
+    close(fd);
+    g_free(ring);
+    errno = saved_errno;
+    return NULL;
+  }
+  // El tamaño ya no puede cambiar: un lector puede confiar en el mapeo que hizo
+  fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+  struct ShmRingHeader *header = ring->map.header;
+  header->capacity = rounded;
+  atomic_init(&header->reserve, 0);
+  atomic_init(&header->head, 0);
+  atomic_init(&header->wake_word, 0);
+  atomic_init(&header->waiters, 0);
+  header->version = SHM_RING_VERSION;
+  // El número mágico va al final: un lector que abre el memfd a medio inicializar lo rechaza
+  atomic_thread_fence(memory_order_release);
+  header->magic = SHM_RING_MAGIC;
+  return ring;
+}
+
+void serial_shm_ring_publish(struct SerialShmRing *ring, const guchar *data, gsize length) {
+  struct ShmRingHeader *header = ring->map.header;
+  guint64 capacity = header->capacity;
+  guint64 head = atomic_load_explicit(&header->head, memory_order_relaxed);
+  guint64 end = head + length;
+  // De un bloque más grande que el buffer solamente caben los últimos bytes
+  if (length > capacity) {
+    data += length - capacity;
+    length = capacity;
+  }
+  atomic_store_explicit(&header->reserve, end, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  guint64 start = (end - length) & (capacity - 1);
+  gsize first = MIN(length, capacity - start);
+  memcpy(ring->map.data + start, data, first);
+  memcpy(ring->map.data, data + first, length - first);
+  // `seq_cst` y no solamente `release`: la lectura de `waiters` no se puede adelantar a esta escritura. Si se
+  // adelantara, un lector que se registra en medio vería el `head` anterior, se dormiría y nadie lo despertaría
+  atomic_store(&header->head, end);
+  if (atomic_load(&header->waiters) > 0) {
+    atomic_fetch_add(&header->wake_word, 1);
+    futex(&header->wake_word, FUTEX_WAKE, INT_MAX, NULL);
+  }
+}
+
+gchar *serial_shm_ring_get_path(struct SerialShmRing *ring) {
+  return g_strdup_printf("/proc/%d/fd/%d", (int) getpid(), ring->map.fd);
+}
+
+void serial_shm_ring_free(struct SerialShmRing *ring) {
+  unmap_ring(&ring->map);
+  g_free(ring);
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                              Implementación del lector
+//===--------------------------------------------------------------------------------------------------------------===//
+struct SerialShmReader *serial_shm_reader_open(const gchar *path) {
+  // Lectura y escritura: el lector también actualiza `waiters` para dormir en el futex
+  int fd = open(path, O_RDWR | O_CLOEXEC);
+  if (fd==-1) {
+    return NULL;
+  }
+  struct stat info;
+  if (fstat(fd, &info)==-1 || info.st_size <= SHM_RING_HEADER_SIZE) {
+    close(fd);
+    errno = EINVAL;
+    return NULL;
+  }
+  struct SerialShmReader *reader = g_new0(struct SerialShmReader, 1);
+  if (!map_ring(&reader->map, fd, (gsize) info.st_size)) {
+    int saved_errno = errno;
+    close(fd);
+    g_free(reader);
+    errno = saved_errno;
+    return NULL;
+  }
+  struct ShmRingHeader *header = reader->map.header;
+  if (header->magic!=SHM_RING_MAGIC || header->version!=SHM_RING_VERSION
+      || SHM_RING_HEADER_SIZE + header->capacity!=(guint64) info.st_size) {
+    serial_shm_reader_close(reader);
+    errno = EINVAL;
+    return NULL;
+  }
+  reader->position = atomic_load_explicit(&header->head, memory_order_acquire);
+  return reader;
+}
+
+gsize serial_shm_reader_read(struct SerialShmReader *reader, guchar *buffer, gsize size, guint64 *lost) {
+  struct ShmRingHeader *header = reader->map.header;
+  guint64 capacity = header->capacity;
+  while (TRUE) {
+    guint64 head = atomic_load_explicit(&header->head, memory_order_acquire);
+    if (head==reader->position || size==0) {
+      return 0;
+    }
+    if (head - reader->position > capacity) {
+      // El escritor dio la vuelta completa: lo más viejo que queda está una capacidad atrás de `head`
+      if (lost!=NULL) {
+        *lost += head - capacity - reader->position;
+      }
+      reader->position = head - capacity;
+    }
+    gsize length = (gsize) MIN(head - reader->position, size);
+    guint64 start = reader->position & (capacity - 1);
+    gsize first = MIN(length, capacity - start);
+    memcpy(buffer, reader->map.data + start, first);
+    memcpy(buffer + first, reader->map.data, length - first);
+    // Si mientras se copiaba el escritor reservó una región que alcanza lo copiado, la copia no sirve
+    atomic_thread_fence(memory_order_acquire);
+    guint64 reserve = atomic_load_explicit(&header->reserve, memory_order_relaxed);
+    if (reserve > capacity && reserve - capacity > reader->position) {
+      if (lost!=NULL) {
+        *lost += reserve - capacity - reader->position;
+      }
+      reader->position = reserve - capacity;
+      continue;
+    }
+    reader->position += length;
+    return length;
+  }
+}
+
+gboolean serial_shm_reader_wait(struct SerialShmReader *reader, gint timeout) {
+  struct ShmRingHeader *header = reader->map.header;
+  guint32 word = atomic_load(&header->wake_word);
+  atomic_fetch_add(&header->waiters, 1);
+  // Si el escritor publicó entre la lectura de la palabra y el incremento, no hay que dormir
+  if (atomic_load(&header->head)==reader->position) {
+    struct timespec limit = {timeout/1000, (timeout%1000)*1000000L};
+    futex(&header->wake_word, FUTEX_WAIT, word, timeout < 0 ? NULL : &limit);
+  }
+  atomic_fetch_sub(&header->waiters, 1);
+  return atomic_load_explicit(&header->head, memory_order_acquire)!=reader->position;
+}
+
+void serial_shm_reader_close(struct SerialShmReader *reader) {
+  unmap_ring(&reader->map);
+  g_free(reader);
+}
@@ -0,0 +1,65 @@
+//===-- lib/abserio/shmring.h - Flujo recibido en memoria compartida --------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Publica los bytes recibidos en un buffer circular dentro de un memfd (solamente Linux), para que otros procesos
+/// lean el mismo flujo sin que haya que copiarlo por sockets. Solamente hay un escritor (el hilo que recibe); los
+/// lectores pueden ser cualquier cantidad de procesos y cada uno lleva su propia posición.
+///
+/// El escritor nunca espera a los lectores: un lector que se atrasa más que la capacidad del buffer pierde los bytes
+/// más viejos, y `serial_shm_reader_read` le dice cuántos.
+///
+/// Los lectores abren el memfd del escritor por su ruta en `/proc/<pid>/fd/<fd>` (ver `serial_shm_ring_get_path`),
+/// así que deben ser del mismo usuario.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#ifndef ABSERIO_SHMRING_H
+#define ABSERIO_SHMRING_H
+#include <glib.h>
+
+// El lado del escritor es opaco
+struct SerialShmRing;
+// El lado de un lector es opaco
+struct SerialShmReader;
+
+// Crea el memfd con la capacidad dada (se redondea a una potencia de dos). Devuelve NULL con errno configurado si no
+// se puede crear.
+struct SerialShmRing *serial_shm_ring_new(gsize);
+
+// Publica un bloque de bytes. No bloquea ni toma mutex; solamente debe haber un hilo escritor a la vez.
+void serial_shm_ring_publish(struct SerialShmRing *, const guchar *, gsize);
+
+// Ruta con la que otros procesos pueden abrir el memfd. Hay que liberarla con g_free.
+gchar *serial_shm_ring_get_path(struct SerialShmRing *);
+
+// Libera el memfd. Los lectores que ya lo mapearon pueden seguir leyendo lo que quedó.
+void serial_shm_ring_free(struct SerialShmRing *);
+
+// Abre el flujo publicado en la ruta dada. El lector empieza en la posición actual del escritor (solamente recibe lo
+// que se publique después). Devuelve NULL con errno configurado si la ruta no es un flujo válido.
+struct SerialShmReader *serial_shm_reader_open(const gchar *);
+
+// Copia los bytes pendientes (hasta el tamaño del buffer) y devuelve cuántos; 0 si no hay nada nuevo. Si el lector se
+// atrasó tanto que el escritor ya sobreescribió parte de lo pendiente, salta a lo más viejo que sigue disponible y
+// suma a `*lost` los bytes perdidos (si no es NULL).
+gsize serial_shm_reader_read(struct SerialShmReader *, guchar *, gsize, guint64 *);
+
+// Espera hasta que haya bytes nuevos o hasta que pase el timeout (en ms, -1 para siempre). Devuelve TRUE si hay bytes
+// pendientes.
+gboolean serial_shm_reader_wait(struct SerialShmReader *, gint);
+
+// Libera el lector
+void serial_shm_reader_close(struct SerialShmReader *);
+#endif // ABSERIO_SHMRING_H
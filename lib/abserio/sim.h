@@ -0,0 +1,83 @@
+//===-- lib/abserio/sim.h - Par de puertos simulados ------------------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Un tercer driver, además de los de POSIX y Windows: dos puertos en memoria conectados entre sí, como los dos
+/// extremos de un cable. Sirve para medir y probar sin hardware ni pseudo-terminales: lo que se escribe en un extremo
+/// llega al otro al ritmo de la línea (baud rate, pariedad y bits de parada del que escribe), más un retraso fijo y
+/// una variación aleatoria opcionales. También puede perder bytes o invertir bits con una probabilidad dada. Los
+/// errores salen de un generador con semilla, así que con la misma semilla y las mismas escrituras se pierden y se
+/// corrompen los mismos bytes.
+///
+/// Cada dirección tiene una cola de salida (bytes en camino) y una cola de entrada en el receptor (bytes que ya
+/// llegaron y nadie ha leído):
+///  -> Si la cola de salida está llena, `write_buffer` devuelve -1 con EAGAIN, igual que con un puerto real
+///  -> Sin control de flujo por hardware en el emisor, lo que llega con la cola de entrada llena se pierde (overrun)
+///  -> Con control de flujo por hardware en el emisor, la cola de entrada del receptor detiene al emisor: la espera de
+///     `wait_writable` cuenta en `flow_blocked_ns`
+///
+/// El receptor no revisa la configuración de la línea: si los dos extremos tienen baud rates distintos, los bytes
+/// llegan de todas formas. `get_native_fd` devuelve -1, así que el puente TCP no acepta puertos simulados.
+///
+/// Los dos extremos se cierran por separado con `close_serial_port`. Leer de un extremo cuyo otro extremo se cerró
+/// devuelve lo que quedaba en camino y después -1 con errno en EIO; escribirle devuelve -1 con EIO.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#ifndef ABSERIO_SIM_H
+#define ABSERIO_SIM_H
+#include "abserio.h"
+
+// Tamaño de las colas cuando la configuración tiene cero (el de la cola de una TTY en Linux)
+#define SERIAL_SIM_DEFAULT_QUEUE        4096
+
+// Comportamiento de la línea simulada; el mismo para las dos direcciones
+struct SerialSimConfig {
+  // Retraso fijo entre que un byte termina de salir y que llega, en microsegundos
+  guint latency_us;
+  // Retraso aleatorio adicional, entre 0 y este valor, que se sortea en cada escritura. Los bytes nunca llegan en
+  // desorden
+  guint jitter_us;
+  // Probabilidad de que se pierda un byte (de 0 a 1)
+  gdouble drop_rate;
+  // Probabilidad de que se invierta cada bit de datos (de 0 a 1)
+  gdouble bit_error_rate;
+  // Semilla del generador de errores. Cada dirección usa su propio generador
+  guint32 seed;
+  // Bytes en camino que acepta cada extremo (cero para SERIAL_SIM_DEFAULT_QUEUE)
+  gsize tx_queue;
+  // Bytes recibidos sin leer que guarda cada extremo (cero para SERIAL_SIM_DEFAULT_QUEUE)
+  gsize rx_queue;
+};
+
+// Lo que la línea le hizo a los bytes que recibió un extremo
+struct SerialSimStats {
+  // Bytes perdidos por `drop_rate`
+  guint64 dropped;
+  // Bytes con al menos un bit invertido
+  guint64 corrupted;
+  // Bytes perdidos porque la cola de entrada estaba llena
+  guint64 overruns;
+};
+
+// Abre los dos extremos de un par simulado, a 115200 baudios, 8N1 y sin control de flujo. Los punteros deben ser
+// NULL. La configuración se copia; con NULL, la línea es perfecta y sin retraso. Retorna FALSE con errno en EINVAL
+// si la configuración no es válida.
+gboolean open_serial_sim_pair(const struct AbstractSerialDevice **,
+                              const struct AbstractSerialDevice **,
+                              const struct SerialSimConfig *);
+
+// Copia los contadores de errores del extremo. Retorna FALSE si el puerto no es simulado.
+gboolean get_serial_sim_stats(const struct AbstractSerialDevice **, struct SerialSimStats *);
+#endif // ABSERIO_SIM_H
@@ -0,0 +1,799 @@
+//===-- lib/abserio/sim_alloc.c - Par de puertos simulados ------------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Este bloque de código no depende de la plataforma. Cada dirección del par es una `SimLine`: un anillo con los bytes
+/// en camino y su fecha de llegada, y otro con la cola de entrada del receptor. Nadie mueve los bytes de un anillo al
+/// otro en segundo plano: cada operación sobre la línea primero pasa a la cola de entrada lo que ya llegó
+/// (`line_settle`). Quien espera (lectura, cola de salida llena, `drain_output`) duerme en la condición de la línea
+/// hasta la siguiente fecha de llegada o hasta que otra operación la cambie.
+///
+/// El tiempo de un byte se calcula igual que en los drivers reales: a partir del momento en que la línea queda en
+/// silencio, no de cuando se escribió. Las pausas de `write_frame` se agregan al calendario de la línea en lugar de
+/// dormir, así que se cumplen con exactitud.
+///
+/// Las funciones son `static`: los nombres globales (`read_buffer`, etc.) son los del driver de la plataforma.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#define G_LOG_DOMAIN                    "SimAbSerIO"
+#include "sim.h"
+#include "trace.h"
+#include <errno.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <string.h>
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Estructuras de datos
+//===--------------------------------------------------------------------------------------------------------------===//
+// Una dirección del par
+struct SimLine {
+  GMutex lock;
+  // Se transmite cada vez que cambia algo de la línea: bytes nuevos, bytes leídos, cancelaciones y cierres
+  GCond changed;
+  struct SerialSimConfig config;
+  GRand *rand;
+  // Bytes en camino y su fecha de llegada (ns)
+  guint8 *flight;
+  gint64 *arrival;
+  gsize flight_capacity;
+  gsize flight_head;
+  gsize flight_count;
+  // Cola de entrada del receptor
+  guint8 *rx;
+  gsize rx_capacity;
+  gsize rx_head;
+  gsize rx_count;
+  // Momento en que la línea termina de transmitir lo que tiene, y llegada del último byte
+  gint64 idle_ns;
+  gint64 last_arrival_ns;
+  // Contadores de `get_serial_sim_stats` (del receptor)
+  guint64 dropped;
+  guint64 corrupted;
+  guint64 overruns;
+  gboolean sender_closed;
+  gboolean receiver_closed;
+};
+
+struct SimPair {
+  struct SimLine lines[2];
+  // Extremos que siguen abiertos; el último en cerrarse libera el par
+  atomic_int refs;
+};
+
+// Estructura de datos interna de un extremo
+struct InternalRepresentation {
+  struct SimPair *pair;
+  // Línea por la que escribe este extremo y línea por la que recibe
+  struct SimLine *tx;
+  struct SimLine *rx;
+  GMutex write_lock;
+  GMutex access_lock;
+  volatile atomic_bool open;
+  // `cancel_read` pendiente
+  volatile atomic_bool cancel;
+  // Configuración de la línea. Se protege con `access_lock`
+  glong baud_rate;
+  gboolean parity;
+  gboolean parity_odd;
+  gboolean software_flow;
+  volatile atomic_bool hardware_flow;
+  // Cuántas veces se ha llamado a `flush_output`. Una trama de `write_frame` que ve cambiar la cuenta se interrumpe
+  atomic_uint flush_count;
+  atomic_uint_fast64_t rx_bytes;
+  atomic_uint_fast64_t tx_bytes;
+  atomic_uint_fast64_t tx_wait_ns;
+  atomic_uint_fast64_t flow_blocked_ns;
+  // Pausas de `write_frame` y sus estadísticas. Se protegen con `write_lock`
+  struct SerialPacing pacing;
+  struct SerialPacingStats pacing_stats;
+  // La última trama de `write_frame` quedó a medias por el control de flujo; la siguiente llamada es su continuación
+  gboolean frame_stalled;
+  gdouble late_m2;
+};
+
+#define IR(x)                           ((struct InternalRepresentation *) (x))
+#define INT_INFO(x)                     IR((x)->_internal_info)
+#define WRITE_LOCK                      &INT_INFO(*dev)->write_lock
+#define ACCESS_LOCK                     &INT_INFO(*dev)->access_lock
+#define NSEC_PER_SEC                    1000000000LL
+// Los puntos de traza de un puerto simulado no tienen descriptor
+#define SIM_FD                          (-1)
+// Máximo que `write_frame` espera a que la cola de salida acepte un byte
+#define PACING_WRITE_TIMEOUT_MS         1000
+
+// Las constantes de `abserio.h` y su baud rate. En Windows son el mismo número; en Linux no (p.e. B115200 es 0x1002).
+// Cualquier otro valor se toma como el baud rate en bits por segundo
+static const struct {
+  glong constant;
+  glong bps;
+} BAUD_TABLE[] = {{STD_BAUD_110, 110}, {STD_BAUD_300, 300}, {STD_BAUD_600, 600}, {STD_BAUD_1200, 1200},
+                  {STD_BAUD_2400, 2400}, {STD_BAUD_4800, 4800}, {STD_BAUD_9600, 9600}, {STD_BAUD_19200, 19200},
+                  {STD_BAUD_38400, 38400}, {STD_BAUD_57600, 57600}, {STD_BAUD_115200, 115200}};
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                   Funciones extra
+//===--------------------------------------------------------------------------------------------------------------===//
+// El mismo reloj que usa `g_cond_wait_until`
+static gint64 monotonic_ns(void) {
+  return g_get_monotonic_time()*1000;
+}
+
+// Espera en la condición de la línea hasta la fecha dada (ns), o sin límite si es G_MAXINT64
+static void line_wait_until(struct SimLine *line, gint64 deadline) {
+  if (deadline==G_MAXINT64) {
+    g_cond_wait(&line->changed, &line->lock);
+  } else {
+    g_cond_wait_until(&line->changed, &line->lock, (deadline + 999)/1000);
+  }
+}
+
+// Pasa a la cola de entrada los bytes que ya llegaron. Se llama con el mutex de la línea
+static void line_settle(struct SimLine *line, gint64 now) {
+  while (line->flight_count > 0 && line->arrival[line->flight_head] <= now) {
+    guint8 byte = line->flight[line->flight_head];
+    line->flight_head = (line->flight_head + 1)%line->flight_capacity;
+    line->flight_count--;
+    if (line->rx_count==line->rx_capacity) {
+      line->overruns++;
+      continue;
+    }
+    line->rx[(line->rx_head + line->rx_count)%line->rx_capacity] = byte;
+    line->rx_count++;
+  }
+}
+
+// Bytes que acepta la línea ahora. Con control de flujo, lo que está en camino tiene que caber en la cola de entrada
+static gsize line_space(const struct SimLine *line, gboolean hardware_flow) {
+  gsize space = line->flight_capacity - line->flight_count;
+  if (hardware_flow) {
+    gsize pending = line->rx_count + line->flight_count;
+    space = MIN(space, pending < line->rx_capacity ? line->rx_capacity - pending : 0);
+  }
+  return space;
+}
+
+// Pone en camino hasta `size` bytes que empiezan a salir en `start` (o cuando la línea quede en silencio). Aplica
+// las pérdidas, los bits invertidos y el retraso. Se llama con el mutex de la línea; devuelve los bytes aceptados
+static gsize line_push(struct SimLine *line,
+                       const guchar *buffer,
+                       gsize size,
+                       gint64 start,
+                       gint64 char_ns,
+                       gboolean hardware_flow) {
+  size = MIN(size, line_space(line, hardware_flow));
+  if (size==0) {
+    return 0;
+  }
+  const struct SerialSimConfig *config = &line->config;
+  start = MAX(start, line->idle_ns);
+  gint64 delay = (gint64) config->latency_us*1000;
+  if (config->jitter_us > 0) {
+    delay += (gint64) g_rand_int_range(line->rand, 0, (gint32) MIN(config->jitter_us, G_MAXINT32 - 1) + 1)*1000;
+  }
+  for (gsize i = 0; i < size; i++) {
+    // El byte ocupa la línea aunque se pierda
+    gint64 sent = start + (gint64) (i + 1)*char_ns;
+    if (config->drop_rate > 0.0 && g_rand_double(line->rand) < config->drop_rate) {
+      line->dropped++;
+      continue;
+    }
+    guint8 byte = buffer[i];
+    if (config->bit_error_rate > 0.0) {
+      guint8 flips = 0;
+      for (guint bit = 0; bit < 8; bit++) {
+        if (g_rand_double(line->rand) < config->bit_error_rate) {
+          flips |= (guint8) (1u << bit);
+        }
+      }
+      if (flips!=0) {
+        byte ^= flips;
+        line->corrupted++;
+      }
+    }
+    gsize slot = (line->flight_head + line->flight_count)%line->flight_capacity;
+    line->flight[slot] = byte;
+    // Un retraso sorteado más corto no adelanta a los bytes anteriores
+    line->last_arrival_ns = MAX(line->last_arrival_ns, sent + delay);
+    line->arrival[slot] = line->last_arrival_ns;
+    line->flight_count++;
+  }
+  line->idle_ns = start + (gint64) size*char_ns;
+  g_cond_broadcast(&line->changed);
+  return size;
+}
+
+// Copia hasta `size` bytes de la cola de entrada. Se llama con el mutex de la línea
+static gsize line_pop(struct SimLine *line, guchar *buffer, gsize size) {
+  gsize n = MIN(size, line->rx_count);
+  gsize first = MIN(n, line->rx_capacity - line->rx_head);
+  memcpy(buffer, line->rx + line->rx_head, first);
+  memcpy(buffer + first, line->rx, n - first);
+  line->rx_head = (line->rx_head + n)%line->rx_capacity;
+  line->rx_count -= n;
+  if (n > 0) {
+    // Con control de flujo, el emisor puede estar esperando espacio
+    g_cond_broadcast(&line->changed);
+  }
+  return n;
+}
+
+static void line_init(struct SimLine *line, const struct SerialSimConfig *config, guint32 seed) {
+  g_mutex_init(&line->lock);
+  g_cond_init(&line->changed);
+  line->config = *config;
+  line->rand = g_rand_new_with_seed(seed);
+  line->flight_capacity = config->tx_queue > 0 ? config->tx_queue : SERIAL_SIM_DEFAULT_QUEUE;
+  line->flight = g_malloc(line->flight_capacity);
+  line->arrival = g_new(gint64, line->flight_capacity);
+  line->rx_capacity = config->rx_queue > 0 ? config->rx_queue : SERIAL_SIM_DEFAULT_QUEUE;
+  line->rx = g_malloc(line->rx_capacity);
+}
+
+static void line_clear(struct SimLine *line) {
+  g_mutex_clear(&line->lock);
+  g_cond_clear(&line->changed);
+  g_rand_free(line->rand);
+  g_free(line->flight);
+  g_free(line->arrival);
+  g_free(line->rx);
+}
+
+// Despierta a todos los que esperan en la línea después de cambiar una bandera
+static void line_signal(struct SimLine *line, gboolean *flag) {
+  g_mutex_lock(&line->lock);
+  if (flag!=NULL) {
+    *flag = TRUE;
+  }
+  g_cond_broadcast(&line->changed);
+  g_mutex_unlock(&line->lock);
+}
+
+static glong baud_to_bps(glong baud_rate) {
+  for (gsize i = 0; i < G_N_ELEMENTS(BAUD_TABLE); i++) {
+    if (BAUD_TABLE[i].constant==baud_rate) {
+      return BAUD_TABLE[i].bps;
+    }
+  }
+  return baud_rate;
+}
+
+// Acumula el retraso de una escritura programada (algoritmo de Welford para el promedio y la varianza)
+static void record_lateness(struct InternalRepresentation *ir, gint64 late) {
+  struct SerialPacingStats *stats = &ir->pacing_stats;
+  stats->gaps++;
+  if (stats->gaps==1 || late < stats->min_late_ns) {
+    stats->min_late_ns = late;
+  }
+  if (stats->gaps==1 || late > stats->max_late_ns) {
+    stats->max_late_ns = late;
+  }
+  gdouble delta = late - stats->mean_late_ns;
+  stats->mean_late_ns += delta/stats->gaps;
+  ir->late_m2 += delta*(late - stats->mean_late_ns);
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                           Implementación de la interfaz
+//===--------------------------------------------------------------------------------------------------------------===//
+static gboolean sim_set_baud_rate(glong baud_rate, const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  if (baud_to_bps(baud_rate) <= 0) {
+    errno = EINVAL;
+    return FALSE;
+  }
+  g_mutex_lock(ACCESS_LOCK);
+  INT_INFO(*dev)->baud_rate = baud_rate;
+  g_mutex_unlock(ACCESS_LOCK);
+  return TRUE;
+}
+
+static glong sim_get_baud_rate(const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  g_mutex_lock(ACCESS_LOCK);
+  glong baud_rate = INT_INFO(*dev)->baud_rate;
+  g_mutex_unlock(ACCESS_LOCK);
+  return baud_rate;
+}
+
+static gboolean sim_set_parity_bit(gboolean bit_enable, gboolean odd_neven, const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  g_mutex_lock(ACCESS_LOCK);
+  INT_INFO(*dev)->parity = bit_enable;
+  INT_INFO(*dev)->parity_odd = odd_neven;
+  g_mutex_unlock(ACCESS_LOCK);
+  return TRUE;
+}
+
+static gboolean sim_get_parity_bit(const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  g_mutex_lock(ACCESS_LOCK);
+  gboolean parity = INT_INFO(*dev)->parity;
+  g_mutex_unlock(ACCESS_LOCK);
+  return parity;
+}
+
+static gboolean sim_get_parity_odd_neven(const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  g_mutex_lock(ACCESS_LOCK);
+  gboolean odd = INT_INFO(*dev)->parity_odd;
+  g_mutex_unlock(ACCESS_LOCK);
+  return odd;
+}
+
+static gboolean sim_set_software_control_flow(gboolean bit_enable, const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  // Se guarda para `get_software_control_flow`; la línea simulada no interpreta XON/XOFF
+  g_mutex_lock(ACCESS_LOCK);
+  INT_INFO(*dev)->software_flow = bit_enable;
+  g_mutex_unlock(ACCESS_LOCK);
+  return TRUE;
+}
+
+static gboolean sim_get_software_control_flow(const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  g_mutex_lock(ACCESS_LOCK);
+  gboolean software_flow = INT_INFO(*dev)->software_flow;
+  g_mutex_unlock(ACCESS_LOCK);
+  return software_flow;
+}
+
+static gboolean sim_set_hardware_control_flow(gboolean bit_enable, const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  atomic_store(&INT_INFO(*dev)->hardware_flow, bit_enable);
+  // Quien espera espacio en la cola de salida tiene que volver a calcularlo
+  line_signal(INT_INFO(*dev)->tx, NULL);
+  return TRUE;
+}
+
+static gboolean sim_get_hardware_control_flow(const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  return atomic_load(&INT_INFO(*dev)->hardware_flow);
+}
+
+static glong sim_get_line_rate(const struct AbstractSerialDevice **cdev) {
+  return baud_to_bps(sim_get_baud_rate(cdev));
+}
+
+static guint sim_get_frame_bits(const struct AbstractSerialDevice **cdev) {
+  // Bit de inicio + 8 bits de datos + pariedad + un bit de parada
+  return 1 + 8 + (sim_get_parity_bit(cdev) ? 1 : 0) + 1;
+}
+
+// Duración de un carácter con la configuración actual del extremo
+static gint64 char_time_ns(const struct AbstractSerialDevice **cdev) {
+  return (gint64) sim_get_frame_bits(cdev)*NSEC_PER_SEC/sim_get_line_rate(cdev);
+}
+
+// `write_buffer` sin el mutex de escritura ni los puntos de traza. La línea empieza a transmitir en `start`
+static gssize push_bytes(const guchar *buffer, gsize size, gint64 start, struct AbstractSerialDevice **dev) {
+  struct InternalRepresentation *ir = INT_INFO(*dev);
+  gint64 char_ns = char_time_ns((const struct AbstractSerialDevice **) dev);
+  g_mutex_lock(&ir->tx->lock);
+  if (ir->tx->receiver_closed) {
+    g_mutex_unlock(&ir->tx->lock);
+    errno = EIO;
+    return -1;
+  }
+  gint64 now = monotonic_ns();
+  line_settle(ir->tx, now);
+  gsize n = line_push(ir->tx, buffer, size, MAX(start, now), char_ns, atomic_load(&ir->hardware_flow));
+  g_mutex_unlock(&ir->tx->lock);
+  if (n==0 && size > 0) {
+    errno = EAGAIN;
+    return -1;
+  }
+  atomic_fetch_add_explicit(&ir->tx_bytes, (uint_fast64_t) n, memory_order_relaxed);
+  return (gssize) n;
+}
+
+static gssize sim_write_buffer(const guchar *buffer, gsize size, const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  SERIAL_TRACE(SERIAL_TRACE_WRITE_BEGIN, SIM_FD, size, 0);
+  guint32 lock_wait = 0;
+  SERIAL_TRACE_LOCK(WRITE_LOCK, lock_wait);
+  gssize n = push_bytes(buffer, size, 0, dev);
+  g_mutex_unlock(WRITE_LOCK);
+  SERIAL_TRACE(SERIAL_TRACE_WRITE_END, SIM_FD, MAX(n, 0), lock_wait);
+  return n;
+}
+
+static gboolean sim_wait_writable(gint timeout, const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  struct InternalRepresentation *ir = INT_INFO(*dev);
+  struct SimLine *line = ir->tx;
+  SERIAL_TRACE(SERIAL_TRACE_WAIT_WRITABLE_BEGIN, SIM_FD, 0, 0);
+  gint64 start = monotonic_ns();
+  gint64 deadline = timeout < 0 ? G_MAXINT64 : start + (gint64) timeout*1000000;
+  gboolean writable = FALSE;
+  gboolean blocked = FALSE;
+  g_mutex_lock(&line->lock);
+  while (TRUE) {
+    gint64 now = monotonic_ns();
+    line_settle(line, now);
+    gboolean hardware_flow = atomic_load(&ir->hardware_flow);
+    // Una línea sin receptor "acepta" bytes para que la escritura falle con EIO
+    if (line->receiver_closed || line_space(line, hardware_flow) > 0) {
+      writable = TRUE;
+      break;
+    }
+    if (now >= deadline) {
+      break;
+    }
+    // La cola de salida llena se vacía sola con el tiempo; la de entrada solamente si el receptor lee
+    blocked = hardware_flow && line->flight_count < line->flight_capacity;
+    gint64 wake = blocked ? deadline : MIN(deadline, line->arrival[line->flight_head]);
+    line_wait_until(line, wake);
+  }
+  g_mutex_unlock(&line->lock);
+  guint64 waited = (guint64) (monotonic_ns() - start);
+  SERIAL_TRACE(SERIAL_TRACE_WAIT_WRITABLE_END, SIM_FD, 0, 0);
+  atomic_fetch_add_explicit(&ir->tx_wait_ns, waited, memory_order_relaxed);
+  if (blocked) {
+    atomic_fetch_add_explicit(&ir->flow_blocked_ns, waited, memory_order_relaxed);
+  }
+  return writable;
+}
+
+static gboolean sim_write_byte(gchar byte, const struct AbstractSerialDevice **cdev) {
+  guchar one_byte = (guchar) byte;
+  // Igual que con un puerto real sin bloqueo, una cola llena se espera en lugar de fallar
+  gssize n;
+  while ((n = sim_write_buffer(&one_byte, 1, cdev))==-1 && errno==EAGAIN) {
+    sim_wait_writable(-1, cdev);
+  }
+  if (n==1) {
+    return TRUE;
+  }
+  g_critical("Returning with an invalid number of bytes sent. Expected %d, sent %d", 1, (int) n);
+  g_critical("Message: \'%s\'", g_strerror(errno));
+  return FALSE;
+}
+
+static gboolean sim_drain_output(const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  struct SimLine *line = INT_INFO(*dev)->tx;
+  g_mutex_lock(&line->lock);
+  while (line->idle_ns > monotonic_ns() && !line->receiver_closed) {
+    line_wait_until(line, line->idle_ns);
+  }
+  g_mutex_unlock(&line->lock);
+  return TRUE;
+}
+
+static gboolean sim_flush_output(const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  struct SimLine *line = INT_INFO(*dev)->tx;
+  atomic_fetch_add(&INT_INFO(*dev)->flush_count, 1);
+  g_mutex_lock(&line->lock);
+  // Lo que ya llegó se queda en la cola de entrada; lo que sigue en camino se pierde y la línea queda en silencio
+  gint64 now = monotonic_ns();
+  line_settle(line, now);
+  line->flight_count = 0;
+  line->idle_ns = MIN(line->idle_ns, now);
+  g_cond_broadcast(&line->changed);
+  g_mutex_unlock(&line->lock);
+  return TRUE;
+}
+
+static gboolean sim_set_pacing(const struct SerialPacing *pacing, const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  if (!(pacing->inter_byte >= 0.0) || !(pacing->inter_frame >= 0.0)) {
+    errno = EINVAL;
+    return FALSE;
+  }
+  g_mutex_lock(WRITE_LOCK);
+  INT_INFO(*dev)->pacing = *pacing;
+  INT_INFO(*dev)->pacing_stats = (struct SerialPacingStats) {0};
+  INT_INFO(*dev)->late_m2 = 0.0;
+  INT_INFO(*dev)->frame_stalled = FALSE;
+  g_mutex_unlock(WRITE_LOCK);
+  return TRUE;
+}
+
+static void sim_get_pacing(struct SerialPacing *pacing, const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  g_mutex_lock(WRITE_LOCK);
+  *pacing = INT_INFO(*dev)->pacing;
+  g_mutex_unlock(WRITE_LOCK);
+}
+
+static gssize sim_write_frame(const guchar *buffer, gsize size, const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  gint64 char_ns = char_time_ns(cdev);
+  SERIAL_TRACE(SERIAL_TRACE_FRAME_BEGIN, SIM_FD, size, 0);
+  // Antes de esperar a otra trama: un `flush_output` desde aquí también descarta esta
+  guint flushes = atomic_load(&INT_INFO(*dev)->flush_count);
+  guint32 lock_wait = 0;
+  SERIAL_TRACE_LOCK(WRITE_LOCK, lock_wait);
+  struct InternalRepresentation *ir = INT_INFO(*dev);
+  ir->pacing_stats.char_time_ns = char_ns;
+  gint64 byte_gap = (gint64) (ir->pacing.inter_byte*char_ns);
+  gint64 frame_gap = (gint64) (ir->pacing.inter_frame*char_ns);
+  gboolean paced = byte_gap > 0 || frame_gap > 0;
+  g_mutex_lock(&ir->tx->lock);
+  // El resto de una trama detenida por el control de flujo no es una trama nueva: lleva la pausa entre bytes
+  gint64 deadline = ir->tx->idle_ns + (ir->frame_stalled ? byte_gap : frame_gap);
+  g_mutex_unlock(&ir->tx->lock);
+  gsize sent = 0;
+  while (sent < size) {
+    if (atomic_load(&ir->flush_count)!=flushes) {
+      errno = ECANCELED;
+      break;
+    }
+    // La pausa va en el calendario de la línea: el byte sale exactamente en la fecha límite
+    if (paced && deadline > monotonic_ns()) {
+      record_lateness(ir, 0);
+    }
+    gsize chunk = byte_gap > 0 ? 1 : size - sent;
+    gssize n = push_bytes(buffer + sent, chunk, paced ? deadline : 0, dev);
+    if (n==-1) {
+      if (errno==EAGAIN && sim_wait_writable(PACING_WRITE_TIMEOUT_MS, cdev)) {
+        continue;
+      }
+      if (errno==EAGAIN && !atomic_load(&ir->hardware_flow)) {
+        errno = ETIMEDOUT;
+      }
+      break;
+    }
+    sent += (gsize) n;
+    g_mutex_lock(&ir->tx->lock);
+    deadline = ir->tx->idle_ns + byte_gap;
+    g_mutex_unlock(&ir->tx->lock);
+  }
+  ir->frame_stalled = sent < size && errno==EAGAIN;
+  g_mutex_unlock(WRITE_LOCK);
+  SERIAL_TRACE(SERIAL_TRACE_FRAME_END, SIM_FD, sent, lock_wait);
+  if (sent < size && errno==EAGAIN) {
+    // El otro extremo detuvo el flujo: no es un error, es contrapresión
+    SERIAL_TRACE(SERIAL_TRACE_FRAME_STALLED, SIM_FD, sent, 0);
+    return (gssize) sent;
+  }
+  if (sent < size && errno==ECANCELED) {
+    // Lo pidió quien llamó a `flush_output`: no es un error del puerto
+    return -1;
+  }
+  if (sent < size) {
+    g_critical("Frame interrupted after %" G_GSIZE_FORMAT " of %" G_GSIZE_FORMAT " bytes.", sent, size);
+    g_critical("Message: \'%s\'", g_strerror(errno));
+    return -1;
+  }
+  return (gssize) sent;
+}
+
+static void sim_get_pacing_stats(struct SerialPacingStats *stats, const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  g_mutex_lock(WRITE_LOCK);
+  *stats = INT_INFO(*dev)->pacing_stats;
+  stats->jitter_ns = stats->gaps > 1 ? sqrt(INT_INFO(*dev)->late_m2/(stats->gaps - 1)) : 0.0;
+  g_mutex_unlock(WRITE_LOCK);
+}
+
+// `read_buffer` sin los puntos de traza
+static gssize wait_and_read(guchar *buffer, gsize size, struct AbstractSerialDevice **dev) {
+  struct InternalRepresentation *ir = INT_INFO(*dev);
+  struct SimLine *line = ir->rx;
+  g_mutex_lock(&line->lock);
+  while (TRUE) {
+    if (atomic_exchange(&ir->cancel, FALSE) || !atomic_load(&ir->open)) {
+      g_mutex_unlock(&line->lock);
+      SERIAL_TRACE(SERIAL_TRACE_READ_CANCELLED, SIM_FD, 0, 0);
+      errno = ECANCELED;
+      return -1;
+    }
+    line_settle(line, monotonic_ns());
+    if (line->rx_count > 0) {
+      gsize n = line_pop(line, buffer, size);
+      g_mutex_unlock(&line->lock);
+      atomic_fetch_add_explicit(&ir->rx_bytes, (uint_fast64_t) n, memory_order_relaxed);
+      return (gssize) n;
+    }
+    if (line->flight_count==0 && line->sender_closed) {
+      // El otro extremo se cerró y ya no queda nada en camino
+      g_mutex_unlock(&line->lock);
+      errno = EIO;
+      return -1;
+    }
+    line_wait_until(line, line->flight_count > 0 ? line->arrival[line->flight_head] : G_MAXINT64);
+  }
+}
+
+static gssize sim_read_buffer(guchar *buffer, gsize size, const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  SERIAL_TRACE(SERIAL_TRACE_READ_BEGIN, SIM_FD, size, 0);
+  gssize r = wait_and_read(buffer, size, dev);
+  SERIAL_TRACE(SERIAL_TRACE_READ_END, SIM_FD, MAX(r, 0), 0);
+  return r;
+}
+
+static gssize sim_read_available(guchar *buffer, gsize size, const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  struct SimLine *line = INT_INFO(*dev)->rx;
+  g_mutex_lock(&line->lock);
+  line_settle(line, monotonic_ns());
+  gsize n = line_pop(line, buffer, size);
+  gboolean hung_up = n==0 && line->flight_count==0 && line->sender_closed;
+  g_mutex_unlock(&line->lock);
+  if (n > 0) {
+    atomic_fetch_add_explicit(&INT_INFO(*dev)->rx_bytes, (uint_fast64_t) n, memory_order_relaxed);
+    SERIAL_TRACE(SERIAL_TRACE_READ_AVAILABLE, SIM_FD, n, 0);
+  }
+  if (hung_up) {
+    errno = EIO;
+    return -1;
+  }
+  return (gssize) n;
+}
+
+static char sim_read_byte(const struct AbstractSerialDevice **cdev) {
+  guchar one_byte;
+  if (sim_read_buffer(&one_byte, 1, cdev)==1) {
+    return (char) one_byte;
+  }
+  return (char) -1;
+}
+
+static void sim_cancel_read(const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  atomic_store(&INT_INFO(*dev)->cancel, TRUE);
+  line_signal(INT_INFO(*dev)->rx, NULL);
+}
+
+static void sim_get_stats(struct SerialStats *stats, const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  stats->rx_bytes = atomic_load_explicit(&INT_INFO(*dev)->rx_bytes, memory_order_relaxed);
+  stats->tx_bytes = atomic_load_explicit(&INT_INFO(*dev)->tx_bytes, memory_order_relaxed);
+  stats->tx_wait_ns = atomic_load_explicit(&INT_INFO(*dev)->tx_wait_ns, memory_order_relaxed);
+  stats->flow_blocked_ns = atomic_load_explicit(&INT_INFO(*dev)->flow_blocked_ns, memory_order_relaxed);
+}
+
+static gint sim_get_native_fd(const struct AbstractSerialDevice **cdev) {
+  return -1;
+}
+
+static void sim_add_stats(const struct SerialStats *stats, const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  atomic_fetch_add_explicit(&INT_INFO(*dev)->rx_bytes, stats->rx_bytes, memory_order_relaxed);
+  atomic_fetch_add_explicit(&INT_INFO(*dev)->tx_bytes, stats->tx_bytes, memory_order_relaxed);
+  atomic_fetch_add_explicit(&INT_INFO(*dev)->tx_wait_ns, stats->tx_wait_ns, memory_order_relaxed);
+  atomic_fetch_add_explicit(&INT_INFO(*dev)->flow_blocked_ns, stats->flow_blocked_ns, memory_order_relaxed);
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                          Funciones de control del puerto
+//===--------------------------------------------------------------------------------------------------------------===//
+// Cierre del extremo (`_close`); `close_serial_port` ya detuvo el hilo lector
+static void sim_close(struct AbstractSerialDevice **dev) {
+  struct InternalRepresentation *ir = INT_INFO(*dev);
+  atomic_store(&ir->open, FALSE);
+  // El otro extremo ve el cierre: sus lecturas terminan con EIO y sus escrituras fallan
+  line_signal(ir->tx, &ir->tx->sender_closed);
+  line_signal(ir->rx, &ir->rx->receiver_closed);
+  // Nadie más puede estar escribiendo desde este extremo
+  g_mutex_lock(WRITE_LOCK);
+  g_mutex_unlock(WRITE_LOCK);
+  if (atomic_fetch_sub(&ir->pair->refs, 1)==1) {
+    line_clear(&ir->pair->lines[0]);
+    line_clear(&ir->pair->lines[1]);
+    g_free(ir->pair);
+    g_debug("Both ends of the simulated pair closed. The pair will be freed.");
+  }
+  g_mutex_clear(ACCESS_LOCK);
+  g_mutex_clear(WRITE_LOCK);
+  g_free(ir);
+  g_free(*dev);
+  *dev = NULL;
+}
+
+static void sim_open_end(struct AbstractSerialDevice **dev, struct SimPair *pair, guint index) {
+  *dev = g_new0(struct AbstractSerialDevice, 1);
+  struct InternalRepresentation *ir = g_new0(struct InternalRepresentation, 1);
+  (*dev)->_internal_info = ir;
+  (*dev)->_listener = NULL;
+  (*dev)->_close = sim_close;
+  ir->pair = pair;
+  ir->tx = &pair->lines[index];
+  ir->rx = &pair->lines[1 - index];
+  g_mutex_init(ACCESS_LOCK);
+  g_mutex_init(WRITE_LOCK);
+  atomic_init(&ir->open, TRUE);
+  atomic_init(&ir->cancel, FALSE);
+  atomic_init(&ir->hardware_flow, FALSE);
+  atomic_init(&ir->flush_count, 0);
+  atomic_init(&ir->rx_bytes, 0);
+  atomic_init(&ir->tx_bytes, 0);
+  atomic_init(&ir->tx_wait_ns, 0);
+  atomic_init(&ir->flow_blocked_ns, 0);
+  ir->baud_rate = STD_BAUD_115200;
+
+  // Configura las funciones del driver
+  (*dev)->set_baud_rate = sim_set_baud_rate;
+  (*dev)->get_baud_rate = sim_get_baud_rate;
+  (*dev)->set_parity_bit = sim_set_parity_bit;
+  (*dev)->get_parity_bit = sim_get_parity_bit;
+  (*dev)->get_parity_odd_neven = sim_get_parity_odd_neven;
+  (*dev)->set_software_control_flow = sim_set_software_control_flow;
+  (*dev)->get_software_control_flow = sim_get_software_control_flow;
+  (*dev)->set_hardware_control_flow = sim_set_hardware_control_flow;
+  (*dev)->get_hardware_control_flow = sim_get_hardware_control_flow;
+  (*dev)->write_byte = sim_write_byte;
+  (*dev)->read_byte = sim_read_byte;
+  (*dev)->read_buffer = sim_read_buffer;
+  (*dev)->read_available = sim_read_available;
+  (*dev)->cancel_read = sim_cancel_read;
+  (*dev)->get_stats = sim_get_stats;
+  (*dev)->write_buffer = sim_write_buffer;
+  (*dev)->wait_writable = sim_wait_writable;
+  (*dev)->drain_output = sim_drain_output;
+  (*dev)->flush_output = sim_flush_output;
+  (*dev)->get_line_rate = sim_get_line_rate;
+  (*dev)->get_frame_bits = sim_get_frame_bits;
+  (*dev)->set_pacing = sim_set_pacing;
+  (*dev)->get_pacing = sim_get_pacing;
+  (*dev)->write_frame = sim_write_frame;
+  (*dev)->get_pacing_stats = sim_get_pacing_stats;
+  (*dev)->get_native_fd = sim_get_native_fd;
+  (*dev)->add_stats = sim_add_stats;
+}
+
+gboolean open_serial_sim_pair(const struct AbstractSerialDevice **cdev_a,
+                              const struct AbstractSerialDevice **cdev_b,
+                              const struct SerialSimConfig *config) {
+  struct AbstractSerialDevice **dev_a = (struct AbstractSerialDevice **) cdev_a;
+  struct AbstractSerialDevice **dev_b = (struct AbstractSerialDevice **) cdev_b;
+  if (dev_a==NULL || *dev_a!=NULL || dev_b==NULL || *dev_b!=NULL) {
+    // Si no es NULL, podemos estar cayendo encima de un driver reservado que ya no se podrá liberar.
+    g_error("Trying to allocate a driver in a pointer which is not NULL. This is considered a bug.");
+    return FALSE;
+  }
+  struct SerialSimConfig perfect = {0};
+  if (config==NULL) {
+    config = &perfect;
+  }
+  if (!(config->drop_rate >= 0.0 && config->drop_rate <= 1.0)
+      || !(config->bit_error_rate >= 0.0 && config->bit_error_rate <= 1.0)) {
+    errno = EINVAL;
+    return FALSE;
+  }
+  struct SimPair *pair = g_new0(struct SimPair, 1);
+  // Semillas distintas por dirección para que las dos no pierdan los mismos bytes
+  line_init(&pair->lines[0], config, config->seed*2);
+  line_init(&pair->lines[1], config, config->seed*2 + 1);
+  atomic_init(&pair->refs, 2);
+  sim_open_end(dev_a, pair, 0);
+  sim_open_end(dev_b, pair, 1);
+  g_debug("Simulated pair created (latency %u us, jitter %u us, drop rate %g, bit error rate %g, seed %u).",
+          config->latency_us,
+          config->jitter_us,
+          config->drop_rate,
+          config->bit_error_rate,
+          config->seed);
+  return TRUE;
+}
+
+gboolean get_serial_sim_stats(const struct AbstractSerialDevice **cdev, struct SerialSimStats *stats) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  if (dev==NULL || *dev==NULL || (*dev)->_close!=sim_close) {
+    return FALSE;
+  }
+  struct SimLine *line = INT_INFO(*dev)->rx;
+  g_mutex_lock(&line->lock);
+  line_settle(line, monotonic_ns());
+  stats->dropped = line->dropped;
+  stats->corrupted = line->corrupted;
+  stats->overruns = line->overruns;
+  g_mutex_unlock(&line->lock);
+  return TRUE;
+}
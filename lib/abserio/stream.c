@@ -0,0 +1,262 @@
+//===-- lib/abserio/stream.c - Reparto de lo recibido a varios suscriptores ------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// El bloque y sus bytes se reservan juntos, y el `GBytes` es el dueño de esa memoria: las referencias del bloque son
+/// las del `GBytes`, así que hay un solo contador para las dos cosas.
+///
+/// La lista de suscriptores se protege con un candado de lectores y escritores: publicar solamente la lee, y
+/// suscribirse o cancelar (que casi nunca pasa) la modifica. La cola de cada suscriptor es un arreglo circular con su
+/// propio mutex; quien publica solamente despierta al suscriptor si está esperando, para no hacer una llamada al
+/// sistema por cada bloque.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#define G_LOG_DOMAIN                    "StreamAbSerIO"
+#include "stream.h"
+#include <string.h>
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Estructuras de datos
+//===--------------------------------------------------------------------------------------------------------------===//
+struct SerialStream {
+  GRWLock lock;
+  GPtrArray *subscribers;
+  // Solamente la toca quien publica
+  guint64 sequence;
+};
+
+struct SerialSubscription {
+  struct SerialStream *stream;
+  GMutex lock;
+  GCond cond;
+  // Cola circular: `count` bloques a partir de `head`
+  struct SerialChunk **ring;
+  guint capacity;
+  guint head;
+  guint count;
+  enum SerialOverflowPolicy overflow;
+  // El suscriptor está esperando en `cond`
+  gboolean waiting;
+  gboolean stop;
+  struct SerialSubscriptionStats stats;
+  // Solamente para las suscripciones con función
+  SerialChunkFunc func;
+  gpointer user_data;
+  GThread *thread;
+};
+
+// Un bloque y sus bytes, en una sola reserva
+struct StreamBlock {
+  struct SerialChunk chunk;
+  guchar data[];
+};
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                   Funciones extra
+//===--------------------------------------------------------------------------------------------------------------===//
+static struct SerialChunk *new_chunk(const guchar *data, gsize length, const struct SerialTimestamp *stamp,
+                                     guint64 sequence) {
+  struct StreamBlock *block = g_malloc(sizeof(struct StreamBlock) + length);
+  memcpy(block->data, data, length);
+  block->chunk.bytes = g_bytes_new_with_free_func(block->data, length, g_free, block);
+  block->chunk.stamp = *stamp;
+  block->chunk.sequence = sequence;
+  return &block->chunk;
+}
+
+// Agrega el bloque a la cola del suscriptor, descartando uno si está llena
+static void enqueue(struct SerialSubscription *subscription, struct SerialChunk *chunk) {
+  struct SerialChunk *dropped = NULL;
+  g_mutex_lock(&subscription->lock);
+  if (subscription->count==subscription->capacity) {
+    if (subscription->overflow==SERIAL_OVERFLOW_DROP_NEWEST) {
+      subscription->stats.dropped_chunks++;
+      subscription->stats.dropped_bytes += g_bytes_get_size(chunk->bytes);
+      g_mutex_unlock(&subscription->lock);
+      return;
+    }
+    dropped = subscription->ring[subscription->head];
+    subscription->head = (subscription->head + 1)%subscription->capacity;
+    subscription->count--;
+    subscription->stats.dropped_chunks++;
+    subscription->stats.dropped_bytes += g_bytes_get_size(dropped->bytes);
+  }
+  subscription->ring[(subscription->head + subscription->count)%subscription->capacity] = serial_chunk_ref(chunk);
+  subscription->count++;
+  subscription->stats.max_queued = MAX(subscription->stats.max_queued, subscription->count);
+  if (subscription->waiting) {
+    g_cond_signal(&subscription->cond);
+  }
+  g_mutex_unlock(&subscription->lock);
+  // Fuera del mutex: quizá era la última referencia y hay que liberar la memoria
+  if (dropped!=NULL) {
+    serial_chunk_unref(dropped);
+  }
+}
+
+static struct SerialSubscription *new_subscription(struct SerialStream *stream,
+                                                   guint capacity,
+                                                   enum SerialOverflowPolicy overflow) {
+  struct SerialSubscription *subscription = g_new0(struct SerialSubscription, 1);
+  subscription->stream = stream;
+  g_mutex_init(&subscription->lock);
+  g_cond_init(&subscription->cond);
+  subscription->capacity = MAX(capacity, 1);
+  subscription->ring = g_new(struct SerialChunk *, subscription->capacity);
+  subscription->overflow = overflow;
+  return subscription;
+}
+
+static void add_subscription(struct SerialStream *stream, struct SerialSubscription *subscription) {
+  g_rw_lock_writer_lock(&stream->lock);
+  g_ptr_array_add(stream->subscribers, subscription);
+  g_rw_lock_writer_unlock(&stream->lock);
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Hilos de ejecución
+//===--------------------------------------------------------------------------------------------------------------===//
+static gpointer subscription_thread(gpointer data) {
+  struct SerialSubscription *subscription = data;
+  struct SerialChunk *chunk;
+  // `serial_subscription_pop` devuelve NULL solamente cuando se cancela la suscripción y ya no queda nada en la cola
+  while ((chunk = serial_subscription_pop(subscription, -1))!=NULL) {
+    subscription->func(chunk, subscription->user_data);
+    serial_chunk_unref(chunk);
+  }
+  return NULL;
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                           Implementación de la interfaz
+//===--------------------------------------------------------------------------------------------------------------===//
+struct SerialStream *serial_stream_new(void) {
+  struct SerialStream *stream = g_new0(struct SerialStream, 1);
+  g_rw_lock_init(&stream->lock);
+  stream->subscribers = g_ptr_array_new();
+  return stream;
+}
+
+void serial_stream_publish(struct SerialStream *stream,
+                           const guchar *data,
+                           gsize length,
+                           const struct SerialTimestamp *stamp) {
+  guint64 sequence = stream->sequence++;
+  g_rw_lock_reader_lock(&stream->lock);
+  if (stream->subscribers->len==0) {
+    g_rw_lock_reader_unlock(&stream->lock);
+    return;
+  }
+  struct SerialChunk *chunk = new_chunk(data, length, stamp, sequence);
+  for (guint i = 0; i < stream->subscribers->len; i++) {
+    enqueue(g_ptr_array_index(stream->subscribers, i), chunk);
+  }
+  g_rw_lock_reader_unlock(&stream->lock);
+  // Cada cola tomó su propia referencia
+  serial_chunk_unref(chunk);
+}
+
+struct SerialSubscription *serial_stream_subscribe(struct SerialStream *stream,
+                                                   guint capacity,
+                                                   enum SerialOverflowPolicy overflow) {
+  struct SerialSubscription *subscription = new_subscription(stream, capacity, overflow);
+  add_subscription(stream, subscription);
+  return subscription;
+}
+
+struct SerialSubscription *serial_stream_subscribe_func(struct SerialStream *stream,
+                                                        guint capacity,
+                                                        enum SerialOverflowPolicy overflow,
+                                                        SerialChunkFunc func,
+                                                        gpointer user_data) {
+  struct SerialSubscription *subscription = new_subscription(stream, capacity, overflow);
+  subscription->func = func;
+  subscription->user_data = user_data;
+  subscription->thread = g_thread_new("abserio-subscriber", subscription_thread, subscription);
+  add_subscription(stream, subscription);
+  return subscription;
+}
+
+struct SerialChunk *serial_subscription_pop(struct SerialSubscription *subscription, gint64 timeout_us) {
+  gint64 deadline = timeout_us > 0 ? g_get_monotonic_time() + timeout_us : 0;
+  struct SerialChunk *chunk = NULL;
+  g_mutex_lock(&subscription->lock);
+  while (subscription->count==0 && !subscription->stop && timeout_us!=0) {
+    subscription->waiting = TRUE;
+    if (timeout_us < 0) {
+      g_cond_wait(&subscription->cond, &subscription->lock);
+    } else if (!g_cond_wait_until(&subscription->cond, &subscription->lock, deadline)) {
+      subscription->waiting = FALSE;
+      break;
+    }
+    subscription->waiting = FALSE;
+  }
+  if (subscription->count > 0) {
+    chunk = subscription->ring[subscription->head];
+    subscription->head = (subscription->head + 1)%subscription->capacity;
+    subscription->count--;
+    subscription->stats.delivered++;
+  }
+  g_mutex_unlock(&subscription->lock);
+  return chunk;
+}
+
+void serial_subscription_get_stats(struct SerialSubscription *subscription, struct SerialSubscriptionStats *stats) {
+  g_mutex_lock(&subscription->lock);
+  *stats = subscription->stats;
+  stats->queued = subscription->count;
+  g_mutex_unlock(&subscription->lock);
+}
+
+void serial_subscription_free(struct SerialSubscription *subscription) {
+  // Primero deja de recibir: después de esto nadie más toca la cola
+  struct SerialStream *stream = subscription->stream;
+  g_rw_lock_writer_lock(&stream->lock);
+  g_ptr_array_remove(stream->subscribers, subscription);
+  g_rw_lock_writer_unlock(&stream->lock);
+  if (subscription->thread!=NULL) {
+    g_mutex_lock(&subscription->lock);
+    subscription->stop = TRUE;
+    g_cond_signal(&subscription->cond);
+    g_mutex_unlock(&subscription->lock);
+    g_thread_join(subscription->thread);
+  }
+  for (guint i = 0; i < subscription->count; i++) {
+    serial_chunk_unref(subscription->ring[(subscription->head + i)%subscription->capacity]);
+  }
+  g_free(subscription->ring);
+  g_mutex_clear(&subscription->lock);
+  g_cond_clear(&subscription->cond);
+  g_free(subscription);
+}
+
+void serial_stream_free(struct SerialStream *stream) {
+  if (stream->subscribers->len > 0) {
+    g_critical("Freeing a stream with %u subscribers left. This is considered a bug.", stream->subscribers->len);
+  }
+  g_ptr_array_free(stream->subscribers, TRUE);
+  g_rw_lock_clear(&stream->lock);
+  g_free(stream);
+}
+
+struct SerialChunk *serial_chunk_ref(struct SerialChunk *chunk) {
+  g_bytes_ref(chunk->bytes);
+  return chunk;
+}
+
+void serial_chunk_unref(struct SerialChunk *chunk) {
+  // Si era la última referencia, el bloque (`chunk` incluido) se libera aquí
+  g_bytes_unref(chunk->bytes);
+}
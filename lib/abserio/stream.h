@@ -0,0 +1,109 @@
+//===-- lib/abserio/stream.h - Reparto de lo recibido a varios suscriptores -------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Un flujo reparte cada bloque recibido a todos sus suscriptores (la GUI, la grabación, decodificadores...). El
+/// bloque se copia una sola vez, al publicarlo, y todos los suscriptores reciben el mismo bloque con un contador de
+/// referencias: nadie vuelve a copiar los bytes.
+///
+/// Cada suscriptor tiene su propia cola con un límite de bloques. Publicar nunca espera: si la cola de un suscriptor
+/// está llena, se descarta un bloque según la política de ese suscriptor y se cuenta. Así un suscriptor lento no
+/// retrasa al hilo lector ni a los demás suscriptores.
+///
+/// Un suscriptor puede sacar los bloques de su cola (`serial_subscription_pop`) o dar una función, que se ejecuta en
+/// un hilo propio de la suscripción.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#ifndef ABSERIO_STREAM_H
+#define ABSERIO_STREAM_H
+#include "timestamp.h"
+
+// El flujo y las suscripciones son opacos
+struct SerialStream;
+struct SerialSubscription;
+
+// Un bloque publicado. Es de solo lectura y lo comparten todos los suscriptores
+struct SerialChunk {
+  // Los bytes. El bloque completo vive mientras haya referencias a `bytes`, así que también se puede conservar
+  // solamente esta referencia
+  GBytes *bytes;
+  // Fecha del bloque (ver `timestamp.h`)
+  struct SerialTimestamp stamp;
+  // Número del bloque desde que se creó el flujo: un hueco en la secuencia de un suscriptor son bloques descartados
+  guint64 sequence;
+};
+
+// Qué bloque se descarta cuando la cola de un suscriptor está llena
+enum SerialOverflowPolicy {
+  // El nuevo: el suscriptor conserva lo más viejo (p.e. una grabación, que no debe tener huecos en medio)
+  SERIAL_OVERFLOW_DROP_NEWEST,
+  // El más viejo de la cola: el suscriptor siempre ve lo más reciente (p.e. una vista)
+  SERIAL_OVERFLOW_DROP_OLDEST
+};
+
+// Contadores de una suscripción
+struct SerialSubscriptionStats {
+  // Bloques entregados al suscriptor
+  guint64 delivered;
+  // Bloques (y sus bytes) descartados porque la cola estaba llena
+  guint64 dropped_chunks;
+  guint64 dropped_bytes;
+  // Bloques en la cola ahora y el máximo que ha tenido
+  guint queued;
+  guint max_queued;
+};
+
+// Función que recibe los bloques de una suscripción. Se ejecuta en el hilo de la suscripción; el bloque se libera al
+// regresar, así que para conservarlo hay que tomar una referencia.
+typedef void (*SerialChunkFunc)(struct SerialChunk *, gpointer);
+
+// Crea un flujo sin suscriptores
+struct SerialStream *serial_stream_new(void);
+
+// Publica un bloque recibido a todos los suscriptores. Nunca bloquea; sin suscriptores, no copia nada. Se llama desde
+// un solo hilo a la vez (el hilo lector o el puente), p.e. desde su `SerialReceiveFunc`.
+void serial_stream_publish(struct SerialStream *, const guchar *, gsize, const struct SerialTimestamp *);
+
+// Se suscribe con una cola de a lo más `capacity` bloques, de la que se sacan con `serial_subscription_pop`.
+// Recibe los bloques publicados desde este momento.
+struct SerialSubscription *serial_stream_subscribe(struct SerialStream *, guint, enum SerialOverflowPolicy);
+
+// Igual que `serial_stream_subscribe`, pero un hilo de la suscripción saca los bloques y los entrega a la función
+struct SerialSubscription *serial_stream_subscribe_func(struct SerialStream *,
+                                                        guint,
+                                                        enum SerialOverflowPolicy,
+                                                        SerialChunkFunc,
+                                                        gpointer);
+
+// Saca el bloque más viejo de la cola. Espera hasta el timeout dado (en microsegundos; 0 no espera y uno negativo
+// espera indefinidamente). Devuelve NULL si no llegó ninguno; quien lo recibe lo libera con `serial_chunk_unref`.
+// Solamente un hilo saca bloques de cada suscripción.
+struct SerialChunk *serial_subscription_pop(struct SerialSubscription *, gint64);
+
+// Copia los contadores. Se puede llamar desde cualquier hilo.
+void serial_subscription_get_stats(struct SerialSubscription *, struct SerialSubscriptionStats *);
+
+// Cancela la suscripción: deja de recibir bloques y, si tiene función, espera a que su hilo entregue lo que quedó en
+// la cola y termine; sin función, lo que quedó se descarta. No se debe llamar mientras otro hilo espera en
+// `serial_subscription_pop`, ni desde la función de la suscripción.
+void serial_subscription_free(struct SerialSubscription *);
+
+// Libera el flujo. Todas las suscripciones se deben cancelar antes.
+void serial_stream_free(struct SerialStream *);
+
+// Toma y suelta una referencia a un bloque
+struct SerialChunk *serial_chunk_ref(struct SerialChunk *);
+void serial_chunk_unref(struct SerialChunk *);
+#endif // ABSERIO_STREAM_H
@@ -0,0 +1,100 @@
+//===-- lib/abserio/timestamp.c - Fecha de los bloques recibidos -----------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// En POSIX los relojes se leen con `clock_gettime` (vDSO en Linux: sin llamada al sistema). En Windows se usan los
+/// de GLib, que tienen resolución de microsegundos.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#define G_LOG_DOMAIN                    "TimestampAbSerIO"
+#include "timestamp.h"
+#include <stdatomic.h>
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Estructuras de datos
+//===--------------------------------------------------------------------------------------------------------------===//
+#define NSEC_PER_SEC                    1000000000LL
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                      Globales
+//===--------------------------------------------------------------------------------------------------------------===//
+// Cuántos han pedido la fecha CLOCK_REALTIME. Lo leen todos los lectores con cada bloque
+static atomic_int wall_clock = 0;
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                   Funciones extra
+//===--------------------------------------------------------------------------------------------------------------===//
+static gint64 clock_ns(gboolean realtime) {
+#ifdef _WIN32
+  return (realtime ? g_get_real_time() : g_get_monotonic_time())*1000;
+#else
+  struct timespec now;
+  clock_gettime(realtime ? CLOCK_REALTIME : CLOCK_MONOTONIC, &now);
+  return (gint64) now.tv_sec*NSEC_PER_SEC + now.tv_nsec;
+#endif
+}
+
+static gint64 line_char_ns(const struct AbstractSerialDevice **dev) {
+  glong bps = (*dev)->get_line_rate(dev);
+  if (bps <= 0) {
+    return 0;
+  }
+  return (gint64) (*dev)->get_frame_bits(dev)*NSEC_PER_SEC/bps;
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                           Implementación de la interfaz
+//===--------------------------------------------------------------------------------------------------------------===//
+void serial_timestamp_set_wall_clock(gboolean enabled) {
+  if (enabled) {
+    atomic_fetch_add_explicit(&wall_clock, 1, memory_order_relaxed);
+  } else if (atomic_fetch_sub_explicit(&wall_clock, 1, memory_order_relaxed) <= 0) {
+    g_critical("Unbalanced call to serial_timestamp_set_wall_clock(FALSE). This is considered a bug.");
+    atomic_fetch_add_explicit(&wall_clock, 1, memory_order_relaxed);
+  }
+}
+
+gint64 serial_timestamp_byte(const struct SerialTimestamp *stamp, gsize length, gsize index) {
+  return stamp->monotonic_ns - (gint64) (length - 1 - index)*stamp->char_ns;
+}
+
+gint64 serial_timestamp_byte_realtime(const struct SerialTimestamp *stamp, gsize length, gsize index) {
+  if (stamp->realtime_ns==0) {
+    return 0;
+  }
+  return stamp->realtime_ns - (gint64) (length - 1 - index)*stamp->char_ns;
+}
+
+void serial_stamper_init(struct SerialStamper *stamper) {
+  stamper->char_ns = 0;
+  // Obliga a calcular el tiempo de carácter con la primera fecha
+  stamper->char_checked_ns = G_MININT64/2;
+}
+
+void serial_stamper_stamp(struct SerialStamper *stamper,
+                          const struct AbstractSerialDevice **dev,
+                          struct SerialTimestamp *stamp) {
+  // Los relojes primero: lo demás no debe retrasar la fecha
+  stamp->monotonic_ns = clock_ns(FALSE);
+  stamp->realtime_ns = atomic_load_explicit(&wall_clock, memory_order_relaxed) > 0 ? clock_ns(TRUE) : 0;
+  if (stamp->monotonic_ns - stamper->char_checked_ns >= SERIAL_STAMPER_REFRESH_NS) {
+    stamper->char_ns = line_char_ns(dev);
+    stamper->char_checked_ns = stamp->monotonic_ns;
+  }
+  stamp->char_ns = stamper->char_ns;
+}
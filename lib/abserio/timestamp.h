@@ -0,0 +1,71 @@
+//===-- lib/abserio/timestamp.h - Fecha de los bloques recibidos -----------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Cada bloque que entrega el hilo lector (o el puente) lleva la fecha en que regresó la lectura: una sola lectura del
+/// reloj por bloque, no por byte. La fecha de cada byte se reconstruye cuando alguien la pide, hacia atrás desde el
+/// final del bloque: el último byte llegó cuando regresó la lectura y cada byte anterior, un tiempo de carácter antes
+/// que el siguiente. Es exacto mientras la línea no tenga pausas dentro del bloque; con pausas, los primeros bytes
+/// quedan más tarde de lo que llegaron.
+///
+/// El tiempo de carácter sale del baud rate, la pariedad y los bits de parada. Leerlos cuesta llamadas al sistema, así
+/// que cada lector los vuelve a leer a lo más cada SERIAL_STAMPER_REFRESH_NS: un cambio de configuración tarda ese
+/// tiempo en verse en las fechas.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#ifndef ABSERIO_TIMESTAMP_H
+#define ABSERIO_TIMESTAMP_H
+#include "abserio.h"
+
+// Cada cuánto un lector vuelve a calcular el tiempo de carácter, en ns
+#define SERIAL_STAMPER_REFRESH_NS       (250*1000*1000LL)
+
+// Fecha de un bloque recibido
+struct SerialTimestamp {
+  // CLOCK_MONOTONIC en ns, leído justo después de que regresó la lectura
+  gint64 monotonic_ns;
+  // CLOCK_REALTIME en ns desde la época Unix, leído junto con el anterior; 0 si no se pidió (ver
+  // `serial_timestamp_set_wall_clock`)
+  gint64 realtime_ns;
+  // Tiempo de carácter de la línea en ns, o 0 si no se conoce (entonces todos los bytes tienen la fecha del bloque)
+  gint64 char_ns;
+};
+
+// Estado de quien pone las fechas: el hilo lector y el puente tienen uno cada uno
+struct SerialStamper {
+  gint64 char_ns;
+  // Fecha (CLOCK_MONOTONIC) en que se calculó `char_ns`
+  gint64 char_checked_ns;
+};
+
+// Pide (TRUE) o devuelve una petición (FALSE) de que las fechas de todos los puertos lleven también CLOCK_REALTIME.
+// Las peticiones se cuentan: la fecha se lee mientras quede al menos una, así que cada TRUE necesita su FALSE. Se
+// puede llamar desde cualquier hilo; aplica desde el siguiente bloque leído.
+void serial_timestamp_set_wall_clock(gboolean);
+
+// Fecha (CLOCK_MONOTONIC, ns) del byte en la posición dada de un bloque de la longitud dada
+gint64 serial_timestamp_byte(const struct SerialTimestamp *, gsize, gsize);
+
+// Igual que `serial_timestamp_byte`, pero en CLOCK_REALTIME (ns desde la época Unix). Si el bloque no lleva esa
+// fecha, devuelve 0.
+gint64 serial_timestamp_byte_realtime(const struct SerialTimestamp *, gsize, gsize);
+
+// Prepara el estado. El tiempo de carácter se calcula con la primera fecha
+void serial_stamper_init(struct SerialStamper *);
+
+// Pone la fecha a un bloque recién leído del puerto dado. Se llama en cuanto regresa la lectura, antes de entregar
+// los bytes.
+void serial_stamper_stamp(struct SerialStamper *, const struct AbstractSerialDevice **, struct SerialTimestamp *);
+#endif // ABSERIO_TIMESTAMP_H
@@ -0,0 +1,258 @@
+//===-- lib/abserio/trace.c - Puntos de traza binarios ----------------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Cada hilo escribe solamente en su anillo y publica cada registro avanzando `head` (release). Quien copia el anillo
+/// (`serial_trace_dump`) no detiene al hilo: lee `head`, copia los registros y vuelve a leer `head`; los registros que
+/// el hilo pudo reemplazar mientras tanto se descartan, igual que la lectura de un seqlock.
+///
+/// El anillo de un hilo que termina se conserva para el siguiente volcado (de ahí salen las trazas del hilo lector de
+/// un puerto que ya se cerró), hasta un máximo de TRACE_MAX_FINISHED; después se libera el más viejo.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#define _GNU_SOURCE
+#define G_LOG_DOMAIN                    "TraceAbSerIO"
+#include "trace.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Estructuras de datos
+//===--------------------------------------------------------------------------------------------------------------===//
+// Anillos de hilos terminados que se conservan
+#define TRACE_MAX_FINISHED              64
+#define NSEC_PER_SEC                    1000000000ULL
+
+struct TraceRing {
+  guint64 thread_id;
+  gchar name[16];
+  gboolean finished;
+  // Registros escritos desde que se creó el anillo; el siguiente va en `head % SERIAL_TRACE_RING_SIZE`
+  atomic_uint_fast64_t head;
+  struct SerialTraceRecord records[SERIAL_TRACE_RING_SIZE];
+};
+
+static const gchar *EVENT_NAMES[SERIAL_TRACE_EVENT_COUNT] = {
+  [SERIAL_TRACE_READ_BEGIN] = "read",
+  [SERIAL_TRACE_READ_END] = "read",
+  [SERIAL_TRACE_READ_AVAILABLE] = "read_available",
+  [SERIAL_TRACE_READ_CANCELLED] = "read cancelled",
+  [SERIAL_TRACE_WRITE_BEGIN] = "write",
+  [SERIAL_TRACE_WRITE_END] = "write",
+  [SERIAL_TRACE_WRITE_CONTENDED] = "write while reading",
+  [SERIAL_TRACE_WAIT_WRITABLE_BEGIN] = "wait_writable",
+  [SERIAL_TRACE_WAIT_WRITABLE_END] = "wait_writable",
+  [SERIAL_TRACE_FRAME_BEGIN] = "write_frame",
+  [SERIAL_TRACE_FRAME_END] = "write_frame",
+  [SERIAL_TRACE_PACING_BEGIN] = "pacing",
+  [SERIAL_TRACE_PACING_END] = "pacing",
+  [SERIAL_TRACE_FRAME_STALLED] = "frame stalled by flow control",
+  [SERIAL_TRACE_DELIVER_BEGIN] = "deliver",
+  [SERIAL_TRACE_DELIVER_END] = "deliver",
+};
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                      Globales
+//===--------------------------------------------------------------------------------------------------------------===//
+static void ring_finished(gpointer data);
+
+// Protege la lista de anillos; los hilos solamente lo toman al crear su anillo y al terminar
+static GMutex trace_lock;
+static GPtrArray *trace_rings = NULL;
+static guint finished_rings = 0;
+static GPrivate current_ring = G_PRIVATE_INIT(ring_finished);
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                   Funciones extra
+//===--------------------------------------------------------------------------------------------------------------===//
+static guint64 current_thread_id(void) {
+#if defined(__linux__)
+  return (guint64) syscall(SYS_gettid);
+#elif defined(__APPLE__)
+  guint64 id = 0;
+  pthread_threadid_np(NULL, &id);
+  return id;
+#elif defined(_WIN32)
+  return (guint64) GetCurrentThreadId();
+#else
+  return (guint64) (guintptr) pthread_self();
+#endif
+}
+
+static void ring_finished(gpointer data) {
+  struct TraceRing *ring = data;
+  g_mutex_lock(&trace_lock);
+  ring->finished = TRUE;
+  if (++finished_rings > TRACE_MAX_FINISHED) {
+    // El más viejo de los terminados es el primero de la lista que ya terminó
+    for (guint i = 0; i < trace_rings->len; i++) {
+      struct TraceRing *old = g_ptr_array_index(trace_rings, i);
+      if (old->finished) {
+        g_ptr_array_remove_index(trace_rings, i);
+        g_free(old);
+        finished_rings--;
+        break;
+      }
+    }
+  }
+  g_mutex_unlock(&trace_lock);
+}
+
+static struct TraceRing *new_ring(void) {
+  struct TraceRing *ring = g_new0(struct TraceRing, 1);
+  ring->thread_id = current_thread_id();
+#if defined(__linux__) || defined(__APPLE__)
+  pthread_getname_np(pthread_self(), ring->name, sizeof(ring->name));
+#endif
+  atomic_init(&ring->head, 0);
+  g_mutex_lock(&trace_lock);
+  if (trace_rings==NULL) {
+    trace_rings = g_ptr_array_new();
+  }
+  g_ptr_array_add(trace_rings, ring);
+  g_mutex_unlock(&trace_lock);
+  g_private_set(&current_ring, ring);
+  return ring;
+}
+
+// Copia los registros que siguen válidos del anillo. Devuelve cuántos copió y cuántos se perdieron en total
+static guint64 copy_ring(struct TraceRing *ring, struct SerialTraceRecord *copy, guint64 *dropped) {
+  guint64 head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  guint64 first = head > SERIAL_TRACE_RING_SIZE ? head - SERIAL_TRACE_RING_SIZE : 0;
+  for (guint64 i = first; i < head; i++) {
+    copy[i - first] = ring->records[i%SERIAL_TRACE_RING_SIZE];
+  }
+  atomic_thread_fence(memory_order_acquire);
+  guint64 after = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  // El hilo pudo reemplazar los índices menores que `after - SERIAL_TRACE_RING_SIZE` y puede estar escribiendo
+  // encima del índice `after - SERIAL_TRACE_RING_SIZE`
+  guint64 valid = after >= SERIAL_TRACE_RING_SIZE ? after - SERIAL_TRACE_RING_SIZE + 1 : 0;
+  guint64 skip = valid > first ? MIN(valid - first, head - first) : 0;
+  memmove(copy, copy + skip, (gsize) (head - first - skip)*sizeof(struct SerialTraceRecord));
+  *dropped = first + skip;
+  return head - first - skip;
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                           Implementación de la interfaz
+//===--------------------------------------------------------------------------------------------------------------===//
+const gchar *serial_trace_event_name(guint16 event) {
+  return event < SERIAL_TRACE_EVENT_COUNT ? EVENT_NAMES[event] : NULL;
+}
+
+gchar serial_trace_event_phase(guint16 event) {
+  switch (event) {
+    case SERIAL_TRACE_READ_BEGIN:
+    case SERIAL_TRACE_WRITE_BEGIN:
+    case SERIAL_TRACE_WAIT_WRITABLE_BEGIN:
+    case SERIAL_TRACE_FRAME_BEGIN:
+    case SERIAL_TRACE_PACING_BEGIN:
+    case SERIAL_TRACE_DELIVER_BEGIN://
+      return 'B';
+    case SERIAL_TRACE_READ_END:
+    case SERIAL_TRACE_WRITE_END:
+    case SERIAL_TRACE_WAIT_WRITABLE_END:
+    case SERIAL_TRACE_FRAME_END:
+    case SERIAL_TRACE_PACING_END:
+    case SERIAL_TRACE_DELIVER_END://
+      return 'E';
+    default://
+      return 'i';
+  }
+}
+
+guint64 serial_trace_now(void) {
+#ifdef _WIN32
+  return (guint64) g_get_monotonic_time()*1000;
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (guint64) now.tv_sec*NSEC_PER_SEC + (guint64) now.tv_nsec;
+#endif
+}
+
+void serial_trace_record(guint16 event, gint32 fd, guint32 length, guint32 lock_wait_ns) {
+  struct TraceRing *ring = g_private_get(&current_ring);
+  if (G_UNLIKELY(ring==NULL)) {
+    ring = new_ring();
+  }
+  // Solamente este hilo escribe `head`
+  guint64 head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  struct SerialTraceRecord *record = &ring->records[head%SERIAL_TRACE_RING_SIZE];
+  record->timestamp_ns = serial_trace_now();
+  record->length = length;
+  record->lock_wait_ns = lock_wait_ns;
+  record->fd = fd;
+  record->event = event;
+  record->reserved = 0;
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+guint32 serial_trace_lock(GMutex *mutex) {
+  // Sin contención no hace falta leer el reloj
+  if (g_mutex_trylock(mutex)) {
+    return 0;
+  }
+  guint64 start = serial_trace_now();
+  g_mutex_lock(mutex);
+  return (guint32) MIN(serial_trace_now() - start, G_MAXUINT32);
+}
+
+gboolean serial_trace_dump(const gchar *path) {
+  FILE *file = fopen(path, "wb");
+  if (file==NULL) {
+    return FALSE;
+  }
+  struct SerialTraceRecord *copy = g_new(struct SerialTraceRecord, SERIAL_TRACE_RING_SIZE);
+  g_mutex_lock(&trace_lock);
+  struct SerialTraceFileHeader header = {{0}};
+  memcpy(header.magic, SERIAL_TRACE_MAGIC, sizeof(header.magic));
+  header.version = SERIAL_TRACE_VERSION;
+  header.threads = trace_rings!=NULL ? trace_rings->len : 0;
+  gboolean ok = fwrite(&header, sizeof(header), 1, file)==1;
+  for (guint i = 0; ok && i < header.threads; i++) {
+    struct TraceRing *ring = g_ptr_array_index(trace_rings, i);
+    struct SerialTraceFileThread thread = {0};
+    thread.thread_id = ring->thread_id;
+    memcpy(thread.name, ring->name, sizeof(thread.name));
+    thread.count = copy_ring(ring, copy, &thread.dropped);
+    ok = fwrite(&thread, sizeof(thread), 1, file)==1
+        && fwrite(copy, sizeof(struct SerialTraceRecord), (gsize) thread.count, file)==thread.count;
+  }
+  g_mutex_unlock(&trace_lock);
+  g_free(copy);
+  int saved_errno = errno;
+  if (fclose(file)!=0 && ok) {
+    return FALSE;
+  }
+  if (!ok) {
+    g_critical("Unable to write the trace to '%s'.", path);
+    g_critical("Message: '%s'", g_strerror(saved_errno));
+    errno = saved_errno;
+  }
+  return ok;
+}
@@ -0,0 +1,123 @@
+//===-- lib/abserio/trace.h - Puntos de traza binarios ----------------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Puntos de traza para las operaciones frecuentes de los drivers, en lugar de mensajes de `g_debug`: formatear un
+/// mensaje por operación cambia los tiempos que se quieren observar. Cada punto guarda un registro binario de 24 bytes
+/// (evento, fecha del reloj monotónico, descriptor, longitud y espera por el mutex) en un anillo propio del hilo que
+/// lo produce, así que no hay mutex ni operaciones atómicas compartidas entre hilos. Cuando el anillo se llena, los
+/// registros nuevos reemplazan a los más viejos.
+///
+/// Los puntos solamente existen si la biblioteca se compila con la opción ABSERIO_TRACE; sin ella, las macros de este
+/// archivo no generan código. `serial_trace_dump` guarda los anillos en un archivo que `abserio-trace2json` convierte
+/// a una línea de tiempo en el formato de Chrome (chrome://tracing, Perfetto).
+///
+/// Formato del archivo (little endian, el de la máquina que lo escribe):
+///   -> struct SerialTraceFileHeader
+///   -> Por cada hilo: struct SerialTraceFileThread seguido de `count` registros (struct SerialTraceRecord), del más
+///      viejo al más nuevo
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#ifndef ABSERIO_TRACE_H
+#define ABSERIO_TRACE_H
+#include <glib.h>
+
+#define SERIAL_TRACE_MAGIC              "ABSTRACE"
+#define SERIAL_TRACE_VERSION            1
+// Registros por hilo (24 bytes cada uno)
+#define SERIAL_TRACE_RING_SIZE          16384
+
+// Eventos. Los pares _BEGIN/_END son intervalos; los demás son instantáneos
+enum SerialTraceEvent {
+  // `read_buffer`: espera a que haya datos; al terminar, la longitud es lo que se leyó
+  SERIAL_TRACE_READ_BEGIN,
+  SERIAL_TRACE_READ_END,
+  // `read_available` con datos
+  SERIAL_TRACE_READ_AVAILABLE,
+  // `read_buffer` cancelado por `cancel_read` o porque el puerto se cerró
+  SERIAL_TRACE_READ_CANCELLED,
+  // `write_byte` y `write_buffer`; la espera es la del mutex de escritura
+  SERIAL_TRACE_WRITE_BEGIN,
+  SERIAL_TRACE_WRITE_END,
+  // `write_byte` mientras otro hilo lee
+  SERIAL_TRACE_WRITE_CONTENDED,
+  // `wait_writable`: la cola de salida está llena
+  SERIAL_TRACE_WAIT_WRITABLE_BEGIN,
+  SERIAL_TRACE_WAIT_WRITABLE_END,
+  // `write_frame` completo y cada pausa entre bytes o tramas
+  SERIAL_TRACE_FRAME_BEGIN,
+  SERIAL_TRACE_FRAME_END,
+  SERIAL_TRACE_PACING_BEGIN,
+  SERIAL_TRACE_PACING_END,
+  // Una trama detenida por el control de flujo; la longitud es lo que sí se envió
+  SERIAL_TRACE_FRAME_STALLED,
+  // El hilo lector entregando un bloque a la función del usuario
+  SERIAL_TRACE_DELIVER_BEGIN,
+  SERIAL_TRACE_DELIVER_END,
+  SERIAL_TRACE_EVENT_COUNT
+};
+
+// Un registro. El hilo no se guarda en cada registro sino una vez por anillo
+struct SerialTraceRecord {
+  guint64 timestamp_ns;
+  guint32 length;
+  // Nanosegundos esperando el mutex antes de la operación (saturado a G_MAXUINT32)
+  guint32 lock_wait_ns;
+  gint32 fd;
+  guint16 event;
+  guint16 reserved;
+};
+
+struct SerialTraceFileHeader {
+  gchar magic[8];
+  guint32 version;
+  guint32 threads;
+};
+
+struct SerialTraceFileThread {
+  guint64 thread_id;
+  gchar name[16];
+  guint64 count;
+  // Registros que se reemplazaron porque el anillo se llenó
+  guint64 dropped;
+};
+
+// Nombre del evento, o NULL si no existe
+const gchar *serial_trace_event_name(guint16);
+
+// Fase del evento como en el formato de Chrome: 'B' (inicio de intervalo), 'E' (fin) o 'i' (instantáneo)
+gchar serial_trace_event_phase(guint16);
+
+// Guarda los anillos de todos los hilos (también los de hilos que ya terminaron) en el archivo. Los registros que se
+// escriben durante la copia pueden quedar fuera. Devuelve FALSE con errno configurado si no se pudo escribir.
+gboolean serial_trace_dump(const gchar *);
+
+// Reloj de los registros: CLOCK_MONOTONIC en nanosegundos
+guint64 serial_trace_now(void);
+
+// Agrega un registro al anillo del hilo actual (lo crea la primera vez)
+void serial_trace_record(guint16, gint32, guint32, guint32);
+
+// Toma el mutex y devuelve cuántos nanosegundos esperó
+guint32 serial_trace_lock(GMutex *);
+
+#ifdef ABSERIO_TRACE
+#define SERIAL_TRACE(event, fd, length, wait) serial_trace_record((event), (fd), (guint32) (length), (wait))
+#define SERIAL_TRACE_LOCK(mutex, wait)  ((wait) = serial_trace_lock(mutex))
+#else
+#define SERIAL_TRACE(event, fd, length, wait) ((void) 0)
+#define SERIAL_TRACE_LOCK(mutex, wait)  ((void) (wait), g_mutex_lock(mutex))
+#endif
+#endif // ABSERIO_TRACE_H
@@ -0,0 +1,174 @@
+//===-- lib/abserio/transmit.c - Transmisión de bloques grandes -------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// El hilo escribe con `write_buffer` todo lo que acepte la cola de salida y, cuando está llena, espera con
+/// `wait_writable` (poll sobre POLLOUT en POSIX). El kernel despierta al hilo cuando la cola baja de su umbral, así
+/// que la línea no se queda ociosa y el hilo no consume CPU mientras espera.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#define G_LOG_DOMAIN                    "TransmitAbSerIO"
+#include "transmit.h"
+#include "dispatch.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <glib/gstdio.h>
+#include <stdatomic.h>
+#ifndef _WIN32
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Estructuras de datos
+//===--------------------------------------------------------------------------------------------------------------===//
+// Máximo de bytes por llamada a `write_buffer`
+#define TRANSMIT_CHUNK                  65536
+// Cada cuánto (ms) se revisa la cancelación mientras la cola de salida está llena
+#define TRANSMIT_POLL_MS                100
+
+struct SerialTransmit {
+  GThread *thread;
+  // Copia del puntero al driver, igual que el hilo lector
+  const struct AbstractSerialDevice *dev;
+  GBytes *bytes;
+  guint64 total;
+  glong line_rate;
+  guint frame_bits;
+  gint64 started;
+  atomic_uint_fast64_t sent;
+  atomic_int_fast64_t finished;
+  volatile atomic_bool cancel;
+  volatile atomic_bool done;
+  int error;
+};
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Hilos de ejecución
+//===--------------------------------------------------------------------------------------------------------------===//
+static gpointer transmit_thread(gpointer data) {
+  struct SerialTransmit *job = data;
+  gsize size;
+  const guchar *buffer = g_bytes_get_data(job->bytes, &size);
+  gsize offset = 0;
+  job->error = 0;
+  while (offset < size) {
+    if (atomic_load(&job->cancel)) {
+      // Lo que se escribió después de que `serial_transmit_cancel` vació la cola también se descarta
+      job->dev->flush_output(&job->dev);
+      job->error = ECANCELED;
+      break;
+    }
+    errno = 0x00;
+    gssize n = serial_write_buffer(buffer + offset, MIN(size - offset, TRANSMIT_CHUNK), &job->dev);
+    if (n > 0) {
+      offset += (gsize) n;
+      atomic_store(&job->sent, offset);
+    } else if (n==-1 && errno!=EAGAIN && errno!=EINTR) {
+      job->error = errno;
+      g_critical("Transmission stopped after %" G_GSIZE_FORMAT " bytes.", offset);
+      g_critical("Message: \'%s\'", g_strerror(errno));
+      break;
+    } else {
+      // Cola llena: dormir hasta que el kernel la vacíe lo suficiente
+      job->dev->wait_writable(TRANSMIT_POLL_MS, &job->dev);
+    }
+  }
+  if (offset==size) {
+    // Para que la eficiencia final refleje lo que realmente salió por la línea. `drain_output` no se puede cancelar,
+    // pero retorna en cuanto `serial_transmit_cancel` vacía la cola
+    job->dev->drain_output(&job->dev);
+  }
+  atomic_store(&job->finished, g_get_monotonic_time());
+  atomic_store(&job->done, TRUE);
+  return NULL;
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                           Implementación de la interfaz
+//===--------------------------------------------------------------------------------------------------------------===//
+struct SerialTransmit *serial_transmit_bytes(const struct AbstractSerialDevice **dev, GBytes *bytes) {
+  if (dev==NULL || *dev==NULL || bytes==NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+  struct SerialTransmit *job = g_new0(struct SerialTransmit, 1);
+  job->dev = *dev;
+  job->bytes = g_bytes_ref(bytes);
+  job->total = g_bytes_get_size(bytes);
+  job->line_rate = (*dev)->get_line_rate(dev);
+  job->frame_bits = (*dev)->get_frame_bits(dev);
+  atomic_init(&job->sent, 0);
+  atomic_init(&job->finished, 0);
+  atomic_init(&job->cancel, FALSE);
+  atomic_init(&job->done, FALSE);
+  job->started = g_get_monotonic_time();
+  job->thread = g_thread_new("abserio-transmit", transmit_thread, job);
+  return job;
+}
+
+struct SerialTransmit *serial_transmit_file(const struct AbstractSerialDevice **dev, const gchar *path) {
+  // Se abre a mano para conservar errno; el mapeo sobrevive al close
+  int fd = g_open(path, O_RDONLY, 0);
+  if (fd==-1) {
+    return NULL;
+  }
+  GError *error = NULL;
+  GMappedFile *mapped = g_mapped_file_new_from_fd(fd, FALSE, &error);
+  close(fd);
+  if (mapped==NULL) {
+    g_critical("Unable to map \'%s\': %s", path, error->message);
+    g_error_free(error);
+    errno = EIO;
+    return NULL;
+  }
+  GBytes *bytes = g_mapped_file_get_bytes(mapped);
+  g_mapped_file_unref(mapped);
+  struct SerialTransmit *job = serial_transmit_bytes(dev, bytes);
+  g_bytes_unref(bytes);
+  return job;
+}
+
+void serial_transmit_get_progress(struct SerialTransmit *job, struct SerialTransmitProgress *progress) {
+  progress->done = atomic_load(&job->done);
+  progress->sent = atomic_load(&job->sent);
+  progress->total = job->total;
+  gint64 end = progress->done ? atomic_load(&job->finished) : g_get_monotonic_time();
+  progress->elapsed = end - job->started;
+  progress->efficiency = 0.0;
+  if (progress->elapsed > 0 && job->line_rate > 0) {
+    gdouble achieved = progress->sent*(gdouble) G_USEC_PER_SEC/progress->elapsed;
+    progress->efficiency = achieved*job->frame_bits/job->line_rate;
+  }
+}
+
+void serial_transmit_cancel(struct SerialTransmit *job) {
+  atomic_store(&job->cancel, TRUE);
+  // Con una línea lenta la cola del sistema puede tardar mucho en vaciarse; sin esto, `serial_transmit_finish`
+  // esperaría a que se transmitiera completa. Si ya terminó, lo que hay en la cola es de alguien más
+  if (!atomic_load(&job->done)) {
+    job->dev->flush_output(&job->dev);
+  }
+}
+
+gboolean serial_transmit_finish(struct SerialTransmit *job) {
+  g_thread_join(job->thread);
+  int error = job->error;
+  g_bytes_unref(job->bytes);
+  g_free(job);
+  errno = error;
+  return error==0;
+}
@@ -0,0 +1,60 @@
+//===-- lib/abserio/transmit.h - Transmisión de bloques grandes -------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Envía un bloque de bytes (p.e. un archivo mapeado en memoria) desde un hilo dedicado, manteniendo llena la cola de
+/// salida del sistema sin hacer busy-waiting.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#ifndef ABSERIO_TRANSMIT_H
+#define ABSERIO_TRANSMIT_H
+#include "abserio.h"
+
+// El trabajo de transmisión es opaco
+struct SerialTransmit;
+
+// Estado de una transmisión
+struct SerialTransmitProgress {
+  // Bytes aceptados por el puerto y el total a enviar
+  guint64 sent;
+  guint64 total;
+  // Microsegundos desde el inicio
+  gint64 elapsed;
+  // Bytes por segundo logrados entre la velocidad teórica de la línea (baud rate / bits por carácter). Cerca de 1.0
+  // significa que la línea nunca estuvo ociosa
+  gdouble efficiency;
+  // TRUE cuando el hilo terminó (completo, cancelado o con error)
+  gboolean done;
+};
+
+// Empieza a enviar los bytes dados. El trabajo guarda una referencia a `GBytes`, así que no se copian.
+//  -> El puerto no se debe cerrar antes de llamar a `serial_transmit_finish`
+struct SerialTransmit *serial_transmit_bytes(const struct AbstractSerialDevice **, GBytes *);
+
+// Mapea el archivo en memoria (`GMappedFile`: mmap en POSIX) y lo envía sin copiarlo a un buffer. Devuelve NULL con
+// errno configurado si el archivo no se puede abrir.
+struct SerialTransmit *serial_transmit_file(const struct AbstractSerialDevice **, const gchar *);
+
+// Copia el estado actual de la transmisión. Se puede llamar desde cualquier hilo.
+void serial_transmit_get_progress(struct SerialTransmit *, struct SerialTransmitProgress *);
+
+// Pide que la transmisión se detenga lo antes posible. Lo que está en la cola de salida del sistema y no se ha
+// transmitido se descarta (`flush_output`), así que `serial_transmit_finish` no espera a la línea
+void serial_transmit_cancel(struct SerialTransmit *);
+
+// Espera a que el hilo termine y libera el trabajo. Devuelve TRUE si se enviaron todos los bytes; si no, errno
+// indica la causa (ECANCELED si se canceló).
+gboolean serial_transmit_finish(struct SerialTransmit *);
+#endif // ABSERIO_TRANSMIT_H
@@ -0,0 +1,402 @@
+//===-- lib/abserio/uring.c - Lecturas del puerto con io_uring --------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// El puerto es O_NONBLOCK (así lo necesita `write_buffer`), y io_uring respeta esa bandera: un READ sobre la TTY
+/// vacía termina de inmediato con -EAGAIN en lugar de esperar. Por eso la lectura va enlazada (IOSQE_IO_LINK) detrás
+/// de un POLL_ADD: el kernel solamente la ejecuta cuando el puerto tiene datos. Si entre el poll y la lectura otro
+/// proceso se lleva los datos, la lectura termina con -EAGAIN y la cadena se vuelve a enviar.
+///
+/// Las lecturas copian al buffer de quien llama desde el buffer registrado. Si quien llama pide menos bytes de los que
+/// llegaron, el resto se entrega en la siguiente llamada sin entrar al kernel.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#define G_LOG_DOMAIN                    "UringAbSerIO"
+#include "uring.h"
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Estructuras de datos
+//===--------------------------------------------------------------------------------------------------------------===//
+// Entradas del anillo: como máximo hay tres operaciones en vuelo (el poll, la lectura y la del pipe)
+#define URING_ENTRIES                   8
+// Tamaño del buffer registrado. Una TTY rara vez entrega más de 4 KiB por lectura, pero un pty rápido sí
+#define URING_BUFFER_SIZE               (64*1024)
+// El buffer va en su propio mapeo, con una página extra al final para el token del pipe
+#define URING_BUFFER_MAP_SIZE           (URING_BUFFER_SIZE + 4096)
+
+// Índices de los descriptores registrados
+#define URING_FILE_PORT                 0
+#define URING_FILE_WAKE                 1
+// Veces seguidas que se vuelve a encolar la cadena cuando el poll falla sin reportar por qué
+#define URING_READ_RETRIES              16
+
+// Etiquetas (`user_data`) de cada operación
+enum UringTag {
+  URING_TAG_POLL = 1,
+  URING_TAG_READ,
+  URING_TAG_WAKE
+};
+
+struct SerialUring {
+  int ring_fd;
+  int wake_fd;
+  // Mapeos de los anillos. Con IORING_FEAT_SINGLE_MMAP, el de CQ es el mismo que el de SQ
+  void *sq_map;
+  gsize sq_map_size;
+  void *cq_map;
+  gsize cq_map_size;
+  struct io_uring_sqe *sqes;
+  gsize sqes_size;
+  // Anillo de envío: solamente lo escribe este proceso, el kernel avanza `head`
+  _Atomic guint32 *sq_head;
+  _Atomic guint32 *sq_tail;
+  guint32 sq_mask;
+  guint32 *sq_array;
+  // Entradas llenas que el kernel todavía no ve (no se ha publicado el `tail`)
+  guint32 queued;
+  // Anillo de completados: el kernel avanza `tail`, este proceso avanza `head`
+  _Atomic guint32 *cq_head;
+  _Atomic guint32 *cq_tail;
+  guint32 cq_mask;
+  struct io_uring_cqe *cqes;
+  // Buffer registrado y lo que queda en él sin entregar. Se mapea aparte (no con malloc): si el kernel termina una
+  // operación después de `serial_uring_free`, escribe en páginas que ya nadie más usa
+  guchar *buffer;
+  gsize pending_offset;
+  gsize pending_length;
+  // Destino de la lectura del pipe (el contenido no importa). Está en la página extra del buffer
+  guchar *wake_token;
+  // Operaciones en vuelo
+  gboolean read_inflight;
+  gboolean wake_inflight;
+  // Error del último poll enlazado (la lectura se cancela con ECANCELED, pero el motivo lo reporta el poll) y veces
+  // seguidas que se ha vuelto a encolar la cadena sin leer nada
+  int poll_error;
+  guint read_retries;
+  // El pipe se activó mientras se entregaban datos: la siguiente llamada se cancela
+  gboolean cancel_pending;
+};
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                   Funciones extra
+//===--------------------------------------------------------------------------------------------------------------===//
+static int uring_setup(guint32 entries, struct io_uring_params *params) {
+  return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(int fd, guint32 to_submit, guint32 min_complete, guint32 flags) {
+  return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_register(int fd, guint32 opcode, const void *arg, guint32 count) {
+  return (int) syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+static void unmap_rings(struct SerialUring *ring) {
+  if (ring->sqes!=NULL) {
+    munmap(ring->sqes, ring->sqes_size);
+  }
+  if (ring->cq_map!=NULL && ring->cq_map!=ring->sq_map) {
+    munmap(ring->cq_map, ring->cq_map_size);
+  }
+  if (ring->sq_map!=NULL) {
+    munmap(ring->sq_map, ring->sq_map_size);
+  }
+}
+
+static gboolean map_rings(struct SerialUring *ring, const struct io_uring_params *params) {
+  ring->sq_map_size = params->sq_off.array + params->sq_entries*sizeof(guint32);
+  ring->cq_map_size = params->cq_off.cqes + params->cq_entries*sizeof(struct io_uring_cqe);
+  if (params->features & IORING_FEAT_SINGLE_MMAP) {
+    ring->sq_map_size = MAX(ring->sq_map_size, ring->cq_map_size);
+  }
+  ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ring_fd,
+                      IORING_OFF_SQ_RING);
+  if (ring->sq_map==MAP_FAILED) {
+    ring->sq_map = NULL;
+    return FALSE;
+  }
+  if (params->features & IORING_FEAT_SINGLE_MMAP) {
+    ring->cq_map = ring->sq_map;
+  } else {
+    ring->cq_map = mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ring_fd,
+                        IORING_OFF_CQ_RING);
+    if (ring->cq_map==MAP_FAILED) {
+      ring->cq_map = NULL;
+      return FALSE;
+    }
+  }
+  ring->sqes_size = params->sq_entries*sizeof(struct io_uring_sqe);
+  ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ring_fd,
+                    IORING_OFF_SQES);
+  if (ring->sqes==MAP_FAILED) {
+    ring->sqes = NULL;
+    return FALSE;
+  }
+  guchar *sq = ring->sq_map;
+  ring->sq_head = (_Atomic guint32 *) (sq + params->sq_off.head);
+  ring->sq_tail = (_Atomic guint32 *) (sq + params->sq_off.tail);
+  ring->sq_mask = *(guint32 *) (sq + params->sq_off.ring_mask);
+  ring->sq_array = (guint32 *) (sq + params->sq_off.array);
+  guchar *cq = ring->cq_map;
+  ring->cq_head = (_Atomic guint32 *) (cq + params->cq_off.head);
+  ring->cq_tail = (_Atomic guint32 *) (cq + params->cq_off.tail);
+  ring->cq_mask = *(guint32 *) (cq + params->cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *) (cq + params->cq_off.cqes);
+  return TRUE;
+}
+
+// Devuelve la siguiente entrada libre del anillo de envío, ya en ceros. Nunca hay más de tres operaciones en vuelo,
+// así que siempre hay lugar
+static struct io_uring_sqe *next_sqe(struct SerialUring *ring, guint8 opcode, guint64 tag) {
+  guint32 tail = atomic_load_explicit(ring->sq_tail, memory_order_relaxed) + ring->queued;
+  guint32 index = tail & ring->sq_mask;
+  struct io_uring_sqe *sqe = &ring->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = opcode;
+  sqe->flags = IOSQE_FIXED_FILE;
+  sqe->user_data = tag;
+  ring->sq_array[index] = index;
+  ring->queued++;
+  return sqe;
+}
+
+// Encola la cadena POLL_ADD -> READ_FIXED sobre el puerto
+static void queue_read(struct SerialUring *ring) {
+  struct io_uring_sqe *poll = next_sqe(ring, IORING_OP_POLL_ADD, URING_TAG_POLL);
+  poll->fd = URING_FILE_PORT;
+  poll->flags |= IOSQE_IO_LINK;
+  poll->poll32_events = POLLIN;
+  struct io_uring_sqe *read = next_sqe(ring, IORING_OP_READ_FIXED, URING_TAG_READ);
+  read->fd = URING_FILE_PORT;
+  read->addr = (guint64) (guintptr) ring->buffer;
+  read->len = URING_BUFFER_SIZE;
+  read->buf_index = 0;
+  ring->read_inflight = TRUE;
+}
+
+static void queue_wake(struct SerialUring *ring) {
+  struct io_uring_sqe *wake = next_sqe(ring, IORING_OP_READ, URING_TAG_WAKE);
+  wake->fd = URING_FILE_WAKE;
+  wake->addr = (guint64) (guintptr) ring->wake_token;
+  wake->len = 1;
+  ring->wake_inflight = TRUE;
+}
+
+// Descarta los tokens que hayan quedado en el pipe (p.e. varias cancelaciones seguidas)
+static void drain_wake(struct SerialUring *ring) {
+  guchar token;
+  while (read(ring->wake_fd, &token, 1)==1) {
+  }
+}
+
+static gsize take_pending(struct SerialUring *ring, guchar *buffer, gsize size) {
+  gsize length = MIN(size, ring->pending_length);
+  memcpy(buffer, ring->buffer + ring->pending_offset, length);
+  ring->pending_offset += length;
+  ring->pending_length -= length;
+  return length;
+}
+
+// Publica las entradas encoladas y entra al kernel hasta que haya al menos `min_complete` completados
+static int submit(struct SerialUring *ring, guint32 min_complete) {
+  // El kernel lee las entradas nuevas después de ver el `tail`
+  guint32 tail = atomic_load_explicit(ring->sq_tail, memory_order_relaxed) + ring->queued;
+  atomic_store_explicit(ring->sq_tail, tail, memory_order_release);
+  ring->queued = 0;
+  while (TRUE) {
+    // Lo que el kernel no consumió (p.e. porque una señal interrumpió la llamada anterior) se vuelve a enviar
+    guint32 unsubmitted = tail - atomic_load_explicit(ring->sq_head, memory_order_acquire);
+    if (uring_enter(ring->ring_fd, unsubmitted, min_complete, min_complete > 0 ? IORING_ENTER_GETEVENTS : 0)!=-1) {
+      return 0;
+    }
+    if (errno!=EINTR) {
+      return -1;
+    }
+  }
+}
+
+// Procesa los completados pendientes. Deja los bytes leídos en el buffer registrado, vuelve a encolar la cadena si la
+// lectura no trajo nada y marca `*cancelled` si se activó el pipe. Devuelve el errno de la lectura, o 0
+static int reap(struct SerialUring *ring, gboolean *cancelled) {
+  int error = 0;
+  guint32 head = atomic_load_explicit(ring->cq_head, memory_order_relaxed);
+  guint32 completed = atomic_load_explicit(ring->cq_tail, memory_order_acquire);
+  for (; head!=completed; head++) {
+    const struct io_uring_cqe *cqe = &ring->cqes[head & ring->cq_mask];
+    switch (cqe->user_data) {
+      case URING_TAG_WAKE://
+        ring->wake_inflight = FALSE;
+        if (cqe->res==1) {
+          *cancelled = TRUE;
+        } else if (cqe->res==-EAGAIN || cqe->res==-EINTR) {
+          queue_wake(ring);
+        } else {
+          // Sin el pipe ya no hay forma de cancelar la lectura
+          g_warning("Wake pipe read failed (%d).", cqe->res);
+          error = EIO;
+        }
+        break;
+      case URING_TAG_READ://
+        ring->read_inflight = FALSE;
+        if (cqe->res > 0) {
+          ring->pending_offset = 0;
+          ring->pending_length = (gsize) cqe->res;
+          ring->read_retries = 0;
+        } else if (cqe->res==0) {
+          // Fin de archivo: el otro extremo desapareció (p.e. el adaptador USB se desconectó)
+          error = EIO;
+        } else if (cqe->res==-ECANCELED && ring->poll_error!=0) {
+          // El poll enlazado falló y canceló la lectura: el error que importa es el del poll
+          error = ring->poll_error;
+        } else if ((cqe->res==-EAGAIN || cqe->res==-EINTR || cqe->res==-ECANCELED)
+                   && ++ring->read_retries <= URING_READ_RETRIES) {
+          // Otro proceso se llevó los datos
+          queue_read(ring);
+        } else if (cqe->res==-ECANCELED) {
+          error = EIO;
+        } else {
+          error = -cqe->res;
+        }
+        ring->poll_error = 0;
+        break;
+      default://
+        // El poll solamente importa si falla; la lectura enlazada se completa después con ECANCELED
+        if (cqe->res < 0 && cqe->res!=-ECANCELED) {
+          ring->poll_error = -cqe->res;
+        }
+        break;
+    }
+  }
+  atomic_store_explicit(ring->cq_head, head, memory_order_release);
+  if (*cancelled) {
+    drain_wake(ring);
+  }
+  return error;
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                           Implementación de la interfaz
+//===--------------------------------------------------------------------------------------------------------------===//
+struct SerialUring *serial_uring_new(int fd, int wake_fd) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  int ring_fd = uring_setup(URING_ENTRIES, &params);
+  if (ring_fd==-1) {
+    return NULL;
+  }
+  struct SerialUring *ring = g_new0(struct SerialUring, 1);
+  ring->ring_fd = ring_fd;
+  ring->wake_fd = wake_fd;
+  ring->buffer = mmap(NULL, URING_BUFFER_MAP_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ring->buffer==MAP_FAILED) {
+    int saved_errno = errno;
+    close(ring_fd);
+    g_free(ring);
+    errno = saved_errno;
+    return NULL;
+  }
+  ring->wake_token = ring->buffer + URING_BUFFER_SIZE;
+  const int files[] = {fd, wake_fd};
+  struct iovec registered = {ring->buffer, URING_BUFFER_SIZE};
+  if (!map_rings(ring, &params)
+      || uring_register(ring_fd, IORING_REGISTER_FILES, files, G_N_ELEMENTS(files))==-1
+      || uring_register(ring_fd, IORING_REGISTER_BUFFERS, &registered, 1)==-1) {
+    int saved_errno = errno;
+    serial_uring_free(ring);
+    errno = saved_errno;
+    return NULL;
+  }
+  g_debug("io_uring ready for Kernel File Descriptor %d (features 0x%x).", fd, params.features);
+  return ring;
+}
+
+gssize serial_uring_read(struct SerialUring *ring, guchar *buffer, gsize size) {
+  if (ring->pending_length > 0) {
+    return (gssize) take_pending(ring, buffer, size);
+  }
+  if (ring->cancel_pending) {
+    ring->cancel_pending = FALSE;
+    errno = ECANCELED;
+    return -1;
+  }
+  if (!ring->wake_inflight) {
+    queue_wake(ring);
+  }
+  if (!ring->read_inflight) {
+    queue_read(ring);
+  }
+  while (TRUE) {
+    if (submit(ring, 1)==-1) {
+      return -1;
+    }
+    gboolean cancelled = FALSE;
+    int error = reap(ring, &cancelled);
+    if (ring->pending_length > 0) {
+      ring->cancel_pending = cancelled;
+      return (gssize) take_pending(ring, buffer, size);
+    }
+    if (cancelled) {
+      g_debug("Read operation cancelled: woken up by 'cancel_read'.");
+      errno = ECANCELED;
+      return -1;
+    }
+    if (error!=0) {
+      errno = error;
+      return -1;
+    }
+  }
+}
+
+gssize serial_uring_read_available(struct SerialUring *ring, guchar *buffer, gsize size) {
+  // Revisar los completados no necesita llamadas al sistema; solamente se entra al kernel para volver a enviar la
+  // cadena después de una lectura
+  gboolean cancelled = FALSE;
+  int error = ring->pending_length > 0 ? 0 : reap(ring, &cancelled);
+  if (cancelled) {
+    // Como con el pipe: la siguiente lectura bloqueante es la que se cancela
+    ring->cancel_pending = TRUE;
+  }
+  gsize length = take_pending(ring, buffer, size);
+  if (error!=0 && length==0) {
+    errno = error;
+    return -1;
+  }
+  // La siguiente lectura usa el mismo buffer registrado: solamente se envía cuando ya se entregó todo
+  if (ring->pending_length==0 && !ring->read_inflight) {
+    queue_read(ring);
+  }
+  if (ring->queued > 0 && submit(ring, 0)==-1) {
+    return length > 0 ? (gssize) length : -1;
+  }
+  return (gssize) length;
+}
+
+void serial_uring_free(struct SerialUring *ring) {
+  unmap_rings(ring);
+  // Cerrar el anillo cancela las operaciones en vuelo y libera los registros
+  close(ring->ring_fd);
+  munmap(ring->buffer, URING_BUFFER_MAP_SIZE);
+  g_free(ring);
+}
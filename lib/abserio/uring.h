@@ -0,0 +1,48 @@
+//===-- lib/abserio/uring.h - Lecturas del puerto con io_uring --------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Alternativa a `poll` + `read` para el hilo lector del driver POSIX (solamente Linux). Cada puerto tiene su propio
+/// io_uring con el descriptor del puerto y el del pipe de `cancel_read` registrados, y un buffer registrado para las
+/// lecturas. Una espera es una cadena de dos operaciones enlazadas, POLL_ADD y READ_FIXED, que se envía y se espera
+/// con una sola llamada a `io_uring_enter`; la lectura del pipe queda pendiente en el mismo anillo, así que cancelar
+/// no necesita otra llamada al sistema.
+///
+/// No se usa liburing: solamente las llamadas al sistema y `<linux/io_uring.h>`.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#ifndef ABSERIO_URING_H
+#define ABSERIO_URING_H
+#include <glib.h>
+
+// El anillo es opaco
+struct SerialUring;
+
+// Crea el anillo para el descriptor del puerto y el extremo de lectura del pipe de cancelación (los dos deben ser
+// O_NONBLOCK). Devuelve NULL con errno configurado si el kernel no soporta io_uring (ENOSYS) o no lo permite (EPERM).
+struct SerialUring *serial_uring_new(int, int);
+
+// Igual que `read_buffer`: bloquea hasta que haya datos (devuelve cuántos copió) o hasta que alguien escriba en el
+// pipe, en cuyo caso devuelve -1 con errno en ECANCELED. Si el puerto llega al fin de archivo, -1 con errno en EIO.
+// Solamente un hilo puede leer a la vez.
+gssize serial_uring_read(struct SerialUring *, guchar *, gsize);
+
+// Igual que `read_available`: copia lo que ya llegó sin bloquear y devuelve cuántos bytes, o 0 si no hay nada. La
+// cadena de lectura queda en vuelo entre llamadas, así que mientras no llegue nada no hace llamadas al sistema.
+gssize serial_uring_read_available(struct SerialUring *, guchar *, gsize);
+
+// Libera el anillo; las operaciones pendientes se cancelan. Los descriptores no se cierran.
+void serial_uring_free(struct SerialUring *);
+#endif // ABSERIO_URING_H
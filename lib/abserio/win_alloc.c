@@ -24,6 +24,7 @@
 
 #define G_LOG_DOMAIN                    "Win32AbSerIO"
 #include "abserio.h"
+#include "trace.h"
 #include <errno.h>
 #include <stdatomic.h>
 
@@ -38,6 +39,15 @@ struct InternalRepresentation {
   GMutex write_lock;
   GMutex access_lock;
   volatile atomic_bool open;
+  // Contadores para `get_stats`; los actualizan el hilo lector y quien escriba
+  atomic_uint_fast64_t rx_bytes;
+  atomic_uint_fast64_t tx_bytes;
+  atomic_uint_fast64_t tx_wait_ns;
+  atomic_uint_fast64_t flow_blocked_ns;
+  // Cuántas veces se ha llamado a `flush_output`. Una trama de `write_frame` que ve cambiar la cuenta se interrumpe
+  atomic_uint flush_count;
+  // Lo activa `cancel_read`; el hilo lector lo revisa cada vez que `ReadFile` vence por timeout
+  volatile atomic_bool cancel;
   COMMTIMEOUTS *tout;
 };
 
@@ -47,6 +57,8 @@ struct InternalRepresentation {
 #define WRITE_LOCK                      &INT_INFO(*dev)->write_lock
 #define ACCESS_LOCK                     &INT_INFO(*dev)->access_lock
 #define PRINT_ERRNO(x)                  x("Message: \'%s\'", g_strerror(errno))
+// Bytes por llamada a WriteFile en `write_buffer`
+#define WIN_WRITE_CHUNK                 4096
 
 //===--------------------------------------------------------------------------------------------------------------===//
 //                                           Implementación de la interfaz
@@ -193,13 +205,60 @@ gboolean get_software_control_flow(const struct AbstractSerialDevice **cdev) {
   return FALSE;
 }
 
+gboolean set_hardware_control_flow(gboolean bit_enable, const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  g_mutex_lock(ACCESS_LOCK);
+  if (GetCommState(INT_INFO(*dev)->k_com, INT_INFO(*dev)->params)) {
+    if (bit_enable) {
+      (INT_INFO(*dev)->params)->fOutxCtsFlow = TRUE;
+      (INT_INFO(*dev)->params)->fRtsControl = RTS_CONTROL_HANDSHAKE;
+    } else {
+      (INT_INFO(*dev)->params)->fOutxCtsFlow = FALSE;
+      (INT_INFO(*dev)->params)->fRtsControl = RTS_CONTROL_ENABLE;
+    }
+    gboolean eval = SetCommState(INT_INFO(*dev)->k_com, INT_INFO(*dev)->params);
+    errno = (int) (GetLastError()!=0 ? GetLastError() : (DWORD) errno);
+    if (!eval) {
+      g_critical("Unable to set hardware control configuration. Won't restore original.");
+      PRINT_ERRNO(g_critical);
+      g_mutex_unlock(ACCESS_LOCK);
+      return FALSE;
+    }
+    g_mutex_unlock(ACCESS_LOCK);
+    return TRUE;
+  }
+  errno = (int) (GetLastError()!=0 ? GetLastError() : (DWORD) errno);
+  g_critical("Unable to read port information.");
+  PRINT_ERRNO(g_critical);
+  g_mutex_unlock(ACCESS_LOCK);
+  return FALSE;
+}
+
+gboolean get_hardware_control_flow(const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  g_mutex_lock(ACCESS_LOCK);
+  if (GetCommState(INT_INFO(*dev)->k_com, INT_INFO(*dev)->params)) {
+    errno = (int) (GetLastError()!=0 ? GetLastError() : (DWORD) errno);
+    g_mutex_unlock(ACCESS_LOCK);
+    return (gboolean) (INT_INFO(*dev)->params)->fOutxCtsFlow;
+  }
+  errno = (int) (GetLastError()!=0 ? GetLastError() : (DWORD) errno);
+  g_critical("Unable to read port information.");
+  PRINT_ERRNO(g_critical);
+  g_mutex_unlock(ACCESS_LOCK);
+  return FALSE;
+}
+
 gboolean write_byte(gchar byte, const struct AbstractSerialDevice **cdev) {
   struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  // El puerto es un HANDLE, no un descriptor: los registros de la traza llevan -1
+  SERIAL_TRACE(SERIAL_TRACE_WRITE_BEGIN, -1, 1, 0);
   gboolean isReading = !(g_mutex_trylock(READ_LOCK));
   DWORD n;
+  guint32 lock_wait = 0;
   if (isReading) {
-    g_mutex_lock(WRITE_LOCK);
-    g_debug("Performing \'write\' operation while a \'read\' operation is running.");
+    SERIAL_TRACE_LOCK(WRITE_LOCK, lock_wait);
+    SERIAL_TRACE(SERIAL_TRACE_WRITE_CONTENDED, -1, 1, lock_wait);
     WriteFile(INT_INFO(*dev)->k_com, &byte, 1, &n, NULL);
     g_mutex_unlock(WRITE_LOCK);
   } else {
@@ -207,12 +266,14 @@ gboolean write_byte(gchar byte, const struct AbstractSerialDevice **cdev) {
     // lock
     g_mutex_unlock(READ_LOCK);
     g_mutex_lock(ACCESS_LOCK);
-    g_mutex_lock(WRITE_LOCK);
+    SERIAL_TRACE_LOCK(WRITE_LOCK, lock_wait);
     WriteFile(INT_INFO(*dev)->k_com, &byte, 1, &n, NULL);
     g_mutex_unlock(WRITE_LOCK);
     g_mutex_unlock(ACCESS_LOCK);
   }
+  SERIAL_TRACE(SERIAL_TRACE_WRITE_END, -1, n, lock_wait);
   if (n==1) {
+    atomic_fetch_add_explicit(&INT_INFO(*dev)->tx_bytes, 1, memory_order_relaxed);
     return TRUE;
   }
   g_critical("Returning with an invalid number of bytes sent. Expected %d, sent %d", 1, (int) n);
@@ -220,32 +281,201 @@ gboolean write_byte(gchar byte, const struct AbstractSerialDevice **cdev) {
   return FALSE;
 }
 
-char read_byte(const struct AbstractSerialDevice **cdev) {
+gssize write_buffer(const guchar *buffer, gsize size, const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  // El HANDLE no es OVERLAPPED: WriteFile bloquea hasta escribir todo, así que se limita el tamaño de cada llamada
+  // para que quien escribe pueda revisar si lo cancelaron
+  DWORD n = 0;
+  // Aquí la contrapresión es el propio WriteFile: si el otro extremo desactivó CTS, el tiempo que bloquea se cuenta
+  // como detenido por el flujo
+  DWORD comm_errors;
+  COMSTAT comm_status;
+  gboolean held = ClearCommError(INT_INFO(*dev)->k_com, &comm_errors, &comm_status) && comm_status.fCtsHold;
+  SERIAL_TRACE(SERIAL_TRACE_WRITE_BEGIN, -1, size, 0);
+  guint32 lock_wait = 0;
+  SERIAL_TRACE_LOCK(WRITE_LOCK, lock_wait);
+  gint64 start = g_get_monotonic_time();
+  gboolean eval = WriteFile(INT_INFO(*dev)->k_com, buffer, (DWORD) MIN(size, WIN_WRITE_CHUNK), &n, NULL);
+  guint64 waited = (guint64) (g_get_monotonic_time() - start)*1000;
+  g_mutex_unlock(WRITE_LOCK);
+  SERIAL_TRACE(SERIAL_TRACE_WRITE_END, -1, n, lock_wait);
+  atomic_fetch_add_explicit(&INT_INFO(*dev)->tx_wait_ns, waited, memory_order_relaxed);
+  if (held) {
+    atomic_fetch_add_explicit(&INT_INFO(*dev)->flow_blocked_ns, waited, memory_order_relaxed);
+  }
+  if (!eval) {
+    errno = EIO;
+    return -1;
+  }
+  atomic_fetch_add_explicit(&INT_INFO(*dev)->tx_bytes, n, memory_order_relaxed);
+  return (gssize) n;
+}
+
+gboolean wait_writable(gint timeout, const struct AbstractSerialDevice **cdev) {
+  // `write_buffer` ya bloquea hasta que la cola acepta los bytes
+  return TRUE;
+}
+
+gboolean drain_output(const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  return FlushFileBuffers(INT_INFO(*dev)->k_com);
+}
+
+gboolean flush_output(const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  atomic_fetch_add(&INT_INFO(*dev)->flush_count, 1);
+  return PurgeComm(INT_INFO(*dev)->k_com, PURGE_TXABORT | PURGE_TXCLEAR);
+}
+
+glong get_line_rate(const struct AbstractSerialDevice **cdev) {
+  return get_baud_rate(cdev);
+}
+
+guint get_frame_bits(const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  g_mutex_lock(ACCESS_LOCK);
+  GetCommState(INT_INFO(*dev)->k_com, INT_INFO(*dev)->params);
+  guint bits = 1 + (INT_INFO(*dev)->params)->ByteSize;
+  bits += (INT_INFO(*dev)->params)->Parity!=NOPARITY ? 1 : 0;
+  bits += (INT_INFO(*dev)->params)->StopBits==TWOSTOPBITS ? 2 : 1;
+  g_mutex_unlock(ACCESS_LOCK);
+  return bits;
+}
+
+gboolean set_pacing(const struct SerialPacing *pacing, const struct AbstractSerialDevice **cdev) {
+  // Win32 no tiene temporizadores con fechas absolutas de resolución menor a un milisegundo; solamente se acepta
+  // desactivar las pausas
+  if (pacing->inter_byte!=0.0 || pacing->inter_frame!=0.0) {
+    g_critical("Paced transmission is not supported on Win32.");
+    errno = ENOSYS;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+void get_pacing(struct SerialPacing *pacing, const struct AbstractSerialDevice **cdev) {
+  *pacing = (struct SerialPacing) {0};
+}
+
+gssize write_frame(const guchar *buffer, gsize size, const struct AbstractSerialDevice **cdev) {
   struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  guint flushes = atomic_load(&INT_INFO(*dev)->flush_count);
+  gsize sent = 0;
+  while (sent < size) {
+    if (atomic_load(&INT_INFO(*dev)->flush_count)!=flushes) {
+      errno = ECANCELED;
+      return -1;
+    }
+    gssize n = write_buffer(buffer + sent, size - sent, cdev);
+    if (n==-1 && atomic_load(&INT_INFO(*dev)->flush_count)!=flushes) {
+      // PURGE_TXABORT hace fallar al WriteFile en curso
+      errno = ECANCELED;
+    }
+    if (n==-1) {
+      return -1;
+    }
+    sent += (gsize) n;
+  }
+  return (gssize) sent;
+}
+
+void get_pacing_stats(struct SerialPacingStats *stats, const struct AbstractSerialDevice **cdev) {
+  *stats = (struct SerialPacingStats) {0};
+}
+
+gint get_native_fd(const struct AbstractSerialDevice **cdev) {
+  // El puerto es un HANDLE de Win32, no un descriptor de archivo
+  return -1;
+}
+
+void add_stats(const struct SerialStats *stats, const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  atomic_fetch_add_explicit(&INT_INFO(*dev)->rx_bytes, stats->rx_bytes, memory_order_relaxed);
+  atomic_fetch_add_explicit(&INT_INFO(*dev)->tx_bytes, stats->tx_bytes, memory_order_relaxed);
+  atomic_fetch_add_explicit(&INT_INFO(*dev)->tx_wait_ns, stats->tx_wait_ns, memory_order_relaxed);
+  atomic_fetch_add_explicit(&INT_INFO(*dev)->flow_blocked_ns, stats->flow_blocked_ns, memory_order_relaxed);
+}
+
+// `read_buffer` sin los puntos de traza
+static gssize wait_and_read(guchar *buffer, gsize size, struct AbstractSerialDevice **dev) {
   DWORD n;
-  gchar readed;
   do {
-    if (*dev==NULL) {
-      g_debug("Read operation cancelled: resource not available.");
+    if (INT_INFO(*dev)->open==FALSE) {
+      SERIAL_TRACE(SERIAL_TRACE_READ_CANCELLED, -1, 0, 0);
       errno = ECANCELED;
       return -1;
     }
-    g_mutex_lock(ACCESS_LOCK);
-    if (INT_INFO(*dev)->open==FALSE) {
-      g_mutex_unlock(ACCESS_LOCK);
-      g_debug("Read operation cancelled: file HANDLE is closed.");
+    // El HANDLE no es OVERLAPPED, así que no hay forma de esperar al puerto y a un evento a la vez. La cancelación se
+    // revisa con cada timeout de `ReadFile` (1/60 s).
+    if (atomic_exchange(&INT_INFO(*dev)->cancel, FALSE)) {
+      SERIAL_TRACE(SERIAL_TRACE_READ_CANCELLED, -1, 0, 0);
       errno = ECANCELED;
       return -1;
     }
-    g_thread_yield();
     g_mutex_lock(READ_LOCK);
-    ReadFile(INT_INFO(*dev)->k_com, &readed, 1, &n, NULL);
+    gboolean eval = ReadFile(INT_INFO(*dev)->k_com, buffer, (DWORD) size, &n, NULL);
     g_mutex_unlock(READ_LOCK);
-    g_mutex_unlock(ACCESS_LOCK);
-    g_thread_yield();
-  } while (n!=1);
-  g_debug("Returning from blocking-read, read '%d' from port.", readed);
-  return readed;
+    if (!eval) {
+      errno = EIO;
+      return -1;
+    }
+  } while (n==0);
+  atomic_fetch_add_explicit(&INT_INFO(*dev)->rx_bytes, n, memory_order_relaxed);
+  return (gssize) n;
+}
+
+gssize read_buffer(guchar *buffer, gsize size, const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  SERIAL_TRACE(SERIAL_TRACE_READ_BEGIN, -1, size, 0);
+  gssize r = wait_and_read(buffer, size, dev);
+  SERIAL_TRACE(SERIAL_TRACE_READ_END, -1, MAX(r, 0), 0);
+  return r;
+}
+
+gssize read_available(guchar *buffer, gsize size, const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  // Solamente se piden los bytes que ya están en la cola, así que `ReadFile` no espera al timeout
+  DWORD errors;
+  COMSTAT status;
+  if (!ClearCommError(INT_INFO(*dev)->k_com, &errors, &status)) {
+    errno = EIO;
+    return -1;
+  }
+  DWORD n = MIN(status.cbInQue, (DWORD) size);
+  if (n==0) {
+    return 0;
+  }
+  g_mutex_lock(READ_LOCK);
+  gboolean eval = ReadFile(INT_INFO(*dev)->k_com, buffer, n, &n, NULL);
+  g_mutex_unlock(READ_LOCK);
+  if (!eval) {
+    errno = EIO;
+    return -1;
+  }
+  atomic_fetch_add_explicit(&INT_INFO(*dev)->rx_bytes, n, memory_order_relaxed);
+  SERIAL_TRACE(SERIAL_TRACE_READ_AVAILABLE, -1, n, 0);
+  return (gssize) n;
+}
+
+char read_byte(const struct AbstractSerialDevice **cdev) {
+  guchar readed;
+  if (read_buffer(&readed, 1, cdev)==1) {
+    return (char) readed;
+  }
+  return (char) -1;
+}
+
+void cancel_read(const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  INT_INFO(*dev)->cancel = TRUE;
+}
+
+void get_stats(struct SerialStats *stats, const struct AbstractSerialDevice **cdev) {
+  struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
+  stats->rx_bytes = atomic_load_explicit(&INT_INFO(*dev)->rx_bytes, memory_order_relaxed);
+  stats->tx_bytes = atomic_load_explicit(&INT_INFO(*dev)->tx_bytes, memory_order_relaxed);
+  stats->tx_wait_ns = atomic_load_explicit(&INT_INFO(*dev)->tx_wait_ns, memory_order_relaxed);
+  stats->flow_blocked_ns = atomic_load_explicit(&INT_INFO(*dev)->flow_blocked_ns, memory_order_relaxed);
 }
 
 //===--------------------------------------------------------------------------------------------------------------===//
@@ -275,6 +505,14 @@ gboolean open_serial_port(const struct AbstractSerialDevice **cdev, GString *os_
     // Reservar memoria para el driver abstracto
     *dev = malloc(sizeof(struct AbstractSerialDevice));
     (*dev)->_internal_info = malloc(sizeof(struct InternalRepresentation));
+    (*dev)->_listener = NULL;
+    (*dev)->_close = NULL;
+    INT_INFO(*dev)->cancel = FALSE;
+    atomic_init(&INT_INFO(*dev)->rx_bytes, 0);
+    atomic_init(&INT_INFO(*dev)->tx_bytes, 0);
+    atomic_init(&INT_INFO(*dev)->tx_wait_ns, 0);
+    atomic_init(&INT_INFO(*dev)->flow_blocked_ns, 0);
+    atomic_init(&INT_INFO(*dev)->flush_count, 0);
     INT_INFO(*dev)->params = malloc(sizeof(DCB));
     INT_INFO(*dev)->tout = malloc(sizeof(COMMTIMEOUTS));
     // Inicializar los mutex
@@ -324,8 +562,26 @@ gboolean open_serial_port(const struct AbstractSerialDevice **cdev, GString *os_
       (*dev)->get_parity_odd_neven = get_parity_odd_neven;
       (*dev)->set_software_control_flow = set_software_control_flow;
       (*dev)->get_software_control_flow = get_software_control_flow;
+      (*dev)->set_hardware_control_flow = set_hardware_control_flow;
+      (*dev)->get_hardware_control_flow = get_hardware_control_flow;
       (*dev)->write_byte = write_byte;
       (*dev)->read_byte = read_byte;
+      (*dev)->read_buffer = read_buffer;
+      (*dev)->read_available = read_available;
+      (*dev)->cancel_read = cancel_read;
+      (*dev)->get_stats = get_stats;
+      (*dev)->write_buffer = write_buffer;
+      (*dev)->wait_writable = wait_writable;
+      (*dev)->drain_output = drain_output;
+      (*dev)->flush_output = flush_output;
+      (*dev)->get_line_rate = get_line_rate;
+      (*dev)->get_frame_bits = get_frame_bits;
+      (*dev)->set_pacing = set_pacing;
+      (*dev)->get_pacing = get_pacing;
+      (*dev)->write_frame = write_frame;
+      (*dev)->get_pacing_stats = get_pacing_stats;
+      (*dev)->get_native_fd = get_native_fd;
+      (*dev)->add_stats = add_stats;
 
       // Configuracion inicial
       (INT_INFO(*dev)->params)->ByteSize = 0x08;
@@ -357,23 +613,34 @@ gboolean open_serial_port(const struct AbstractSerialDevice **cdev, GString *os_
     free_sources(dev);
     return FALSE;
   }
+  return FALSE;
+}
+
+gboolean open_serial_port_with_backend(const struct AbstractSerialDevice **cdev,
+                                       GString *os_dev,
+                                       enum SerialBackend backend) {
+  // io_uring solamente existe en Linux
+  if (backend!=SERIAL_BACKEND_DEFAULT) {
+    errno = ENOTSUP;
+    return FALSE;
+  }
+  return open_serial_port(cdev, os_dev);
 }
 
 void close_serial_port(const struct AbstractSerialDevice **cdev) {
   struct AbstractSerialDevice **dev = (struct AbstractSerialDevice **) cdev;
   if (dev!=NULL && *dev!=NULL) {
+    // Primero termina el hilo lector: después del join nadie más puede estar usando el driver desde ese hilo
+    stop_serial_listener(cdev);
+    if ((*dev)->_close!=NULL) {
+      (*dev)->_close(dev);
+      return;
+    }
     g_mutex_lock(ACCESS_LOCK);
     INT_INFO(*dev)->open = FALSE;
     CloseHandle(INT_INFO(*dev)->k_com);
     g_mutex_unlock(ACCESS_LOCK);
-    g_debug("HANDLE %d closed. The driver will be unlocked and this thread will yield.",
-            INT_INFO(*dev)->k_com);
-    g_thread_yield();
-    g_mutex_lock(ACCESS_LOCK);
-    g_debug(
-        "Thread returned from yield for HANDLE %d. The driver will be permanently locked and freed.",
-        INT_INFO(*dev)->k_com);
+    g_debug("HANDLE %d closed. The driver will be freed.", INT_INFO(*dev)->k_com);
     free_sources(dev);
   }
 }
-
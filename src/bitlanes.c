@@ -0,0 +1,170 @@
+//===-- src/bitlanes.c - Vista de bits estilo analizador lógico -------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Las columnas se dibujan en una superficie de Cairo que funciona como buffer circular: cada byte nuevo ocupa la
+/// siguiente columna y, al llegar al final, se vuelve a empezar desde el principio. Así, en cada frame solamente se
+/// dibujan las columnas nuevas y al mostrar se copia la superficie en dos partes (de la columna más vieja al final y
+/// del principio a la más nueva). No hay que desplazar nada.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#include "bitlanes.h"
+#include "config.h"
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Estructuras de datos
+//===--------------------------------------------------------------------------------------------------------------===//
+// Ocho carriles de bits más la franja del valor del byte
+#define BITLANES_ROWS                   (APP_SWO_SIZE + 1)
+#define BITLANES_DATA                   "bit-lanes-data"
+
+struct BitLanes {
+  GtkWidget *area;
+  // Superficie circular con una columna por byte
+  cairo_surface_t *surface;
+  // Siguiente columna a dibujar en la superficie y columnas que ya tienen datos
+  guint write_column;
+  guint filled;
+  // Bytes que llegaron desde el último frame. Si llegan más de los que caben, solamente importan los últimos
+  GMutex pending_lock;
+  guchar pending[APP_BITLANES_COLUMNS];
+  guint pending_head;
+  guint pending_count;
+};
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                   Funciones extra
+//===--------------------------------------------------------------------------------------------------------------===//
+static void free_bit_lanes(gpointer data) {
+  struct BitLanes *lanes = data;
+  if (lanes->surface!=NULL) {
+    cairo_surface_destroy(lanes->surface);
+  }
+  g_mutex_clear(&lanes->pending_lock);
+  g_free(lanes);
+}
+
+// Dibuja un byte en su columna de la superficie circular
+static void draw_column(cairo_t *cr, guint column, guchar value) {
+  gdouble x = column*APP_BITLANES_COLUMN_WIDTH;
+  for (int bit = 0; bit < APP_SWO_SIZE; bit++) {
+    if ((value >> bit) & 0x01) {
+      cairo_set_source_rgb(cr, 0.2, 0.9, 0.3);
+    } else {
+      cairo_set_source_rgb(cr, 0.12, 0.2, 0.12);
+    }
+    cairo_rectangle(cr, x, bit*APP_BITLANES_LANE_HEIGHT, APP_BITLANES_COLUMN_WIDTH, APP_BITLANES_LANE_HEIGHT - 1);
+    cairo_fill(cr);
+  }
+  // La franja del valor: más claro mientras mayor es el byte
+  gdouble level = value/255.0;
+  cairo_set_source_rgb(cr, 0.2 + 0.8*level, 0.2 + 0.6*level, 0.2);
+  cairo_rectangle(cr, x, APP_SWO_SIZE*APP_BITLANES_LANE_HEIGHT, APP_BITLANES_COLUMN_WIDTH, APP_BITLANES_LANE_HEIGHT);
+  cairo_fill(cr);
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                        Callbacks para los eventos de la GUI
+//===--------------------------------------------------------------------------------------------------------------===//
+static gboolean on_bit_lanes_tick(GtkWidget *widget, GdkFrameClock *clock, gpointer user_data) {
+  struct BitLanes *lanes = user_data;
+  guchar fresh[APP_BITLANES_COLUMNS];
+  g_mutex_lock(&lanes->pending_lock);
+  guint count = lanes->pending_count;
+  guint start = (lanes->pending_head + APP_BITLANES_COLUMNS - count)%APP_BITLANES_COLUMNS;
+  for (guint i = 0; i < count; i++) {
+    fresh[i] = lanes->pending[(start + i)%APP_BITLANES_COLUMNS];
+  }
+  lanes->pending_count = 0;
+  g_mutex_unlock(&lanes->pending_lock);
+  if (count==0) {
+    return G_SOURCE_CONTINUE;
+  }
+  if (lanes->surface==NULL) {
+    lanes->surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+                                                APP_BITLANES_COLUMNS*APP_BITLANES_COLUMN_WIDTH,
+                                                BITLANES_ROWS*APP_BITLANES_LANE_HEIGHT);
+  }
+  // Solamente se dibujan las columnas nuevas
+  cairo_t *cr = cairo_create(lanes->surface);
+  for (guint i = 0; i < count; i++) {
+    draw_column(cr, lanes->write_column, fresh[i]);
+    lanes->write_column = (lanes->write_column + 1)%APP_BITLANES_COLUMNS;
+  }
+  cairo_destroy(cr);
+  lanes->filled = MIN(lanes->filled + count, APP_BITLANES_COLUMNS);
+  gtk_widget_queue_draw(widget);
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean on_bit_lanes_draw(GtkWidget *widget, cairo_t *cr, gpointer user_data) {
+  struct BitLanes *lanes = user_data;
+  gdouble width = gtk_widget_get_allocated_width(widget);
+  gdouble height = gtk_widget_get_allocated_height(widget);
+  cairo_set_source_rgb(cr, 0.05, 0.05, 0.05);
+  cairo_paint(cr);
+  if (lanes->surface==NULL) {
+    return FALSE;
+  }
+  gdouble surface_width = APP_BITLANES_COLUMNS*APP_BITLANES_COLUMN_WIDTH;
+  cairo_scale(cr, width/surface_width, height/(BITLANES_ROWS*APP_BITLANES_LANE_HEIGHT));
+  // La columna más nueva queda pegada a la derecha: [write_column, fin) va primero y [0, write_column) después
+  gdouble split = lanes->write_column*APP_BITLANES_COLUMN_WIDTH;
+  gdouble visible_start = surface_width - lanes->filled*APP_BITLANES_COLUMN_WIDTH;
+  cairo_rectangle(cr, visible_start, 0, surface_width - visible_start, BITLANES_ROWS*APP_BITLANES_LANE_HEIGHT);
+  cairo_clip(cr);
+  cairo_set_source_surface(cr, lanes->surface, -split, 0);
+  cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_NEAREST);
+  cairo_paint(cr);
+  cairo_set_source_surface(cr, lanes->surface, surface_width - split, 0);
+  cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_NEAREST);
+  cairo_paint(cr);
+  return FALSE;
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                           Implementación de la interfaz
+//===--------------------------------------------------------------------------------------------------------------===//
+struct BitLanes *bit_lanes_new(void) {
+  struct BitLanes *lanes = g_new0(struct BitLanes, 1);
+  g_mutex_init(&lanes->pending_lock);
+  lanes->area = gtk_drawing_area_new();
+  gtk_widget_set_size_request(lanes->area,
+                              APP_BITLANES_COLUMNS*APP_BITLANES_COLUMN_WIDTH,
+                              BITLANES_ROWS*APP_BITLANES_LANE_HEIGHT);
+  g_object_set_data_full(G_OBJECT(lanes->area), BITLANES_DATA, lanes, free_bit_lanes);
+  g_signal_connect(lanes->area, "draw", G_CALLBACK(on_bit_lanes_draw), lanes);
+  gtk_widget_add_tick_callback(lanes->area, on_bit_lanes_tick, lanes, NULL);
+  return lanes;
+}
+
+GtkWidget *bit_lanes_get_widget(struct BitLanes *lanes) {
+  return lanes->area;
+}
+
+void bit_lanes_push(struct BitLanes *lanes, const guchar *data, gsize length) {
+  // De un bloque grande solamente caben los últimos bytes
+  if (length > APP_BITLANES_COLUMNS) {
+    data += length - APP_BITLANES_COLUMNS;
+    length = APP_BITLANES_COLUMNS;
+  }
+  g_mutex_lock(&lanes->pending_lock);
+  for (gsize i = 0; i < length; i++) {
+    lanes->pending[lanes->pending_head] = data[i];
+    lanes->pending_head = (lanes->pending_head + 1)%APP_BITLANES_COLUMNS;
+  }
+  lanes->pending_count = MIN(lanes->pending_count + (guint) length, APP_BITLANES_COLUMNS);
+  g_mutex_unlock(&lanes->pending_lock);
+}
@@ -0,0 +1,37 @@
+//===-- src/bitlanes.h - Vista de bits estilo analizador lógico -------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===---------------------------------------------------------------------------------------------------------------===//
+///
+/// Muestra los últimos APP_BITLANES_COLUMNS bytes recibidos como ocho carriles de bits que se desplazan (uno por bit)
+/// más una franja con el valor de cada byte.
+///
+//===---------------------------------------------------------------------------------------------------------------===//
+
+#ifndef BITLANES_H
+#define BITLANES_H
+#include <gtk/gtk.h>
+
+// El estado es opaco. Pertenece al widget y se libera cuando el widget se destruye.
+struct BitLanes;
+
+// Crea la vista
+struct BitLanes *bit_lanes_new(void);
+
+// Devuelve el widget (un GtkDrawingArea) para agregarlo a un contenedor
+GtkWidget *bit_lanes_get_widget(struct BitLanes *);
+
+// Agrega bytes recibidos. Se puede llamar desde el hilo lector: solamente copia a un buffer pendiente, y el widget
+// dibuja las columnas nuevas en el siguiente frame.
+void bit_lanes_push(struct BitLanes *, const guchar *, gsize);
+#endif // BITLANES_H
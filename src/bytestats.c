@@ -0,0 +1,241 @@
+//===-- src/bytestats.c - Estadísticas de los bytes recibidos ---------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// El hilo lector suma cada bloque al histograma con `serial_histogram_add` (varias tablas, ver `histogram.h`); eso
+/// es todo lo que hace por byte. Las demás estadísticas salen del histograma: el mínimo y el máximo son el primer y
+/// el último valor con cuenta, la media es la suma ponderada y los imprimibles son la suma de sus valores. Así el
+/// costo en la GUI no depende de cuántos bytes llegan.
+///
+/// En cada frame el widget copia el histograma (el mutex se toma solamente para la copia) y, si cambió, recalcula
+/// el texto y redibuja. Los bytes por segundo se miden cada APP_BYTESTATS_RATE_MS con el reloj de frames.
+///
+/// La pausa más larga sale de las fechas de los bloques (`timestamp.h`): la del primer byte de cada bloque contra la
+/// del último byte del bloque anterior, menos el tiempo que tarda en llegar el propio byte.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#include "bytestats.h"
+#include "config.h"
+#include <abserio/histogram.h>
+#include <abserio/payload.h>
+#include <abserio/timestamp.h>
+#include <string.h>
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Estructuras de datos
+//===--------------------------------------------------------------------------------------------------------------===//
+#define BYTESTATS_DATA                  "byte-stats-data"
+
+struct ByteStats {
+  GtkWidget *grid;
+  GtkWidget *area;
+  GtkWidget *label;
+  // Lo que cuenta el hilo lector
+  GMutex lock;
+  guint64 histogram[256];
+  guint64 total;
+  // Fecha (CLOCK_MONOTONIC, ns) del último byte recibido, 0 si no ha llegado ninguno, y la pausa más larga
+  gint64 last_byte_ns;
+  gint64 max_idle_ns;
+  // Copia del último frame; la usan el texto y el dibujo
+  guint64 snapshot[256];
+  guint64 snapshot_total;
+  gint64 snapshot_idle_ns;
+  // Inicio de la medición de bytes por segundo (en microsegundos del reloj de frames, 0 si no ha empezado)
+  gint64 rate_time;
+  guint64 rate_total;
+  gdouble rate;
+};
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                   Funciones extra
+//===--------------------------------------------------------------------------------------------------------------===//
+static void free_byte_stats(gpointer data) {
+  struct ByteStats *stats = data;
+  g_mutex_clear(&stats->lock);
+  g_free(stats);
+}
+
+static gboolean is_printable(guint value) {
+  return (value >= 0x20 && value <= 0x7E) || value=='\t' || value=='\n' || value=='\r';
+}
+
+// Recalcula el texto a partir de la copia
+static void update_label(struct ByteStats *stats) {
+  const guint64 *histogram = stats->snapshot;
+  guint64 total = stats->snapshot_total;
+  gchar *rate = g_format_size((guint64) stats->rate);
+  if (total==0) {
+    gchar *text = g_strdup_printf(APP_BYTESTATS_EMPTY, rate);
+    gtk_label_set_text(GTK_LABEL(stats->label), text);
+    g_free(text);
+    g_free(rate);
+    return;
+  }
+  guint min = 0;
+  while (histogram[min]==0) {
+    min++;
+  }
+  guint max = 255;
+  while (histogram[max]==0) {
+    max--;
+  }
+  gdouble weighted = 0.0;
+  guint64 printable = 0;
+  for (guint value = min; value <= max; value++) {
+    weighted += (gdouble) value*histogram[value];
+    printable += is_printable(value) ? histogram[value] : 0;
+  }
+  gchar min_text[SERIAL_PAYLOAD_BYTE_MAX];
+  gchar max_text[SERIAL_PAYLOAD_BYTE_MAX];
+  serial_payload_format_byte((guint8) min, SERIAL_PAYLOAD_HEX, min_text);
+  serial_payload_format_byte((guint8) max, SERIAL_PAYLOAD_HEX, max_text);
+  gchar *text = g_strdup_printf(APP_BYTESTATS_LABEL,
+                                total,
+                                rate,
+                                serial_histogram_entropy(histogram, total),
+                                100.0*printable/total,
+                                min_text,
+                                max_text,
+                                weighted/total,
+                                stats->snapshot_idle_ns/1e6);
+  gtk_label_set_text(GTK_LABEL(stats->label), text);
+  g_free(text);
+  g_free(rate);
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                        Callbacks para los eventos de la GUI
+//===--------------------------------------------------------------------------------------------------------------===//
+static gboolean on_byte_stats_tick(GtkWidget *widget, GdkFrameClock *clock, gpointer user_data) {
+  struct ByteStats *stats = user_data;
+  g_mutex_lock(&stats->lock);
+  gboolean changed = stats->total!=stats->snapshot_total;
+  if (changed) {
+    memcpy(stats->snapshot, stats->histogram, sizeof(stats->snapshot));
+    stats->snapshot_total = stats->total;
+    stats->snapshot_idle_ns = stats->max_idle_ns;
+  }
+  g_mutex_unlock(&stats->lock);
+  gint64 now = gdk_frame_clock_get_frame_time(clock);
+  if (stats->rate_time==0) {
+    stats->rate_time = now;
+    stats->rate_total = stats->snapshot_total;
+  } else if (now - stats->rate_time >= APP_BYTESTATS_RATE_MS*1000) {
+    gdouble rate = (stats->snapshot_total - stats->rate_total)*1e6/(now - stats->rate_time);
+    changed = changed || rate!=stats->rate;
+    stats->rate = rate;
+    stats->rate_time = now;
+    stats->rate_total = stats->snapshot_total;
+  }
+  if (changed) {
+    update_label(stats);
+    gtk_widget_queue_draw(widget);
+  }
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean on_byte_stats_draw(GtkWidget *widget, cairo_t *cr, gpointer user_data) {
+  struct ByteStats *stats = user_data;
+  gdouble width = gtk_widget_get_allocated_width(widget);
+  gdouble height = gtk_widget_get_allocated_height(widget);
+  cairo_set_source_rgb(cr, 0.05, 0.05, 0.05);
+  cairo_paint(cr);
+  guint64 peak = 0;
+  for (guint value = 0; value < 256; value++) {
+    peak = MAX(peak, stats->snapshot[value]);
+  }
+  if (peak==0) {
+    return FALSE;
+  }
+  // Una barra por valor, con la altura relativa al valor más frecuente; verde para los imprimibles, gris para los
+  // de control y naranja para los de 0x80 en adelante
+  gdouble bar = width/256.0;
+  for (guint value = 0; value < 256; value++) {
+    if (stats->snapshot[value]==0) {
+      continue;
+    }
+    if (is_printable(value)) {
+      cairo_set_source_rgb(cr, 0.2, 0.9, 0.3);
+    } else if (value < 0x80) {
+      cairo_set_source_rgb(cr, 0.6, 0.6, 0.6);
+    } else {
+      cairo_set_source_rgb(cr, 0.9, 0.6, 0.2);
+    }
+    gdouble bar_height = MAX(1.0, height*stats->snapshot[value]/peak);
+    cairo_rectangle(cr, value*bar, height - bar_height, MAX(1.0, bar), bar_height);
+    cairo_fill(cr);
+  }
+  return FALSE;
+}
+
+static void on_byte_stats_reset(GtkButton *button, gpointer user_data) {
+  struct ByteStats *stats = user_data;
+  g_mutex_lock(&stats->lock);
+  memset(stats->histogram, 0, sizeof(stats->histogram));
+  stats->total = 0;
+  stats->last_byte_ns = 0;
+  stats->max_idle_ns = 0;
+  g_mutex_unlock(&stats->lock);
+  memset(stats->snapshot, 0, sizeof(stats->snapshot));
+  stats->snapshot_total = 0;
+  stats->snapshot_idle_ns = 0;
+  stats->rate_time = 0;
+  stats->rate = 0.0;
+  update_label(stats);
+  gtk_widget_queue_draw(stats->area);
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                           Implementación de la interfaz
+//===--------------------------------------------------------------------------------------------------------------===//
+struct ByteStats *byte_stats_new(void) {
+  struct ByteStats *stats = g_new0(struct ByteStats, 1);
+  g_mutex_init(&stats->lock);
+  stats->grid = gtk_grid_new();
+  g_object_set_data_full(G_OBJECT(stats->grid), BYTESTATS_DATA, stats, free_byte_stats);
+  stats->area = gtk_drawing_area_new();
+  gtk_widget_set_size_request(stats->area, APP_BYTESTATS_WIDTH, APP_BYTESTATS_HEIGHT);
+  gtk_widget_set_vexpand(stats->area, TRUE);
+  gtk_grid_attach(GTK_GRID(stats->grid), stats->area, 0, 0, 1, 1);
+  stats->label = gtk_label_new(NULL);
+  gtk_label_set_xalign(GTK_LABEL(stats->label), 0.0f);
+  gtk_grid_attach(GTK_GRID(stats->grid), stats->label, 0, 1, 1, 1);
+  GtkWidget *reset = gtk_button_new_with_label(APP_STR_RESET_STATS);
+  gtk_grid_attach(GTK_GRID(stats->grid), reset, 0, 2, 1, 1);
+  update_label(stats);
+
+  g_signal_connect(stats->area, "draw", G_CALLBACK(on_byte_stats_draw), stats);
+  g_signal_connect(reset, "clicked", G_CALLBACK(on_byte_stats_reset), stats);
+  gtk_widget_add_tick_callback(stats->area, on_byte_stats_tick, stats, NULL);
+  return stats;
+}
+
+GtkWidget *byte_stats_get_widget(struct ByteStats *stats) {
+  return stats->grid;
+}
+
+void byte_stats_push(struct ByteStats *stats, const guchar *data, gsize length, const struct SerialTimestamp *stamp) {
+  // El primer byte empieza a llegar un tiempo de carácter antes de su fecha
+  gint64 first_start = serial_timestamp_byte(stamp, length, 0) - stamp->char_ns;
+  g_mutex_lock(&stats->lock);
+  serial_histogram_add(data, length, stats->histogram);
+  stats->total += length;
+  if (stats->last_byte_ns!=0) {
+    stats->max_idle_ns = MAX(stats->max_idle_ns, first_start - stats->last_byte_ns);
+  }
+  stats->last_byte_ns = stamp->monotonic_ns;
+  g_mutex_unlock(&stats->lock);
+}
@@ -0,0 +1,40 @@
+//===-- src/bytestats.h - Estadísticas de los bytes recibidos ---------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===---------------------------------------------------------------------------------------------------------------===//
+///
+/// Panel con el histograma de los 256 valores de byte recibidos y, debajo, el total de bytes, los bytes por segundo,
+/// la entropía de Shannon, la proporción de imprimibles (ASCII de 0x20 a 0x7E más TAB, LF y CR) y los valores mínimo,
+/// máximo y medio y la pausa más larga entre dos bytes. Todo cuenta desde que se creó el panel o desde el último clic
+/// en el botón para reiniciar.
+///
+//===---------------------------------------------------------------------------------------------------------------===//
+
+#ifndef BYTESTATS_H
+#define BYTESTATS_H
+#include <gtk/gtk.h>
+#include <abserio/timestamp.h>
+
+// El estado es opaco. Pertenece al widget y se libera cuando el widget se destruye.
+struct ByteStats;
+
+// Crea el panel
+struct ByteStats *byte_stats_new(void);
+
+// Devuelve el widget (el histograma, el texto y el botón) para agregarlo a un contenedor
+GtkWidget *byte_stats_get_widget(struct ByteStats *);
+
+// Cuenta un bloque recibido, con su fecha. Se puede llamar desde el hilo lector: el histograma se actualiza aquí
+// mismo y el panel toma una copia en el siguiente frame.
+void byte_stats_push(struct ByteStats *, const guchar *, gsize, const struct SerialTimestamp *);
+#endif // BYTESTATS_H
@@ -0,0 +1,237 @@
+//===-- src/captureview.c - Visor de capturas -------------------------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// La barra de desplazamiento cuenta renglones, no pixeles: su rango es el total de renglones de la captura (un
+/// gdouble es exacto hasta 2^53) y cada vez que se dibuja se leen de la captura solamente los renglones que caben.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#include "captureview.h"
+#include "config.h"
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Estructuras de datos
+//===--------------------------------------------------------------------------------------------------------------===//
+#define CAPTURE_VIEW_DATA               "capture-view-data"
+// Caracteres antes de los bytes en hexadecimal: la posición (12 dígitos) y dos espacios
+#define CAPTURE_VIEW_HEX_COLUMN         14
+
+struct CaptureView {
+  struct SerialCapture *capture;
+  GtkWidget *area;
+  GtkAdjustment *rows;
+  // Byte que se resalta (el destino del último salto), G_MAXUINT64 si no hay
+  guint64 mark;
+};
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                   Funciones extra
+//===--------------------------------------------------------------------------------------------------------------===//
+static void free_capture_view(gpointer data) {
+  struct CaptureView *view = data;
+  serial_capture_close(view->capture);
+  g_free(view);
+}
+
+// Fecha (ns desde la época Unix) en hora local con el formato dado; las fracciones de segundo se agregan aparte
+static gchar *format_capture_time(gint64 timestamp, const gchar *format) {
+  GDateTime *date = g_date_time_new_from_unix_local(timestamp/1000000000);
+  gchar *text = g_date_time_format(date, format);
+  g_date_time_unref(date);
+  return text;
+}
+
+// Interpreta el texto de la entrada: una posición o una fecha. FALSE si no se entiende.
+static gboolean parse_capture_target(struct CaptureView *view, const gchar *text, guint64 *offset) {
+  gchar *end = NULL;
+  if (text[0]!='@') {
+    *offset = g_ascii_strtoull(text, &end, 0);
+    return end!=text && *end=='\0';
+  }
+  gint64 timestamp;
+  if (text[1]=='+') {
+    gdouble seconds = g_ascii_strtod(text + 2, &end);
+    if (end==text + 2 || *end!='\0') {
+      return FALSE;
+    }
+    timestamp = serial_capture_get_start_time(view->capture) + (gint64) (seconds*1e9);
+  } else {
+    GTimeZone *local = g_time_zone_new_local();
+    GDateTime *date = g_date_time_new_from_iso8601(text + 1, local);
+    g_time_zone_unref(local);
+    if (date==NULL) {
+      return FALSE;
+    }
+    timestamp = g_date_time_to_unix(date)*1000000000 + (gint64) g_date_time_get_microsecond(date)*1000;
+    g_date_time_unref(date);
+  }
+  *offset = serial_capture_find_time(view->capture, timestamp);
+  return TRUE;
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                        Callbacks para los eventos de la GUI
+//===--------------------------------------------------------------------------------------------------------------===//
+static gboolean on_capture_view_draw(GtkWidget *widget, cairo_t *cr, gpointer user_data) {
+  struct CaptureView *view = user_data;
+  gdouble height = gtk_widget_get_allocated_height(widget);
+  cairo_set_source_rgb(cr, 0.1, 0.1, 0.1);
+  cairo_paint(cr);
+  cairo_select_font_face(cr, "monospace", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+  cairo_set_font_size(cr, APP_CAPTURE_FONT_SIZE);
+  cairo_text_extents_t glyph;
+  cairo_text_extents(cr, "0", &glyph);
+
+  // Solamente los renglones visibles se leen de la captura
+  guint rows = (guint) (height/APP_CAPTURE_ROW_HEIGHT) + 1;
+  guint64 first = (guint64) gtk_adjustment_get_value(view->rows);
+  guint64 offset = first*APP_CAPTURE_ROW_BYTES;
+  guchar *bytes = g_malloc((gsize) rows*APP_CAPTURE_ROW_BYTES);
+  gsize available = serial_capture_read(view->capture, offset, bytes, (gsize) rows*APP_CAPTURE_ROW_BYTES);
+  gint64 previous_time = G_MININT64;
+  for (guint row = 0; (gsize) row*APP_CAPTURE_ROW_BYTES < available; row++) {
+    guint64 row_offset = offset + (guint64) row*APP_CAPTURE_ROW_BYTES;
+    gsize count = MIN(APP_CAPTURE_ROW_BYTES, available - (gsize) row*APP_CAPTURE_ROW_BYTES);
+    const guchar *data = bytes + (gsize) row*APP_CAPTURE_ROW_BYTES;
+    gdouble y = (row + 1)*APP_CAPTURE_ROW_HEIGHT - 4;
+    if (view->mark >= row_offset && view->mark < row_offset + count) {
+      guint column = (guint) (view->mark - row_offset);
+      cairo_set_source_rgb(cr, 0.2, 0.7, 1.0);
+      cairo_rectangle(cr,
+                      (CAPTURE_VIEW_HEX_COLUMN + column*3 + (column >= APP_CAPTURE_ROW_BYTES/2))*glyph.x_advance + 4,
+                      row*APP_CAPTURE_ROW_HEIGHT,
+                      2*glyph.x_advance,
+                      APP_CAPTURE_ROW_HEIGHT);
+      cairo_fill(cr);
+    }
+    GString *line = g_string_sized_new(128);
+    g_string_append_printf(line, "%012" G_GINT64_MODIFIER "X  ", row_offset);
+    for (gsize i = 0; i < APP_CAPTURE_ROW_BYTES; i++) {
+      if (i==APP_CAPTURE_ROW_BYTES/2) {
+        g_string_append_c(line, ' ');
+      }
+      if (i < count) {
+        g_string_append_printf(line, "%02X ", data[i]);
+      } else {
+        g_string_append(line, "   ");
+      }
+    }
+    g_string_append_c(line, ' ');
+    for (gsize i = 0; i < count; i++) {
+      g_string_append_c(line, g_ascii_isprint(data[i]) ? (gchar) data[i] : '.');
+    }
+    // La fecha solamente se muestra cuando el renglón empieza en un bloque distinto al del renglón anterior
+    gint64 timestamp = serial_capture_get_time(view->capture, row_offset);
+    if (timestamp!=previous_time) {
+      gchar *time_text = format_capture_time(timestamp, "%H:%M:%S");
+      g_string_append_printf(line,
+                             "%*s%s.%03d",
+                             (int) (APP_CAPTURE_ROW_BYTES - count + 2),
+                             "",
+                             time_text,
+                             (int) (timestamp%1000000000/1000000));
+      g_free(time_text);
+      previous_time = timestamp;
+    }
+    cairo_set_source_rgb(cr, 0.9, 0.9, 0.9);
+    cairo_move_to(cr, 4, y);
+    cairo_show_text(cr, line->str);
+    g_string_free(line, TRUE);
+  }
+  g_free(bytes);
+  return FALSE;
+}
+
+static void on_capture_view_allocate(GtkWidget *widget, GdkRectangle *allocation, gpointer user_data) {
+  struct CaptureView *view = user_data;
+  gdouble page = MAX(1, allocation->height/APP_CAPTURE_ROW_HEIGHT);
+  gtk_adjustment_set_page_size(view->rows, page);
+  gtk_adjustment_set_page_increment(view->rows, page);
+}
+
+static gboolean on_capture_view_scroll(GtkWidget *widget, GdkEventScroll *event, gpointer user_data) {
+  struct CaptureView *view = user_data;
+  gdouble delta = 0.0;
+  if (event->direction==GDK_SCROLL_UP) {
+    delta = -APP_CAPTURE_SCROLL_ROWS;
+  } else if (event->direction==GDK_SCROLL_DOWN) {
+    delta = APP_CAPTURE_SCROLL_ROWS;
+  } else if (event->direction==GDK_SCROLL_SMOOTH) {
+    delta = event->delta_y*APP_CAPTURE_SCROLL_ROWS;
+  }
+  gtk_adjustment_set_value(view->rows, gtk_adjustment_get_value(view->rows) + delta);
+  return TRUE;
+}
+
+static void on_capture_view_scrolled(GtkAdjustment *adjustment, gpointer user_data) {
+  struct CaptureView *view = user_data;
+  gtk_widget_queue_draw(view->area);
+}
+
+static void on_capture_view_goto(GtkEntry *entry, gpointer user_data) {
+  struct CaptureView *view = user_data;
+  guint64 offset;
+  GtkStyleContext *style = gtk_widget_get_style_context(GTK_WIDGET(entry));
+  if (!parse_capture_target(view, gtk_entry_get_text(entry), &offset)) {
+    gtk_style_context_add_class(style, GTK_STYLE_CLASS_ERROR);
+    return;
+  }
+  gtk_style_context_remove_class(style, GTK_STYLE_CLASS_ERROR);
+  view->mark = offset;
+  // El renglón del destino queda arriba
+  gtk_adjustment_set_value(view->rows, (gdouble) (offset/APP_CAPTURE_ROW_BYTES));
+  gtk_widget_queue_draw(view->area);
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                           Implementación de la interfaz
+//===--------------------------------------------------------------------------------------------------------------===//
+GtkWidget *capture_view_new(struct SerialCapture *capture) {
+  struct CaptureView *view = g_new0(struct CaptureView, 1);
+  view->capture = capture;
+  view->mark = G_MAXUINT64;
+  guint64 length = serial_capture_get_length(capture);
+  gdouble total_rows = (gdouble) ((length + APP_CAPTURE_ROW_BYTES - 1)/APP_CAPTURE_ROW_BYTES);
+  view->rows = gtk_adjustment_new(0.0, 0.0, total_rows, 1.0, 1.0, 1.0);
+
+  GtkWidget *grid = gtk_grid_new();
+  g_object_set_data_full(G_OBJECT(grid), CAPTURE_VIEW_DATA, view, free_capture_view);
+  GtkWidget *goto_entry = gtk_entry_new();
+  gtk_entry_set_placeholder_text(GTK_ENTRY(goto_entry), APP_CAPTURE_GOTO_PLACEHOLDER);
+  gtk_widget_set_hexpand(goto_entry, TRUE);
+  gtk_grid_attach(GTK_GRID(grid), goto_entry, 0, 0, 1, 1);
+  gchar *start = format_capture_time(serial_capture_get_start_time(capture), APP_CAPTURE_TIME_FORMAT);
+  gchar *end = format_capture_time(serial_capture_get_end_time(capture), APP_CAPTURE_TIME_FORMAT);
+  gchar *status = g_strdup_printf(APP_CAPTURE_STATUS, length, start, end);
+  gtk_grid_attach(GTK_GRID(grid), gtk_label_new(status), 1, 0, 2, 1);
+  g_free(status);
+  g_free(end);
+  g_free(start);
+
+  view->area = gtk_drawing_area_new();
+  gtk_widget_set_hexpand(view->area, TRUE);
+  gtk_widget_set_vexpand(view->area, TRUE);
+  gtk_widget_add_events(view->area, GDK_SCROLL_MASK | GDK_SMOOTH_SCROLL_MASK);
+  gtk_grid_attach(GTK_GRID(grid), view->area, 0, 1, 2, 1);
+  GtkWidget *scrollbar = gtk_scrollbar_new(GTK_ORIENTATION_VERTICAL, view->rows);
+  gtk_grid_attach(GTK_GRID(grid), scrollbar, 2, 1, 1, 1);
+
+  g_signal_connect(view->area, "draw", G_CALLBACK(on_capture_view_draw), view);
+  g_signal_connect(view->area, "size-allocate", G_CALLBACK(on_capture_view_allocate), view);
+  g_signal_connect(view->area, "scroll-event", G_CALLBACK(on_capture_view_scroll), view);
+  g_signal_connect(view->rows, "value-changed", G_CALLBACK(on_capture_view_scrolled), view);
+  g_signal_connect(goto_entry, "activate", G_CALLBACK(on_capture_view_goto), view);
+  return grid;
+}
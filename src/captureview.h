@@ -0,0 +1,30 @@
+//===-- src/captureview.h - Visor de capturas -------------------------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===---------------------------------------------------------------------------------------------------------------===//
+///
+/// Visor de capturas grabadas: un volcado hexadecimal de APP_CAPTURE_ROW_BYTES bytes por renglón con la fecha de cada
+/// bloque. Solamente se leen de la captura los renglones visibles, así que abrir y recorrer una captura de varios GB
+/// cuesta lo mismo que una pequeña. La entrada de arriba salta a una posición (`1234`, `0x4D2`) o a una fecha
+/// (`@2018-05-01T12:00:00`, o `@+90.5` segundos desde el inicio).
+///
+//===---------------------------------------------------------------------------------------------------------------===//
+
+#ifndef CAPTUREVIEW_H
+#define CAPTUREVIEW_H
+#include <gtk/gtk.h>
+#include <abserio/capture.h>
+
+// Crea el visor para la captura dada. El widget se queda con la captura y la cierra cuando se destruye.
+GtkWidget *capture_view_new(struct SerialCapture *);
+#endif // CAPTUREVIEW_H
@@ -25,10 +25,33 @@
 #define APP_SWO_SIZE                    8
 #define APP_IDX_FORMAT                  "%02d"
 #define APP_HEX_ZERO                    "0x00"
+#define APP_BITLANES_COLUMNS            256
+#define APP_BITLANES_COLUMN_WIDTH       2
+#define APP_BITLANES_LANE_HEIGHT        14
+#define APP_RATE_SAMPLE_MS              100
+#define APP_RATE_GRAPH_WIDTH            480
+#define APP_RATE_GRAPH_HEIGHT           120
+#define APP_RATE_GRAPH_MARGIN           16
 
 #define APP_STR_MAIN_TITLE              "GTK Serial Tester"
 #define APP_STR_SEND_BYTE               "Enviar byte"
 #define APP_STR_SETUP_PORT              "PORT..."
+#define APP_STR_SWITCH_PORT             "Cambiar puerto..."
+#define APP_STR_SEND_FILE               "Enviar archivo..."
+#define APP_STR_RUN_MACRO               "Ejecutar macro"
+#define APP_STR_STOP_MACRO              "Detener macro"
+#define APP_STR_BRIDGE                  "Compartir por TCP"
+#define APP_STR_BRIDGE_ACTIVE           "TCP: %u clientes, %u monitores"
+#define APP_STR_BRIDGE_FAILED           "TCP detenido: %s"
+#define APP_STR_SHM_RING                "Flujo compartido: %s"
+#define APP_STR_RECORD                  "Grabar captura..."
+#define APP_STR_RECORDING               "Grabando captura"
+#define APP_STR_OPEN_CAPTURE            "Abrir captura..."
+#define APP_STR_RESET_STATS             "Reiniciar estadísticas"
+#define APP_STR_RESPONDER               "Respuestas automáticas..."
+#define APP_STR_RESPONDER_ACTIVE        "Contestar"
+#define APP_STR_DECODE                  "Decodificar mensajes..."
+#define APP_STR_DECODE_ACTIVE           "Decodificar"
 #define APP_STR_ASCII                   "ASCII"
 #define APP_STR_DEC                     "DEC"
 #define APP_STR_HEX                     "HEX"
@@ -40,9 +63,105 @@
 #define APP_CANCEL                      "Cancelar"
 #define APP_DIALOG_ASK_MSG_WIN          "Ingrese el número del puerto COM:"
 #define APP_DIALOG_ASK_MSG_POS          "Ingrese la ruta hacia el archivo del puerto:"
+#define APP_DIALOG_PORT_UNKNOWN         "(puerto sin información del sistema)"
 #define APP_DIALOG_BAUD_RATE            "Baud rate: "
 #define APP_DIALOG_PARITY_ENABLE        "Bit de pariedad: "
 #define APP_DIALOG_PARITY_ODD           "Bit par/!impar: "
 #define APP_DIALOG_SWCTL                "Control de flujo por software: "
+#define APP_DIALOG_HWCTL                "Control de flujo por hardware (RTS/CTS): "
+#define APP_DIALOG_INTER_BYTE           "Pausa entre bytes (caracteres): "
+#define APP_DIALOG_INTER_FRAME          "Pausa entre tramas (caracteres): "
+#define APP_DIALOG_PACING_STATS         "Carácter: %.1f us. %" G_GUINT64_FORMAT " pausas con retraso promedio de %.1f us " \
+                                        "(máx. %.1f us, jitter %.1f us)"
+#define APP_DIALOG_FLOW_STATS           "Escrituras en espera: %.2f s (%.2f s con el flujo detenido por CTS)"
+#define APP_DIALOG_JITTER_STATS         "Hilo lector en tiempo real: %" G_GUINT64_FORMAT " despertares, " \
+                                        "retraso promedio %.1f us (p99 < %.1f us, máx. %.1f us)"
+#define APP_PACING_MAX_CHARS            1000.0
+#define APP_SEND_FILE_TITLE             "Enviar archivo"
+#define APP_TRANSMIT_FORMAT             "%" G_GUINT64_FORMAT " de %" G_GUINT64_FORMAT " bytes en %.1f s (eficiencia %.0f%%)"
+#define APP_TRANSMIT_BAR                "transmit-bar"
+#define APP_TRANSMIT_LABEL              "transmit-label"
+#define APP_TRANSMIT_UPDATE_MS          100
+#define APP_SEND_PAYLOAD_TITLE          "Enviar bytes"
+#define APP_PAYLOAD_DESCRIPTION         "%" G_GSIZE_FORMAT " bytes escritos en la caja de texto"
+#define APP_PAYLOAD_BASE64_PREFIX       "b64:"
+#define APP_MACRO_PLACEHOLDER           "02 \"AT\\r\\n\" 5ms 0x1B 1s ..."
+#define APP_MACRO_POLL_MS               100
+#define APP_BRIDGE_ADDRESS              "127.0.0.1"
+#define APP_BRIDGE_PORT                 7000
+#define APP_BRIDGE_MONITOR_PORT         7001
+#define APP_SHM_RING_SIZE               (4*1024*1024)
+#define APP_STREAM_GUI_CHUNKS           256
+#define APP_STREAM_CAPTURE_CHUNKS       16384
+#define APP_STREAM_SHM_CHUNKS           1024
+#define APP_STREAM_DECODE_CHUNKS        1024
+#define APP_RECORD_TITLE                "Grabar captura"
+#define APP_OPEN_CAPTURE_TITLE          "Abrir captura"
+#define APP_CAPTURE_PATTERN             "*.abscap"
+#define APP_CAPTURE_VIEW_TITLE          "Captura: %s"
+#define APP_CAPTURE_VIEW_WIDTH          820
+#define APP_CAPTURE_VIEW_HEIGHT         480
+#define APP_CAPTURE_GOTO_PLACEHOLDER    "Ir a: 1234, 0x4D2, @2018-05-01T12:00:00, @+90.5"
+#define APP_CAPTURE_STATUS              "%" G_GUINT64_FORMAT " bytes, de %s a %s"
+#define APP_CAPTURE_TIME_FORMAT         "%Y-%m-%d %H:%M:%S"
+#define APP_CAPTURE_ROW_BYTES           16
+#define APP_CAPTURE_ROW_HEIGHT          16
+#define APP_CAPTURE_FONT_SIZE           12
+#define APP_CAPTURE_SCROLL_ROWS         3
+#define APP_CONSOLE_WIDTH               560
+#define APP_CONSOLE_ROW_HEIGHT          16
+#define APP_CONSOLE_FONT_SIZE           12
+#define APP_CONSOLE_SCROLL_ROWS         3
+#define APP_CONSOLE_TAB_WIDTH           8
+#define APP_CONSOLE_CHUNK_SIZE          (64*1024)
+#define APP_CONSOLE_SCROLLBACK_CHUNKS   256
+#define APP_CONSOLE_SCROLLBACK_LINES    1000000
+#define APP_CONSOLE_LINE_MAX            1024
+#define APP_CONSOLE_PENDING_MAX         (4*1024*1024)
+#define APP_CONSOLE_WRITE_TIMEOUT_MS    100
+#define APP_BYTESTATS_WIDTH             256
+#define APP_BYTESTATS_HEIGHT            120
+#define APP_BYTESTATS_RATE_MS           500
+#define APP_BYTESTATS_EMPTY             "0 bytes, %s/s"
+#define APP_BYTESTATS_LABEL             "%" G_GUINT64_FORMAT " bytes, %s/s\nEntropía: %.3f bits/byte\n" \
+                                        "Imprimibles: %.1f %%\nMín. %s, máx. %s, media %.1f\n" \
+                                        "Pausa más larga: %.3f ms"
+#define APP_RESPONDER_TITLE             "Respuestas automáticas"
+#define APP_RESPONDER_WIDTH             560
+#define APP_RESPONDER_HEIGHT            360
+#define APP_RESPONDER_UPDATE_MS         250
+#define APP_RESPONDER_EXAMPLE           "# Una regla por renglón: petición => [pausa] respuesta\n" \
+                                        "# \"AT\\r\" => 2ms \"OK\\r\\n\"\n"
+#define APP_RESPONDER_INACTIVE          "Sin reglas activas"
+#define APP_RESPONDER_RULE_COUNTS       "Regla %u: %" G_GUINT64_FORMAT " peticiones, %" G_GUINT64_FORMAT \
+                                        " respuestas, %" G_GUINT64_FORMAT " errores"
+#define APP_RESPONDER_RULE_LATENCY      "; latencia %.1f us (mín. %" G_GINT64_FORMAT " us, máx. %" G_GINT64_FORMAT \
+                                        " us)"
+#define APP_RESPONDER_ERROR             "Las reglas tienen un error en “%s”"
+#define APP_ERROR_CONTEXT_CHARS         16
+#define APP_DECODE_TITLE                "Decodificar mensajes"
+#define APP_DECODE_WIDTH                720
+#define APP_DECODE_HEIGHT               560
+#define APP_DECODE_MESSAGES             1000
+#define APP_DECODE_EXAMPLE              "# Un mensaje por bloque: message <nombre> <prefijo>, sus campos y end\n" \
+                                        "# message estado 02 \"S\"\n" \
+                                        "#   u8     version\n#   u16le  temperatura\n#   str8   serie\n" \
+                                        "# end\n"
+#define APP_DECODE_COLUMN_NAME          "Mensaje / campo"
+#define APP_DECODE_COLUMN_VALUE         "Valor"
+#define APP_DECODE_COLUMN_TIME          "Tiempo"
+#define APP_DECODE_LENGTH               "%" G_GSIZE_FORMAT " bytes"
+#define APP_DECODE_TIME                 "%.3f s"
+#define APP_DECODE_ERROR                "El esquema tiene un error en “%s”"
+#define APP_DECODE_LABEL                "%" G_GUINT64_FORMAT " mensajes, %" G_GUINT64_FORMAT " bytes sin reconocer"
+#define APP_OPTION_IO_URING             "Leer los puertos con io_uring en lugar de poll"
+#define APP_OPTION_REALTIME             "Hilo lector en tiempo real (SCHED_FIFO) con la prioridad dada"
+#define APP_OPTION_REALTIME_CPU         "CPU a la que se fija el hilo lector en tiempo real"
+#define APP_OPTION_REALTIME_PERIOD      "Periodo del hilo lector en tiempo real, en microsegundos"
+#define APP_OPTION_REALTIME_RR          "Usar SCHED_RR en lugar de SCHED_FIFO"
+#define APP_OPTION_REALTIME_LOCK        "Bloquear en RAM la pila y el buffer del hilo lector en tiempo real"
+#define APP_REALTIME_PERIOD_US          1000
+#define APP_OPTION_TRACE                "Guardar los puntos de traza de AbSerIO en el archivo al salir"
+#define APP_RATE_GRAPH_LABEL            "RX %s  TX %s  (escala %s, ventana %u s)"
 
 #endif // CONFIG_H
@@ -0,0 +1,476 @@
+//===-- src/console.c - Consola de texto ------------------------------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// No usa un GtkTextBuffer: cada inserción en uno recalcula etiquetas, iteradores y el acomodo del texto, y a 1 MB/s
+/// el main loop se queda sin tiempo. En su lugar, el texto se guarda en bloques de APP_CONSOLE_CHUNK_SIZE bytes y un
+/// anillo de renglones apunta a su texto dentro de los bloques. Un renglón nunca queda partido entre dos bloques: si
+/// el renglón abierto (el último) ya no cabe, se copia al bloque nuevo, y ningún renglón pasa de APP_CONSOLE_LINE_MAX
+/// bytes. Cuando hay demasiados bloques se libera el más viejo junto con sus renglones.
+///
+/// El hilo lector solamente copia los bytes a un buffer pendiente. En cada frame, el widget cambia ese buffer por uno
+/// vacío (el mutex se toma solamente para el cambio), interpreta lo nuevo y dibuja con Cairo los renglones que caben
+/// en la ventana, igual que el visor de capturas. La barra de desplazamiento cuenta renglones; mientras está al final,
+/// sigue al texto nuevo.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#include "console.h"
+#include "config.h"
+#include <string.h>
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Estructuras de datos
+//===--------------------------------------------------------------------------------------------------------------===//
+#define CONSOLE_DATA                    "console-data"
+#define CONSOLE_ESC                     0x1B
+
+struct ConsoleChunk {
+  gsize used;
+  gchar data[APP_CONSOLE_CHUNK_SIZE];
+};
+
+struct ConsoleLine {
+  struct ConsoleChunk *chunk;
+  guint32 start;
+  guint32 length;
+};
+
+// Estado del intérprete entre dos bloques recibidos
+enum ConsoleEscape {
+  CONSOLE_TEXT,
+  // Después de ESC
+  CONSOLE_ESCAPE,
+  // Dentro de `ESC [`, hasta el byte final (de 0x40 a 0x7E)
+  CONSOLE_CSI
+};
+
+struct Console {
+  GtkWidget *grid;
+  GtkWidget *area;
+  GtkAdjustment *rows;
+  ConsoleSendFunc send;
+  gpointer send_data;
+  // Bloques de texto, del más viejo al más nuevo
+  GQueue chunks;
+  // Anillo de renglones; el último es el renglón abierto
+  struct ConsoleLine *lines;
+  gsize line_capacity;
+  gsize line_head;
+  gsize line_count;
+  // Renglones descartados desde que se creó la consola
+  guint64 discarded;
+  enum ConsoleEscape escape;
+  // Un CR sin LF: el siguiente texto reemplaza al renglón
+  gboolean pending_cr;
+  // Bytes que llegaron desde el último frame. Si se acumulan más de APP_CONSOLE_PENDING_MAX, se descartan los más
+  // viejos
+  GMutex pending_lock;
+  GByteArray *pending;
+  GByteArray *spare;
+};
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                   Funciones extra
+//===--------------------------------------------------------------------------------------------------------------===//
+static void free_console(gpointer data) {
+  struct Console *console = data;
+  g_queue_clear_full(&console->chunks, g_free);
+  g_free(console->lines);
+  g_byte_array_unref(console->pending);
+  g_byte_array_unref(console->spare);
+  g_mutex_clear(&console->pending_lock);
+  g_free(console);
+}
+
+static struct ConsoleLine *line_at(struct Console *console, gsize index) {
+  return &console->lines[(console->line_head + index)%console->line_capacity];
+}
+
+static struct ConsoleLine *open_line(struct Console *console) {
+  return line_at(console, console->line_count - 1);
+}
+
+static void drop_oldest_line(struct Console *console) {
+  console->line_head = (console->line_head + 1)%console->line_capacity;
+  console->line_count--;
+  console->discarded++;
+}
+
+// Libera lo que sobra: renglones de más, bloques de más (con sus renglones) y bloques que ya no tienen renglones
+static void trim_console(struct Console *console) {
+  while (console->line_count > APP_CONSOLE_SCROLLBACK_LINES) {
+    drop_oldest_line(console);
+  }
+  while (g_queue_get_length(&console->chunks) > APP_CONSOLE_SCROLLBACK_CHUNKS) {
+    struct ConsoleChunk *oldest = g_queue_pop_head(&console->chunks);
+    // El renglón abierto está en el bloque más nuevo, así que nunca se descarta
+    while (line_at(console, 0)->chunk==oldest) {
+      drop_oldest_line(console);
+    }
+    g_free(oldest);
+  }
+  while (g_queue_peek_head(&console->chunks)!=line_at(console, 0)->chunk) {
+    g_free(g_queue_pop_head(&console->chunks));
+  }
+}
+
+static void new_line(struct Console *console) {
+  if (console->line_count==console->line_capacity) {
+    // El anillo crece al doble; los renglones quedan en orden desde el principio
+    struct ConsoleLine *lines = g_new(struct ConsoleLine, console->line_capacity*2);
+    for (gsize i = 0; i < console->line_count; i++) {
+      lines[i] = *line_at(console, i);
+    }
+    g_free(console->lines);
+    console->lines = lines;
+    console->line_capacity *= 2;
+    console->line_head = 0;
+  }
+  struct ConsoleChunk *chunk = g_queue_peek_tail(&console->chunks);
+  *line_at(console, console->line_count) = (struct ConsoleLine) {chunk, (guint32) chunk->used, 0};
+  console->line_count++;
+}
+
+// Agrega texto al renglón abierto. `count` nunca pasa de APP_CONSOLE_LINE_MAX
+static void append_text(struct Console *console, const gchar *text, gsize count) {
+  struct ConsoleLine *line = open_line(console);
+  if (console->pending_cr) {
+    line->length = 0;
+    line->chunk->used = line->start;
+    console->pending_cr = FALSE;
+  }
+  if (line->length + count > APP_CONSOLE_LINE_MAX) {
+    new_line(console);
+    line = open_line(console);
+  }
+  struct ConsoleChunk *chunk = line->chunk;
+  if (line->start + line->length + count > APP_CONSOLE_CHUNK_SIZE) {
+    // El renglón abierto se muda completo al bloque nuevo
+    struct ConsoleChunk *fresh = g_new(struct ConsoleChunk, 1);
+    memcpy(fresh->data, chunk->data + line->start, line->length);
+    fresh->used = line->length;
+    chunk->used = line->start;
+    line->chunk = fresh;
+    line->start = 0;
+    g_queue_push_tail(&console->chunks, fresh);
+    chunk = fresh;
+  }
+  memcpy(chunk->data + line->start + line->length, text, count);
+  line->length += (guint32) count;
+  chunk->used = line->start + line->length;
+}
+
+static void erase_character(struct Console *console) {
+  struct ConsoleLine *line = open_line(console);
+  // Un carácter UTF-8 completo: los bytes de continuación son 10xxxxxx
+  while (line->length > 0) {
+    guchar removed = (guchar) line->chunk->data[line->start + --line->length];
+    if ((removed & 0xC0)!=0x80) {
+      break;
+    }
+  }
+  line->chunk->used = line->start + line->length;
+}
+
+// Interpreta un byte de control (o uno que sigue a ESC)
+static void control_byte(struct Console *console, guchar byte) {
+  switch (console->escape) {
+    case CONSOLE_ESCAPE://
+      console->escape = byte=='[' ? CONSOLE_CSI : CONSOLE_TEXT;
+      return;
+    case CONSOLE_CSI://
+      if (byte >= 0x40 && byte <= 0x7E) {
+        console->escape = CONSOLE_TEXT;
+      }
+      return;
+    default://
+      break;
+  }
+  switch (byte) {
+    case '\n'://
+      console->pending_cr = FALSE;
+      new_line(console);
+      break;
+    case '\r'://
+      console->pending_cr = TRUE;
+      break;
+    case '\b'://
+      erase_character(console);
+      break;
+    case '\t'://
+    {
+      static const gchar spaces[APP_CONSOLE_TAB_WIDTH] = "        ";
+      guint32 column = console->pending_cr ? 0 : open_line(console)->length;
+      append_text(console, spaces, APP_CONSOLE_TAB_WIDTH - column%APP_CONSOLE_TAB_WIDTH);
+      break;
+    }
+    case '\a'://
+      break;
+    case CONSOLE_ESC://
+      console->escape = CONSOLE_ESCAPE;
+      break;
+    default://
+    {
+      // Notación de circunflejo: ^@ a ^_ y ^? para DEL
+      gchar caret[2] = {'^', byte==0x7F ? '?' : (gchar) (byte + 0x40)};
+      append_text(console, caret, sizeof(caret));
+      break;
+    }
+  }
+}
+
+// Texto que sí se agrega tal cual: todo menos los controles C0 y DEL
+static inline gboolean is_text(guchar byte) {
+  return byte >= 0x20 && byte!=0x7F;
+}
+
+static void interpret(struct Console *console, const guchar *data, gsize length) {
+  gsize i = 0;
+  while (i < length) {
+    if (console->escape==CONSOLE_TEXT && is_text(data[i])) {
+      // Una corrida de texto se copia de una vez, partida si el renglón llega al máximo
+      gsize end = i;
+      while (end < length && is_text(data[end])) {
+        end++;
+      }
+      while (i < end) {
+        gsize room = APP_CONSOLE_LINE_MAX - (console->pending_cr ? 0 : open_line(console)->length);
+        if (room==0) {
+          new_line(console);
+          room = APP_CONSOLE_LINE_MAX;
+        }
+        gsize count = MIN(end - i, room);
+        append_text(console, (const gchar *) data + i, count);
+        i += count;
+      }
+    } else {
+      control_byte(console, data[i]);
+      i++;
+    }
+  }
+  trim_console(console);
+}
+
+// Flechas como en una terminal VT100: ESC [ A (arriba), B, C y D
+static gsize cursor_key(guchar *bytes, gchar final) {
+  bytes[0] = CONSOLE_ESC;
+  bytes[1] = '[';
+  bytes[2] = (guchar) final;
+  return 3;
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                        Callbacks para los eventos de la GUI
+//===--------------------------------------------------------------------------------------------------------------===//
+static gboolean on_console_tick(GtkWidget *widget, GdkFrameClock *clock, gpointer user_data) {
+  struct Console *console = user_data;
+  g_mutex_lock(&console->pending_lock);
+  GByteArray *fresh = console->pending;
+  console->pending = console->spare;
+  console->spare = fresh;
+  g_mutex_unlock(&console->pending_lock);
+  if (fresh->len==0) {
+    return G_SOURCE_CONTINUE;
+  }
+  // Al final de la barra (o con todo visible), la vista sigue al texto nuevo
+  gdouble value = gtk_adjustment_get_value(console->rows);
+  gdouble page = gtk_adjustment_get_page_size(console->rows);
+  gboolean follow = value + page >= gtk_adjustment_get_upper(console->rows);
+  guint64 discarded = console->discarded;
+  interpret(console, fresh->data, fresh->len);
+  g_byte_array_set_size(fresh, 0);
+  gdouble upper = (gdouble) console->line_count;
+  if (follow) {
+    value = MAX(0.0, upper - page);
+  } else {
+    // Sin seguir al texto, la vista se queda en el mismo renglón aunque se hayan descartado los del principio
+    value = MAX(0.0, value - (gdouble) (console->discarded - discarded));
+  }
+  gtk_adjustment_configure(console->rows, value, 0.0, upper, 1.0, page, page);
+  gtk_widget_queue_draw(console->area);
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean on_console_draw(GtkWidget *widget, cairo_t *cr, gpointer user_data) {
+  struct Console *console = user_data;
+  gdouble height = gtk_widget_get_allocated_height(widget);
+  cairo_set_source_rgb(cr, 0.1, 0.1, 0.1);
+  cairo_paint(cr);
+  cairo_select_font_face(cr, "monospace", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+  cairo_set_font_size(cr, APP_CONSOLE_FONT_SIZE);
+  cairo_set_source_rgb(cr, 0.9, 0.9, 0.9);
+
+  // Solamente los renglones visibles se convierten a texto
+  gsize first = (gsize) gtk_adjustment_get_value(console->rows);
+  gsize rows = (gsize) (height/APP_CONSOLE_ROW_HEIGHT) + 1;
+  gchar text[APP_CONSOLE_LINE_MAX + 1];
+  for (gsize row = 0; row < rows && first + row < console->line_count; row++) {
+    const struct ConsoleLine *line = line_at(console, first + row);
+    memcpy(text, line->chunk->data + line->start, line->length);
+    text[line->length] = '\0';
+    cairo_move_to(cr, 4, (row + 1)*APP_CONSOLE_ROW_HEIGHT - 4);
+    if (g_utf8_validate(text, line->length, NULL)) {
+      cairo_show_text(cr, text);
+    } else {
+      // Bytes que no son UTF-8 (p.e. Latin-1 o ruido en la línea) se muestran como U+FFFD
+      gchar *valid = g_utf8_make_valid(text, line->length);
+      cairo_show_text(cr, valid);
+      g_free(valid);
+    }
+  }
+  return FALSE;
+}
+
+static void on_console_allocate(GtkWidget *widget, GdkRectangle *allocation, gpointer user_data) {
+  struct Console *console = user_data;
+  gdouble page = MAX(1, allocation->height/APP_CONSOLE_ROW_HEIGHT);
+  gtk_adjustment_set_page_size(console->rows, page);
+  gtk_adjustment_set_page_increment(console->rows, page);
+}
+
+static gboolean on_console_scroll(GtkWidget *widget, GdkEventScroll *event, gpointer user_data) {
+  struct Console *console = user_data;
+  gdouble delta = 0.0;
+  if (event->direction==GDK_SCROLL_UP) {
+    delta = -APP_CONSOLE_SCROLL_ROWS;
+  } else if (event->direction==GDK_SCROLL_DOWN) {
+    delta = APP_CONSOLE_SCROLL_ROWS;
+  } else if (event->direction==GDK_SCROLL_SMOOTH) {
+    delta = event->delta_y*APP_CONSOLE_SCROLL_ROWS;
+  }
+  gtk_adjustment_set_value(console->rows, gtk_adjustment_get_value(console->rows) + delta);
+  return TRUE;
+}
+
+static void on_console_scrolled(GtkAdjustment *adjustment, gpointer user_data) {
+  struct Console *console = user_data;
+  gtk_widget_queue_draw(console->area);
+}
+
+static gboolean on_console_click(GtkWidget *widget, GdkEventButton *event, gpointer user_data) {
+  gtk_widget_grab_focus(widget);
+  return FALSE;
+}
+
+// Convierte la tecla a los bytes que enviaría una terminal y los envía sin esperar a nada más
+static gboolean on_console_key(GtkWidget *widget, GdkEventKey *event, gpointer user_data) {
+  struct Console *console = user_data;
+  guchar bytes[8];
+  gsize length = 0;
+  switch (event->keyval) {
+    case GDK_KEY_Return:
+    case GDK_KEY_KP_Enter://
+      bytes[length++] = '\r';
+      break;
+    case GDK_KEY_BackSpace://
+      bytes[length++] = '\b';
+      break;
+    case GDK_KEY_Tab://
+      bytes[length++] = '\t';
+      break;
+    case GDK_KEY_Escape://
+      bytes[length++] = CONSOLE_ESC;
+      break;
+    case GDK_KEY_Up://
+      length = cursor_key(bytes, 'A');
+      break;
+    case GDK_KEY_Down://
+      length = cursor_key(bytes, 'B');
+      break;
+    case GDK_KEY_Right://
+      length = cursor_key(bytes, 'C');
+      break;
+    case GDK_KEY_Left://
+      length = cursor_key(bytes, 'D');
+      break;
+    default://
+    {
+      gunichar character = gdk_keyval_to_unicode(event->keyval);
+      if ((event->state & GDK_CONTROL_MASK) && g_ascii_isalpha((gchar) character)) {
+        // Ctrl+A es 0x01, Ctrl+C es 0x03, etc.
+        bytes[length++] = (guchar) (g_ascii_toupper((gchar) character) - '@');
+      } else if (character!=0) {
+        length = (gsize) g_unichar_to_utf8(character, (gchar *) bytes);
+      }
+      break;
+    }
+  }
+  if (length==0) {
+    // Modificadores y teclas sin texto siguen su camino normal
+    return FALSE;
+  }
+  console->send(bytes, length, console->send_data);
+  return TRUE;
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                           Implementación de la interfaz
+//===--------------------------------------------------------------------------------------------------------------===//
+struct Console *console_new(ConsoleSendFunc send, gpointer user_data) {
+  struct Console *console = g_new0(struct Console, 1);
+  console->send = send;
+  console->send_data = user_data;
+  g_mutex_init(&console->pending_lock);
+  console->pending = g_byte_array_new();
+  console->spare = g_byte_array_new();
+  g_queue_init(&console->chunks);
+  struct ConsoleChunk *chunk = g_new(struct ConsoleChunk, 1);
+  chunk->used = 0;
+  g_queue_push_tail(&console->chunks, chunk);
+  console->line_capacity = 1024;
+  console->lines = g_new(struct ConsoleLine, console->line_capacity);
+  new_line(console);
+  console->rows = gtk_adjustment_new(0.0, 0.0, 1.0, 1.0, 1.0, 1.0);
+
+  console->grid = gtk_grid_new();
+  g_object_set_data_full(G_OBJECT(console->grid), CONSOLE_DATA, console, free_console);
+  console->area = gtk_drawing_area_new();
+  gtk_widget_set_size_request(console->area, APP_CONSOLE_WIDTH, -1);
+  gtk_widget_set_hexpand(console->area, TRUE);
+  gtk_widget_set_vexpand(console->area, TRUE);
+  gtk_widget_set_can_focus(console->area, TRUE);
+  gtk_widget_add_events(console->area,
+                        GDK_SCROLL_MASK | GDK_SMOOTH_SCROLL_MASK | GDK_BUTTON_PRESS_MASK | GDK_KEY_PRESS_MASK);
+  gtk_grid_attach(GTK_GRID(console->grid), console->area, 0, 0, 1, 1);
+  GtkWidget *scrollbar = gtk_scrollbar_new(GTK_ORIENTATION_VERTICAL, console->rows);
+  gtk_grid_attach(GTK_GRID(console->grid), scrollbar, 1, 0, 1, 1);
+
+  g_signal_connect(console->area, "draw", G_CALLBACK(on_console_draw), console);
+  g_signal_connect(console->area, "size-allocate", G_CALLBACK(on_console_allocate), console);
+  g_signal_connect(console->area, "scroll-event", G_CALLBACK(on_console_scroll), console);
+  g_signal_connect(console->area, "button-press-event", G_CALLBACK(on_console_click), console);
+  g_signal_connect(console->area, "key-press-event", G_CALLBACK(on_console_key), console);
+  g_signal_connect(console->rows, "value-changed", G_CALLBACK(on_console_scrolled), console);
+  gtk_widget_add_tick_callback(console->area, on_console_tick, console, NULL);
+  return console;
+}
+
+GtkWidget *console_get_widget(struct Console *console) {
+  return console->grid;
+}
+
+void console_push(struct Console *console, const guchar *data, gsize length) {
+  // De un bloque más grande que el límite solamente importa el final
+  if (length > APP_CONSOLE_PENDING_MAX) {
+    data += length - APP_CONSOLE_PENDING_MAX;
+    length = APP_CONSOLE_PENDING_MAX;
+  }
+  g_mutex_lock(&console->pending_lock);
+  if (console->pending->len + length > APP_CONSOLE_PENDING_MAX) {
+    g_byte_array_remove_range(console->pending, 0, (guint) (console->pending->len + length - APP_CONSOLE_PENDING_MAX));
+  }
+  g_byte_array_append(console->pending, data, (guint) length);
+  g_mutex_unlock(&console->pending_lock);
+}
@@ -0,0 +1,44 @@
+//===-- src/console.h - Consola de texto ------------------------------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===---------------------------------------------------------------------------------------------------------------===//
+///
+/// Muestra lo recibido como texto (ASCII/UTF-8) que se desplaza, como una terminal sencilla: saltos de línea (LF,
+/// CRLF), retorno de carro, retroceso y tabuladores; las secuencias de escape ANSI se descartan y los demás caracteres
+/// de control se muestran como `^X`. Se guardan las últimas APP_CONSOLE_SCROLLBACK_CHUNKS*APP_CONSOLE_CHUNK_SIZE
+/// bytes (y a lo más APP_CONSOLE_SCROLLBACK_LINES renglones).
+///
+/// Con el foco en la consola, cada tecla se envía al puerto en cuanto se presiona.
+///
+//===---------------------------------------------------------------------------------------------------------------===//
+
+#ifndef CONSOLE_H
+#define CONSOLE_H
+#include <gtk/gtk.h>
+
+// El estado es opaco. Pertenece al widget y se libera cuando el widget se destruye.
+struct Console;
+
+// Función que envía los bytes de una tecla. Se ejecuta en el hilo de la GUI.
+typedef void (*ConsoleSendFunc)(const guchar *, gsize, gpointer);
+
+// Crea la consola. Las teclas se entregan a la función dada
+struct Console *console_new(ConsoleSendFunc, gpointer);
+
+// Devuelve el widget (el área de texto con su barra de desplazamiento) para agregarlo a un contenedor
+GtkWidget *console_get_widget(struct Console *);
+
+// Agrega bytes recibidos. Se puede llamar desde el hilo lector: solamente copia a un buffer pendiente, y el widget
+// los interpreta y dibuja en el siguiente frame.
+void console_push(struct Console *, const guchar *, gsize);
+#endif // CONSOLE_H
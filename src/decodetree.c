@@ -0,0 +1,304 @@
+//===-- src/decodetree.c - Mensajes decodificados con un esquema ------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// El hilo que llama a `decode_tree_push` separa los mensajes: lo que quedó del bloque anterior más el bloque nuevo
+/// se recorre saltando hasta el siguiente byte con el que puede empezar un mensaje y ahí se decodifica. Un mensaje
+/// incompleto se queda para el siguiente bloque; si no es ningún mensaje, se salta un byte. Los valores se escriben
+/// en un arreglo del panel, así que por mensaje decodificado hay una sola reserva: la copia del mensaje y sus valores
+/// que espera a la GUI. El texto de cada campo se arma hasta que el mensaje se muestra.
+///
+/// En cada frame el widget toma los mensajes pendientes (el mutex se toma solamente para eso) y los agrega al árbol.
+/// Como no se muestran más de APP_DECODE_MESSAGES, tampoco se guardan más pendientes: si la GUI se atrasa, los más
+/// viejos se descartan sin llegar al árbol.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#include "decodetree.h"
+#include "config.h"
+#include <string.h>
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Estructuras de datos
+//===--------------------------------------------------------------------------------------------------------------===//
+#define DECODETREE_DATA                 "decode-tree-data"
+
+enum {
+  DECODE_COLUMN_NAME,
+  DECODE_COLUMN_VALUE,
+  DECODE_COLUMN_TIME,
+  DECODE_COLUMNS
+};
+
+// Mensaje decodificado que espera a la GUI. Los valores y, detrás de ellos, los bytes del mensaje van en la misma
+// reserva
+struct DecodedMessage {
+  guint message;
+  gsize length;
+  // Fecha (CLOCK_MONOTONIC, ns) del último byte del mensaje
+  gint64 time_ns;
+  struct SerialSchemaValue values[];
+};
+
+struct DecodeTree {
+  GtkWidget *grid;
+  GtkWidget *view;
+  GtkTreeStore *store;
+  GtkWidget *label;
+  // Lo que usa el hilo que decodifica
+  GMutex lock;
+  struct SerialSchema *schema;
+  struct SerialSchemaValue *values;
+  // Lo que quedó sin decodificar del bloque anterior (a lo más un mensaje incompleto)
+  GByteArray *buffer;
+  GQueue pending;
+  guint64 decoded;
+  guint64 skipped;
+  // Lo que ya se mostró; solamente lo usa el hilo principal
+  guint64 shown_decoded;
+  guint64 shown_skipped;
+  gint64 first_ns;
+  guint rows;
+};
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                   Funciones extra
+//===--------------------------------------------------------------------------------------------------------------===//
+static void clear_pending(GQueue *pending) {
+  gpointer message;
+  while ((message = g_queue_pop_head(pending))!=NULL) {
+    g_free(message);
+  }
+}
+
+static void free_decode_tree(gpointer data) {
+  struct DecodeTree *tree = data;
+  g_mutex_clear(&tree->lock);
+  clear_pending(&tree->pending);
+  g_byte_array_free(tree->buffer, TRUE);
+  g_free(tree->values);
+  if (tree->schema!=NULL) {
+    serial_schema_free(tree->schema);
+  }
+  g_free(tree);
+}
+
+static const guint8 *get_frame(const struct DecodedMessage *decoded, guint field_count) {
+  return (const guint8 *) (decoded->values + field_count);
+}
+
+// Copia un mensaje recién decodificado a los pendientes. Se llama con el mutex tomado
+static void queue_message(struct DecodeTree *tree, guint message, const guint8 *frame, gsize length, gint64 time_ns) {
+  guint field_count = serial_schema_get_field_count(tree->schema, message);
+  struct DecodedMessage *decoded = g_malloc(sizeof(struct DecodedMessage)
+                                            + field_count*sizeof(struct SerialSchemaValue)
+                                            + length);
+  decoded->message = message;
+  decoded->length = length;
+  decoded->time_ns = time_ns;
+  memcpy(decoded->values, tree->values, field_count*sizeof(struct SerialSchemaValue));
+  memcpy((guint8 *) get_frame(decoded, field_count), frame, length);
+  g_queue_push_tail(&tree->pending, decoded);
+  if (g_queue_get_length(&tree->pending) > APP_DECODE_MESSAGES) {
+    g_free(g_queue_pop_head(&tree->pending));
+  }
+}
+
+static void update_label(struct DecodeTree *tree) {
+  gchar *text = g_strdup_printf(APP_DECODE_LABEL, tree->shown_decoded, tree->shown_skipped);
+  gtk_label_set_text(GTK_LABEL(tree->label), text);
+  g_free(text);
+}
+
+// Agrega un mensaje arriba del árbol, con un renglón por campo
+static void insert_message(struct DecodeTree *tree, const struct DecodedMessage *decoded, GString *text) {
+  struct SerialSchema *schema = tree->schema;
+  guint field_count = serial_schema_get_field_count(schema, decoded->message);
+  const guint8 *frame = get_frame(decoded, field_count);
+  if (tree->first_ns==0) {
+    tree->first_ns = decoded->time_ns;
+  }
+  GtkTreeIter row;
+  gchar *length = g_strdup_printf(APP_DECODE_LENGTH, decoded->length);
+  gchar *time = g_strdup_printf(APP_DECODE_TIME, (decoded->time_ns - tree->first_ns)/1e9);
+  gtk_tree_store_insert_with_values(tree->store,
+                                    &row,
+                                    NULL,
+                                    0,
+                                    DECODE_COLUMN_NAME, serial_schema_get_message_name(schema, decoded->message),
+                                    DECODE_COLUMN_VALUE, length,
+                                    DECODE_COLUMN_TIME, time,
+                                    -1);
+  g_free(length);
+  g_free(time);
+  for (guint field = 0; field < field_count; field++) {
+    g_string_truncate(text, 0);
+    serial_schema_format_value(schema, decoded->message, field, frame, &decoded->values[field], text);
+    gtk_tree_store_insert_with_values(tree->store,
+                                      NULL,
+                                      &row,
+                                      -1,
+                                      DECODE_COLUMN_NAME, serial_schema_get_field_name(schema, decoded->message, field),
+                                      DECODE_COLUMN_VALUE, text->str,
+                                      -1);
+  }
+  tree->rows++;
+}
+
+static void append_column(GtkWidget *view, const gchar *title, gint column, gboolean monospace) {
+  GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
+  if (monospace) {
+    g_object_set(renderer, "family", "monospace", NULL);
+  }
+  GtkTreeViewColumn *view_column = gtk_tree_view_column_new_with_attributes(title, renderer, "text", column, NULL);
+  gtk_tree_view_column_set_resizable(view_column, TRUE);
+  gtk_tree_view_append_column(GTK_TREE_VIEW(view), view_column);
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                        Callbacks para los eventos de la GUI
+//===--------------------------------------------------------------------------------------------------------------===//
+static gboolean on_decode_tree_tick(GtkWidget *widget, GdkFrameClock *clock, gpointer user_data) {
+  struct DecodeTree *tree = user_data;
+  g_mutex_lock(&tree->lock);
+  GQueue pending = tree->pending;
+  g_queue_init(&tree->pending);
+  gboolean changed = tree->decoded!=tree->shown_decoded || tree->skipped!=tree->shown_skipped;
+  tree->shown_decoded = tree->decoded;
+  tree->shown_skipped = tree->skipped;
+  g_mutex_unlock(&tree->lock);
+  if (!changed) {
+    return G_SOURCE_CONTINUE;
+  }
+  GString *text = g_string_new(NULL);
+  struct DecodedMessage *decoded;
+  while ((decoded = g_queue_pop_head(&pending))!=NULL) {
+    insert_message(tree, decoded, text);
+    g_free(decoded);
+  }
+  g_string_free(text, TRUE);
+  // Los más viejos están al final
+  GtkTreeIter last;
+  while (tree->rows > APP_DECODE_MESSAGES
+         && gtk_tree_model_iter_nth_child(GTK_TREE_MODEL(tree->store), &last, NULL, (gint) tree->rows - 1)) {
+    gtk_tree_store_remove(tree->store, &last);
+    tree->rows--;
+  }
+  update_label(tree);
+  return G_SOURCE_CONTINUE;
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                           Implementación de la interfaz
+//===--------------------------------------------------------------------------------------------------------------===//
+struct DecodeTree *decode_tree_new(void) {
+  struct DecodeTree *tree = g_new0(struct DecodeTree, 1);
+  g_mutex_init(&tree->lock);
+  g_queue_init(&tree->pending);
+  tree->buffer = g_byte_array_new();
+  tree->grid = gtk_grid_new();
+  g_object_set_data_full(G_OBJECT(tree->grid), DECODETREE_DATA, tree, free_decode_tree);
+  tree->store = gtk_tree_store_new(DECODE_COLUMNS, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING);
+  tree->view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(tree->store));
+  // La vista se queda con el modelo
+  g_object_unref(tree->store);
+  append_column(tree->view, APP_DECODE_COLUMN_NAME, DECODE_COLUMN_NAME, FALSE);
+  append_column(tree->view, APP_DECODE_COLUMN_VALUE, DECODE_COLUMN_VALUE, TRUE);
+  append_column(tree->view, APP_DECODE_COLUMN_TIME, DECODE_COLUMN_TIME, FALSE);
+  GtkWidget *scroll = gtk_scrolled_window_new(NULL, NULL);
+  gtk_widget_set_hexpand(scroll, TRUE);
+  gtk_widget_set_vexpand(scroll, TRUE);
+  gtk_container_add(GTK_CONTAINER(scroll), tree->view);
+  gtk_grid_attach(GTK_GRID(tree->grid), scroll, 0, 0, 1, 1);
+  tree->label = gtk_label_new(NULL);
+  gtk_label_set_xalign(GTK_LABEL(tree->label), 0.0f);
+  gtk_grid_attach(GTK_GRID(tree->grid), tree->label, 0, 1, 1, 1);
+  update_label(tree);
+
+  gtk_widget_add_tick_callback(tree->view, on_decode_tree_tick, tree, NULL);
+  return tree;
+}
+
+GtkWidget *decode_tree_get_widget(struct DecodeTree *tree) {
+  return tree->grid;
+}
+
+void decode_tree_set_schema(struct DecodeTree *tree, struct SerialSchema *schema) {
+  g_mutex_lock(&tree->lock);
+  struct SerialSchema *old = tree->schema;
+  tree->schema = schema;
+  g_free(tree->values);
+  tree->values = schema!=NULL ? g_new(struct SerialSchemaValue, MAX(1, serial_schema_get_max_fields(schema))) : NULL;
+  g_byte_array_set_size(tree->buffer, 0);
+  clear_pending(&tree->pending);
+  tree->decoded = 0;
+  tree->skipped = 0;
+  g_mutex_unlock(&tree->lock);
+  // Después de soltar el mutex ya nadie decodifica con el esquema anterior
+  if (old!=NULL) {
+    serial_schema_free(old);
+  }
+  gtk_tree_store_clear(tree->store);
+  tree->rows = 0;
+  tree->first_ns = 0;
+  tree->shown_decoded = 0;
+  tree->shown_skipped = 0;
+  update_label(tree);
+}
+
+void decode_tree_push(struct DecodeTree *tree, const guchar *data, gsize length, const struct SerialTimestamp *stamp) {
+  g_mutex_lock(&tree->lock);
+  if (tree->schema==NULL) {
+    g_mutex_unlock(&tree->lock);
+    return;
+  }
+  // Lo que ya estaba en el buffer llegó en bloques anteriores; el resto es de este bloque
+  gsize kept = tree->buffer->len;
+  g_byte_array_append(tree->buffer, data, (guint) length);
+  const guint8 *buffer = tree->buffer->data;
+  gsize total = tree->buffer->len;
+  gsize position = 0;
+  while (position < total) {
+    gsize start = serial_schema_find_start(tree->schema, buffer + position, total - position);
+    tree->skipped += start;
+    position += start;
+    if (position==total) {
+      break;
+    }
+    guint message;
+    gsize frame_length;
+    enum SerialSchemaResult result = serial_schema_decode(tree->schema,
+                                                          buffer + position,
+                                                          total - position,
+                                                          &message,
+                                                          &frame_length,
+                                                          tree->values);
+    if (result==SERIAL_SCHEMA_INCOMPLETE) {
+      break;
+    }
+    if (result==SERIAL_SCHEMA_NO_MATCH) {
+      tree->skipped++;
+      position++;
+      continue;
+    }
+    // Un mensaje que se decodifica ahora termina en este bloque (si no, se habría decodificado antes)
+    gsize end = position + frame_length;
+    gint64 time_ns = serial_timestamp_byte(stamp, length, end > kept ? end - kept - 1 : 0);
+    queue_message(tree, message, buffer + position, frame_length, time_ns);
+    tree->decoded++;
+    position = end;
+  }
+  g_byte_array_remove_range(tree->buffer, 0, (guint) position);
+  g_mutex_unlock(&tree->lock);
+}
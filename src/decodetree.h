@@ -0,0 +1,44 @@
+//===-- src/decodetree.h - Mensajes decodificados con un esquema ------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===---------------------------------------------------------------------------------------------------------------===//
+///
+/// Panel con los mensajes recibidos, decodificados con un esquema (ver `abserio/schema.h`): un renglón por mensaje,
+/// el más reciente arriba, con un renglón hijo por campo. Debajo, cuántos mensajes se han decodificado y cuántos
+/// bytes no fueron el inicio de ningún mensaje. Se muestran los últimos APP_DECODE_MESSAGES.
+///
+//===---------------------------------------------------------------------------------------------------------------===//
+
+#ifndef DECODETREE_H
+#define DECODETREE_H
+#include <gtk/gtk.h>
+#include <abserio/schema.h>
+#include <abserio/timestamp.h>
+
+// El estado es opaco. Pertenece al widget y se libera cuando el widget se destruye.
+struct DecodeTree;
+
+// Crea el panel, sin esquema
+struct DecodeTree *decode_tree_new(void);
+
+// Devuelve el widget (el árbol y el texto) para agregarlo a un contenedor
+GtkWidget *decode_tree_get_widget(struct DecodeTree *);
+
+// Cambia el esquema (el panel se queda con él; NULL para no decodificar) y borra los mensajes. Solamente desde el
+// hilo principal.
+void decode_tree_set_schema(struct DecodeTree *, struct SerialSchema *);
+
+// Decodifica un bloque recibido, con su fecha. Se puede llamar desde el hilo de una suscripción: los mensajes se
+// separan y decodifican aquí mismo y el panel los agrega en el siguiente frame.
+void decode_tree_push(struct DecodeTree *, const guchar *, gsize, const struct SerialTimestamp *);
+#endif // DECODETREE_H
@@ -18,9 +18,31 @@
 //===--------------------------------------------------------------------------------------------------------------===//
 
 #include "config.h"
+#include "bitlanes.h"
+#include "bytestats.h"
+#include "captureview.h"
+#include "console.h"
+#include "decodetree.h"
+#include "rategraph.h"
 #include <gtk/gtk.h>
 #include <abserio/abserio.h>
+#include <abserio/capture.h>
+#include <abserio/dispatch.h>
+#include <abserio/macro.h>
+#include <abserio/payload.h>
+#include <abserio/responder.h>
+#include <abserio/schema.h>
+#include <abserio/stream.h>
+#include <abserio/timestamp.h>
+#include <abserio/trace.h>
+#include <abserio/transmit.h>
 #include <errno.h>
+#include <stdatomic.h>
+#ifdef __linux__
+#include <abserio/bridge.h>
+#include <abserio/portenum.h>
+#include <abserio/shmring.h>
+#endif
 #ifdef _WIN32
 #include <stdint.h>
 #endif
@@ -34,17 +56,105 @@
 //===--------------------------------------------------------------------------------------------------------------===//
 
 GtkWidget *input_swi[APP_SWI_SIZE];
-GtkWidget *output_swo[APP_SWO_SIZE];
+struct BitLanes *bit_lanes;
+struct ByteStats *byte_stats;
+struct Console *console;
 GtkWidget *hex_tbi;
 GtkWidget *hex_tbo;
+GtkWidget *rate_graph;
+guint rate_sampler = 0;
+// Último byte recibido y si ya hay un idle pendiente para mostrarlo en `hex_tbo`
+atomic_uint last_received;
+atomic_bool update_pending;
 volatile char *print_format;
 const struct AbstractSerialDevice *abstract_port = NULL;
 GString *os_port;
-gchar data_readed;
+// Transmisión de un archivo o de una carga útil en curso (NULL si no hay)
+struct SerialTransmit *active_transmit = NULL;
+// Macros de la sesión: texto -> bytecode, para compilar cada una solamente una vez
+GHashTable *macros = NULL;
+GtkWidget *macro_picker;
+// Macro en ejecución (NULL si no hay) y el timer que espera a que termine
+struct SerialMacroRun *active_macro = NULL;
+guint macro_watcher = 0;
+// Flujo en el que el hilo lector publica lo recibido y la suscripción de la GUI
+struct SerialStream *stream = NULL;
+struct SerialSubscription *gui_subscription = NULL;
+// Captura en grabación (NULL si no hay) y su suscripción. La usa el hilo de la suscripción, así que se protege con
+// `capture_lock`
+struct SerialCaptureWriter *capture_writer = NULL;
+struct SerialSubscription *capture_subscription = NULL;
+GMutex capture_lock;
+// Respuestas automáticas activas (NULL si no hay). Las usa el hilo lector, así que se protegen con `responder_lock`
+struct SerialResponder *responder = NULL;
+GMutex responder_lock;
+// Texto de las reglas, que se conserva al cerrar la ventana, y la ventana (solamente mientras está abierta)
+gchar *responder_rules = NULL;
+GtkWidget *responder_window = NULL;
+GtkWidget *responder_tgb = NULL;
+guint responder_updater = 0;
+// Decodificación de mensajes: el texto del esquema, que se conserva al cerrar la ventana, la ventana y su panel
+// (solamente mientras está abierta) y la suscripción que alimenta al panel (NULL si no está decodificando)
+gchar *decode_schema = NULL;
+GtkWidget *decode_window = NULL;
+struct DecodeTree *decode_tree = NULL;
+struct SerialSubscription *decode_subscription = NULL;
+#ifdef __linux__
+// Puente TCP (NULL si no está activo); mientras existe, reemplaza al hilo lector
+struct SerialBridge *bridge = NULL;
+GtkWidget *bridge_tgb = NULL;
+// Flujo recibido en memoria compartida para otros procesos (NULL si no se pudo crear)
+struct SerialShmRing *shm_ring = NULL;
+struct SerialSubscription *shm_subscription = NULL;
+struct SerialPortIndex *port_index = NULL;
+// Solamente existen mientras el diálogo para elegir el puerto está abierto
+GtkWidget *port_picker = NULL;
+GtkWidget *port_details = NULL;
+// Con `--io-uring` los puertos se abren con el backend de io_uring
+gboolean use_io_uring = FALSE;
+#endif
+// Con `--realtime=PRIORIDAD` el hilo lector corre en tiempo real (0 es el hilo normal)
+gint realtime_priority = 0;
+gint realtime_cpu = -1;
+gint realtime_period_us = APP_REALTIME_PERIOD_US;
+gboolean realtime_rr = FALSE;
+gboolean realtime_lock = FALSE;
+#ifdef ABSERIO_TRACE
+// Con `--trace=ARCHIVO` los puntos de traza de AbSerIO se guardan en el archivo al salir
+gchar *trace_path = NULL;
+#endif
+GOptionEntry app_options[] = {
+#ifdef __linux__
+  {"io-uring", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &use_io_uring, APP_OPTION_IO_URING, NULL},
+#endif
+  {"realtime", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, &realtime_priority, APP_OPTION_REALTIME, "PRIORIDAD"},
+  {"realtime-cpu", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, &realtime_cpu, APP_OPTION_REALTIME_CPU, "CPU"},
+  {"realtime-period", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, &realtime_period_us, APP_OPTION_REALTIME_PERIOD, "US"},
+  {"realtime-rr", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &realtime_rr, APP_OPTION_REALTIME_RR, NULL},
+  {"realtime-lock", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &realtime_lock, APP_OPTION_REALTIME_LOCK, NULL},
+#ifdef ABSERIO_TRACE
+  {"trace", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME, &trace_path, APP_OPTION_TRACE, "ARCHIVO"},
+#endif
+  {NULL}
+};
 
 //===--------------------------------------------------------------------------------------------------------------===//
 //                                                   Funciones extra
 //===--------------------------------------------------------------------------------------------------------------===//
+// El formato de visualización elegido; el mismo con el que se interpreta lo que se escribe en `hex_tbi`
+enum SerialPayloadFormat display_format(void) {
+  if (strcmp((const char *) print_format, APP_STR_DEC)==0) {
+    return SERIAL_PAYLOAD_DECIMAL;
+  } else if (strcmp((const char *) print_format, APP_STR_OCT)==0) {
+    return SERIAL_PAYLOAD_OCTAL;
+  } else if (strcmp((const char *) print_format, APP_STR_BIN)==0) {
+    return SERIAL_PAYLOAD_BINARY;
+  } else if (strcmp((const char *) print_format, APP_STR_ASCII)==0) {
+    return SERIAL_PAYLOAD_ESCAPED;
+  }
+  return SERIAL_PAYLOAD_HEX;
+}
+
 void print_formatted_input(void) {
   // Obtiene el valor binario a partir de lo switches
   unsigned long val = 0x00;
@@ -53,37 +163,51 @@ void print_formatted_input(void) {
     binval = (binval & 0x01);
     val |= binval << i;
   }
-  char *use_format = "";
-  char formatted[10];
-  // Detecta el formato de salida
-  if (strcmp((const char *) print_format, APP_STR_ASCII)==0) {
-    // Usar el valor decimal con un \ para los valores de 0 a 31.
-    // De 31 a 254, usar el valor ASCII normal
-    switch (val) {
-      case 0 ... 31://
-        use_format = "\'\\%02d\'";
-        break;
-      case 0x7F://
-        use_format = "\'\\DEL\'";
-        break;
-      case 0x80 ... 0xFF://
-        use_format = "\'\\-%02d\'";
-        break;
-      default://
-        use_format = "\'%c\'";
-        break;
-    }
-  } else if (strcmp((const char *) print_format, APP_STR_HEX)==0) {
-    use_format = "0x%02X";
-  } else if (strcmp((const char *) print_format, APP_STR_DEC)==0) {
-    use_format = "%d";
-  } else if (strcmp((const char *) print_format, APP_STR_OCT)==0) {
-    use_format = "0%0o";
-  }
-  sprintf(formatted, use_format, val);
+  gchar formatted[SERIAL_PAYLOAD_BYTE_MAX];
+  serial_payload_format_byte((guint8) val, display_format(), formatted);
   gtk_entry_set_text(GTK_ENTRY(hex_tbi), formatted);
 }
 
+#ifdef __linux__
+// Texto descriptivo de un puerto, p.e. "FTDI FT232R USB UART (S/N: A1B2C3) [0403:6001, ftdi_sio]"
+gchar *describe_port(const struct SerialPortInfo *info) {
+  GString *text = g_string_new(NULL);
+  if (info->manufacturer!=NULL) {
+    g_string_append_printf(text, "%s ", info->manufacturer);
+  }
+  if (info->product!=NULL) {
+    g_string_append_printf(text, "%s ", info->product);
+  }
+  if (info->serial_number!=NULL) {
+    g_string_append_printf(text, "(S/N: %s) ", info->serial_number);
+  }
+  g_string_append(text, "[");
+  if (info->vendor_id!=NULL && info->product_id!=NULL) {
+    g_string_append_printf(text, "%s:%s, ", info->vendor_id, info->product_id);
+  }
+  g_string_append_printf(text, "%s]", info->driver!=NULL ? info->driver : "?");
+  return g_string_free(text, FALSE);
+}
+
+// Llena el selector de puertos desde el índice, conservando lo que el usuario haya escrito
+void fill_port_picker(void) {
+  gchar *typed = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(port_picker));
+  gtk_combo_box_text_remove_all(GTK_COMBO_BOX_TEXT(port_picker));
+  GPtrArray *ports = serial_port_index_list(port_index);
+  for (guint i = 0; i < ports->len; i++) {
+    const struct SerialPortInfo *info = g_ptr_array_index(ports, i);
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(port_picker), info->device, info->device);
+  }
+  if (typed!=NULL && typed[0]!=0x00) {
+    gtk_entry_set_text(GTK_ENTRY(gtk_bin_get_child(GTK_BIN(port_picker))), typed);
+  } else if (ports->len > 0) {
+    gtk_combo_box_set_active(GTK_COMBO_BOX(port_picker), 0);
+  }
+  g_ptr_array_unref(ports);
+  g_free(typed);
+}
+#endif
+
 //===--------------------------------------------------------------------------------------------------------------===//
 //                                        Callbacks para los eventos de la GUI
 //===--------------------------------------------------------------------------------------------------------------===//
@@ -103,28 +227,24 @@ void on_radiobtn_change(GtkToggleButton *togglebutton, gpointer user_data) {
   }
 }
 
-void on_inputhex_change(GtkEditable *editable, gpointer user_data) {
-  const char *ctext = gtk_entry_get_text(GTK_ENTRY(editable));
-  unsigned long parsed_value = 0x00;
-  if (strcmp((const char *) print_format, APP_STR_ASCII)==0) {
-    if (ctext[0]=='\'' && ctext[2]=='\'') {
-      parsed_value = (unsigned long) *(ctext + 1);
-    }
-  } else if (strcmp((const char *) print_format, APP_STR_HEX)==0) {
-    char **tmp = NULL;
-    parsed_value = strtoul(ctext, tmp, 16);
-  } else if (strcmp((const char *) print_format, APP_STR_DEC)==0) {
-    char **tmp = NULL;
-    parsed_value = strtoul(ctext, tmp, 10);
-  } else if (strcmp((const char *) print_format, APP_STR_OCT)==0) {
-    char **tmp = NULL;
-    parsed_value = strtoul(ctext, tmp, 8);
-  }
-  for (int i = 0; i < APP_SWI_SIZE; i++) {
-    gboolean bit_n = (gboolean) ((parsed_value >> i) & 0x01);
-    gtk_switch_set_state(GTK_SWITCH(input_swi[i]), bit_n);
+#ifdef __linux__
+void on_port_picker_change(GtkComboBox *combo, gpointer user_data) {
+  gchar *device = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(combo));
+  const struct SerialPortInfo *info = serial_port_index_lookup(port_index, device);
+  gchar *details = info!=NULL ? describe_port(info) : g_strdup(APP_DIALOG_PORT_UNKNOWN);
+  gtk_label_set_text(GTK_LABEL(port_details), details);
+  g_free(details);
+  g_free(device);
+}
+
+void on_ports_changed(struct SerialPortIndex *index, gpointer user_data) {
+  // Un adaptador se conectó o se desconectó: si el diálogo está abierto, se actualiza en vivo
+  if (port_picker!=NULL) {
+    fill_port_picker();
+    on_port_picker_change(GTK_COMBO_BOX(port_picker), NULL);
   }
 }
+#endif
 
 void setup_port_diag(GtkButton *button, GtkWindow *window) {
   char formatted[100];
@@ -176,6 +296,56 @@ void setup_port_diag(GtkButton *button, GtkWindow *window) {
   gtk_grid_attach(GTK_GRID(grid_dialog), gtk_label_new(APP_DIALOG_SWCTL), 0, 3, 1, 1);
   gtk_grid_attach(GTK_GRID(grid_dialog), switch_swofl_enable, 1, 3, 1, 1);
 
+  // Switch para el control por hardware (RTS/CTS)
+  GtkWidget *switch_hwfl_enable = gtk_switch_new();
+  gtk_switch_set_state(GTK_SWITCH(switch_hwfl_enable), abstract_port->get_hardware_control_flow(&abstract_port));
+  gtk_grid_attach(GTK_GRID(grid_dialog), gtk_label_new(APP_DIALOG_HWCTL), 0, 4, 1, 1);
+  gtk_grid_attach(GTK_GRID(grid_dialog), switch_hwfl_enable, 1, 4, 1, 1);
+
+  // Pausas de las tramas (macros y `send_byte`), en tiempos de carácter
+  struct SerialPacing pacing;
+  struct SerialPacingStats pacing_stats;
+  abstract_port->get_pacing(&pacing, &abstract_port);
+  abstract_port->get_pacing_stats(&pacing_stats, &abstract_port);
+  GtkWidget *spin_inter_byte = gtk_spin_button_new_with_range(0.0, APP_PACING_MAX_CHARS, 0.5);
+  gtk_spin_button_set_digits(GTK_SPIN_BUTTON(spin_inter_byte), 1);
+  gtk_spin_button_set_value(GTK_SPIN_BUTTON(spin_inter_byte), pacing.inter_byte);
+  GtkWidget *spin_inter_frame = gtk_spin_button_new_with_range(0.0, APP_PACING_MAX_CHARS, 0.5);
+  gtk_spin_button_set_digits(GTK_SPIN_BUTTON(spin_inter_frame), 1);
+  gtk_spin_button_set_value(GTK_SPIN_BUTTON(spin_inter_frame), pacing.inter_frame);
+  gtk_grid_attach(GTK_GRID(grid_dialog), gtk_label_new(APP_DIALOG_INTER_BYTE), 0, 5, 1, 1);
+  gtk_grid_attach(GTK_GRID(grid_dialog), spin_inter_byte, 1, 5, 1, 1);
+  gtk_grid_attach(GTK_GRID(grid_dialog), gtk_label_new(APP_DIALOG_INTER_FRAME), 0, 6, 1, 1);
+  gtk_grid_attach(GTK_GRID(grid_dialog), spin_inter_frame, 1, 6, 1, 1);
+  // Qué tan puntuales fueron las pausas desde la última configuración
+  gchar *pacing_text = g_strdup_printf(APP_DIALOG_PACING_STATS,
+                                       pacing_stats.char_time_ns/1000.0,
+                                       pacing_stats.gaps,
+                                       pacing_stats.mean_late_ns/1000.0,
+                                       pacing_stats.max_late_ns/1000.0,
+                                       pacing_stats.jitter_ns/1000.0);
+  gtk_grid_attach(GTK_GRID(grid_dialog), gtk_label_new(pacing_text), 0, 7, 2, 1);
+  g_free(pacing_text);
+  // Cuánto tiempo esperaron las escrituras a la cola de salida y cuánto de eso fue por el control de flujo
+  struct SerialStats port_stats;
+  serial_get_stats(&port_stats, &abstract_port);
+  gchar *flow_text = g_strdup_printf(APP_DIALOG_FLOW_STATS,
+                                     port_stats.tx_wait_ns/1e9,
+                                     port_stats.flow_blocked_ns/1e9);
+  gtk_grid_attach(GTK_GRID(grid_dialog), gtk_label_new(flow_text), 0, 8, 2, 1);
+  g_free(flow_text);
+  // Retraso de los despertares del hilo lector, solamente si corre en tiempo real
+  struct SerialJitterHistogram jitter;
+  if (get_serial_listener_jitter(&abstract_port, &jitter)) {
+    gchar *jitter_text = g_strdup_printf(APP_DIALOG_JITTER_STATS,
+                                         jitter.samples,
+                                         jitter.mean_ns/1e3,
+                                         serial_jitter_percentile(&jitter, 0.99)/1e3,
+                                         jitter.max_ns/1e3);
+    gtk_grid_attach(GTK_GRID(grid_dialog), gtk_label_new(jitter_text), 0, 9, 2, 1);
+    g_free(jitter_text);
+  }
+
   // Muestra y ejecuta el diálogo
   gtk_widget_show_all(GTK_WIDGET(content_area));
   gint dialog_response = gtk_dialog_run(setup_port_dialog);
@@ -183,6 +353,9 @@ void setup_port_diag(GtkButton *button, GtkWindow *window) {
   gboolean parity_enable_boolean_switch = gtk_switch_get_state(GTK_SWITCH(switch_parity_enable));
   gboolean parity_odd_boolean_switch = gtk_switch_get_state(GTK_SWITCH(switch_parity_odd));
   gboolean switch_swofl_boolean_switch = gtk_switch_get_state(GTK_SWITCH(switch_swofl_enable));
+  gboolean switch_hwfl_boolean_switch = gtk_switch_get_state(GTK_SWITCH(switch_hwfl_enable));
+  pacing.inter_byte = gtk_spin_button_get_value(GTK_SPIN_BUTTON(spin_inter_byte));
+  pacing.inter_frame = gtk_spin_button_get_value(GTK_SPIN_BUTTON(spin_inter_frame));
   switch (dialog_response) {
     case GTK_RESPONSE_ACCEPT://
       errno = 0x00;
@@ -195,6 +368,10 @@ void setup_port_diag(GtkButton *button, GtkWindow *window) {
       if (errno!=0) goto on_errno_not_zero_setup_port;
       abstract_port->set_software_control_flow(switch_swofl_boolean_switch, &abstract_port);
       if (errno!=0) goto on_errno_not_zero_setup_port;
+      abstract_port->set_hardware_control_flow(switch_hwfl_boolean_switch, &abstract_port);
+      if (errno!=0) goto on_errno_not_zero_setup_port;
+      abstract_port->set_pacing(&pacing, &abstract_port);
+      if (errno!=0) goto on_errno_not_zero_setup_port;
     on_errno_not_zero_setup_port:
       if (errno!=0x00) {
         GtkWidget *error_chg_serial = gtk_message_dialog_new(GTK_WINDOW(setup_port_dialog),
@@ -226,7 +403,9 @@ void send_byte(GtkButton *button, GtkWindow *window) {
     binval = (binval & 0x01);
     val |= binval << i;
   }
-  gboolean success = abstract_port->write_byte((gchar) val, &abstract_port);
+  // El byte es una trama de un solo byte, así respeta la pausa entre tramas configurada
+  guchar byte = (guchar) val;
+  gboolean success = abstract_port->write_frame(&byte, 1, &abstract_port)==1;
   if (!success) {
     GtkWidget *error_send_serial = gtk_message_dialog_new(GTK_WINDOW(window),
                                                           GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
@@ -240,71 +419,860 @@ void send_byte(GtkButton *button, GtkWindow *window) {
   }
 }
 
+// Teclas de la consola: se escriben directo en el puerto, sin pausas ni diálogos. Si la cola de salida está llena
+// (p.e. durante una transmisión), se espera un poco; una tecla que no cabe se pierde, como en una terminal
+void send_console_keys(const guchar *data, gsize length, gpointer user_data) {
+  if (abstract_port==NULL) {
+    return;
+  }
+  gsize sent = 0;
+  while (sent < length) {
+    gssize n = serial_write_buffer(data + sent, length - sent, &abstract_port);
+    if (n > 0) {
+      sent += (gsize) n;
+    } else if (n==-1 && errno==EAGAIN && abstract_port->wait_writable(APP_CONSOLE_WRITE_TIMEOUT_MS, &abstract_port)) {
+      continue;
+    } else {
+      g_warning("Keystroke dropped: %s", g_strerror(errno));
+      return;
+    }
+  }
+}
+
+gboolean update_transmit_progress(gpointer user_data) {
+  if (active_transmit==NULL) {
+    // `deactivate` ya terminó la transmisión (y el diálogo ya no existe); `run_transmit_dialog` quita este timer
+    return G_SOURCE_CONTINUE;
+  }
+  GtkDialog *dialog = GTK_DIALOG(user_data);
+  GtkWidget *bar = g_object_get_data(G_OBJECT(dialog), APP_TRANSMIT_BAR);
+  GtkWidget *label = g_object_get_data(G_OBJECT(dialog), APP_TRANSMIT_LABEL);
+  struct SerialTransmitProgress progress;
+  serial_transmit_get_progress(active_transmit, &progress);
+  gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(bar), progress.total > 0 ? (gdouble) progress.sent/progress.total : 1.0);
+  gchar *text = g_strdup_printf(APP_TRANSMIT_FORMAT,
+                                progress.sent,
+                                progress.total,
+                                progress.elapsed/(gdouble) G_USEC_PER_SEC,
+                                progress.efficiency*100.0);
+  gtk_label_set_text(GTK_LABEL(label), text);
+  g_free(text);
+  if (progress.done) {
+    gtk_dialog_response(dialog, GTK_RESPONSE_ACCEPT);
+    return G_SOURCE_REMOVE;
+  }
+  return G_SOURCE_CONTINUE;
+}
+
+// Cancela la transmisión en curso (si hay) y espera a que su hilo termine. Devuelve el resultado de la transmisión.
+gboolean stop_transmit(void) {
+  if (active_transmit==NULL) {
+    return TRUE;
+  }
+  serial_transmit_cancel(active_transmit);
+  gboolean result = serial_transmit_finish(active_transmit);
+  active_transmit = NULL;
+  return result;
+}
+
+// Muestra el progreso de `active_transmit` hasta que termina (o el usuario la cancela) y la termina. Devuelve FALSE,
+// con errno configurado, si falló; una transmisión cancelada, o cuya ventana se cerró, no es un error que mostrar.
+gboolean run_transmit_dialog(GtkWindow *window, const gchar *title, const gchar *description) {
+  // Diálogo de progreso; el botón cancela la transmisión
+  GtkDialog *progress_dialog = (GtkDialog *) gtk_dialog_new_with_buttons(title,
+                                                                         window,
+                                                                         GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+                                                                         APP_CANCEL,
+                                                                         GTK_RESPONSE_CANCEL,
+                                                                         NULL);
+  GtkWidget *content_area = gtk_dialog_get_content_area(progress_dialog);
+  GtkWidget *bar = gtk_progress_bar_new();
+  GtkWidget *label = gtk_label_new(description);
+  gtk_container_add(GTK_CONTAINER(content_area), bar);
+  gtk_container_add(GTK_CONTAINER(content_area), label);
+  g_object_set_data(G_OBJECT(progress_dialog), APP_TRANSMIT_BAR, bar);
+  g_object_set_data(G_OBJECT(progress_dialog), APP_TRANSMIT_LABEL, label);
+  gtk_widget_show_all(GTK_WIDGET(content_area));
+  guint updater = g_timeout_add(APP_TRANSMIT_UPDATE_MS, update_transmit_progress, progress_dialog);
+  gint response = gtk_dialog_run(progress_dialog);
+  if (response!=GTK_RESPONSE_ACCEPT) {
+    // Cancelado por el usuario (o la ventana se cerró, en cuyo caso `deactivate` ya terminó la transmisión)
+    g_source_remove(updater);
+  }
+  errno = 0x00;
+  gboolean success = stop_transmit();
+  if (response==GTK_RESPONSE_NONE) {
+    return TRUE;
+  }
+  gtk_widget_destroy(GTK_WIDGET(progress_dialog));
+  return success || errno==ECANCELED;
+}
+
+void send_file(GtkButton *button, GtkWindow *window) {
+  GtkWidget *chooser = gtk_file_chooser_dialog_new(APP_SEND_FILE_TITLE,
+                                                   window,
+                                                   GTK_FILE_CHOOSER_ACTION_OPEN,
+                                                   APP_CANCEL,
+                                                   GTK_RESPONSE_CANCEL,
+                                                   APP_OK,
+                                                   GTK_RESPONSE_ACCEPT,
+                                                   NULL);
+  if (gtk_dialog_run(GTK_DIALOG(chooser))!=GTK_RESPONSE_ACCEPT) {
+    gtk_widget_destroy(chooser);
+    return;
+  }
+  gchar *path = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(chooser));
+  gtk_widget_destroy(chooser);
+  active_transmit = serial_transmit_file(&abstract_port, path);
+  if (active_transmit==NULL) {
+    GtkWidget *error_open_file = gtk_message_dialog_new(window,
+                                                        GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+                                                        GTK_MESSAGE_ERROR,
+                                                        GTK_BUTTONS_CLOSE,
+                                                        "No se puede abrir el archivo “%s”: %s",
+                                                        path,
+                                                        g_strerror(errno));
+    gtk_dialog_run(GTK_DIALOG(error_open_file));
+    gtk_widget_destroy(error_open_file);
+    g_free(path);
+    return;
+  }
+  if (!run_transmit_dialog(window, APP_SEND_FILE_TITLE, path)) {
+    GtkWidget *error_send_file = gtk_message_dialog_new(window,
+                                                        GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+                                                        GTK_MESSAGE_ERROR,
+                                                        GTK_BUTTONS_CLOSE,
+                                                        "No se ha enviado el archivo “%s”: %s",
+                                                        path,
+                                                        g_strerror(errno));
+    gtk_dialog_run(GTK_DIALOG(error_send_file));
+    gtk_widget_destroy(error_send_file);
+  }
+  g_free(path);
+}
+
+// El formato del texto sale del formato de visualización elegido; el prefijo `b64:` indica base64 en cualquiera
+enum SerialPayloadFormat payload_format(const gchar **text) {
+  if (g_str_has_prefix(*text, APP_PAYLOAD_BASE64_PREFIX)) {
+    *text += strlen(APP_PAYLOAD_BASE64_PREFIX);
+    return SERIAL_PAYLOAD_BASE64;
+  }
+  return display_format();
+}
+
+// Un byte se muestra en los switches (para enviarlo con el botón); más de uno se envía de inmediato como un solo
+// bloque, con el mismo diálogo de progreso que un archivo
+void on_inputhex_change(GtkEditable *editable, GtkWindow *window) {
+  const gchar *ctext = gtk_entry_get_text(GTK_ENTRY(editable));
+  const gchar *text = ctext;
+  enum SerialPayloadFormat format = payload_format(&text);
+  gchar *unquoted = NULL;
+  gsize length = strlen(text);
+  if (format==SERIAL_PAYLOAD_ESCAPED && length >= 2 && (text[0]=='\'' || text[0]=='"') && text[length - 1]==text[0]) {
+    // El texto entre comillas, como lo muestra el formato ASCII
+    unquoted = g_strndup(text + 1, length - 2);
+  }
+  gsize error_offset = 0;
+  GBytes *payload = serial_payload_decode(unquoted!=NULL ? unquoted : text, format, &error_offset);
+  GtkStyleContext *style = gtk_widget_get_style_context(GTK_WIDGET(editable));
+  if (payload==NULL) {
+    // El cursor queda en el primer carácter inválido
+    const gchar *error_at = text + error_offset + (unquoted!=NULL ? 1 : 0);
+    gtk_style_context_add_class(style, GTK_STYLE_CLASS_ERROR);
+    gtk_editable_set_position(editable, (gint) g_utf8_pointer_to_offset(ctext, error_at));
+    g_free(unquoted);
+    return;
+  }
+  gtk_style_context_remove_class(style, GTK_STYLE_CLASS_ERROR);
+  g_free(unquoted);
+  gsize size;
+  const guchar *data = g_bytes_get_data(payload, &size);
+  if (size <= 1) {
+    unsigned long parsed_value = size==1 ? data[0] : 0x00;
+    for (int i = 0; i < APP_SWI_SIZE; i++) {
+      gboolean bit_n = (gboolean) ((parsed_value >> i) & 0x01);
+      gtk_switch_set_state(GTK_SWITCH(input_swi[i]), bit_n);
+    }
+    g_bytes_unref(payload);
+    return;
+  }
+  // El trabajo guarda su propia referencia
+  active_transmit = serial_transmit_bytes(&abstract_port, payload);
+  if (active_transmit==NULL) {
+    GtkWidget *error_send_payload = gtk_message_dialog_new(window,
+                                                           GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+                                                           GTK_MESSAGE_ERROR,
+                                                           GTK_BUTTONS_CLOSE,
+                                                           "No se han enviado los %" G_GSIZE_FORMAT " bytes: %s",
+                                                           size,
+                                                           g_strerror(errno));
+    gtk_dialog_run(GTK_DIALOG(error_send_payload));
+    gtk_widget_destroy(error_send_payload);
+    g_bytes_unref(payload);
+    return;
+  }
+  g_bytes_unref(payload);
+  gchar *description = g_strdup_printf(APP_PAYLOAD_DESCRIPTION, size);
+  if (!run_transmit_dialog(window, APP_SEND_PAYLOAD_TITLE, description)) {
+    GtkWidget *error_send_payload = gtk_message_dialog_new(window,
+                                                           GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+                                                           GTK_MESSAGE_ERROR,
+                                                           GTK_BUTTONS_CLOSE,
+                                                           "No se han enviado los %" G_GSIZE_FORMAT " bytes: %s",
+                                                           size,
+                                                           g_strerror(errno));
+    gtk_dialog_run(GTK_DIALOG(error_send_payload));
+    gtk_widget_destroy(error_send_payload);
+  }
+  g_free(description);
+}
+
+// Cancela la macro en ejecución (si hay) y espera a que su hilo termine. Devuelve el resultado de la ejecución.
+gboolean stop_macro(void) {
+  if (active_macro==NULL) {
+    return TRUE;
+  }
+  serial_macro_cancel(active_macro);
+  gboolean result = serial_macro_finish(active_macro);
+  active_macro = NULL;
+  return result;
+}
+
+gboolean watch_macro(gpointer user_data) {
+  GtkButton *button = GTK_BUTTON(user_data);
+  if (active_macro!=NULL && !serial_macro_is_done(active_macro)) {
+    return G_SOURCE_CONTINUE;
+  }
+  errno = 0x00;
+  gboolean success = stop_macro();
+  macro_watcher = 0;
+  gtk_button_set_label(button, APP_STR_RUN_MACRO);
+  if (!success && errno!=ECANCELED) {
+    GtkWidget *error_run_macro = gtk_message_dialog_new(GTK_WINDOW(gtk_widget_get_toplevel(GTK_WIDGET(button))),
+                                                        GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+                                                        GTK_MESSAGE_ERROR,
+                                                        GTK_BUTTONS_CLOSE,
+                                                        "La macro no terminó: %s",
+                                                        g_strerror(errno));
+    gtk_dialog_run(GTK_DIALOG(error_run_macro));
+    gtk_widget_destroy(error_run_macro);
+  }
+  return G_SOURCE_REMOVE;
+}
+
+void run_macro(GtkButton *button, GtkWindow *window) {
+  // El mismo botón detiene la macro que se está ejecutando; `watch_macro` la termina
+  if (active_macro!=NULL) {
+    serial_macro_cancel(active_macro);
+    return;
+  }
+  const gchar *source = gtk_entry_get_text(GTK_ENTRY(gtk_bin_get_child(GTK_BIN(macro_picker))));
+  GBytes *bytecode = g_hash_table_lookup(macros, source);
+  if (bytecode==NULL) {
+    gsize error_at = 0;
+    bytecode = serial_macro_compile(source, &error_at);
+    if (bytecode==NULL) {
+      GtkWidget *error_macro = gtk_message_dialog_new(window,
+                                                      GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+                                                      GTK_MESSAGE_ERROR,
+                                                      GTK_BUTTONS_CLOSE,
+                                                      "La macro tiene un error en “%.16s”",
+                                                      source + error_at);
+      gtk_dialog_run(GTK_DIALOG(error_macro));
+      gtk_widget_destroy(error_macro);
+      return;
+    }
+    // La macro queda guardada en la sesión para ejecutarla de nuevo sin volver a compilarla
+    g_hash_table_insert(macros, g_strdup(source), bytecode);
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(macro_picker), source);
+  }
+  active_macro = serial_macro_run(&abstract_port, bytecode);
+  if (active_macro==NULL) {
+    return;
+  }
+  gtk_button_set_label(button, APP_STR_STOP_MACRO);
+  macro_watcher = g_timeout_add(APP_MACRO_POLL_MS, watch_macro, button);
+}
+
+#ifdef __linux__
+// Termina el puente (si hay) sin volver a crear el hilo lector; el botón queda desactivado
+void stop_bridge(void) {
+  if (bridge==NULL) {
+    return;
+  }
+  serial_bridge_free(bridge);
+  bridge = NULL;
+  if (bridge_tgb!=NULL) {
+    // `on_bridge_toggled` no hace nada porque el puente ya no existe
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(bridge_tgb), FALSE);
+    gtk_button_set_label(GTK_BUTTON(bridge_tgb), APP_STR_BRIDGE);
+  }
+}
+#endif
+
+// Se ejecuta en el hilo de la suscripción de la grabación
+void on_capture_chunk(struct SerialChunk *chunk, gpointer user_data) {
+  gsize length;
+  const guchar *data = g_bytes_get_data(chunk->bytes, &length);
+  // Un bloque leído justo antes de empezar a grabar todavía no trae la fecha CLOCK_REALTIME
+  gint64 realtime = chunk->stamp.realtime_ns!=0 ? chunk->stamp.realtime_ns : g_get_real_time()*1000;
+  g_mutex_lock(&capture_lock);
+  if (capture_writer!=NULL && !serial_capture_writer_append(capture_writer, realtime, data, length)) {
+    g_critical("Recording stopped: unable to write the capture.");
+    g_critical("Message: \'%s\'", g_strerror(errno));
+    serial_capture_writer_free(capture_writer);
+    capture_writer = NULL;
+  }
+  g_mutex_unlock(&capture_lock);
+}
+
+// Termina la grabación (si hay) y cierra el archivo
+void stop_capture(void) {
+  // Primero la suscripción: su hilo escribe lo que quedó en la cola y termina
+  if (capture_subscription!=NULL) {
+    struct SerialSubscriptionStats stats;
+    serial_subscription_get_stats(capture_subscription, &stats);
+    if (stats.dropped_chunks > 0) {
+      g_warning("The capture lost %" G_GUINT64_FORMAT " bytes: the disk could not keep up.", stats.dropped_bytes);
+    }
+    serial_subscription_free(capture_subscription);
+    capture_subscription = NULL;
+    // Devuelve la petición de la fecha CLOCK_REALTIME que hizo `on_record_toggled`
+    serial_timestamp_set_wall_clock(FALSE);
+  }
+  g_mutex_lock(&capture_lock);
+  if (capture_writer!=NULL) {
+    serial_capture_writer_free(capture_writer);
+    capture_writer = NULL;
+  }
+  g_mutex_unlock(&capture_lock);
+}
+
+void on_record_toggled(GtkToggleButton *button, GtkWindow *window) {
+  if (!gtk_toggle_button_get_active(button)) {
+    stop_capture();
+    gtk_button_set_label(GTK_BUTTON(button), APP_STR_RECORD);
+    return;
+  }
+  GtkWidget *chooser = gtk_file_chooser_dialog_new(APP_RECORD_TITLE,
+                                                   window,
+                                                   GTK_FILE_CHOOSER_ACTION_SAVE,
+                                                   APP_CANCEL,
+                                                   GTK_RESPONSE_CANCEL,
+                                                   APP_OK,
+                                                   GTK_RESPONSE_ACCEPT,
+                                                   NULL);
+  gtk_file_chooser_set_do_overwrite_confirmation(GTK_FILE_CHOOSER(chooser), TRUE);
+  if (gtk_dialog_run(GTK_DIALOG(chooser))!=GTK_RESPONSE_ACCEPT) {
+    gtk_widget_destroy(chooser);
+    // Vuelve a llamar a este callback, que no tiene nada que detener
+    gtk_toggle_button_set_active(button, FALSE);
+    return;
+  }
+  gchar *path = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(chooser));
+  gtk_widget_destroy(chooser);
+  struct SerialCaptureWriter *writer = serial_capture_writer_new(path);
+  if (writer==NULL) {
+    GtkWidget *error_record = gtk_message_dialog_new(window,
+                                                     GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+                                                     GTK_MESSAGE_ERROR,
+                                                     GTK_BUTTONS_CLOSE,
+                                                     "No se puede crear la captura “%s”: %s",
+                                                     path,
+                                                     g_strerror(errno));
+    gtk_dialog_run(GTK_DIALOG(error_record));
+    gtk_widget_destroy(error_record);
+    gtk_toggle_button_set_active(button, FALSE);
+    g_free(path);
+    return;
+  }
+  serial_timestamp_set_wall_clock(TRUE);
+  g_mutex_lock(&capture_lock);
+  capture_writer = writer;
+  g_mutex_unlock(&capture_lock);
+  // Una grabación no debe tener huecos en medio: si el disco no alcanza, se pierde lo más nuevo
+  capture_subscription = serial_stream_subscribe_func(stream,
+                                                      APP_STREAM_CAPTURE_CHUNKS,
+                                                      SERIAL_OVERFLOW_DROP_NEWEST,
+                                                      on_capture_chunk,
+                                                      NULL);
+  gtk_button_set_label(GTK_BUTTON(button), APP_STR_RECORDING);
+  g_free(path);
+}
+
+// Abre una captura en su propia ventana. No necesita el puerto, así que también sirve sin conexión (`parent` puede
+// ser NULL)
+gboolean open_capture_window(GtkApplication *app, const gchar *path, GtkWindow *parent) {
+  struct SerialCapture *capture = serial_capture_open(path);
+  if (capture==NULL) {
+    GtkWidget *error_capture = gtk_message_dialog_new(parent,
+                                                      GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+                                                      GTK_MESSAGE_ERROR,
+                                                      GTK_BUTTONS_CLOSE,
+                                                      "No se puede abrir la captura “%s”: %s",
+                                                      path,
+                                                      g_strerror(errno));
+    gtk_dialog_run(GTK_DIALOG(error_capture));
+    gtk_widget_destroy(error_capture);
+    return FALSE;
+  }
+  GtkWidget *viewer = gtk_application_window_new(app);
+  gchar *name = g_path_get_basename(path);
+  gchar *title = g_strdup_printf(APP_CAPTURE_VIEW_TITLE, name);
+  gtk_window_set_title(GTK_WINDOW(viewer), title);
+  gtk_window_set_default_size(GTK_WINDOW(viewer), APP_CAPTURE_VIEW_WIDTH, APP_CAPTURE_VIEW_HEIGHT);
+  gtk_container_add(GTK_CONTAINER(viewer), capture_view_new(capture));
+  gtk_widget_show_all(viewer);
+  g_free(title);
+  g_free(name);
+  return TRUE;
+}
+
+void open_capture(GtkButton *button, GtkWindow *window) {
+  GtkWidget *chooser = gtk_file_chooser_dialog_new(APP_OPEN_CAPTURE_TITLE,
+                                                   window,
+                                                   GTK_FILE_CHOOSER_ACTION_OPEN,
+                                                   APP_CANCEL,
+                                                   GTK_RESPONSE_CANCEL,
+                                                   APP_OK,
+                                                   GTK_RESPONSE_ACCEPT,
+                                                   NULL);
+  GtkFileFilter *filter = gtk_file_filter_new();
+  gtk_file_filter_add_pattern(filter, APP_CAPTURE_PATTERN);
+  gtk_file_chooser_set_filter(GTK_FILE_CHOOSER(chooser), filter);
+  if (gtk_dialog_run(GTK_DIALOG(chooser))!=GTK_RESPONSE_ACCEPT) {
+    gtk_widget_destroy(chooser);
+    return;
+  }
+  gchar *path = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(chooser));
+  gtk_widget_destroy(chooser);
+  open_capture_window(gtk_window_get_application(window), path, window);
+  g_free(path);
+}
+
+// Desactiva las respuestas automáticas (si hay). Las respuestas con pausa pendientes se descartan
+void stop_responder(void) {
+  g_mutex_lock(&responder_lock);
+  struct SerialResponder *old = responder;
+  responder = NULL;
+  g_mutex_unlock(&responder_lock);
+  if (old!=NULL) {
+    serial_responder_free(old);
+  }
+  if (responder_tgb!=NULL) {
+    // `on_responder_toggled` no hace nada porque ya no hay reglas
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(responder_tgb), FALSE);
+  }
+}
+
+gboolean update_responder_stats(gpointer user_data) {
+  GtkLabel *label = GTK_LABEL(user_data);
+  if (responder==NULL) {
+    gtk_label_set_text(label, APP_RESPONDER_INACTIVE);
+    return G_SOURCE_CONTINUE;
+  }
+  GString *text = g_string_new(NULL);
+  for (guint i = 0; i < serial_responder_get_rule_count(responder); i++) {
+    struct SerialResponderStats stats;
+    serial_responder_get_stats(responder, i, &stats);
+    g_string_append_printf(text, APP_RESPONDER_RULE_COUNTS, i + 1, stats.matches, stats.replies, stats.errors);
+    if (stats.replies > 0) {
+      g_string_append_printf(text,
+                             APP_RESPONDER_RULE_LATENCY,
+                             (gdouble) stats.latency_total_us/stats.replies,
+                             stats.latency_min_us,
+                             stats.latency_max_us);
+    }
+    g_string_append_c(text, '\n');
+  }
+  gtk_label_set_text(label, text->str);
+  g_string_free(text, TRUE);
+  return G_SOURCE_CONTINUE;
+}
+
+gchar *get_text_view_text(GtkTextView *view) {
+  GtkTextBuffer *buffer = gtk_text_view_get_buffer(view);
+  GtkTextIter start, end;
+  gtk_text_buffer_get_bounds(buffer, &start, &end);
+  return gtk_text_buffer_get_text(buffer, &start, &end, FALSE);
+}
+
+// Copia los primeros APP_ERROR_CONTEXT_CHARS caracteres a partir del error, sin partir un carácter UTF-8
+gchar *get_error_context(const gchar *text, gsize error_at) {
+  gchar *context = g_malloc0(APP_ERROR_CONTEXT_CHARS*6 + 1);
+  g_utf8_strncpy(context, text + error_at, APP_ERROR_CONTEXT_CHARS);
+  return context;
+}
+
+void on_responder_toggled(GtkToggleButton *button, GtkTextView *view) {
+  if (!gtk_toggle_button_get_active(button)) {
+    if (responder!=NULL) {
+      stop_responder();
+    }
+    return;
+  }
+  gchar *rules = get_text_view_text(view);
+  gsize error_at = 0;
+  struct SerialResponder *compiled = serial_responder_new(rules, &error_at);
+  if (compiled==NULL) {
+    // El cursor queda en el error
+    GtkTextBuffer *buffer = gtk_text_view_get_buffer(view);
+    GtkTextIter error_iter;
+    gtk_text_buffer_get_iter_at_offset(buffer, &error_iter, (gint) g_utf8_pointer_to_offset(rules, rules + error_at));
+    gtk_text_buffer_place_cursor(buffer, &error_iter);
+    gchar *context = get_error_context(rules, error_at);
+    GtkWidget *error_rules = gtk_message_dialog_new(GTK_WINDOW(gtk_widget_get_toplevel(GTK_WIDGET(button))),
+                                                    GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+                                                    GTK_MESSAGE_ERROR,
+                                                    GTK_BUTTONS_CLOSE,
+                                                    APP_RESPONDER_ERROR,
+                                                    context);
+    g_free(context);
+    gtk_dialog_run(GTK_DIALOG(error_rules));
+    gtk_widget_destroy(error_rules);
+    g_free(rules);
+    gtk_toggle_button_set_active(button, FALSE);
+    return;
+  }
+  g_free(rules);
+  g_mutex_lock(&responder_lock);
+  struct SerialResponder *old = responder;
+  responder = compiled;
+  g_mutex_unlock(&responder_lock);
+  if (old!=NULL) {
+    serial_responder_free(old);
+  }
+}
+
+void on_responder_window_destroy(GtkWidget *widget, GtkTextView *view) {
+  // Las reglas siguen activas; el texto queda para la próxima vez que se abra la ventana
+  g_free(responder_rules);
+  responder_rules = get_text_view_text(view);
+  g_source_remove(responder_updater);
+  responder_updater = 0;
+  responder_tgb = NULL;
+  responder_window = NULL;
+}
+
+void open_responder(GtkButton *button, GtkWindow *window) {
+  if (responder_window!=NULL) {
+    gtk_window_present(GTK_WINDOW(responder_window));
+    return;
+  }
+  responder_window = gtk_application_window_new(gtk_window_get_application(window));
+  gtk_window_set_title(GTK_WINDOW(responder_window), APP_RESPONDER_TITLE);
+  gtk_window_set_transient_for(GTK_WINDOW(responder_window), window);
+  gtk_window_set_default_size(GTK_WINDOW(responder_window), APP_RESPONDER_WIDTH, APP_RESPONDER_HEIGHT);
+  GtkWidget *grid = gtk_grid_new();
+  gtk_container_add(GTK_CONTAINER(responder_window), grid);
+
+  GtkWidget *view = gtk_text_view_new();
+  gtk_text_view_set_monospace(GTK_TEXT_VIEW(view), TRUE);
+  gtk_text_buffer_set_text(gtk_text_view_get_buffer(GTK_TEXT_VIEW(view)),
+                           responder_rules!=NULL ? responder_rules : APP_RESPONDER_EXAMPLE,
+                           -1);
+  GtkWidget *scroll = gtk_scrolled_window_new(NULL, NULL);
+  gtk_widget_set_hexpand(scroll, TRUE);
+  gtk_widget_set_vexpand(scroll, TRUE);
+  gtk_container_add(GTK_CONTAINER(scroll), view);
+  gtk_grid_attach(GTK_GRID(grid), scroll, 0, 0, 1, 1);
+  responder_tgb = gtk_toggle_button_new_with_label(APP_STR_RESPONDER_ACTIVE);
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(responder_tgb), responder!=NULL);
+  gtk_grid_attach(GTK_GRID(grid), responder_tgb, 0, 1, 1, 1);
+  GtkWidget *stats_lbl = gtk_label_new(NULL);
+  gtk_label_set_xalign(GTK_LABEL(stats_lbl), 0.0f);
+  gtk_grid_attach(GTK_GRID(grid), stats_lbl, 0, 2, 1, 1);
+  update_responder_stats(stats_lbl);
+
+  g_signal_connect(responder_tgb, "toggled", G_CALLBACK(on_responder_toggled), view);
+  g_signal_connect(responder_window, "destroy", G_CALLBACK(on_responder_window_destroy), view);
+  responder_updater = g_timeout_add(APP_RESPONDER_UPDATE_MS, update_responder_stats, stats_lbl);
+  gtk_widget_show_all(responder_window);
+}
+
+void on_decode_chunk(struct SerialChunk *chunk, gpointer user_data) {
+  // Se ejecuta en el hilo de la suscripción: ahí mismo se separan y decodifican los mensajes
+  gsize length;
+  const guchar *data = g_bytes_get_data(chunk->bytes, &length);
+  decode_tree_push(user_data, data, length, &chunk->stamp);
+}
+
+// Deja de decodificar (si estaba decodificando); lo que ya está en el panel se queda
+void stop_decode(void) {
+  if (decode_subscription!=NULL) {
+    serial_subscription_free(decode_subscription);
+    decode_subscription = NULL;
+  }
+}
+
+void on_decode_toggled(GtkToggleButton *button, GtkTextView *view) {
+  if (!gtk_toggle_button_get_active(button)) {
+    stop_decode();
+    return;
+  }
+  gchar *source = get_text_view_text(view);
+  gsize error_at = 0;
+  struct SerialSchema *schema = serial_schema_new(source, &error_at);
+  if (schema==NULL) {
+    // El cursor queda en el error
+    GtkTextBuffer *buffer = gtk_text_view_get_buffer(view);
+    GtkTextIter error_iter;
+    gtk_text_buffer_get_iter_at_offset(buffer, &error_iter, (gint) g_utf8_pointer_to_offset(source, source + error_at));
+    gtk_text_buffer_place_cursor(buffer, &error_iter);
+    gchar *context = get_error_context(source, error_at);
+    GtkWidget *error_schema = gtk_message_dialog_new(GTK_WINDOW(gtk_widget_get_toplevel(GTK_WIDGET(button))),
+                                                     GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+                                                     GTK_MESSAGE_ERROR,
+                                                     GTK_BUTTONS_CLOSE,
+                                                     APP_DECODE_ERROR,
+                                                     context);
+    g_free(context);
+    gtk_dialog_run(GTK_DIALOG(error_schema));
+    gtk_widget_destroy(error_schema);
+    g_free(source);
+    gtk_toggle_button_set_active(button, FALSE);
+    return;
+  }
+  g_free(source);
+  // El panel empieza de nuevo con el esquema nuevo; decodifica lo que llegue desde ahora
+  decode_tree_set_schema(decode_tree, schema);
+  decode_subscription = serial_stream_subscribe_func(stream,
+                                                     APP_STREAM_DECODE_CHUNKS,
+                                                     SERIAL_OVERFLOW_DROP_OLDEST,
+                                                     on_decode_chunk,
+                                                     decode_tree);
+}
+
+void on_decode_window_destroy(GtkWidget *widget, GtkTextView *view) {
+  // Antes de que se destruya el panel: después de esto ya nadie le entrega bloques
+  stop_decode();
+  g_free(decode_schema);
+  decode_schema = get_text_view_text(view);
+  decode_tree = NULL;
+  decode_window = NULL;
+}
+
+void open_decode(GtkButton *button, GtkWindow *window) {
+  if (decode_window!=NULL) {
+    gtk_window_present(GTK_WINDOW(decode_window));
+    return;
+  }
+  decode_window = gtk_application_window_new(gtk_window_get_application(window));
+  gtk_window_set_title(GTK_WINDOW(decode_window), APP_DECODE_TITLE);
+  gtk_window_set_transient_for(GTK_WINDOW(decode_window), window);
+  gtk_window_set_default_size(GTK_WINDOW(decode_window), APP_DECODE_WIDTH, APP_DECODE_HEIGHT);
+  GtkWidget *grid = gtk_grid_new();
+  gtk_container_add(GTK_CONTAINER(decode_window), grid);
+
+  GtkWidget *view = gtk_text_view_new();
+  gtk_text_view_set_monospace(GTK_TEXT_VIEW(view), TRUE);
+  gtk_text_buffer_set_text(gtk_text_view_get_buffer(GTK_TEXT_VIEW(view)),
+                           decode_schema!=NULL ? decode_schema : APP_DECODE_EXAMPLE,
+                           -1);
+  GtkWidget *scroll = gtk_scrolled_window_new(NULL, NULL);
+  gtk_widget_set_hexpand(scroll, TRUE);
+  gtk_widget_set_vexpand(scroll, TRUE);
+  gtk_container_add(GTK_CONTAINER(scroll), view);
+  gtk_grid_attach(GTK_GRID(grid), scroll, 0, 0, 1, 1);
+  GtkWidget *decode_tgb = gtk_toggle_button_new_with_label(APP_STR_DECODE_ACTIVE);
+  gtk_grid_attach(GTK_GRID(grid), decode_tgb, 0, 1, 1, 1);
+  decode_tree = decode_tree_new();
+  gtk_grid_attach(GTK_GRID(grid), decode_tree_get_widget(decode_tree), 0, 2, 1, 1);
+
+  g_signal_connect(decode_tgb, "toggled", G_CALLBACK(on_decode_toggled), view);
+  g_signal_connect(decode_window, "destroy", G_CALLBACK(on_decode_window_destroy), view);
+  gtk_widget_show_all(decode_window);
+}
+
 void deactivate(GtkWidget *object, gpointer user_data) {
-  // Libera el puerto serial
+  if (rate_sampler!=0) {
+    g_source_remove(rate_sampler);
+    rate_sampler = 0;
+  }
+  if (macro_watcher!=0) {
+    g_source_remove(macro_watcher);
+    macro_watcher = 0;
+  }
+  // La transmisión, la macro y las respuestas automáticas usan el puerto: hay que terminarlas antes de cerrarlo
+  stop_transmit();
+  stop_macro();
+  stop_responder();
+#ifdef __linux__
+  bridge_tgb = NULL;
+  stop_bridge();
+#endif
+  // Libera el puerto serial (también termina el hilo lector)
   close_serial_port(&abstract_port);
+  // Ya no hay hilo que publique: cada suscripción entrega lo que le quedó y termina
+  stop_capture();
+#ifdef __linux__
+  if (shm_subscription!=NULL) {
+    serial_subscription_free(shm_subscription);
+    shm_subscription = NULL;
+  }
+  if (shm_ring!=NULL) {
+    serial_shm_ring_free(shm_ring);
+    shm_ring = NULL;
+  }
+#endif
+  if (gui_subscription!=NULL) {
+    serial_subscription_free(gui_subscription);
+    gui_subscription = NULL;
+  }
+  stop_decode();
+  if (macros!=NULL) {
+    g_hash_table_destroy(macros);
+    macros = NULL;
+  }
+  g_free(responder_rules);
+  responder_rules = NULL;
+  g_free(decode_schema);
+  decode_schema = NULL;
+#ifdef __linux__
+  serial_port_index_free(port_index);
+  port_index = NULL;
+#endif
+#ifdef ABSERIO_TRACE
+  // Después de cerrar el puerto, para que la traza incluya el final del hilo lector
+  if (trace_path!=NULL) {
+    serial_trace_dump(trace_path);
+  }
+#endif
 }
 
 //===--------------------------------------------------------------------------------------------------------------===//
 //                                                 Hilos de ejecución
 //===--------------------------------------------------------------------------------------------------------------===//
 gboolean update_from_serial(gpointer data) {
-  guchar readed = *((guchar *) data);
-  for (int i = 0; i < APP_SWO_SIZE; i++) {
-    gboolean bit_n = (gboolean) ((readed >> i) & 0x01);
-    gtk_switch_set_state(GTK_SWITCH(output_swo[i]), bit_n);
-  }
-  char *use_format = "";
-  char formatted[10];
-  // Detecta el formato de salida
-  if (strcmp((const char *) print_format, APP_STR_ASCII)==0) {
-    // Usar el valor decimal con un \ para los valores de 0 a 31.
-    // De 31 a 254, usar el valor ASCII normal
-    switch (readed) {
-      case 0 ... 31://
-        use_format = "\'\\%02d\'";
-        break;
-      case 0x7F://
-        use_format = "\'\\DEL\'";
-        break;
-      case 0x80 ... 0xFF://
-        use_format = "\'\\-%02d\'";
-        break;
-      default://
-        use_format = "\'%c\'";
-        break;
-    }
-  } else if (strcmp((const char *) print_format, APP_STR_HEX)==0) {
-    use_format = "0x%02X";
-  } else if (strcmp((const char *) print_format, APP_STR_DEC)==0) {
-    use_format = "%d";
-  } else if (strcmp((const char *) print_format, APP_STR_OCT)==0) {
-    use_format = "0%0o";
-  }
-  sprintf(formatted, use_format, readed);
+  // Los bits se dibujan en `bit_lanes`; aquí solamente se muestra el último byte en el formato elegido
+  atomic_store(&update_pending, FALSE);
+  guchar readed = (guchar) atomic_load(&last_received);
+  gchar formatted[SERIAL_PAYLOAD_BYTE_MAX];
+  serial_payload_format_byte(readed, display_format(), formatted);
   gtk_entry_set_text(GTK_ENTRY(hex_tbo), formatted);
   return FALSE;
 }
-static gpointer blocking_listener(gpointer user_data) {
-  while (abstract_port!=NULL) {
-    errno = 0x00;
-    data_readed = abstract_port->read_byte(&abstract_port);
-    if (errno==ECANCELED) {
-      return NULL;
+gboolean sample_rates(gpointer user_data) {
+  // Diferencia de los contadores del driver desde la muestra anterior
+  static struct SerialStats previous;
+  static const struct AbstractSerialDevice *previous_port = NULL;
+  struct SerialStats current = {0};
+  if (abstract_port!=NULL) {
+    serial_get_stats(&current, &abstract_port);
+  }
+  if (abstract_port!=previous_port || current.rx_bytes < previous.rx_bytes || current.tx_bytes < previous.tx_bytes) {
+    // Se cambió de puerto: los contadores del puerto nuevo empiezan en cero
+    previous = (struct SerialStats) {0};
+    previous_port = abstract_port;
+  }
+  gdouble per_second = 1000.0/APP_RATE_SAMPLE_MS;
+  rate_graph_push(rate_graph,
+                  (current.rx_bytes - previous.rx_bytes)*per_second,
+                  (current.tx_bytes - previous.tx_bytes)*per_second);
+  previous = current;
+#ifdef __linux__
+  if (bridge!=NULL && bridge_tgb!=NULL) {
+    struct SerialBridgeStats bridge_stats;
+    serial_bridge_get_stats(bridge, &bridge_stats);
+    gchar *label = bridge_stats.error!=0
+                   ? g_strdup_printf(APP_STR_BRIDGE_FAILED, g_strerror(bridge_stats.error))
+                   : g_strdup_printf(APP_STR_BRIDGE_ACTIVE, bridge_stats.clients, bridge_stats.monitors);
+    gtk_button_set_label(GTK_BUTTON(bridge_tgb), label);
+    g_free(label);
+  }
+#endif
+  return G_SOURCE_CONTINUE;
+}
+
+void on_serial_data(const guchar *data, gsize length, const struct SerialTimestamp *stamp, gpointer user_data) {
+  // Se ejecuta en el hilo lector. Las respuestas automáticas se contestan aquí mismo: del otro lado alguien espera la
+  // respuesta. Todo lo demás está suscrito a `stream` y corre en sus propios hilos, así que un consumidor lento no
+  // retrasa la lectura
+  g_mutex_lock(&responder_lock);
+  if (responder!=NULL) {
+    serial_responder_feed(responder, data, length, stamp, &abstract_port);
+  }
+  g_mutex_unlock(&responder_lock);
+  serial_stream_publish(stream, data, length, stamp);
+}
+
+void on_gui_chunk(struct SerialChunk *chunk, gpointer user_data) {
+  // Se ejecuta en el hilo de la suscripción: la GUI solamente se actualiza desde el hilo principal. A lo más hay un
+  // idle pendiente, sin importar cuántos bloques lleguen antes de que el main loop lo atienda.
+  gsize length;
+  const guchar *data = g_bytes_get_data(chunk->bytes, &length);
+  bit_lanes_push(bit_lanes, data, length);
+  byte_stats_push(byte_stats, data, length, &chunk->stamp);
+  console_push(console, data, length);
+  atomic_store(&last_received, data[length - 1]);
+  if (!atomic_exchange(&update_pending, TRUE)) {
+    gdk_threads_add_idle(update_from_serial, NULL);
+  }
+}
+
+#ifdef __linux__
+void on_shm_chunk(struct SerialChunk *chunk, gpointer user_data) {
+  gsize length;
+  const guchar *data = g_bytes_get_data(chunk->bytes, &length);
+  serial_shm_ring_publish(shm_ring, data, length);
+}
+#endif
+
+// Arranca el hilo lector del puerto actual como lo pide la línea de comandos. Si el modo de tiempo real no se puede
+// aplicar (p.e. sin permisos), queda el hilo normal
+void start_listener(void) {
+  if (realtime_priority > 0 && realtime_period_us > 0) {
+    struct SerialRealtime config = {
+      .policy = realtime_rr ? SERIAL_RT_RR : SERIAL_RT_FIFO,
+      .priority = realtime_priority,
+      .cpu = realtime_cpu,
+      .period_us = (guint) realtime_period_us,
+      .lock_memory = realtime_lock,
+    };
+    if (start_serial_listener_realtime(&abstract_port, on_serial_data, NULL, &config)) {
+      return;
     }
-    gdk_threads_add_idle(update_from_serial, &data_readed);
+    g_warning("Falling back to the default listener thread.");
   }
-  return NULL;
+  start_serial_listener(&abstract_port, on_serial_data, NULL);
 }
-//===--------------------------------------------------------------------------------------------------------------===//
-//                                              Inicialización de la GUI
-//===--------------------------------------------------------------------------------------------------------------===//
-static void activate(GtkApplication *app, gpointer user_data) {
-  GtkWidget *window;
-  window = gtk_application_window_new(app);
 
-  //===-------------------------------------------------------------------------
-  // Dialogo modal para introducir el puerto serial
+#ifdef __linux__
+void on_bridge_toggled(GtkToggleButton *button, GtkWindow *window) {
+  gboolean active = gtk_toggle_button_get_active(button);
+  if (active && bridge==NULL) {
+    // El puente lee el puerto por su cuenta y entrega los bytes a `on_serial_data`, igual que el hilo lector
+    stop_serial_listener(&abstract_port);
+    bridge = serial_bridge_new(&abstract_port,
+                               APP_BRIDGE_ADDRESS,
+                               APP_BRIDGE_PORT,
+                               APP_BRIDGE_MONITOR_PORT,
+                               on_serial_data,
+                               NULL);
+    if (bridge==NULL) {
+      GtkWidget *error_bridge = gtk_message_dialog_new(window,
+                                                       GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+                                                       GTK_MESSAGE_ERROR,
+                                                       GTK_BUTTONS_CLOSE,
+                                                       "No se puede compartir el puerto en %s:%d: %s",
+                                                       APP_BRIDGE_ADDRESS,
+                                                       APP_BRIDGE_PORT,
+                                                       g_strerror(errno));
+      gtk_dialog_run(GTK_DIALOG(error_bridge));
+      gtk_widget_destroy(error_bridge);
+      start_listener();
+      gtk_toggle_button_set_active(button, FALSE);
+    }
+  } else if (!active && bridge!=NULL) {
+    stop_bridge();
+    start_listener();
+  }
+}
+#endif
+
+// Muestra el diálogo para elegir el puerto y lo abre. Si ya había un puerto abierto, se cierra solamente cuando el
+// nuevo se abrió correctamente, de forma que un error no deja a la aplicación sin puerto.
+gboolean ask_serial_port(GtkWindow *window) {
   GtkDialog *ask_serial_dialog = (GtkDialog *) gtk_dialog_new_with_buttons(
       APP_SERIAL_DIALOG_TITLE,
       GTK_WINDOW(window),
@@ -327,34 +1295,103 @@ static void activate(GtkApplication *app, gpointer user_data) {
   GtkWidget *msg_lbl = gtk_label_new(APP_DIALOG_ASK_MSG_POS);
 #endif
   gtk_grid_attach(GTK_GRID(grid_dialog), msg_lbl, 0, 0, 1, 1);
+#ifdef __linux__
+  // Selector con los puertos del índice. Tiene un entry, así que todavía se puede escribir cualquier ruta.
+  port_picker = gtk_combo_box_text_new_with_entry();
+  port_details = gtk_label_new(NULL);
+  GtkWidget *os_port_input = gtk_bin_get_child(GTK_BIN(port_picker));
+  if (os_port!=NULL) {
+    gtk_entry_set_text(GTK_ENTRY(os_port_input), os_port->str);
+  }
+  fill_port_picker();
+  on_port_picker_change(GTK_COMBO_BOX(port_picker), NULL);
+  g_signal_connect(port_picker, "changed", G_CALLBACK(on_port_picker_change), NULL);
+  gtk_grid_attach(GTK_GRID(grid_dialog), port_picker, 0, 1, 1, 1);
+  gtk_grid_attach(GTK_GRID(grid_dialog), port_details, 0, 2, 1, 1);
+#else
   GtkWidget *os_port_input = gtk_entry_new();
+  if (os_port!=NULL) {
+    gtk_entry_set_text(GTK_ENTRY(os_port_input), os_port->str);
+  }
   gtk_grid_attach(GTK_GRID(grid_dialog), os_port_input, 0, 1, 1, 1);
+#endif
 
   // Muestra el dialogo
   gtk_widget_show_all(GTK_WIDGET(content_area));
 
   gint dialog_response = gtk_dialog_run(ask_serial_dialog);
-  if (dialog_response==GTK_RESPONSE_ACCEPT) {
-    os_port = g_string_new(gtk_entry_get_text(GTK_ENTRY(os_port_input)));
-    gboolean open_result = open_serial_port(&abstract_port, os_port);
-    if (!open_result) {
-      GtkWidget *error_open_serial = gtk_message_dialog_new(GTK_WINDOW(ask_serial_dialog),
-                                                            GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
-                                                            GTK_MESSAGE_ERROR,
-                                                            GTK_BUTTONS_CLOSE,
-                                                            "Error al intentar abrir el puerto serial “%s”: %s",
-                                                            os_port->str,
-                                                            g_strerror(errno));
-      gtk_dialog_run(GTK_DIALOG (error_open_serial));
-      gtk_widget_destroy(window);
-      return;
-    }
-  } else if (dialog_response==GTK_RESPONSE_REJECT || dialog_response==GTK_RESPONSE_DELETE_EVENT) {
+  GString *new_port = g_string_new(gtk_entry_get_text(GTK_ENTRY(os_port_input)));
+#ifdef __linux__
+  port_picker = NULL;
+  port_details = NULL;
+#endif
+  if (dialog_response!=GTK_RESPONSE_ACCEPT) {
+    gtk_widget_destroy(GTK_WIDGET(ask_serial_dialog));
+    g_string_free(new_port, TRUE);
+    return FALSE;
+  }
+  const struct AbstractSerialDevice *new_abstract_port = NULL;
+#ifdef __linux__
+  enum SerialBackend backend = use_io_uring ? SERIAL_BACKEND_URING : SERIAL_BACKEND_DEFAULT;
+#else
+  enum SerialBackend backend = SERIAL_BACKEND_DEFAULT;
+#endif
+  if (!open_serial_port_with_backend(&new_abstract_port, new_port, backend)) {
+    GtkWidget *error_open_serial = gtk_message_dialog_new(GTK_WINDOW(ask_serial_dialog),
+                                                          GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+                                                          GTK_MESSAGE_ERROR,
+                                                          GTK_BUTTONS_CLOSE,
+                                                          "Error al intentar abrir el puerto serial “%s”: %s",
+                                                          new_port->str,
+                                                          g_strerror(errno));
+    gtk_dialog_run(GTK_DIALOG (error_open_serial));
+    gtk_widget_destroy(GTK_WIDGET(error_open_serial));
+    gtk_widget_destroy(GTK_WIDGET(ask_serial_dialog));
+    g_string_free(new_port, TRUE);
+    return FALSE;
+  }
+  gtk_widget_destroy(GTK_WIDGET(ask_serial_dialog));
+
+  // Cierra el puerto anterior (join del hilo lector incluido) y pone el nuevo en su lugar
+  stop_transmit();
+  stop_macro();
+  stop_responder();
+#ifdef __linux__
+  stop_bridge();
+#endif
+  close_serial_port(&abstract_port);
+  if (os_port!=NULL) {
+    g_string_free(os_port, TRUE);
+  }
+  abstract_port = new_abstract_port;
+  os_port = new_port;
+  start_listener();
+  return TRUE;
+}
+
+void switch_port(GtkButton *button, GtkWindow *window) {
+  ask_serial_port(window);
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                              Inicialización de la GUI
+//===--------------------------------------------------------------------------------------------------------------===//
+static void activate(GtkApplication *app, gpointer user_data) {
+  GtkWidget *window;
+  window = gtk_application_window_new(app);
+
+  //===-------------------------------------------------------------------------
+#ifdef __linux__
+  // El índice de puertos se construye una sola vez; después solamente se actualiza con los eventos de `/dev`
+  port_index = serial_port_index_new();
+  serial_port_index_watch(port_index, on_ports_changed, NULL);
+#endif
+  // Dialogo modal para introducir el puerto serial
+  if (!ask_serial_port(GTK_WINDOW(window))) {
     // Destruye la ventana, lo que resulta en la terminación inmediata de la aplicación
     gtk_widget_destroy(window);
     return;
   }
-  gtk_widget_destroy(GTK_WIDGET(ask_serial_dialog));
 
   //===-------------------------------------------------------------------------
   gtk_window_set_title(GTK_WINDOW(window), APP_STR_MAIN_TITLE);
@@ -376,19 +1413,15 @@ static void activate(GtkApplication *app, gpointer user_data) {
     GtkWidget *lbl = gtk_label_new(str);
     gtk_grid_attach(GTK_GRID(grid), lbl, 0, i, 1, 1);
   }
-  // 8 para salida
-  for (int j = 0; j < APP_SWO_SIZE; j++) {
-    GtkWidget *curr_swi = output_swo[j] = gtk_switch_new();
-    // Agrega cada uno de los switches al grid
-    gtk_grid_attach(GTK_GRID(grid), curr_swi, 3, j, 1, 1);
-    // Deshabilita esta columna de switches
-    gtk_widget_set_sensitive(GTK_WIDGET(curr_swi), FALSE);
-    // Crear un label para el índice del bit
-    char str[3];
-    sprintf(str, APP_IDX_FORMAT, j);
-    GtkWidget *lbl = gtk_label_new(str);
-    gtk_grid_attach(GTK_GRID(grid), lbl, 2, j, 1, 1);
-  }
+  // Los bits recibidos se muestran como carriles de un analizador lógico
+  bit_lanes = bit_lanes_new();
+  gtk_grid_attach(GTK_GRID(grid), bit_lanes_get_widget(bit_lanes), 2, 0, 2, APP_SWO_SIZE);
+  // Lo recibido como texto, a la derecha de todos los controles; con el foco, las teclas se envían al puerto
+  console = console_new(send_console_keys, NULL);
+  gtk_grid_attach(GTK_GRID(grid), console_get_widget(console), 5, 0, 1, APP_SWO_SIZE + 4);
+  // Estadísticas de todo lo recibido, a la derecha de la consola
+  byte_stats = byte_stats_new();
+  gtk_grid_attach(GTK_GRID(grid), byte_stats_get_widget(byte_stats), 6, 0, 1, APP_SWO_SIZE + 4);
 
   // Crea un textbox para cada columna y un botón para enviar en la columna izquierda
   hex_tbi = gtk_entry_new();
@@ -418,6 +1451,73 @@ static void activate(GtkApplication *app, gpointer user_data) {
   gtk_grid_attach(GTK_GRID(grid), setup_port, 4, 4, 1, 1);
   gtk_button_set_label(GTK_BUTTON(setup_port), APP_STR_SETUP_PORT);
 
+  // Botón para enviar un archivo completo
+  GtkWidget *send_file_bto = gtk_button_new();
+  gtk_grid_attach(GTK_GRID(grid), send_file_bto, 4, 6, 1, 1);
+  gtk_button_set_label(GTK_BUTTON(send_file_bto), APP_STR_SEND_FILE);
+
+  // Botones para grabar lo recibido y para abrir capturas grabadas
+  GtkWidget *record_tgb = gtk_toggle_button_new_with_label(APP_STR_RECORD);
+  gtk_grid_attach(GTK_GRID(grid), record_tgb, 4, APP_SWO_SIZE, 1, 1);
+  GtkWidget *open_capture_bto = gtk_button_new();
+  gtk_grid_attach(GTK_GRID(grid), open_capture_bto, 4, APP_SWO_SIZE + 1, 1, 1);
+  gtk_button_set_label(GTK_BUTTON(open_capture_bto), APP_STR_OPEN_CAPTURE);
+
+  // Gráfica de transferencia debajo de los controles
+  rate_graph = rate_graph_new();
+  gtk_widget_set_hexpand(rate_graph, TRUE);
+  gtk_grid_attach(GTK_GRID(grid), rate_graph, 0, APP_SWO_SIZE + 2, 5, 1);
+
+#ifdef __linux__
+  // Botón para compartir el puerto por TCP
+  bridge_tgb = gtk_toggle_button_new_with_label(APP_STR_BRIDGE);
+  gtk_grid_attach(GTK_GRID(grid), bridge_tgb, 4, 7, 1, 1);
+
+  // Los bytes recibidos también se publican en memoria compartida; la ruta se muestra para pasársela a
+  // `abserio-shmcat` u otras herramientas
+  shm_ring = serial_shm_ring_new(APP_SHM_RING_SIZE);
+  if (shm_ring==NULL) {
+    g_warning("Cannot create the shared receive stream. Message: '%s'", g_strerror(errno));
+  } else {
+    gchar *shm_path = serial_shm_ring_get_path(shm_ring);
+    gchar *shm_text = g_strdup_printf(APP_STR_SHM_RING, shm_path);
+    g_message("Publishing the receive stream at '%s'", shm_path);
+    shm_subscription = serial_stream_subscribe_func(stream,
+                                                    APP_STREAM_SHM_CHUNKS,
+                                                    SERIAL_OVERFLOW_DROP_OLDEST,
+                                                    on_shm_chunk,
+                                                    NULL);
+    GtkWidget *shm_lbl = gtk_label_new(shm_text);
+    gtk_label_set_selectable(GTK_LABEL(shm_lbl), TRUE);
+    gtk_grid_attach(GTK_GRID(grid), shm_lbl, 0, APP_SWO_SIZE + 4, 5, 1);
+    g_free(shm_text);
+    g_free(shm_path);
+  }
+#endif
+
+  // Macros de la sesión: se escriben en el entry y quedan en la lista después de ejecutarlas
+  macros = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_bytes_unref);
+  macro_picker = gtk_combo_box_text_new_with_entry();
+  gtk_entry_set_placeholder_text(GTK_ENTRY(gtk_bin_get_child(GTK_BIN(macro_picker))), APP_MACRO_PLACEHOLDER);
+  gtk_grid_attach(GTK_GRID(grid), macro_picker, 0, APP_SWO_SIZE + 3, 4, 1);
+  GtkWidget *run_macro_bto = gtk_button_new();
+  gtk_grid_attach(GTK_GRID(grid), run_macro_bto, 4, APP_SWO_SIZE + 3, 1, 1);
+  gtk_button_set_label(GTK_BUTTON(run_macro_bto), APP_STR_RUN_MACRO);
+
+  // Botón para cambiar (o reabrir) el puerto sin reiniciar la aplicación
+  GtkWidget *switch_port_bto = gtk_button_new();
+  gtk_grid_attach(GTK_GRID(grid), switch_port_bto, 4, 5, 1, 1);
+  gtk_button_set_label(GTK_BUTTON(switch_port_bto), APP_STR_SWITCH_PORT);
+
+  // Botón para abrir la ventana de las respuestas automáticas
+  GtkWidget *responder_bto = gtk_button_new();
+  gtk_grid_attach(GTK_GRID(grid), responder_bto, 4, APP_SWO_SIZE + 5, 1, 1);
+  gtk_button_set_label(GTK_BUTTON(responder_bto), APP_STR_RESPONDER);
+
+  // Botón para abrir la ventana de la decodificación de mensajes
+  GtkWidget *decode_bto = gtk_button_new();
+  gtk_grid_attach(GTK_GRID(grid), decode_bto, 4, APP_SWO_SIZE + 6, 1, 1);
+  gtk_button_set_label(GTK_BUTTON(decode_bto), APP_STR_DECODE);
 
   //===-------------------------------------------------------------------------
   // Agrega los callback
@@ -434,43 +1534,79 @@ static void activate(GtkApplication *app, gpointer user_data) {
   // Esto dispara el handler, necesario para activar el formato correcto
   gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(hex_rbt), TRUE);
   // Conecta a la señal que se produce al dar enter en el text box
-  g_signal_connect(hex_tbi, "activate", G_CALLBACK(on_inputhex_change), NULL);
+  g_signal_connect(hex_tbi, "activate", G_CALLBACK(on_inputhex_change), window);
   // Conecta al botón para mostrar el menú de configuración
   g_signal_connect(setup_port, "clicked", G_CALLBACK(setup_port_diag), window);
+  // Conecta al botón para enviar un archivo
+  g_signal_connect(send_file_bto, "clicked", G_CALLBACK(send_file), window);
+  // Conecta a los botones de las capturas
+  g_signal_connect(record_tgb, "toggled", G_CALLBACK(on_record_toggled), window);
+  g_signal_connect(open_capture_bto, "clicked", G_CALLBACK(open_capture), window);
+  // Conecta al botón para ejecutar (o detener) la macro
+  g_signal_connect(run_macro_bto, "clicked", G_CALLBACK(run_macro), window);
+#ifdef __linux__
+  // Conecta al botón del puente TCP
+  g_signal_connect(bridge_tgb, "toggled", G_CALLBACK(on_bridge_toggled), window);
+#endif
+  // Conecta al botón para cambiar de puerto
+  g_signal_connect(switch_port_bto, "clicked", G_CALLBACK(switch_port), window);
+  // Conecta al botón de las respuestas automáticas
+  g_signal_connect(responder_bto, "clicked", G_CALLBACK(open_responder), window);
+  // Conecta al botón de la decodificación de mensajes
+  g_signal_connect(decode_bto, "clicked", G_CALLBACK(open_decode), window);
   // Conecta al botón para enviar el byte
   g_signal_connect(send_bto, "clicked", G_CALLBACK(send_byte), window);
   // Conecta la aplicación a la señal `destroy`, que finaliza el hilo escucha
   g_signal_connect(window, "destroy", G_CALLBACK(deactivate), NULL);
 
-  /*
-   * En realidad no estoy seguro de lo que pasa en Windows al crear un nuevo g_thread. En POSIX pues tenemos
-   * Posix Thread (pthreads) y soporte completo para los hilos de C11. Voy a suponer que GTK sabe lo mejor para Windows.
-   */
-  g_thread_new(NULL, blocking_listener, NULL);
+  // Muestrea los contadores del puerto para la gráfica
+  rate_sampler = g_timeout_add(APP_RATE_SAMPLE_MS, sample_rates, NULL);
+  // Las vistas reciben lo que publica el hilo lector; si se atrasan, se saltan lo más viejo
+  gui_subscription = serial_stream_subscribe_func(stream,
+                                                  APP_STREAM_GUI_CHUNKS,
+                                                  SERIAL_OVERFLOW_DROP_OLDEST,
+                                                  on_gui_chunk,
+                                                  NULL);
 
   // Muestra la ventana ya diseñada
   gtk_widget_show_all(window);
 }
 
+// Archivos en la línea de comandos: cada uno se abre como captura, sin pedir el puerto (modo sin conexión)
+static void open_files(GApplication *app, GFile **files, gint n_files, const gchar *hint, gpointer user_data) {
+  for (gint i = 0; i < n_files; i++) {
+    gchar *path = g_file_get_path(files[i]);
+    if (path!=NULL) {
+      open_capture_window(GTK_APPLICATION(app), path, NULL);
+      g_free(path);
+    }
+  }
+}
+
 //===--------------------------------------------------------------------------------------------------------------===//
 //                                                        Main
 //===--------------------------------------------------------------------------------------------------------------===//
 int main(int argc, char **argv) {
   // Reservar recursos
+  stream = serial_stream_new();
 
   // Crea una nueva aplicación de GTK
   GtkApplication *app;
   // Esta variable almacena el estado de retorno de la aplicación
   int status;
   // Devuelve una nueva instancia de la App de GTK
-  app = gtk_application_new(APP_ID, G_APPLICATION_FLAGS_NONE);
+  app = gtk_application_new(APP_ID, G_APPLICATION_HANDLES_OPEN);
   // Conecta la aplicación a la señal `activate`, con el callback a la función `activate`, sin datos para pasar
   g_signal_connect(app, "activate", G_CALLBACK(activate), NULL);
+  // `Serial captura.abscap` abre solamente el visor
+  g_signal_connect(app, "open", G_CALLBACK(open_files), NULL);
+  g_application_add_main_option_entries(G_APPLICATION(app), app_options);
 
   // Lanza la aplicación `app` de GTK, con los argumentos argc, argv y bloquea hasta que la aplicación termina
   status = g_application_run(G_APPLICATION(app), argc, argv);
   // Libera la instancia de la `app` (liberando memoria)
   g_object_unref(app);
+  serial_stream_free(stream);
 
   // Retorna
   return status;
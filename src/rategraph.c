@@ -0,0 +1,230 @@
+//===-- src/rategraph.c - Gráfica de transferencia --------------------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Cada nivel de resolución es un buffer circular de RATE_BUCKETS cubetas. El nivel 0 guarda las muestras tal cual;
+/// cuando se completan RATE_LEVEL_RATIO[n] cubetas de un nivel, su agregado (mínimo, máximo y promedio) entra como
+/// una sola cubeta al nivel siguiente. Al dibujar se elige el nivel más fino cuya cantidad de cubetas visibles no
+/// supera el ancho del widget.
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#include "rategraph.h"
+#include "config.h"
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Estructuras de datos
+//===--------------------------------------------------------------------------------------------------------------===//
+#define RATE_LEVELS                     4
+#define RATE_BUCKETS                    1024
+#define RATE_GRAPH_DATA                 "rate-graph-data"
+
+// Cubetas del nivel anterior que forman una cubeta de cada nivel: 0.1 s, 1 s, 10 s y 1 min (17 horas de historial)
+static const guint RATE_LEVEL_RATIO[RATE_LEVELS] = {1, 10, 10, 6};
+
+// Ventanas de tiempo que se pueden ver, en segundos
+static const guint RATE_WINDOWS[] = {10, 60, 600, 3600, 6*3600, 17*3600};
+
+struct RateBucket {
+  gfloat min;
+  gfloat max;
+  gfloat mean;
+};
+
+struct RateSeries {
+  struct RateBucket buckets[RATE_BUCKETS];
+  // Agregado de la cubeta que todavía no se completa
+  struct RateBucket partial;
+};
+
+struct RateLevel {
+  // Duración de una cubeta, en muestras base
+  guint samples;
+  // Siguiente posición a escribir y cubetas válidas
+  guint head;
+  guint length;
+  // Cubetas del nivel anterior que ya están en `partial`
+  guint partial_count;
+  struct RateSeries rx;
+  struct RateSeries tx;
+};
+
+struct RateGraph {
+  struct RateLevel levels[RATE_LEVELS];
+  guint window;
+  gdouble last_rx;
+  gdouble last_tx;
+};
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                   Funciones extra
+//===--------------------------------------------------------------------------------------------------------------===//
+static void merge_bucket(struct RateBucket *into, const struct RateBucket *from, guint count) {
+  if (count==0) {
+    *into = *from;
+    return;
+  }
+  into->min = MIN(into->min, from->min);
+  into->max = MAX(into->max, from->max);
+  into->mean = (into->mean*count + from->mean)/(count + 1);
+}
+
+// Agrega una cubeta al nivel `n` y, si con ella se completa una cubeta del nivel siguiente, la propaga
+static void push_level(struct RateGraph *graph, guint n, const struct RateBucket *rx, const struct RateBucket *tx) {
+  struct RateLevel *level = &graph->levels[n];
+  merge_bucket(&level->rx.partial, rx, level->partial_count);
+  merge_bucket(&level->tx.partial, tx, level->partial_count);
+  if (++level->partial_count < RATE_LEVEL_RATIO[n]) {
+    return;
+  }
+  level->rx.buckets[level->head] = level->rx.partial;
+  level->tx.buckets[level->head] = level->tx.partial;
+  level->head = (level->head + 1)%RATE_BUCKETS;
+  level->length = MIN(level->length + 1, RATE_BUCKETS);
+  level->partial_count = 0;
+  if (n + 1 < RATE_LEVELS) {
+    push_level(graph, n + 1, &level->rx.buckets[(level->head + RATE_BUCKETS - 1)%RATE_BUCKETS],
+               &level->tx.buckets[(level->head + RATE_BUCKETS - 1)%RATE_BUCKETS]);
+  }
+}
+
+static void format_rate(gchar *out, gsize size, gdouble rate) {
+  if (rate >= 1000000.0) {
+    g_snprintf(out, size, "%.2f MB/s", rate/1000000.0);
+  } else if (rate >= 1000.0) {
+    g_snprintf(out, size, "%.1f kB/s", rate/1000.0);
+  } else {
+    g_snprintf(out, size, "%.0f B/s", rate);
+  }
+}
+
+// Dibuja una serie: la banda min/max y la línea del promedio. Cuando hay más cubetas que pixeles, las cubetas que caen
+// en la misma columna se combinan, así que nunca se dibujan más elementos que el ancho del widget.
+static void draw_series(cairo_t *cr, const struct RateLevel *level, const struct RateSeries *series, guint count,
+                        gdouble width, gdouble height, gdouble scale, gdouble r, gdouble g, gdouble b) {
+  gdouble step = width/count;
+  guint visible = MIN(count, level->length);
+  guint first = (level->head + RATE_BUCKETS - visible)%RATE_BUCKETS;
+  gdouble x0 = width - visible*step;
+  gint column = -1;
+  struct RateBucket merged = {0};
+  guint merged_count = 0;
+  cairo_set_source_rgba(cr, r, g, b, 0.3);
+  for (guint i = 0; i <= visible; i++) {
+    gint x = i < visible ? (gint) (x0 + i*step) : G_MAXINT;
+    if (x!=column && merged_count > 0) {
+      gdouble top = height - merged.max*scale;
+      gdouble bottom = height - merged.min*scale;
+      cairo_rectangle(cr, column, top, MAX(step, 1.0), MAX(bottom - top, 1.0));
+      merged_count = 0;
+    }
+    if (i < visible) {
+      merge_bucket(&merged, &series->buckets[(first + i)%RATE_BUCKETS], merged_count++);
+      column = x;
+    }
+  }
+  cairo_fill(cr);
+  cairo_set_source_rgb(cr, r, g, b);
+  cairo_set_line_width(cr, 1.0);
+  column = -1;
+  for (guint i = 0; i < visible; i++) {
+    gint x = (gint) (x0 + i*step);
+    if (x!=column) {
+      cairo_line_to(cr, x + step/2, height - series->buckets[(first + i)%RATE_BUCKETS].mean*scale);
+      column = x;
+    }
+  }
+  cairo_stroke(cr);
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                        Callbacks para los eventos de la GUI
+//===--------------------------------------------------------------------------------------------------------------===//
+static gboolean on_rate_graph_draw(GtkWidget *widget, cairo_t *cr, gpointer user_data) {
+  struct RateGraph *graph = user_data;
+  gdouble width = gtk_widget_get_allocated_width(widget);
+  gdouble height = gtk_widget_get_allocated_height(widget);
+  cairo_set_source_rgb(cr, 0.1, 0.1, 0.1);
+  cairo_paint(cr);
+
+  // El nivel más fino que cabe en el ancho del widget
+  guint window_samples = RATE_WINDOWS[graph->window]*(1000/APP_RATE_SAMPLE_MS);
+  guint n = 0;
+  while (n + 1 < RATE_LEVELS && (window_samples/graph->levels[n].samples > MIN((guint) width, RATE_BUCKETS))) {
+    n++;
+  }
+  const struct RateLevel *level = &graph->levels[n];
+  guint count = MAX(1, MIN(window_samples/level->samples, RATE_BUCKETS));
+
+  // Escala automática a partir del máximo visible
+  gfloat peak = 1.0f;
+  guint visible = MIN(count, level->length);
+  for (guint i = 0; i < visible; i++) {
+    guint idx = (level->head + RATE_BUCKETS - 1 - i)%RATE_BUCKETS;
+    peak = MAX(peak, MAX(level->rx.buckets[idx].max, level->tx.buckets[idx].max));
+  }
+  gdouble scale = (height - APP_RATE_GRAPH_MARGIN)/peak;
+  draw_series(cr, level, &level->tx, count, width, height, scale, 0.9, 0.6, 0.1);
+  draw_series(cr, level, &level->rx, count, width, height, scale, 0.2, 0.7, 1.0);
+
+  gchar rx[32], tx[32], top[32], label[128];
+  format_rate(rx, sizeof(rx), graph->last_rx);
+  format_rate(tx, sizeof(tx), graph->last_tx);
+  format_rate(top, sizeof(top), peak);
+  g_snprintf(label, sizeof(label), APP_RATE_GRAPH_LABEL, rx, tx, top, RATE_WINDOWS[graph->window]);
+  cairo_set_source_rgb(cr, 0.9, 0.9, 0.9);
+  cairo_move_to(cr, 4, 12);
+  cairo_show_text(cr, label);
+  return FALSE;
+}
+
+static gboolean on_rate_graph_scroll(GtkWidget *widget, GdkEventScroll *event, gpointer user_data) {
+  struct RateGraph *graph = user_data;
+  if (event->direction==GDK_SCROLL_UP && graph->window > 0) {
+    graph->window--;
+  } else if (event->direction==GDK_SCROLL_DOWN && graph->window + 1 < G_N_ELEMENTS(RATE_WINDOWS)) {
+    graph->window++;
+  }
+  gtk_widget_queue_draw(widget);
+  return TRUE;
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                           Implementación de la interfaz
+//===--------------------------------------------------------------------------------------------------------------===//
+GtkWidget *rate_graph_new(void) {
+  struct RateGraph *graph = g_new0(struct RateGraph, 1);
+  guint samples = 1;
+  for (int n = 0; n < RATE_LEVELS; n++) {
+    samples *= RATE_LEVEL_RATIO[n];
+    graph->levels[n].samples = samples;
+  }
+  GtkWidget *area = gtk_drawing_area_new();
+  gtk_widget_set_size_request(area, APP_RATE_GRAPH_WIDTH, APP_RATE_GRAPH_HEIGHT);
+  gtk_widget_add_events(area, GDK_SCROLL_MASK);
+  g_object_set_data_full(G_OBJECT(area), RATE_GRAPH_DATA, graph, g_free);
+  g_signal_connect(area, "draw", G_CALLBACK(on_rate_graph_draw), graph);
+  g_signal_connect(area, "scroll-event", G_CALLBACK(on_rate_graph_scroll), graph);
+  return area;
+}
+
+void rate_graph_push(GtkWidget *widget, gdouble rx_rate, gdouble tx_rate) {
+  struct RateGraph *graph = g_object_get_data(G_OBJECT(widget), RATE_GRAPH_DATA);
+  struct RateBucket rx = {(gfloat) rx_rate, (gfloat) rx_rate, (gfloat) rx_rate};
+  struct RateBucket tx = {(gfloat) tx_rate, (gfloat) tx_rate, (gfloat) tx_rate};
+  graph->last_rx = rx_rate;
+  graph->last_tx = tx_rate;
+  push_level(graph, 0, &rx, &tx);
+  gtk_widget_queue_draw(widget);
+}
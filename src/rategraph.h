@@ -0,0 +1,30 @@
+//===-- src/rategraph.h - Gráfica de transferencia --------------------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===---------------------------------------------------------------------------------------------------------------===//
+///
+/// Gráfica de bytes por segundo (RX/TX) dibujada con Cairo. El historial se guarda en cubetas min/max a varias
+/// resoluciones, así que la memoria es fija y el costo de dibujar depende del ancho en pixeles, no del historial.
+///
+//===---------------------------------------------------------------------------------------------------------------===//
+
+#ifndef RATEGRAPH_H
+#define RATEGRAPH_H
+#include <gtk/gtk.h>
+
+// Crea la gráfica (un GtkDrawingArea). La rueda del mouse cambia la ventana de tiempo visible.
+GtkWidget *rate_graph_new(void);
+
+// Agrega una muestra de APP_RATE_SAMPLE_MS milisegundos, en bytes por segundo, y redibuja la gráfica
+void rate_graph_push(GtkWidget *, gdouble, gdouble);
+#endif // RATEGRAPH_H
@@ -0,0 +1,505 @@
+//===-- tools/analyze.c - Estadísticas de un volcado de bytes ---------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Estadísticas de un volcado crudo (p.e. varios GB recibidos en campo), sin cargarlo a memoria:
+///  -> Histograma de los valores de los bytes
+///  -> Mensajes separados por un delimitador: cuántos hay y sus longitudes (mínima, media, máxima y por potencias de
+///     dos). Los bytes después del último delimitador son un mensaje sin terminar y se reportan aparte
+///  -> Cuántas veces aparece cada patrón
+///  -> Posiciones de cada marcador de error
+///
+/// El archivo se mapea a memoria y se parte en bloques que reparte un grupo de hilos con robo de trabajo: cada hilo
+/// empieza con un rango contiguo de bloques y, cuando termina el suyo, le quita la mitad de lo que le queda a otro.
+/// Un patrón o un delimitador que cruza el final de un bloque le pertenece al bloque donde empieza, así que cada
+/// bloque lee hasta `longitud - 1` bytes del siguiente. Los delimitadores no se traslapan entre sí (se buscan como lo
+/// haría una sola pasada); si el último delimitador de un bloque se mete en el siguiente, la mezcla vuelve a buscar
+/// en ese bloque desde donde termina. Los patrones y los marcadores sí cuentan en cada posición donde empiezan.
+///
+/// Los patrones, los marcadores y el delimitador se escriben como en la entrada de la aplicación (con el formato
+/// de `--format`, o base64 con el prefijo `b64:`) y los bytes se muestran con el mismo formato que la aplicación.
+///
+/// Uso: abserio-analyze [opciones] <archivo>    (ver `--help`)
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#include <abserio/histogram.h>
+#include <abserio/payload.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Estructuras de datos
+//===--------------------------------------------------------------------------------------------------------------===//
+#define ANALYZE_BASE64_PREFIX           "b64:"
+#define ANALYZE_CHUNK_KIB               4096
+#define ANALYZE_POSITIONS               10
+// Cubetas de longitudes: 0, 1, 2-3, 4-7, ...
+#define ANALYZE_LENGTH_BUCKETS          65
+// Sin delimitador en el bloque
+#define ANALYZE_NONE                    G_MAXSIZE
+
+// Lo que se busca, ya decodificado
+struct Needle {
+  const gchar *text;
+  const guint8 *data;
+  gsize length;
+  GBytes *bytes;
+};
+
+// Mensajes completos dentro de un bloque (entre dos delimitadores que empiezan en el bloque)
+struct Frames {
+  // Inicio del primer delimitador y fin del último, o ANALYZE_NONE
+  gsize first_start;
+  gsize last_end;
+  guint64 count;
+  guint64 total;
+  gsize min;
+  gsize max;
+  guint64 lengths[ANALYZE_LENGTH_BUCKETS];
+};
+
+// Lo que depende del orden: se guarda por bloque y se mezcla en orden al final
+struct ChunkResult {
+  struct Frames frames;
+  // Un GArray de gsize por marcador
+  GArray **markers;
+};
+
+// Lo que se suma sin importar el orden: se guarda por hilo
+struct Partial {
+  guint64 histogram[256];
+  guint64 *patterns;
+};
+
+struct Analysis;
+
+struct Worker {
+  struct Analysis *analysis;
+  // Bloques pendientes de este hilo [next, end). El dueño toma del inicio y los demás roban del final
+  GMutex lock;
+  gsize next;
+  gsize end;
+  guint index;
+  struct Partial partial;
+  GThread *thread;
+};
+
+struct Analysis {
+  const guint8 *data;
+  gsize size;
+  gsize chunk_size;
+  gsize chunks;
+  struct Needle delimiter;
+  struct Needle *patterns;
+  guint pattern_count;
+  struct Needle *markers;
+  guint marker_count;
+  struct ChunkResult *results;
+  struct Worker *workers;
+  guint worker_count;
+};
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                      Globales
+//===--------------------------------------------------------------------------------------------------------------===//
+gint thread_count = 0;
+gint chunk_kib = ANALYZE_CHUNK_KIB;
+gint max_positions = ANALYZE_POSITIONS;
+gchar *format_name = NULL;
+gchar *delimiter_text = NULL;
+gchar **pattern_texts = NULL;
+gchar **marker_texts = NULL;
+GOptionEntry options[] = {
+  {"threads", 't', G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, &thread_count, "Hilos (por defecto, uno por CPU)", "N"},
+  {"chunk", 'c', G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, &chunk_kib, "Tamaño de los bloques en KiB (4096)", "KIB"},
+  {"format", 'f', G_OPTION_FLAG_NONE, G_OPTION_ARG_STRING, &format_name,
+   "Formato de los bytes: hex (por defecto), dec, oct, bin o ascii", "FORMATO"},
+  {"delimiter", 'd', G_OPTION_FLAG_NONE, G_OPTION_ARG_STRING, &delimiter_text, "Separador de mensajes", "BYTES"},
+  {"pattern", 'p', G_OPTION_FLAG_NONE, G_OPTION_ARG_STRING_ARRAY, &pattern_texts, "Patrón a contar", "BYTES"},
+  {"error", 'e', G_OPTION_FLAG_NONE, G_OPTION_ARG_STRING_ARRAY, &marker_texts, "Marcador de error a ubicar", "BYTES"},
+  {"positions", 'n', G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, &max_positions,
+   "Posiciones que se muestran por marcador (10)", "N"},
+  {NULL}
+};
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                   Funciones extra
+//===--------------------------------------------------------------------------------------------------------------===//
+static gboolean parse_format(const gchar *name, enum SerialPayloadFormat *format) {
+  static const struct {
+    const gchar *name;
+    enum SerialPayloadFormat format;
+  } formats[] = {
+    {"hex", SERIAL_PAYLOAD_HEX},
+    {"dec", SERIAL_PAYLOAD_DECIMAL},
+    {"oct", SERIAL_PAYLOAD_OCTAL},
+    {"bin", SERIAL_PAYLOAD_BINARY},
+    {"ascii", SERIAL_PAYLOAD_ESCAPED},
+  };
+  for (gsize i = 0; i < G_N_ELEMENTS(formats); i++) {
+    if (name==NULL || g_ascii_strcasecmp(name, formats[i].name)==0) {
+      *format = name==NULL ? SERIAL_PAYLOAD_HEX : formats[i].format;
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+// Decodifica como la entrada de la aplicación: con el formato elegido o base64 con el prefijo
+static gboolean decode_needle(const gchar *text, enum SerialPayloadFormat format, struct Needle *needle) {
+  needle->text = text;
+  if (g_str_has_prefix(text, ANALYZE_BASE64_PREFIX)) {
+    text += strlen(ANALYZE_BASE64_PREFIX);
+    format = SERIAL_PAYLOAD_BASE64;
+  }
+  gsize error_offset = 0;
+  needle->bytes = serial_payload_decode(text, format, &error_offset);
+  if (needle->bytes==NULL) {
+    fprintf(stderr, "Invalid bytes '%s' at character %" G_GSIZE_FORMAT "\n", needle->text, error_offset + 1);
+    return FALSE;
+  }
+  needle->data = g_bytes_get_data(needle->bytes, &needle->length);
+  if (needle->length==0) {
+    fprintf(stderr, "Empty bytes '%s'\n", needle->text);
+    g_bytes_unref(needle->bytes);
+    needle->bytes = NULL;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static gboolean decode_needles(gchar **texts, enum SerialPayloadFormat format, struct Needle **needles, guint *count) {
+  *count = texts!=NULL ? g_strv_length(texts) : 0;
+  *needles = g_new0(struct Needle, *count);
+  for (guint i = 0; i < *count; i++) {
+    if (!decode_needle(texts[i], format, &(*needles)[i])) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+static void print_bytes(const struct Needle *needle, enum SerialPayloadFormat format) {
+  gchar text[SERIAL_PAYLOAD_BYTE_MAX];
+  for (gsize i = 0; i < needle->length; i++) {
+    serial_payload_format_byte(needle->data[i], format, text);
+    printf("%s%s", i > 0 ? " " : "", text);
+  }
+}
+
+// Siguiente aparición que empieza en [from, end). Puede leer hasta `needle->length - 1` bytes después de `end`
+static gsize find(const guint8 *data, gsize size, gsize from, gsize end, const struct Needle *needle) {
+  if (needle->length > size) {
+    return ANALYZE_NONE;
+  }
+  end = MIN(end, size - needle->length + 1);
+  while (from < end) {
+    const guint8 *hit = memchr(data + from, needle->data[0], end - from);
+    if (hit==NULL) {
+      return ANALYZE_NONE;
+    }
+    gsize at = (gsize) (hit - data);
+    if (memcmp(hit + 1, needle->data + 1, needle->length - 1)==0) {
+      return at;
+    }
+    from = at + 1;
+  }
+  return ANALYZE_NONE;
+}
+
+static guint length_bucket(gsize length) {
+  return length==0 ? 0 : (guint) g_bit_storage(length);
+}
+
+static void add_frame(struct Frames *frames, gsize length) {
+  frames->count++;
+  frames->total += length;
+  frames->min = MIN(frames->min, length);
+  frames->max = MAX(frames->max, length);
+  frames->lengths[length_bucket(length)]++;
+}
+
+// Delimitadores que empiezan en [from, end), sin traslaparse, como en una sola pasada que empieza en `from`
+static void scan_frames(const struct Analysis *analysis, gsize from, gsize end, struct Frames *frames) {
+  memset(frames, 0, sizeof(*frames));
+  frames->first_start = ANALYZE_NONE;
+  frames->last_end = ANALYZE_NONE;
+  frames->min = G_MAXSIZE;
+  gsize at = find(analysis->data, analysis->size, from, end, &analysis->delimiter);
+  while (at!=ANALYZE_NONE) {
+    if (frames->first_start==ANALYZE_NONE) {
+      frames->first_start = at;
+    } else {
+      add_frame(frames, at - frames->last_end);
+    }
+    frames->last_end = at + analysis->delimiter.length;
+    at = find(analysis->data, analysis->size, frames->last_end, end, &analysis->delimiter);
+  }
+}
+
+static void analyze_chunk(struct Worker *worker, gsize chunk) {
+  struct Analysis *analysis = worker->analysis;
+  struct ChunkResult *result = &analysis->results[chunk];
+  gsize begin = chunk*analysis->chunk_size;
+  gsize end = MIN(begin + analysis->chunk_size, analysis->size);
+  serial_histogram_add(analysis->data + begin, end - begin, worker->partial.histogram);
+  if (analysis->delimiter.bytes!=NULL) {
+    scan_frames(analysis, begin, end, &result->frames);
+  }
+  for (guint i = 0; i < analysis->pattern_count; i++) {
+    gsize at = find(analysis->data, analysis->size, begin, end, &analysis->patterns[i]);
+    while (at!=ANALYZE_NONE) {
+      worker->partial.patterns[i]++;
+      at = find(analysis->data, analysis->size, at + 1, end, &analysis->patterns[i]);
+    }
+  }
+  for (guint i = 0; i < analysis->marker_count; i++) {
+    result->markers[i] = g_array_new(FALSE, FALSE, sizeof(gsize));
+    gsize at = find(analysis->data, analysis->size, begin, end, &analysis->markers[i]);
+    while (at!=ANALYZE_NONE) {
+      g_array_append_val(result->markers[i], at);
+      at = find(analysis->data, analysis->size, at + 1, end, &analysis->markers[i]);
+    }
+  }
+}
+
+// Toma el siguiente bloque propio o, si no quedan, la mitad de los pendientes de otro hilo
+static gboolean next_chunk(struct Worker *worker, gsize *chunk) {
+  g_mutex_lock(&worker->lock);
+  gboolean found = worker->next < worker->end;
+  if (found) {
+    *chunk = worker->next++;
+  }
+  g_mutex_unlock(&worker->lock);
+  if (found) {
+    return TRUE;
+  }
+  struct Analysis *analysis = worker->analysis;
+  for (guint i = 1; i < analysis->worker_count; i++) {
+    struct Worker *victim = &analysis->workers[(worker->index + i)%analysis->worker_count];
+    g_mutex_lock(&victim->lock);
+    gsize left = victim->end - victim->next;
+    gsize stolen_end = victim->end;
+    victim->end -= (left + 1)/2;
+    gsize stolen_next = victim->end;
+    g_mutex_unlock(&victim->lock);
+    if (stolen_next < stolen_end) {
+      *chunk = stolen_next;
+      g_mutex_lock(&worker->lock);
+      worker->next = stolen_next + 1;
+      worker->end = stolen_end;
+      g_mutex_unlock(&worker->lock);
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+static void print_histogram(const guint64 *histogram, gsize size, enum SerialPayloadFormat format) {
+  printf("Histograma de bytes:\n");
+  gchar text[SERIAL_PAYLOAD_BYTE_MAX];
+  for (guint value = 0; value < 256; value++) {
+    if (histogram[value] > 0) {
+      serial_payload_format_byte((guint8) value, format, text);
+      printf("  %-10s %14" G_GUINT64_FORMAT "  %7.3f %%\n", text, histogram[value], 100.0*histogram[value]/size);
+    }
+  }
+}
+
+static void print_frames(const struct Analysis *analysis, const struct Frames *frames, gsize tail,
+                         enum SerialPayloadFormat format) {
+  printf("Mensajes (delimitador ");
+  print_bytes(&analysis->delimiter, format);
+  printf("): %" G_GUINT64_FORMAT, frames->count);
+  if (frames->count > 0) {
+    printf(", longitud mínima %" G_GSIZE_FORMAT ", media %.1f, máxima %" G_GSIZE_FORMAT,
+           frames->min,
+           (gdouble) frames->total/frames->count,
+           frames->max);
+  }
+  printf("; %" G_GSIZE_FORMAT " bytes sin terminar al final\n", tail);
+  for (guint i = 0; i < ANALYZE_LENGTH_BUCKETS; i++) {
+    if (frames->lengths[i] > 0) {
+      guint64 low = i==0 ? 0 : G_GUINT64_CONSTANT(1) << (i - 1);
+      guint64 high = i==0 ? 0 : (G_GUINT64_CONSTANT(1) << (i - 1))*2 - 1;
+      printf("  %10" G_GUINT64_FORMAT " - %-10" G_GUINT64_FORMAT " %14" G_GUINT64_FORMAT "\n",
+             low,
+             high,
+             frames->lengths[i]);
+    }
+  }
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Hilos de ejecución
+//===--------------------------------------------------------------------------------------------------------------===//
+static gpointer worker_thread(gpointer data) {
+  struct Worker *worker = data;
+  gsize chunk;
+  while (next_chunk(worker, &chunk)) {
+    analyze_chunk(worker, chunk);
+  }
+  return NULL;
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                        Main
+//===--------------------------------------------------------------------------------------------------------------===//
+int main(int argc, char **argv) {
+  GError *error = NULL;
+  GOptionContext *context = g_option_context_new("<archivo>");
+  g_option_context_add_main_entries(context, options, NULL);
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    fprintf(stderr, "%s\n", error->message);
+    return 2;
+  }
+  g_option_context_free(context);
+  enum SerialPayloadFormat format;
+  if (argc!=2 || thread_count < 0 || chunk_kib <= 0 || max_positions < 0 || !parse_format(format_name, &format)) {
+    fprintf(stderr, "Usage: %s [options] <file>    (see --help)\n", argv[0]);
+    return 2;
+  }
+
+  struct Analysis analysis = {0};
+  if ((delimiter_text!=NULL && !decode_needle(delimiter_text, format, &analysis.delimiter))
+      || !decode_needles(pattern_texts, format, &analysis.patterns, &analysis.pattern_count)
+      || !decode_needles(marker_texts, format, &analysis.markers, &analysis.marker_count)) {
+    return 2;
+  }
+  GMappedFile *file = g_mapped_file_new(argv[1], FALSE, &error);
+  if (file==NULL) {
+    fprintf(stderr, "Cannot open '%s': %s\n", argv[1], error->message);
+    g_error_free(error);
+    return 1;
+  }
+  analysis.data = (const guint8 *) g_mapped_file_get_contents(file);
+  analysis.size = g_mapped_file_get_length(file);
+  analysis.chunk_size = (gsize) chunk_kib*1024;
+  analysis.chunks = (analysis.size + analysis.chunk_size - 1)/analysis.chunk_size;
+  analysis.results = g_new0(struct ChunkResult, analysis.chunks);
+  for (gsize i = 0; i < analysis.chunks; i++) {
+    analysis.results[i].markers = g_new0(GArray *, analysis.marker_count);
+  }
+  analysis.worker_count = thread_count > 0 ? (guint) thread_count : g_get_num_processors();
+  analysis.worker_count = (guint) MAX(1, MIN(analysis.worker_count, analysis.chunks));
+  analysis.workers = g_new0(struct Worker, analysis.worker_count);
+
+  // Cada hilo empieza con un rango contiguo de bloques
+  gint64 start = g_get_monotonic_time();
+  for (guint i = 0; i < analysis.worker_count; i++) {
+    struct Worker *worker = &analysis.workers[i];
+    worker->analysis = &analysis;
+    worker->index = i;
+    worker->next = analysis.chunks*i/analysis.worker_count;
+    worker->end = analysis.chunks*(i + 1)/analysis.worker_count;
+    worker->partial.patterns = g_new0(guint64, analysis.pattern_count);
+    g_mutex_init(&worker->lock);
+  }
+  for (guint i = 0; i < analysis.worker_count; i++) {
+    analysis.workers[i].thread = g_thread_new("analyze", worker_thread, &analysis.workers[i]);
+  }
+
+  // Lo que no depende del orden se suma por hilo
+  guint64 histogram[256] = {0};
+  guint64 *pattern_totals = g_new0(guint64, analysis.pattern_count);
+  for (guint i = 0; i < analysis.worker_count; i++) {
+    struct Worker *worker = &analysis.workers[i];
+    g_thread_join(worker->thread);
+    for (guint value = 0; value < 256; value++) {
+      histogram[value] += worker->partial.histogram[value];
+    }
+    for (guint j = 0; j < analysis.pattern_count; j++) {
+      pattern_totals[j] += worker->partial.patterns[j];
+    }
+    g_free(worker->partial.patterns);
+    g_mutex_clear(&worker->lock);
+  }
+
+  // Los mensajes se unen en orden: el primero de cada bloque empieza donde terminó el último delimitador anterior
+  struct Frames frames = {0};
+  frames.min = G_MAXSIZE;
+  gsize carry = 0;
+  for (gsize i = 0; i < analysis.chunks && analysis.delimiter.bytes!=NULL; i++) {
+    struct Frames *chunk = &analysis.results[i].frames;
+    gsize chunk_end = MIN((i + 1)*analysis.chunk_size, analysis.size);
+    if (chunk->first_start!=ANALYZE_NONE && chunk->first_start < carry) {
+      // El último delimitador del bloque anterior se traslapa con el primero de este
+      scan_frames(&analysis, carry, chunk_end, chunk);
+    }
+    if (chunk->first_start==ANALYZE_NONE) {
+      continue;
+    }
+    add_frame(&frames, chunk->first_start - carry);
+    frames.count += chunk->count;
+    frames.total += chunk->total;
+    frames.min = MIN(frames.min, chunk->min);
+    frames.max = MAX(frames.max, chunk->max);
+    for (guint j = 0; j < ANALYZE_LENGTH_BUCKETS; j++) {
+      frames.lengths[j] += chunk->lengths[j];
+    }
+    carry = chunk->last_end;
+  }
+  gdouble elapsed = (g_get_monotonic_time() - start)/1e6;
+
+  printf("%s: %" G_GSIZE_FORMAT " bytes, %" G_GSIZE_FORMAT " bloques de %d KiB, %u hilos, %.3f s (%.1f MB/s)\n",
+         argv[1],
+         analysis.size,
+         analysis.chunks,
+         chunk_kib,
+         analysis.worker_count,
+         elapsed,
+         elapsed > 0 ? analysis.size/elapsed/1e6 : 0.0);
+  if (analysis.size > 0) {
+    print_histogram(histogram, analysis.size, format);
+  }
+  if (analysis.delimiter.bytes!=NULL) {
+    print_frames(&analysis, &frames, analysis.size - carry, format);
+  }
+  for (guint i = 0; i < analysis.pattern_count; i++) {
+    printf("Patrón ");
+    print_bytes(&analysis.patterns[i], format);
+    printf(": %" G_GUINT64_FORMAT " apariciones\n", pattern_totals[i]);
+  }
+  for (guint i = 0; i < analysis.marker_count; i++) {
+    guint64 count = 0;
+    for (gsize j = 0; j < analysis.chunks; j++) {
+      count += analysis.results[j].markers[i]->len;
+    }
+    printf("Marcador ");
+    print_bytes(&analysis.markers[i], format);
+    printf(": %" G_GUINT64_FORMAT " apariciones", count);
+    gint shown = 0;
+    for (gsize j = 0; j < analysis.chunks && shown < max_positions; j++) {
+      GArray *positions = analysis.results[j].markers[i];
+      for (guint k = 0; k < positions->len && shown < max_positions; k++, shown++) {
+        printf("%s0x%08" G_GSIZE_MODIFIER "X", shown==0 ? "; en " : ", ", g_array_index(positions, gsize, k));
+      }
+    }
+    printf("%s\n", (guint64) shown < count ? ", ..." : "");
+  }
+
+  for (gsize i = 0; i < analysis.chunks; i++) {
+    for (guint j = 0; j < analysis.marker_count; j++) {
+      g_array_unref(analysis.results[i].markers[j]);
+    }
+    g_free(analysis.results[i].markers);
+  }
+  g_free(analysis.results);
+  g_free(analysis.workers);
+  g_free(pattern_totals);
+  g_mapped_file_unref(file);
+  return 0;
+}
@@ -0,0 +1,222 @@
+//===-- tools/script.c - Pruebas automáticas con scripts de envío y espera --------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Ejecuta un script de envío y espera (ver `abserio/script.h`) en uno o varios puertos a la vez, p.e. para probar
+/// un lote de dispositivos en una estación de pruebas. El script se compila una vez; cada puerto tiene su hilo lector,
+/// que publica lo recibido en un flujo propio, y un hilo que ejecuta el script leyendo de una suscripción a ese flujo.
+///
+/// Al terminar muestra, por puerto, el resultado y el tiempo de cada instrucción. Termina con 0 si el script pasó en
+/// todos los puertos, 1 si falló en alguno y 2 si el script o los argumentos no son válidos.
+///
+/// Uso: abserio-script [opciones] <script> <puerto>...    (ver `--help`)
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#include <abserio/script.h>
+#include <errno.h>
+#include <stdio.h>
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Estructuras de datos
+//===--------------------------------------------------------------------------------------------------------------===//
+// Bloques en la cola de cada puerto; lo que se desborde es lo más viejo, como en el buffer del script
+#define SCRIPT_QUEUE_CHUNKS             4096
+
+struct Port {
+  const gchar *name;
+  const struct AbstractSerialDevice *dev;
+  struct SerialStream *stream;
+  struct SerialSubscription *subscription;
+  struct SerialScriptResult *result;
+  GThread *thread;
+};
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                      Globales
+//===--------------------------------------------------------------------------------------------------------------===//
+gint baud_rate = 0;
+struct SerialScript *script = NULL;
+GOptionEntry options[] = {
+  {"baud", 'b', G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, &baud_rate,
+   "Baud rate de todos los puertos (por defecto, el que tengan)", "BPS"},
+  {NULL}
+};
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                   Funciones extra
+//===--------------------------------------------------------------------------------------------------------------===//
+// Renglón y columna (desde 1) de una posición en bytes
+static void text_position(const gchar *text, gsize at, guint *line, guint *column) {
+  *line = 1;
+  *column = 1;
+  for (gsize i = 0; i < at && text[i]!='\0'; i++) {
+    if (text[i]=='\n') {
+      (*line)++;
+      *column = 1;
+    } else {
+      (*column)++;
+    }
+  }
+}
+
+static void on_port_data(const guchar *data, gsize length, const struct SerialTimestamp *stamp, gpointer user_data) {
+  struct Port *port = user_data;
+  serial_stream_publish(port->stream, data, length, stamp);
+}
+
+static gboolean open_port(struct Port *port) {
+  GString *name = g_string_new(port->name);
+  gboolean opened = open_serial_port(&port->dev, name);
+  g_string_free(name, TRUE);
+  if (!opened) {
+    fprintf(stderr, "Cannot open '%s': %s\n", port->name, g_strerror(errno));
+    return FALSE;
+  }
+  if (baud_rate > 0 && !port->dev->set_baud_rate((glong) baud_rate, &port->dev)) {
+    fprintf(stderr, "Cannot set %d bps on '%s': %s\n", baud_rate, port->name, g_strerror(errno));
+    close_serial_port(&port->dev);
+    return FALSE;
+  }
+  // La suscripción va antes que el hilo lector para no perder nada de lo que llegue
+  port->stream = serial_stream_new();
+  port->subscription = serial_stream_subscribe(port->stream, SCRIPT_QUEUE_CHUNKS, SERIAL_OVERFLOW_DROP_OLDEST);
+  if (!start_serial_listener(&port->dev, on_port_data, port)) {
+    fprintf(stderr, "Cannot read from '%s': %s\n", port->name, g_strerror(errno));
+    serial_subscription_free(port->subscription);
+    serial_stream_free(port->stream);
+    close_serial_port(&port->dev);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static void close_port(struct Port *port) {
+  // Primero el hilo lector: después de esto ya nadie publica en el flujo
+  close_serial_port(&port->dev);
+  serial_subscription_free(port->subscription);
+  serial_stream_free(port->stream);
+}
+
+static void print_result(const struct Port *port) {
+  const struct SerialScriptResult *result = port->result;
+  gdouble duration_ms = result->duration_us/1000.0;
+  if (result->outcome==SERIAL_SCRIPT_PASSED) {
+    printf("%s: pasó en %.3f ms\n", port->name, duration_ms);
+  } else {
+    static const gchar *reasons[] = {
+      [SERIAL_SCRIPT_TIMEOUT] = "se venció el tiempo",
+      [SERIAL_SCRIPT_WRITE_ERROR] = "no se pudo escribir",
+      [SERIAL_SCRIPT_FAILED] = "el script llegó a un fail",
+    };
+    printf("%s: falló a los %.3f ms en el renglón %u (%s): %s\n",
+           port->name,
+           duration_ms,
+           serial_script_get_step_line(script, result->step),
+           reasons[result->outcome],
+           serial_script_get_step_text(script, result->step));
+  }
+  printf("  %7s %8s %8s %10s %10s %10s  %s\n", "renglón", "veces", "vencidos", "mín ms", "media ms", "máx ms",
+         "instrucción");
+  for (guint i = 0; i < serial_script_get_step_count(script); i++) {
+    const struct SerialScriptStepStats *stats = &result->steps[i];
+    if (stats->runs==0) {
+      continue;
+    }
+    printf("  %7u %8u %8u %10.3f %10.3f %10.3f  %s\n",
+           serial_script_get_step_line(script, i),
+           stats->runs,
+           stats->timeouts,
+           stats->min_us/1000.0,
+           stats->total_us/1000.0/stats->runs,
+           stats->max_us/1000.0,
+           serial_script_get_step_text(script, i));
+  }
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                 Hilos de ejecución
+//===--------------------------------------------------------------------------------------------------------------===//
+static gpointer port_thread(gpointer data) {
+  struct Port *port = data;
+  port->result = serial_script_run(script, &port->dev, port->subscription);
+  return NULL;
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                        Main
+//===--------------------------------------------------------------------------------------------------------------===//
+int main(int argc, char **argv) {
+  GError *error = NULL;
+  GOptionContext *context = g_option_context_new("<script> <puerto>...");
+  g_option_context_add_main_entries(context, options, NULL);
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    fprintf(stderr, "%s\n", error->message);
+    return 2;
+  }
+  g_option_context_free(context);
+  if (argc < 3 || baud_rate < 0) {
+    fprintf(stderr, "Usage: %s [options] <script> <port>...    (see --help)\n", argv[0]);
+    return 2;
+  }
+
+  gchar *source = NULL;
+  if (!g_file_get_contents(argv[1], &source, NULL, &error)) {
+    fprintf(stderr, "Cannot read '%s': %s\n", argv[1], error->message);
+    g_error_free(error);
+    return 2;
+  }
+  gsize error_at = 0;
+  script = serial_script_new(source, &error_at);
+  if (script==NULL) {
+    guint line, column;
+    text_position(source, error_at, &line, &column);
+    fprintf(stderr, "Invalid script '%s' at line %u, column %u\n", argv[1], line, column);
+    g_free(source);
+    return 2;
+  }
+  g_free(source);
+
+  guint port_count = (guint) argc - 2;
+  struct Port *ports = g_new0(struct Port, port_count);
+  guint opened = 0;
+  for (; opened < port_count; opened++) {
+    ports[opened].name = argv[opened + 2];
+    if (!open_port(&ports[opened])) {
+      break;
+    }
+  }
+  gint status = 0;
+  if (opened < port_count) {
+    status = 1;
+  } else {
+    for (guint i = 0; i < port_count; i++) {
+      ports[i].thread = g_thread_new("abserio-script", port_thread, &ports[i]);
+    }
+    for (guint i = 0; i < port_count; i++) {
+      g_thread_join(ports[i].thread);
+      print_result(&ports[i]);
+      if (ports[i].result->outcome!=SERIAL_SCRIPT_PASSED) {
+        status = 1;
+      }
+      serial_script_result_free(ports[i].result);
+    }
+  }
+  for (guint i = 0; i < opened; i++) {
+    close_port(&ports[i]);
+  }
+  g_free(ports);
+  serial_script_free(script);
+  return status;
+}
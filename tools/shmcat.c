@@ -0,0 +1,59 @@
+//===-- tools/shmcat.c - Lector del flujo compartido ------------------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Copia a la salida estándar los bytes que la aplicación recibe por el puerto, leyéndolos del flujo en memoria
+/// compartida. Cada vez que el lector se atrasa y pierde bytes, lo avisa por la salida de error.
+///
+/// Uso: abserio-shmcat <ruta>    (la ruta aparece en la ventana de la aplicación, p.e. /proc/1234/fd/17)
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#include <abserio/shmring.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                        Main
+//===--------------------------------------------------------------------------------------------------------------===//
+int main(int argc, char **argv) {
+  if (argc!=2) {
+    fprintf(stderr, "Usage: %s <path>\n", argv[0]);
+    return 2;
+  }
+  struct SerialShmReader *reader = serial_shm_reader_open(argv[1]);
+  if (reader==NULL) {
+    fprintf(stderr, "Cannot open '%s': %s\n", argv[1], strerror(errno));
+    return 1;
+  }
+  guchar buffer[65536];
+  while (TRUE) {
+    guint64 lost = 0;
+    gsize length = serial_shm_reader_read(reader, buffer, sizeof(buffer), &lost);
+    if (lost > 0) {
+      fprintf(stderr, "Reader lagged behind, %" G_GUINT64_FORMAT " bytes lost\n", lost);
+    }
+    if (length==0) {
+      serial_shm_reader_wait(reader, -1);
+      continue;
+    }
+    if (write(STDOUT_FILENO, buffer, length)!=(ssize_t) length) {
+      break;
+    }
+  }
+  serial_shm_reader_close(reader);
+  return 0;
+}
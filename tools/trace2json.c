@@ -0,0 +1,190 @@
+//===-- tools/trace2json.c - Traza binaria a línea de tiempo ----------------------------------------------*- C -*-===//
+//
+// Copyright (c) 2018 Oever González
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+//                                 the License. You may obtain a copy of the License at
+//
+//                                      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software  distributed under the License is distributed on
+//  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+//                    specific language governing permissions and limitations under the License.
+//
+//===--------------------------------------------------------------------------------------------------------------===//
+///
+/// Convierte el archivo de `serial_trace_dump` (p.e. el que deja la aplicación con `--trace`) al formato JSON de
+/// Chrome, que abren chrome://tracing y https://ui.perfetto.dev. Cada hilo es una fila; las operaciones son intervalos
+/// con la longitud, el descriptor y la espera por el mutex como argumentos. Los tiempos se cuentan desde el primer
+/// registro del archivo.
+///
+/// Si un hilo perdió registros porque su anillo se llenó, su primer intervalo puede no tener inicio; Chrome lo ignora.
+///
+/// Uso: abserio-trace2json <traza> [salida.json]    (sin salida, escribe en la salida estándar)
+///
+//===--------------------------------------------------------------------------------------------------------------===//
+
+#include <abserio/trace.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                   Funciones extra
+//===--------------------------------------------------------------------------------------------------------------===//
+// Valida el archivo completo antes de escribir nada. Devuelve el registro más viejo de todos los hilos.
+static gboolean validate(const gchar *data, gsize size, guint64 *origin) {
+  const struct SerialTraceFileHeader *header = (const struct SerialTraceFileHeader *) data;
+  if (size < sizeof(*header) || memcmp(header->magic, SERIAL_TRACE_MAGIC, sizeof(header->magic))!=0) {
+    fprintf(stderr, "Not a trace file\n");
+    return FALSE;
+  }
+  if (header->version!=SERIAL_TRACE_VERSION) {
+    fprintf(stderr, "Unsupported trace version %u\n", header->version);
+    return FALSE;
+  }
+  *origin = G_MAXUINT64;
+  gsize offset = sizeof(*header);
+  for (guint i = 0; i < header->threads; i++) {
+    if (size - offset < sizeof(struct SerialTraceFileThread)) {
+      fprintf(stderr, "Truncated trace file\n");
+      return FALSE;
+    }
+    const struct SerialTraceFileThread *thread = (const struct SerialTraceFileThread *) (data + offset);
+    offset += sizeof(*thread);
+    if (thread->count > (size - offset)/sizeof(struct SerialTraceRecord)) {
+      fprintf(stderr, "Truncated trace file\n");
+      return FALSE;
+    }
+    const struct SerialTraceRecord *records = (const struct SerialTraceRecord *) (data + offset);
+    if (thread->count > 0) {
+      *origin = MIN(*origin, records[0].timestamp_ns);
+    }
+    offset += (gsize) thread->count*sizeof(struct SerialTraceRecord);
+  }
+  if (*origin==G_MAXUINT64) {
+    *origin = 0;
+  }
+  return TRUE;
+}
+
+// Escapa el texto para una cadena de JSON (g_strescape usa escapes octales, que JSON no acepta). Los bytes de
+// control van como \u00XX; los demás bytes no ASCII se copian si el texto es UTF-8 válido y si no, también se escapan
+static gchar *json_escape(const gchar *text) {
+  gboolean utf8 = g_utf8_validate(text, -1, NULL);
+  GString *escaped = g_string_new(NULL);
+  for (const guchar *c = (const guchar *) text; *c!='\0'; c++) {
+    if (*c=='"' || *c=='\\') {
+      g_string_append_c(escaped, '\\');
+      g_string_append_c(escaped, (gchar) *c);
+    } else if (*c < 0x20 || *c==0x7F || (*c >= 0x80 && !utf8)) {
+      g_string_append_printf(escaped, "\\u%04x", *c);
+    } else {
+      g_string_append_c(escaped, (gchar) *c);
+    }
+  }
+  return g_string_free(escaped, FALSE);
+}
+
+static void write_thread_name(FILE *out, const struct SerialTraceFileThread *thread, gboolean *first) {
+  gchar name[sizeof(thread->name) + 1] = {0};
+  memcpy(name, thread->name, sizeof(thread->name));
+  gchar *escaped = json_escape(name[0]!='\0' ? name : "thread");
+  fprintf(out,
+          "%s\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%" G_GUINT64_FORMAT
+          ",\"args\":{\"name\":\"%s\"}}",
+          *first ? "" : ",",
+          thread->thread_id,
+          escaped);
+  g_free(escaped);
+  *first = FALSE;
+}
+
+static void write_record(FILE *out, guint64 tid, const struct SerialTraceRecord *record, guint64 origin) {
+  const gchar *name = serial_trace_event_name(record->event);
+  gchar phase = serial_trace_event_phase(record->event);
+  // Microsegundos con decimales: Chrome acepta fracciones y así no se pierden los nanosegundos
+  gdouble ts = (gdouble) (record->timestamp_ns - origin)/1000.0;
+  fprintf(out,
+          ",\n{\"ph\":\"%c\",\"name\":\"%s\",\"pid\":1,\"tid\":%" G_GUINT64_FORMAT ",\"ts\":%.3f%s",
+          phase,
+          name!=NULL ? name : "unknown",
+          tid,
+          ts,
+          phase=='i' ? ",\"s\":\"t\"" : "");
+  // Los argumentos van en el inicio del intervalo o en el fin; Chrome los junta
+  if (phase!='B' || record->length > 0) {
+    fprintf(out, ",\"args\":{\"fd\":%d,\"length\":%u", record->fd, record->length);
+    if (record->lock_wait_ns > 0) {
+      fprintf(out, ",\"lock_wait_us\":%.3f", record->lock_wait_ns/1000.0);
+    }
+    fprintf(out, "}");
+  }
+  fprintf(out, "}");
+}
+
+//===--------------------------------------------------------------------------------------------------------------===//
+//                                                        Main
+//===--------------------------------------------------------------------------------------------------------------===//
+int main(int argc, char **argv) {
+  if (argc < 2 || argc > 3) {
+    fprintf(stderr, "Usage: %s <trace> [output.json]\n", argv[0]);
+    return 2;
+  }
+  GError *error = NULL;
+  GMappedFile *file = g_mapped_file_new(argv[1], FALSE, &error);
+  if (file==NULL) {
+    fprintf(stderr, "Cannot open '%s': %s\n", argv[1], error->message);
+    g_error_free(error);
+    return 1;
+  }
+  const gchar *data = g_mapped_file_get_contents(file);
+  gsize size = g_mapped_file_get_length(file);
+  guint64 origin;
+  if (!validate(data, size, &origin)) {
+    g_mapped_file_unref(file);
+    return 1;
+  }
+  FILE *out = argc==3 ? fopen(argv[2], "w") : stdout;
+  if (out==NULL) {
+    fprintf(stderr, "Cannot create '%s': %s\n", argv[2], strerror(errno));
+    g_mapped_file_unref(file);
+    return 1;
+  }
+
+  const struct SerialTraceFileHeader *header = (const struct SerialTraceFileHeader *) data;
+  fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  gboolean first = TRUE;
+  guint64 total = 0;
+  gsize offset = sizeof(*header);
+  for (guint i = 0; i < header->threads; i++) {
+    const struct SerialTraceFileThread *thread = (const struct SerialTraceFileThread *) (data + offset);
+    offset += sizeof(*thread);
+    const struct SerialTraceRecord *records = (const struct SerialTraceRecord *) (data + offset);
+    offset += (gsize) thread->count*sizeof(struct SerialTraceRecord);
+    write_thread_name(out, thread, &first);
+    for (guint64 j = 0; j < thread->count; j++) {
+      write_record(out, thread->thread_id, &records[j], origin);
+    }
+    total += thread->count;
+    if (thread->dropped > 0) {
+      fprintf(stderr,
+              "Thread %" G_GUINT64_FORMAT ": %" G_GUINT64_FORMAT " oldest records were overwritten\n",
+              thread->thread_id,
+              thread->dropped);
+    }
+  }
+  fprintf(out, "\n]}\n");
+  gboolean ok = !ferror(out);
+  if (out!=stdout) {
+    ok = fclose(out)==0 && ok;
+  }
+  guint threads = header->threads;
+  g_mapped_file_unref(file);
+  if (!ok) {
+    fprintf(stderr, "Unable to write the output: %s\n", strerror(errno));
+    return 1;
+  }
+  fprintf(stderr, "%u threads, %" G_GUINT64_FORMAT " records\n", threads, total);
+  return 0;
+}